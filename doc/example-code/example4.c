@@ -42,10 +42,13 @@ main(int argc, char *argv[]) {
 	/* run through all the nets in the layer */
 	for (currentNet = workingImage->netlist; currentNet; currentNet = currentNet->next){	
 		/* check if the net aperture is a circle and has diameter < 0.060 inches */
+		gerbv_aperture_t *aperture =
+				gerbv_image_get_aperture (workingImage, currentNet->aperture);
+
 		if ((currentNet->aperture_state != GERBV_APERTURE_STATE_OFF) &&
-				(workingImage->aperture[currentNet->aperture] != NULL) &&
-				(workingImage->aperture[currentNet->aperture]->type == GERBV_APTYPE_CIRCLE) &&
-				(workingImage->aperture[currentNet->aperture]->parameter[0] < 0.060)){
+				(aperture != NULL) &&
+				(aperture->type == GERBV_APTYPE_CIRCLE) &&
+				(aperture->parameter[0] < 0.060)){
 			/* we found a path which meets the criteria, so delete the net for
 			   demostration purposes */
 			gerbv_image_delete_net (currentNet);
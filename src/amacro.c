@@ -31,6 +31,7 @@
 #include <ctype.h>
 
 #include "gerbv.h"
+#include "common.h"
 #include "gerb_file.h"
 #include "amacro.h"
 
@@ -290,6 +291,7 @@ parse_aperture_macro(gerb_file_t *fd)
 	case '%':
 	    gerb_ungetc(fd);  /* Must return with % first in string
 				 since the main parser needs it */
+	    amacro->code = amacro_compile(amacro);
 	    return amacro;
 	default :
 	    /* Whitespace */
@@ -304,6 +306,108 @@ parse_aperture_macro(gerb_file_t *fd)
 }
 
 
+/*
+ * Turns the instruction list into an array.  A math operation on two
+ * constants which were just pushed is replaced by a push of its result,
+ * so macros like 21,1,0.5X2,... don't compute anything when used.
+ */
+amacro_code_t *
+amacro_compile(gerbv_amacro_t *amacro)
+{
+    amacro_code_t *code;
+    gerbv_instruction_t *ip;
+    amacro_op_t *op;
+    int *konst; /* For each stack entry: index of the PUSH of it, or -1 */
+    unsigned int n = 0, depth = 0;
+    double a, b;
+
+    for (ip = amacro->program; ip != NULL; ip = ip->next)
+	n++;
+
+    code = g_new0(amacro_code_t, 1);
+    code->ops = g_new(amacro_op_t, n);
+    konst = g_new(int, n + 1);
+
+    for (ip = amacro->program; ip != NULL && code->error == NULL;
+	    ip = ip->next) {
+	switch (ip->opcode) {
+	case GERBV_OPCODE_NOP:
+	    continue;
+	case GERBV_OPCODE_PUSH:
+	    op = &code->ops[code->nuf_ops];
+	    op->opcode = GERBV_OPCODE_PUSH;
+	    op->fval = ip->data.fval;
+	    konst[depth++] = code->nuf_ops++;
+	    break;
+	case GERBV_OPCODE_PPUSH:
+	case GERBV_OPCODE_PPOP:
+	    if (ip->data.ival < 1 || ip->data.ival > APERTURE_PARAMETERS_MAX) {
+		code->error = N_("Tried to access oob aperture");
+		break;
+	    }
+	    if (ip->opcode == GERBV_OPCODE_PPOP) {
+		if (depth < 1) {
+		    code->error = N_("Tried to pop an empty stack");
+		    break;
+		}
+		depth--;
+	    } else {
+		konst[depth++] = -1;
+	    }
+	    op = &code->ops[code->nuf_ops++];
+	    op->opcode = ip->opcode;
+	    op->ival = ip->data.ival;
+	    break;
+	case GERBV_OPCODE_ADD:
+	case GERBV_OPCODE_SUB:
+	case GERBV_OPCODE_MUL:
+	case GERBV_OPCODE_DIV:
+	    if (depth < 2) {
+		code->error = N_("Tried to pop an empty stack");
+		break;
+	    }
+	    if (konst[depth - 1] == (int)code->nuf_ops - 1
+		    && konst[depth - 2] == (int)code->nuf_ops - 2) {
+		/* Same double arithmetic as when run */
+		a = code->ops[code->nuf_ops - 2].fval;
+		b = code->ops[code->nuf_ops - 1].fval;
+		switch (ip->opcode) {
+		case GERBV_OPCODE_ADD: a = a + b; break;
+		case GERBV_OPCODE_SUB: a = a - b; break;
+		case GERBV_OPCODE_MUL: a = a * b; break;
+		default:	       a = a / b; break;
+		}
+		code->nuf_ops--;
+		code->ops[code->nuf_ops - 1].fval = a;
+		depth--;
+		break;
+	    }
+	    op = &code->ops[code->nuf_ops];
+	    op->opcode = ip->opcode;
+	    depth--;
+	    konst[depth - 1] = -1;
+	    code->nuf_ops++;
+	    break;
+	case GERBV_OPCODE_PRIM:
+	    op = &code->ops[code->nuf_ops++];
+	    op->opcode = GERBV_OPCODE_PRIM;
+	    op->ival = ip->data.ival;
+	    /* The stack is emptied by each primitive */
+	    depth = 0;
+	    break;
+	default:
+	    continue;
+	}
+
+	code->stack_size = MAX(code->stack_size, depth);
+    }
+
+    g_free(konst);
+
+    return code;
+} /* amacro_compile */
+
+
 void 
 free_amacro(gerbv_amacro_t *amacro)
 {
@@ -323,6 +427,11 @@ free_amacro(gerbv_amacro_t *amacro)
 	    instr2 = NULL;
 	}
 
+	if (am1->code != NULL) {
+	    g_free(am1->code->ops);
+	    g_free(am1->code);
+	}
+
 	am2 = am1;
 	am1 = am1->next;
 	free(am2);
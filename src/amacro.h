@@ -33,11 +33,34 @@
 extern "C" {
 #endif
 
+/*
+ * An aperture macro program in one array, ready to run.  Operations on
+ * constants are already done, NOPs are gone, and the parameter indices
+ * and stack use have been checked.
+ */
+typedef struct {
+    gerbv_opcodes_t opcode;
+    int ival;		/* Parameter or primitive number */
+    double fval;	/* Value to push */
+} amacro_op_t;
+
+typedef struct amacro_code {
+    amacro_op_t *ops;
+    unsigned int nuf_ops;
+    unsigned int stack_size;	/* Deepest the stack gets */
+    const char *error;	/* Untranslated reason the program can't run */
+} amacro_code_t;
+
 /*
  * Parses the definition of an aperture macro
  */
 gerbv_amacro_t *parse_aperture_macro(gerb_file_t *fd);
 
+/*
+ * Compiles the program of amacro, also done by parse_aperture_macro()
+ */
+amacro_code_t *amacro_compile(gerbv_amacro_t *amacro);
+
 /*
  * Frees amacro struct completly
  */
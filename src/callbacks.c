@@ -60,6 +60,7 @@
 #include "render.h"
 #include "selection.h"
 #include "table.h"
+#include "watch.h"
 
 #include "draw-gdk.h"
 
@@ -98,9 +99,9 @@ static double arc_length(double, double);
 
 static void aperture_state_report (gerbv_net_t *,
 		gerbv_image_t *, gerbv_project_t *);
-static void aperture_report(gerbv_aperture_t *[], int,
+static void aperture_report(gerbv_aperture_t *, int,
 		double, double, gerbv_image_t *, gerbv_project_t *);
-static void drill_report(gerbv_aperture_t *[], int);
+static void drill_report(gerbv_aperture_t *, int);
 static void parea_report(gerbv_net_t *,
 		gerbv_image_t *, gerbv_project_t *);
 static void net_layer_file_report(gerbv_net_t *,
@@ -383,10 +384,10 @@ callbacks_open_activate(GtkMenuItem *menuitem, gpointer user_data)
 void
 callbacks_revert_activate (GtkMenuItem *menuitem, gpointer user_data)
 {
-	gerbv_revert_all_files (mainProject);
+	gerbv_revert_changed_files (mainProject);
 	selection_clear (&screen.selectionInfo);
 	update_selected_object_message (FALSE);
-	render_refresh_rendered_image_on_screen ();
+	render_refresh_changed_layers_on_screen ();
 	callbacks_update_layer_tree ();
 }
 
@@ -1113,6 +1114,21 @@ static const char *error_type_string(gerbv_message_type_t type) {
 	}
 }
 
+/* --------------------------------------------------------- */
+/* The text of a message, with how often and where it was reported */
+static gchar *error_description(const gerbv_error_list_t *err) {
+	if (err->count <= 1)
+		return g_strdup(err->error_text);
+
+	if (err->first_line > 0 && err->last_line > err->first_line)
+		return g_strdup_printf(
+			_("%s (%d times, up to line %ld)"),
+			err->error_text, err->count, err->last_line);
+
+	return g_strdup_printf(_("%s (%d times)"),
+			err->error_text, err->count);
+}
+
 /* --------------------------------------------------------- */
 /**
   * The analyze -> analyze Gerbers  menu item was selected.
@@ -1199,9 +1215,11 @@ callbacks_analyze_active_gerbers_activate(GtkMenuItem *menuitem,
 				if (i != err_list->layer - 1)
 					continue;
 
+				str = error_description(err_list);
 				table_add_row(general_table, err_list->layer,
 					error_type_string(err_list->type),
-					err_list->error_text);
+					str);
+				g_free(str);
 			}
 		}
 	}
@@ -1566,9 +1584,11 @@ callbacks_analyze_active_drill_activate(GtkMenuItem *menuitem,
 				if (i != err_list->layer - 1)
 					continue;
 
+				str = error_description(err_list);
 				table_add_row(general_table, err_list->layer,
 					error_type_string(err_list->type),
-					err_list->error_text);
+					str);
+				g_free(str);
 			}
 		}
 	}
@@ -2626,11 +2646,43 @@ callbacks_reload_layer_clicked (GtkButton *button, gpointer user_data)
 			&screen.selectionInfo, mainProject->file[index]->image);
 	update_selected_object_message (FALSE);
 
-	gerbv_revert_file (mainProject, index);
-	render_refresh_rendered_image_on_screen ();
+	gerbv_revert_changed_file (mainProject, index);
+	render_refresh_changed_layers_on_screen ();
 	callbacks_update_layer_tree();
 }
 
+/* --------------------------------------------------------- */
+void
+callbacks_reload_changed_layers (gchar const *filename)
+{
+	gboolean found = FALSE;
+	gint i;
+
+	for (i = 0; i <= mainProject->last_loaded; i++) {
+		gerbv_fileinfo_t *file = mainProject->file[i];
+
+		/* Don't throw away edits behind the user's back */
+		if (file == NULL || file->layer_dirty
+		||  file->fullPathname == NULL
+		||  strcmp (file->archivePathname != NULL
+				? file->archivePathname
+				: file->fullPathname, filename) != 0)
+			continue;
+
+		render_remove_selected_objects_belonging_to_layer (
+				&screen.selectionInfo, file->image);
+		gerbv_revert_changed_file (mainProject, i);
+		found = TRUE;
+	}
+
+	if (!found)
+		return;
+
+	update_selected_object_message (FALSE);
+	render_refresh_changed_layers_on_screen ();
+	callbacks_update_layer_tree ();
+}
+
 void
 callbacks_change_layer_edit_clicked  (GtkButton *button, gpointer userData)
 {
@@ -2865,6 +2917,9 @@ callbacks_update_layer_tree (void)
 	if (screen.win.treeIsUpdating)
 		return;
 
+	/* The layers may have changed, so may the files to watch */
+	watch_sync ();
+
 	screen.win.treeIsUpdating = TRUE;
 
 	oldSelectedRow = callbacks_get_selected_row_index();
@@ -3183,22 +3238,28 @@ callbacks_delete_objects_clicked (GtkButton *button, gpointer user_data)
 	}
 
 	guint i;
-	for (i = 0; i < selection_length (&screen.selectionInfo);) {
+	for (i = 0; i < selection_length (&screen.selectionInfo); i++) {
 		gerbv_selection_item_t sel_item =
 			selection_get_item_by_index (&screen.selectionInfo, i);
 		gerbv_fileinfo_t *file_info =
 			gerbv_get_fileinfo_for_image(sel_item.image, mainProject);
 
 		/* Preserve currently invisible selection from deletion */
-		if (!file_info->isVisible) {
-			i++;
+		if (!file_info->isVisible)
 			continue;
-		}
 
 		file_info->layer_dirty = TRUE;
-		selection_clear_item_by_index (&screen.selectionInfo, i);
 		gerbv_image_delete_net (sel_item.net);
 	}
+
+	/* Drop the deleted items all at once rather than one by one */
+	for (gint fidx = 0; fidx <= mainProject->last_loaded; fidx++) {
+		gerbv_fileinfo_t *file_info = mainProject->file[fidx];
+
+		if (file_info && file_info->isVisible)
+			selection_clear_image (&screen.selectionInfo,
+					file_info->image);
+	}
 	update_selected_object_message (FALSE);
 
 	render_refresh_rendered_image_on_screen ();
@@ -4169,11 +4230,12 @@ static void aperture_state_report (gerbv_net_t *net,
 {
 	gerbv_layertype_t layer_type = img->layertype;
 
+	gerbv_aperture_t *aper = gerbv_image_get_aperture (img, net->aperture);
 	gboolean show_length = FALSE;
 	gboolean aperture_is_valid = FALSE;
 	double x, y, len = 0;
 
-	if (net->aperture > 0)
+	if (net->aperture > 0 && aper != NULL)
 		aperture_is_valid = TRUE;
 
 	switch (net->aperture_state) {
@@ -4218,11 +4280,11 @@ static void aperture_state_report (gerbv_net_t *net,
 
 		if (aperture_is_valid) {
 			if (layer_type != GERBV_LAYERTYPE_DRILL)
-				aperture_report(img->aperture, net->aperture,
+				aperture_report(aper, net->aperture,
 						net->start_x, net->start_y,
 						img, prj);
 			else
-				drill_report(img->aperture, net->aperture);
+				drill_report(aper, net->aperture);
 		}
 
 		x = net->start_x;
@@ -4277,8 +4339,6 @@ static void aperture_state_report (gerbv_net_t *net,
 		}
 
 		if (show_length) {
-			gerbv_aperture_t *aper = img->aperture[net->aperture];
-
 			if (layer_type == GERBV_LAYERTYPE_DRILL
 			&&  aperture_is_valid
 			&&  aper->type == GERBV_APTYPE_CIRCLE) {
@@ -4307,11 +4367,11 @@ static void aperture_state_report (gerbv_net_t *net,
 
 		if (aperture_is_valid) {
 			if (layer_type != GERBV_LAYERTYPE_DRILL)
-				aperture_report(img->aperture, net->aperture,
+				aperture_report(aper, net->aperture,
 						net->stop_x, net->stop_y,
 						img, prj);
 			else
-				drill_report(img->aperture, net->aperture);
+				drill_report(aper, net->aperture);
 		}
 
 		x = net->stop_x;
@@ -4329,12 +4389,12 @@ static void aperture_state_report (gerbv_net_t *net,
 }
 
 static void
-aperture_report(gerbv_aperture_t *apertures[], int aperture_num,
+aperture_report(gerbv_aperture_t *aperture, int aperture_num,
 		double x, double y, gerbv_image_t *img, gerbv_project_t *prj)
 {
-	gerbv_aperture_type_t type = apertures[aperture_num]->type;
-	double *params = apertures[aperture_num]->parameter;
-	gerbv_simplified_amacro_t *sam = apertures[aperture_num]->simplified;
+	gerbv_aperture_type_t type = aperture->type;
+	double *params = aperture->parameter;
+	gerbv_simplified_amacro_t *sam = aperture->simplified;
 
 	g_message (_("    Aperture used: D%d"), aperture_num);
 	g_message (_("    Aperture type: %s"),
@@ -4512,10 +4572,10 @@ aperture_report(gerbv_aperture_t *apertures[], int aperture_num,
 	}
 }
 
-static void drill_report(gerbv_aperture_t *apertures[], int aperture_num)
+static void drill_report(gerbv_aperture_t *aperture, int aperture_num)
 {
-	gerbv_aperture_type_t type = apertures[aperture_num]->type;
-	double *params = apertures[aperture_num]->parameter;
+	gerbv_aperture_type_t type = aperture->type;
+	double *params = aperture->parameter;
 
 	g_message (_("    Tool used: T%d"), aperture_num);
 	if (type == GERBV_APTYPE_CIRCLE)
@@ -280,6 +280,10 @@ callbacks_change_background_color_clicked  (GtkButton *button, gpointer   user_d
 void
 callbacks_reload_layer_clicked  (GtkButton *button, gpointer   user_data);
 
+/* Reload the unedited layers read from filename if it changed */
+void
+callbacks_reload_changed_layers (gchar const *filename);
+
 void
 callbacks_change_layer_format_clicked  (GtkButton *button, gpointer   user_data);
 
@@ -42,6 +42,8 @@
 #include "gerbv.h"
 #include "draw-gdk.h"
 #include "common.h"
+#include "gerb_index.h"
+#include "selection.h"
 
 #undef round
 #define round(x) ceil((double)(x))
@@ -869,6 +871,7 @@ draw_gdk_image_to_pixmap(GdkPixmap **pixmap, gerbv_image_t *image,
 	GdkGC *pgc = gdk_gc_new(*pixmap);
 	GdkGCValues gc_values;
 	struct gerbv_net *net;
+	gerbv_aperture_t *aperture;
 	gerbv_netstate_t *oldState;
 	gerbv_layer_t *oldLayer;
 	gint x1, y1, x2, y2;
@@ -899,16 +902,9 @@ draw_gdk_image_to_pixmap(GdkPixmap **pixmap, gerbv_image_t *image,
 	if (drawMode == DRAW_SELECTIONS)
 		polarity = GERBV_POLARITY_POSITIVE;
 
-	gboolean useOptimizations = TRUE;
-	// if the user is using any transformations for this layer, then don't bother using rendering
-	//   optimizations
-	if (fabs(transform.translateX) > GERBV_PRECISION_LINEAR_INCH
-	||  fabs(transform.translateY) > GERBV_PRECISION_LINEAR_INCH
-	||  fabs(transform.scaleX - 1) > GERBV_PRECISION_LINEAR_INCH 
-	||  fabs(transform.scaleY - 1) > GERBV_PRECISION_LINEAR_INCH
-	||  fabs(transform.rotation) > GERBV_PRECISION_ANGLE_RAD
-	||  transform.mirrorAroundX || transform.mirrorAroundY)
-		useOptimizations = FALSE;
+	gboolean useOptimizations;
+	gerbv_render_size_t window;
+	gerb_index_iter_t iter;
 
 	// calculate the transformation matrix for the user_transformation options
 	cairo_matrix_t fullMatrix, scaleMatrix;
@@ -938,13 +934,21 @@ draw_gdk_image_to_pixmap(GdkPixmap **pixmap, gerbv_image_t *image,
 	/* do image rotation */
 	cairo_matrix_rotate (&fullMatrix, image->info->imageRotation);
 
+	window.left = renderInfo->lowerLeftX;
+	window.bottom = renderInfo->lowerLeftY;
+	window.right = renderInfo->lowerLeftX + (renderInfo->displayWidth /
+				renderInfo->scaleFactorX);
+	window.top = renderInfo->lowerLeftY + (renderInfo->displayHeight /
+				renderInfo->scaleFactorY);
+
+	// cull the nets in the coordinates of the image, before the user
+	//   transformation of the layer
+	useOptimizations = gerb_index_untransform_window (&window, &transform);
 	if (useOptimizations) {
-		minX = renderInfo->lowerLeftX;
-		minY = renderInfo->lowerLeftY;
-		maxX = renderInfo->lowerLeftX + (renderInfo->displayWidth /
-					renderInfo->scaleFactorX);
-		maxY = renderInfo->lowerLeftY + (renderInfo->displayHeight /
-					renderInfo->scaleFactorY);
+		minX = window.left;
+		minY = window.bottom;
+		maxX = window.right;
+		maxY = window.top;
 	}
 
 	/* Set up the two "colors" we have */
@@ -965,7 +969,8 @@ draw_gdk_image_to_pixmap(GdkPixmap **pixmap, gerbv_image_t *image,
 	}
 	oldLayer = image->layers;
 	oldState = image->states;
-	for (net = image->netlist->next ; net != NULL; net = gerbv_image_return_next_renderable_object(net)) {
+	gerb_index_iter_init (&iter, image, useOptimizations ? &window : NULL);
+	while ((net = gerb_index_iter_next (&iter)) != NULL) {
 		int repeat_X=1, repeat_Y=1;
 		double repeat_dist_X=0.0, repeat_dist_Y=0.0;
 		int repeat_i, repeat_j;
@@ -992,21 +997,9 @@ draw_gdk_image_to_pixmap(GdkPixmap **pixmap, gerbv_image_t *image,
 			oldLayer = net->layer;
 		}
 
-		if (drawMode == DRAW_SELECTIONS) {
-			gboolean foundNet = FALSE;
-			gerbv_selection_item_t sItem;
-			
-			for (guint i = 0; i < selectionInfo->selectedNodeArray->len; i++) {
-				sItem = g_array_index (selectionInfo->selectedNodeArray,
-						gerbv_selection_item_t, i);
-				if (sItem.net == net) {
-					foundNet = TRUE;
-					break;
-				}
-			}
-			if (!foundNet)
-				continue;
-		}
+		if (drawMode == DRAW_SELECTIONS
+		&&  !selection_contains_net (selectionInfo, net))
+			continue;
 
 		for(repeat_i = 0; repeat_i < repeat_X; repeat_i++) {
 		for(repeat_j = 0; repeat_j < repeat_Y; repeat_j++) {
@@ -1072,7 +1065,8 @@ draw_gdk_image_to_pixmap(GdkPixmap **pixmap, gerbv_image_t *image,
 		 * This happens when gerber files starts, but hasn't decided on 
 		 * which aperture to use.
 		 */
-		if (image->aperture[net->aperture] == NULL) {
+		aperture = gerbv_image_get_aperture(image, net->aperture);
+		if (aperture == NULL) {
 		  /* Commenting this out since it gets emitted every time you click on the screen 
 		     if (net->aperture_state != GERBV_APERTURE_STATE_OFF)
 		     GERB_MESSAGE("Aperture D%d is not defined", net->aperture);
@@ -1124,7 +1118,7 @@ draw_gdk_image_to_pixmap(GdkPixmap **pixmap, gerbv_image_t *image,
 
 		switch (net->aperture_state) {
 		case GERBV_APERTURE_STATE_ON :
-		    tempX = image->aperture[net->aperture]->parameter[0];
+		    tempX = aperture->parameter[0];
 		    cairo_matrix_transform_point (&scaleMatrix, &tempX, &tempY);
 
 		    /* Variables can be negative after transformation */
@@ -1132,7 +1126,7 @@ draw_gdk_image_to_pixmap(GdkPixmap **pixmap, gerbv_image_t *image,
 		    p1 = (int)round(tempX);
 
 		    gdk_gc_set_line_attributes(gc, p1, GDK_LINE_SOLID,
-				    (image->aperture[net->aperture]->type == GERBV_APTYPE_RECTANGLE)?
+				    (aperture->type == GERBV_APTYPE_RECTANGLE)?
 						GDK_CAP_PROJECTING: GDK_CAP_ROUND,
 				    GDK_JOIN_MITER);
 		    
@@ -1152,7 +1146,7 @@ draw_gdk_image_to_pixmap(GdkPixmap **pixmap, gerbv_image_t *image,
 						   GDK_JOIN_MITER);
 			break;
 		    case GERBV_INTERPOLATION_LINEARx1 :
-			if (image->aperture[net->aperture]->type != GERBV_APTYPE_RECTANGLE) {
+			if (aperture->type != GERBV_APTYPE_RECTANGLE) {
 				gdk_draw_line(*pixmap, gc, x1, y1, x2, y2);
 
 				if (renderInfo->show_cross_on_drill_holes
@@ -1168,8 +1162,8 @@ draw_gdk_image_to_pixmap(GdkPixmap **pixmap, gerbv_image_t *image,
 			gint dx, dy;
 			GdkPoint poly[6];
 
-			tempX = image->aperture[net->aperture]->parameter[0]/2;
-			tempY = image->aperture[net->aperture]->parameter[1]/2;
+			tempX = aperture->parameter[0]/2;
+			tempY = aperture->parameter[1]/2;
 			cairo_matrix_transform_point (&scaleMatrix, &tempX, &tempY);
 			dx = (int)round(tempX);
 			dy = (int)round(tempY);
@@ -1204,8 +1198,8 @@ draw_gdk_image_to_pixmap(GdkPixmap **pixmap, gerbv_image_t *image,
 		case GERBV_APERTURE_STATE_OFF :
 		    break;
 		case GERBV_APERTURE_STATE_FLASH :
-		    tempX = image->aperture[net->aperture]->parameter[0];
-		    tempY = image->aperture[net->aperture]->parameter[1];
+		    tempX = aperture->parameter[0];
+		    tempY = aperture->parameter[1];
 		    cairo_matrix_transform_point (&scaleMatrix, &tempX, &tempY);
 
 		    /* Variables can be negative after transformation */
@@ -1214,7 +1208,7 @@ draw_gdk_image_to_pixmap(GdkPixmap **pixmap, gerbv_image_t *image,
 		    p1 = (int)round(tempX);
 		    p2 = (int)round(tempY);
 		    
-		    switch (image->aperture[net->aperture]->type) {
+		    switch (aperture->type) {
 		    case GERBV_APTYPE_CIRCLE :
 			gerbv_gdk_draw_circle(*pixmap, gc, TRUE, x2, y2, p1);
 
@@ -1261,23 +1255,27 @@ draw_gdk_image_to_pixmap(GdkPixmap **pixmap, gerbv_image_t *image,
 		    case GERBV_APTYPE_MACRO :
 			/* TODO: check line22 and others */
 			gerbv_gdk_draw_amacro(*pixmap, gc, 
-					      image->aperture[net->aperture]->simplified,
+					      aperture->simplified,
 					      scale, x2, y2);
 			break;
 		    default :
 			GERB_MESSAGE(_("Unknown aperture type %d"),
-					image->aperture[net->aperture]->type);
+					aperture->type);
+			gerb_index_iter_clear (&iter);
 			return 0;
 		    }
 		    break;
 		default :
 		    GERB_MESSAGE(_("Unknown aperture state %d"),
 				net->aperture_state);
+		    gerb_index_iter_clear (&iter);
 		    return 0;
 		}
 		}
 		}
 	}
+	gerb_index_iter_clear (&iter);
+
 	/*
 	* Destroy GCs before exiting
 	*/
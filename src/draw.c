@@ -38,6 +38,7 @@
 #include "draw.h"
 #include "common.h"
 #include "selection.h"
+#include "gerb_index.h"
 
 #define dprintf if(DEBUG) printf
 
@@ -109,120 +110,6 @@ draw_cairo_translate_adjust (cairo_t *cairoTarget, gdouble x, gdouble y,
 	cairo_translate (cairoTarget, x, y);
 }
 
-/** Check if net is in selection buffer and possibly deselect it.
-  @return TRUE if net is selected, FALSE if not selected.
-  @param net	Checked net.
-  @param selectionInfo	Selection buffer.
-  @param remove		TRUE for deselect net.
- */
-static gboolean
-draw_net_is_in_selection_buffer_remove (gerbv_net_t *net,
-		gerbv_selection_info_t *selectionInfo, gboolean remove)
-{
-	gerbv_selection_item_t sItem;
-
-	for (guint i = 0; i < selection_length (selectionInfo); i++) {
-		sItem = selection_get_item_by_index (selectionInfo, i);
-		if (sItem.net == net) {
-			if (remove)
-				selection_clear_item_by_index (selectionInfo, i);
-
-			return TRUE;
-		}
-	}
-
-	return FALSE;
-}
-
-static void
-draw_check_if_object_is_in_selected_area (cairo_t *cairoTarget,
-		gboolean isStroke, gerbv_selection_info_t *selectionInfo,
-		gerbv_image_t *image, struct gerbv_net *net,
-		enum draw_mode drawMode)
-{
-	gerbv_selection_item_t sItem = {image, net};
-	gdouble corner1X, corner1Y, corner2X, corner2Y;
-	gdouble x1, x2, y1, y2;
-	gdouble minX, minY, maxX, maxY;
-
-	corner1X = selectionInfo->lowerLeftX;
-	corner1Y = selectionInfo->lowerLeftY;
-	corner2X = selectionInfo->upperRightX;
-	corner2Y = selectionInfo->upperRightY;
-
-	/* calculate the coordinate of the user's click in the current
-	   transformation matrix */
-	cairo_device_to_user (cairoTarget, &corner1X, &corner1Y);
-	cairo_device_to_user (cairoTarget, &corner2X, &corner2Y);
-
-	switch (selectionInfo->type) {
-	case GERBV_SELECTION_POINT_CLICK:
-		/* use the cairo in_fill routine to see if the point is within the
-		   drawn area */
-		if ((isStroke && cairo_in_stroke (cairoTarget, corner1X, corner1Y)) ||
-			(!isStroke && cairo_in_fill (cairoTarget, corner1X, corner1Y))) {
-
-			if (!draw_net_is_in_selection_buffer_remove (net,
-					selectionInfo,
-					(drawMode == FIND_SELECTIONS_TOGGLE))) {
-				selection_add_item (selectionInfo, &sItem);
-			}
-		}
-		break;
-
-	case GERBV_SELECTION_DRAG_BOX:
-		/* we can't assume the "lowerleft" corner is actually in the lower left,
-		   since the cairo transformation matrix may be mirrored,etc */
-		minX = MIN(corner1X,corner2X);
-		maxX = MAX(corner1X,corner2X);
-		minY = MIN(corner1Y,corner2Y);
-		maxY = MAX(corner1Y,corner2Y);
-
-		if (isStroke)
-			cairo_stroke_extents (cairoTarget, &x1, &y1, &x2, &y2);
-		else
-			cairo_fill_extents (cairoTarget, &x1, &y1, &x2, &y2);
-
-		if ((minX < x1) && (minY < y1) && (maxX > x2) && (maxY > y2)) {
-			if (!draw_net_is_in_selection_buffer_remove (net,
-					selectionInfo,
-					(drawMode == FIND_SELECTIONS_TOGGLE))) {
-				selection_add_item (selectionInfo, &sItem);
-			}
-		}
-		break;
-	default:
-		break;
-	}
-	/* clear the path, since we didn't actually draw it and cairo
-		 doesn't reset it after the previous calls */
-	cairo_new_path (cairoTarget);
-}
-
-static void
-draw_fill (cairo_t *cairoTarget, enum draw_mode drawMode,
-		gerbv_selection_info_t *selectionInfo,
-		gerbv_image_t *image, struct gerbv_net *net)
-{
-	if ((drawMode == DRAW_IMAGE) || (drawMode == DRAW_SELECTIONS))
-		cairo_fill (cairoTarget);
-	else
-		draw_check_if_object_is_in_selected_area (cairoTarget, FALSE,
-			selectionInfo, image, net, drawMode);
-}
-
-static void
-draw_stroke (cairo_t *cairoTarget, enum draw_mode drawMode,
-		gerbv_selection_info_t *selectionInfo,
-		gerbv_image_t *image, struct gerbv_net *net)
-{
-	if ((drawMode == DRAW_IMAGE) || (drawMode == DRAW_SELECTIONS))
-		cairo_stroke (cairoTarget);
-	else
-		draw_check_if_object_is_in_selected_area (cairoTarget, TRUE,
-			selectionInfo, image, net, drawMode);
-}
-
 /** Draw the circle _centered_ at current Cairo coordinates.
   @param diameter	Circle diameter.
  */
@@ -358,9 +245,7 @@ draw_update_macro_exposure (cairo_t *cairoTarget, cairo_operator_t clearOperator
 static int
 gerbv_draw_amacro(cairo_t *cairoTarget, cairo_operator_t clearOperator,
 	cairo_operator_t darkOperator, gerbv_simplified_amacro_t *s,
-	gint usesClearPrimitive, gdouble pixelWidth, enum draw_mode drawMode,
-	gerbv_selection_info_t *selectionInfo,
-	gerbv_image_t *image, struct gerbv_net *net)
+	gint usesClearPrimitive, gdouble pixelWidth)
 {
 	gerbv_simplified_amacro_t *ls = s;
 	gboolean doVectorExportFix;
@@ -423,16 +308,14 @@ gerbv_draw_amacro(cairo_t *cairoTarget, cairo_operator_t clearOperator,
 				cairo_set_operator (cairoTarget,
 						CAIRO_OPERATOR_OVER);
 
-				draw_fill (cairoTarget, drawMode,
-						selectionInfo, image, net);
+				cairo_fill (cairoTarget);
 
 				cairo_restore (cairoTarget);
 
 				break;
 			}
 
-			draw_fill (cairoTarget, drawMode,
-					selectionInfo, image, net);
+			cairo_fill (cairoTarget);
 			break;
 
 		case GERBV_APTYPE_MACRO_OUTLINE:
@@ -465,8 +348,7 @@ gerbv_draw_amacro(cairo_t *cairoTarget, cairo_operator_t clearOperator,
 				cairo_set_operator (cairoTarget,
 						CAIRO_OPERATOR_OVER);
 
-				draw_fill (cairoTarget, drawMode,
-						selectionInfo, image, net);
+				cairo_fill (cairoTarget);
 
 				cairo_restore (cairoTarget);
 
@@ -477,8 +359,7 @@ gerbv_draw_amacro(cairo_t *cairoTarget, cairo_operator_t clearOperator,
 			 * I interpret it to mean the outline should be closed
 			 * by the rendering softare automatically, since there
 			 * is no dimension for line thickness. */
-			draw_fill (cairoTarget, drawMode,
-					selectionInfo, image, net);
+			cairo_fill (cairoTarget);
 			break;
 
 		case GERBV_APTYPE_MACRO_POLYGON:
@@ -502,16 +383,14 @@ gerbv_draw_amacro(cairo_t *cairoTarget, cairo_operator_t clearOperator,
 				cairo_set_operator (cairoTarget,
 						CAIRO_OPERATOR_OVER);
 
-				draw_fill (cairoTarget, drawMode,
-						selectionInfo, image, net);
+				cairo_fill (cairoTarget);
 
 				cairo_restore (cairoTarget);
 
 				break;
 			}
 
-			draw_fill (cairoTarget, drawMode,
-					selectionInfo, image, net);
+			cairo_fill (cairoTarget);
 			break;
 
 		case GERBV_APTYPE_MACRO_MOIRE: {
@@ -553,8 +432,7 @@ gerbv_draw_amacro(cairo_t *cairoTarget, cairo_operator_t clearOperator,
 				}
 
 				gerbv_draw_circle (cairoTarget, dia);
-				draw_stroke (cairoTarget, drawMode,
-						selectionInfo, image, net);
+				cairo_stroke (cairoTarget);
 			}
 
 
@@ -567,8 +445,7 @@ gerbv_draw_amacro(cairo_t *cairoTarget, cairo_operator_t clearOperator,
 			cairo_move_to (cairoTarget, 0, -crosshairRadius);
 			cairo_line_to (cairoTarget, 0, crosshairRadius);
 
-			draw_stroke (cairoTarget, drawMode,
-					selectionInfo, image, net);
+			cairo_stroke (cairoTarget);
 
 			if (doVectorExportFix
 			&& CAIRO_OPERATOR_CLEAR ==
@@ -620,9 +497,7 @@ gerbv_draw_amacro(cairo_t *cairoTarget, cairo_operator_t clearOperator,
 						ls->parameter[
 						THERMAL_OUTSIDE_DIAMETER]/2.0,
 						startAngle2, endAngle2);
-				draw_fill (cairoTarget,
-						drawMode, selectionInfo,
-						image, net);
+				cairo_fill (cairoTarget);
 				cairo_rotate (cairoTarget, M_PI_2);
 			}
 
@@ -654,16 +529,14 @@ gerbv_draw_amacro(cairo_t *cairoTarget, cairo_operator_t clearOperator,
 				cairo_set_operator (cairoTarget,
 						CAIRO_OPERATOR_OVER);
 
-				draw_stroke (cairoTarget, drawMode,
-						selectionInfo, image, net);
+				cairo_stroke (cairoTarget);
 
 				cairo_restore (cairoTarget);
 
 				break;
 			}
 
-			draw_stroke (cairoTarget, drawMode,
-					selectionInfo, image, net);
+			cairo_stroke (cairoTarget);
 			break;
 
 		case GERBV_APTYPE_MACRO_LINE21:
@@ -693,16 +566,14 @@ gerbv_draw_amacro(cairo_t *cairoTarget, cairo_operator_t clearOperator,
 				cairo_set_operator (cairoTarget,
 						CAIRO_OPERATOR_OVER);
 
-				draw_fill (cairoTarget, drawMode,
-						selectionInfo, image, net);
+				cairo_fill (cairoTarget);
 
 				cairo_restore (cairoTarget);
 
 				break;
 			}
 
-			draw_fill (cairoTarget, drawMode,
-					selectionInfo, image, net);
+			cairo_fill (cairoTarget);
 			break;
 
 		case GERBV_APTYPE_MACRO_LINE22:
@@ -729,16 +600,14 @@ gerbv_draw_amacro(cairo_t *cairoTarget, cairo_operator_t clearOperator,
 				cairo_set_operator (cairoTarget,
 						CAIRO_OPERATOR_OVER);
 
-				draw_fill (cairoTarget, drawMode,
-						selectionInfo, image, net);
+				cairo_fill (cairoTarget);
 
 				cairo_restore (cairoTarget);
 
 				break;
 			}
 
-			draw_fill (cairoTarget, drawMode,
-					selectionInfo, image, net);
+			cairo_fill (cairoTarget);
 			break;
 
 		default:
@@ -791,18 +660,13 @@ draw_apply_netstate_transformation (cairo_t *cairoTarget, gerbv_netstate_t *stat
 
 void
 draw_render_polygon_object (gerbv_net_t *oldNet, cairo_t *cairoTarget,
-		gdouble sr_x, gdouble sr_y, gerbv_image_t *image,
-		enum draw_mode drawMode, gerbv_selection_info_t *selectionInfo,
-		gboolean pixelOutput)
+		gdouble sr_x, gdouble sr_y, gboolean pixelOutput)
 {
-	gerbv_net_t *currentNet, *polygonStartNet;
+	gerbv_net_t *currentNet;
 	int haveDrawnFirstFillPoint = 0;
 	gdouble x2,y2,cp_x=0,cp_y=0;
 
 	haveDrawnFirstFillPoint = FALSE;
-	/* save the first net in the polygon as the "ID" net pointer
-	   in case we are saving this net to the selection array */
-	polygonStartNet = oldNet;
 	cairo_new_path(cairoTarget);
 
 	for (currentNet = oldNet->next; currentNet!=NULL;
@@ -846,7 +710,7 @@ draw_render_polygon_object (gerbv_net_t *oldNet, cairo_t *cairoTarget,
 			   with adjacent polygons (usually on PCB ground planes) */
 			cairo_antialias_t oldAlias = cairo_get_antialias (cairoTarget);
 			cairo_set_antialias (cairoTarget, CAIRO_ANTIALIAS_NONE);
-			draw_fill (cairoTarget, drawMode, selectionInfo, image, polygonStartNet);
+			cairo_fill (cairoTarget);
 			cairo_set_antialias (cairoTarget, oldAlias);
 			return;
 		default :
@@ -918,6 +782,7 @@ draw_image_to_cairo_target (cairo_t *cairoTarget, gerbv_image_t *image,
 {
 	const int hole_cross_inc_px = 8;
 	struct gerbv_net *net, *polygonStartNet=NULL;
+	gerbv_aperture_t *aperture;
 	double x1, y1, x2, y2, cp_x=0, cp_y=0;
 	gdouble *p, p0, p1, dx, dy, lineWidth, r;
 	gerbv_netstate_t *oldState;
@@ -958,25 +823,26 @@ draw_image_to_cairo_target (cairo_t *cairoTarget, gerbv_image_t *image,
 	cairo_scale (cairoTarget, scaleX, scaleY);
 	cairo_rotate (cairoTarget, transform.rotation);
 
-	gboolean useOptimizations = allowOptimization;
-
-	/* If the user is using any transformations for this layer, then don't
-	 * bother using rendering optimizations */
-	if (fabs(transform.translateX) > GERBV_PRECISION_LINEAR_INCH
-	||  fabs(transform.translateY) > GERBV_PRECISION_LINEAR_INCH
-	||  fabs(transform.scaleX - 1) > GERBV_PRECISION_LINEAR_INCH
-	||  fabs(transform.scaleY - 1) > GERBV_PRECISION_LINEAR_INCH
-	||  fabs(transform.rotation) > GERBV_PRECISION_ANGLE_RAD
-	||  transform.mirrorAroundX || transform.mirrorAroundY)
-		useOptimizations = FALSE;
-
-	if (useOptimizations && pixelOutput) {
-		minX = renderInfo->lowerLeftX;
-		minY = renderInfo->lowerLeftY;
-		maxX = renderInfo->lowerLeftX + (renderInfo->displayWidth /
+	gboolean useOptimizations = allowOptimization && pixelOutput;
+	gerbv_render_size_t window;
+	gerb_index_iter_t iter;
+
+	if (useOptimizations) {
+		window.left = renderInfo->lowerLeftX;
+		window.bottom = renderInfo->lowerLeftY;
+		window.right = renderInfo->lowerLeftX + (renderInfo->displayWidth /
 					renderInfo->scaleFactorX);
-		maxY = renderInfo->lowerLeftY + (renderInfo->displayHeight /
+		window.top = renderInfo->lowerLeftY + (renderInfo->displayHeight /
 					renderInfo->scaleFactorY);
+
+		/* The nets are culled in the coordinates of the image, before
+		 * the user transformation of the layer */
+		useOptimizations =
+			gerb_index_untransform_window (&window, &transform);
+		minX = window.left;
+		minY = window.bottom;
+		maxX = window.right;
+		maxY = window.top;
 	}
 
 	/* do initial justify */
@@ -1020,8 +886,8 @@ draw_image_to_cairo_target (cairo_t *cairoTarget, gerbv_image_t *image,
 
 	const char *pnp_net_label_str_prev = NULL;
 
-	for (net = image->netlist->next; net != NULL;
-			net = gerbv_image_return_next_renderable_object(net)) {
+	gerb_index_iter_init (&iter, image, useOptimizations ? &window : NULL);
+	while ((net = gerb_index_iter_next (&iter)) != NULL) {
 
 		/* check if this is a new layer */
 		if (net->layer != oldLayer){
@@ -1072,7 +938,7 @@ draw_image_to_cairo_target (cairo_t *cairoTarget, gerbv_image_t *image,
 						ko->lowerLeftY - ko->border,
 						ko->width + 2*ko->border,
 						ko->height + 2*ko->border);
-				draw_fill (cairoTarget, drawMode, selectionInfo, image, net);
+				cairo_fill (cairoTarget);
 
 				cairo_restore (cairoTarget);
 			}
@@ -1103,8 +969,7 @@ draw_image_to_cairo_target (cairo_t *cairoTarget, gerbv_image_t *image,
 			   we don't want to check the nets inside the polygon) then
 			   polygonStartNet will be set */
 			if (!polygonStartNet) {
-				if (!draw_net_is_in_selection_buffer_remove (net,
-							selectionInfo, FALSE))
+				if (!selection_contains_net (selectionInfo, net))
 					continue;
 			}
 		}
@@ -1145,7 +1010,7 @@ draw_image_to_cairo_target (cairo_t *cairoTarget, gerbv_image_t *image,
 				double sr_x = ix * sr->dist_X;
 				double sr_y = iy * sr->dist_Y;
 
-				if (useOptimizations && pixelOutput
+				if (useOptimizations
 				&& ((net->boundingBox.right+sr_x < minX)
 				 || (net->boundingBox.left+sr_x > maxX)
 				 || (net->boundingBox.top+sr_y < minY)
@@ -1182,16 +1047,14 @@ draw_image_to_cairo_target (cairo_t *cairoTarget, gerbv_image_t *image,
 
 						draw_render_polygon_object (net,
 							cairoTarget,
-							sr_x, sr_y, image,
-							drawMode, selectionInfo,
+							sr_x, sr_y,
 							pixelOutput);
 
 						cairo_restore (cairoTarget);
 					} else {
 						draw_render_polygon_object (net,
 							cairoTarget,
-							sr_x, sr_y, image,
-							drawMode, selectionInfo,
+							sr_x, sr_y,
 							pixelOutput);
 					}
 
@@ -1207,7 +1070,9 @@ draw_image_to_cairo_target (cairo_t *cairoTarget, gerbv_image_t *image,
 				 * This happens when gerber files starts, but hasn't decided on 
 				 * which aperture to use.
 				 */
-				if (image->aperture[net->aperture] == NULL)
+				aperture = gerbv_image_get_aperture (image,
+						net->aperture);
+				if (aperture == NULL)
 					continue;
 
 				switch (net->aperture_state) {
@@ -1218,11 +1083,11 @@ draw_image_to_cairo_target (cairo_t *cairoTarget, gerbv_image_t *image,
 					/* NOTE: also, make sure all lines are at least 1 pixel wide, so they
 					   always show up at low zoom levels */
 
-					if (limitLineWidth&&((image->aperture[net->aperture]->parameter[0] < pixelWidth)&&
+					if (limitLineWidth&&((aperture->parameter[0] < pixelWidth)&&
 							(pixelOutput)))
 						criticalRadius = pixelWidth/2.0;
 					else
-						criticalRadius = image->aperture[net->aperture]->parameter[0]/2.0;
+						criticalRadius = aperture->parameter[0]/2.0;
 					lineWidth = criticalRadius*2.0;
 					// convert to a pixel integer
 					cairo_user_to_device_distance (cairoTarget, &lineWidth, &x1);
@@ -1248,14 +1113,14 @@ draw_image_to_cairo_target (cairo_t *cairoTarget, gerbv_image_t *image,
 						/* weed out any lines that are
 						 * obviously not going to
 						 * render on the visible screen */
-						switch (image->aperture[net->aperture]->type) {
+						switch (aperture->type) {
 						case GERBV_APTYPE_CIRCLE :
 							if (renderInfo->show_cross_on_drill_holes
 							&&  image->layertype == GERBV_LAYERTYPE_DRILL) {
 								/* Draw center crosses on slot hole */
 								cairo_set_line_width (cairoTarget, pixelWidth);
 								cairo_set_line_cap (cairoTarget, CAIRO_LINE_CAP_SQUARE);
-								r = image->aperture[net->aperture]->parameter[0]/2.0 +
+								r = aperture->parameter[0]/2.0 +
 									hole_cross_inc_px*pixelWidth;
 								draw_cairo_cross (cairoTarget, x1, y1, r);
 								draw_cairo_cross (cairoTarget, x2, y2, r);
@@ -1280,26 +1145,18 @@ draw_image_to_cairo_target (cairo_t *cairoTarget, gerbv_image_t *image,
 									cairoTarget,
 									CAIRO_OPERATOR_OVER);
 
-								draw_stroke (
-									cairoTarget,
-									drawMode,
-									selectionInfo,
-									image, net);
+								cairo_stroke (cairoTarget);
 
 								cairo_restore (
 									cairoTarget);
 							} else {
-								draw_stroke (
-									cairoTarget,
-									drawMode,
-									selectionInfo,
-									image, net);
+								cairo_stroke (cairoTarget);
 							}
 
 							break;
 						case GERBV_APTYPE_RECTANGLE :
-							dx = image->aperture[net->aperture]->parameter[0]/2;
-							dy = image->aperture[net->aperture]->parameter[1]/2;
+							dx = aperture->parameter[0]/2;
+							dy = aperture->parameter[1]/2;
 							if(x1 > x2)
 								dx = -dx;
 							if(y1 > y2)
@@ -1311,21 +1168,21 @@ draw_image_to_cairo_target (cairo_t *cairoTarget, gerbv_image_t *image,
 							draw_cairo_line_to (cairoTarget, x2 + dx, y2 + dy, FALSE, pixelOutput);
 							draw_cairo_line_to (cairoTarget, x2 + dx, y2 - dy, FALSE, pixelOutput);
 							draw_cairo_line_to (cairoTarget, x1 + dx, y1 - dy, FALSE, pixelOutput);
-							draw_fill (cairoTarget, drawMode, selectionInfo, image, net);
+							cairo_fill (cairoTarget);
 							break;
 						/* TODO: for now, just render ovals or polygons like a circle */
 						case GERBV_APTYPE_OVAL :
 						case GERBV_APTYPE_POLYGON :
 							draw_cairo_move_to (cairoTarget, x1,y1, oddWidth, pixelOutput);
 							draw_cairo_line_to (cairoTarget, x2,y2, oddWidth, pixelOutput);
-							draw_stroke (cairoTarget, drawMode, selectionInfo, image, net);
+							cairo_stroke (cairoTarget);
 							break;
 						/* macros can only be flashed, so ignore any that might be here */
 						default:
 							GERB_COMPILE_WARNING(
 								_("Unknown aperture type: %s"),
 								_(gerbv_aperture_type_name(
-									image->aperture[net->aperture]->type)));
+									aperture->type)));
 							break;
 						}
 						break;
@@ -1335,7 +1192,7 @@ draw_image_to_cairo_target (cairo_t *cairoTarget, gerbv_image_t *image,
 						 * draw an arc and stretch it by scaling different x and y values
 						 */
 						cairo_new_path(cairoTarget);
-						if (image->aperture[net->aperture]->type == GERBV_APTYPE_RECTANGLE) {
+						if (aperture->type == GERBV_APTYPE_RECTANGLE) {
 							cairo_set_line_cap (cairoTarget, CAIRO_LINE_CAP_SQUARE);
 						}
 						else {
@@ -1355,7 +1212,7 @@ draw_image_to_cairo_target (cairo_t *cairoTarget, gerbv_image_t *image,
 								DEG2RAD(net->cirseg->angle2));
 						}
 						cairo_restore (cairoTarget);
-						draw_stroke (cairoTarget, drawMode, selectionInfo, image, net);
+						cairo_stroke (cairoTarget);
 						break;
 					default :
 						GERB_COMPILE_WARNING(
@@ -1367,12 +1224,12 @@ draw_image_to_cairo_target (cairo_t *cairoTarget, gerbv_image_t *image,
 				case GERBV_APERTURE_STATE_OFF :
 					break;
 				case GERBV_APERTURE_STATE_FLASH :
-					p = image->aperture[net->aperture]->parameter;
+					p = aperture->parameter;
 
 					cairo_save (cairoTarget);
 					draw_cairo_translate_adjust(cairoTarget, x2, y2, pixelOutput);
 
-					switch (image->aperture[net->aperture]->type) {
+					switch (aperture->type) {
 					case GERBV_APTYPE_CIRCLE :
 						if (renderInfo->show_cross_on_drill_holes
 						&& image->layertype == GERBV_LAYERTYPE_DRILL) {
@@ -1417,15 +1274,15 @@ draw_image_to_cairo_target (cairo_t *cairoTarget, gerbv_image_t *image,
 /* TODO: to do it properly for vector export (doVectorExportFix) draw all
  * macros with some vector library with logical operators */
 						gerbv_draw_amacro(cairoTarget, drawOperatorClear, drawOperatorDark,
-							image->aperture[net->aperture]->simplified,
-							(gint)p[0], pixelWidth,
-							drawMode, selectionInfo, image, net);
+							aperture->simplified,
+							(gint)p[0], pixelWidth);
 						break;
 					default :
 						GERB_COMPILE_WARNING(
 							_("Unknown aperture type: %s"),
 							_(gerbv_aperture_type_name(
-								image->aperture[net->aperture]->type)));
+								aperture->type)));
+						gerb_index_iter_clear (&iter);
 						return 0;
 					}
 
@@ -1441,7 +1298,7 @@ draw_image_to_cairo_target (cairo_t *cairoTarget, gerbv_image_t *image,
 							CAIRO_OPERATOR_OVER);
 					}
 
-					draw_fill (cairoTarget, drawMode, selectionInfo, image, net);
+					cairo_fill (cairoTarget);
 					cairo_restore (cairoTarget);
 					break;
 				default:
@@ -1450,11 +1307,13 @@ draw_image_to_cairo_target (cairo_t *cairoTarget, gerbv_image_t *image,
 						_(gerbv_aperture_type_name(
 							net->aperture_state)));
 
+					gerb_index_iter_clear (&iter);
 					return 0;
 				}
 			}
 		}
 	}
+	gerb_index_iter_clear (&iter);
 
 	/* restore the initial two state saves (one for layer, one for netstate)*/
 	cairo_restore (cairoTarget);
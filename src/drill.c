@@ -54,6 +54,8 @@
 #include "common.h"
 #include "drill.h"
 #include "drill_stats.h"
+#include "gerb_stats.h"
+#include "gerb_image.h"
 
 /* DEBUG printing.  #define DEBUG 1 in config.h to use this fcn. */
 #define dprintf if(DEBUG) printf
@@ -190,6 +192,14 @@ static gerbv_HID_Attribute drill_attribute_list[] = {
 #endif
 };
 
+gerbv_HID_Attribute *
+drill_attribute_list_new (int *n_attr)
+{
+    *n_attr = sizeof (drill_attribute_list) / sizeof (drill_attribute_list[0]);
+
+    return gerbv_attribute_dup (drill_attribute_list, *n_attr);
+}
+
 void
 drill_attribute_merge (gerbv_HID_Attribute *dest, int ndest, gerbv_HID_Attribute *src, int nsrc)
 {
@@ -233,16 +243,14 @@ drill_add_drill_hole (gerbv_image_t *image, drill_state_t *state,
 		gerbv_drill_stats_t *stats, gerbv_net_t *curr_net)
 {
     gerbv_render_size_t *bbox;
+    gerbv_aperture_t *aperture;
     double r;
 
     /* Add one to drill stats  for the current tool */
     drill_stats_increment_drill_counter(image->drill_stats->drill_list,
 	    state->current_tool);
 
-    curr_net->next = g_new0(gerbv_net_t, 1);
-    if (curr_net->next == NULL)
-	GERB_FATAL_ERROR("malloc curr_net->next failed in %s()",
-			__FUNCTION__);
+    curr_net->next = gerb_image_new_net(image);
 
     curr_net = curr_net->next;
     curr_net->layer = image->layers;
@@ -266,11 +274,12 @@ drill_add_drill_hole (gerbv_image_t *image, drill_state_t *state,
 
     /* Check if aperture is set. Ignore the below instead of
        causing SEGV... */
-    if(image->aperture[state->current_tool] == NULL)
+    aperture = gerbv_image_get_aperture(image, state->current_tool);
+    if(aperture == NULL)
 	return curr_net;
 
     bbox = &curr_net->boundingBox;
-    r = image->aperture[state->current_tool]->parameter[0] / 2;
+    r = aperture->parameter[0] / 2;
 
     /* Set boundingBox */
     bbox->left   = curr_net->start_x - r;
@@ -295,13 +304,7 @@ parse_drillfile(gerb_file_t *fd, gerbv_HID_Attribute *attr_list, int n_attr, int
     gerbv_drill_stats_t *stats;
     gchar *tmps;
     ssize_t file_line = 1;
-
-    /* 
-     * many locales redefine "." as "," and so on, so sscanf and strtod 
-     * has problems when reading files using %f format.
-     * Fixes bug #1963618 reported by Lorenzo Marcantonio.
-     */
-    setlocale(LC_NUMERIC, "C" );
+    gint64 start = g_get_monotonic_time();
 
     /* Create new image for this layer */
     dprintf("In parse_drillfile, about to create image for this layer\n");
@@ -322,8 +325,7 @@ parse_drillfile(gerb_file_t *fd, gerbv_HID_Attribute *attr_list, int n_attr, int
 	 * copy here because we will allow per-layer editing of the
 	 * attributes.
 	 */
-	image->info->n_attr = sizeof (drill_attribute_list) / sizeof (drill_attribute_list[0]);
-	image->info->attr_list = gerbv_attribute_dup (drill_attribute_list, image->info->n_attr);
+	image->info->attr_list = drill_attribute_list_new (&image->info->n_attr);
 
 	/* now merge any project attributes */
 	drill_attribute_merge (image->info->attr_list, image->info->n_attr,
@@ -338,6 +340,7 @@ parse_drillfile(gerb_file_t *fd, gerbv_HID_Attribute *attr_list, int n_attr, int
     if (stats == NULL)
 	GERB_FATAL_ERROR("malloc stats failed in %s()", __FUNCTION__);
     image->drill_stats = stats;
+    gerb_parse_stats_begin(image, fd->datalen, start);
 
     /* Create local state variable to track photoplotter state */
     state = new_state(state);
@@ -388,7 +391,8 @@ parse_drillfile(gerb_file_t *fd, gerbv_HID_Attribute *attr_list, int n_attr, int
 		break;
 	    }
 	    tmps = get_line(fd);
-	    gerbv_stats_printf(stats->error_list, GERBV_MESSAGE_NOTE, -1,
+	    gerbv_stats_printf_line(stats->error_list,
+		    GERBV_MESSAGE_NOTE, -1, file_line,
 		    _("Comment \"%s\" at line %ld in file \"%s\""),
 		    tmps, file_line, fd->filename);
 	    dprintf("    Comment with ';' \"%s\" at line %ld\n",
@@ -417,7 +421,8 @@ parse_drillfile(gerb_file_t *fd, gerbv_HID_Attribute *attr_list, int n_attr, int
 		}
 		stats->detect = tmps2;
 	    } else {
-		gerbv_stats_printf(stats->error_list, GERBV_MESSAGE_ERROR, -1,
+		gerbv_stats_printf_line(stats->error_list,
+			GERBV_MESSAGE_ERROR, -1, file_line,
 			_("Unrecognised string \"%s\" in header "
 			    "at line %ld in file \"%s\""),
 			tmps, file_line, fd->filename);
@@ -436,8 +441,8 @@ parse_drillfile(gerb_file_t *fd, gerbv_HID_Attribute *attr_list, int n_attr, int
 	    }
 
 	    if (0 == strcmp (tmps, "FMAT,1")) {
-		gerbv_stats_printf(stats->error_list,
-			GERBV_MESSAGE_ERROR, -1,
+		gerbv_stats_printf_line(stats->error_list,
+			GERBV_MESSAGE_ERROR, -1, file_line,
 			_("File in unsupported format 1 "
 			    "at line %ld in file \"%s\""),
 			file_line, fd->filename);
@@ -448,8 +453,8 @@ parse_drillfile(gerb_file_t *fd, gerbv_HID_Attribute *attr_list, int n_attr, int
 		return NULL;
 	    }
 	    
-	    gerbv_stats_printf(stats->error_list,
-			    GERBV_MESSAGE_ERROR, -1,
+	    gerbv_stats_printf_line(stats->error_list,
+			    GERBV_MESSAGE_ERROR, -1, file_line,
 			    _("Unrecognised string \"%s\" in header "
 				    "at line %ld in file \"%s\""),
 			    tmps, file_line, fd->filename);
@@ -470,6 +475,7 @@ parse_drillfile(gerb_file_t *fd, gerbv_HID_Attribute *attr_list, int n_attr, int
 	    case DRILL_G_SLOT : {
 		/* Parse drilled slot end coords */
 		gerbv_render_size_t *bbox = &curr_net->boundingBox;
+		gerbv_aperture_t *aperture;
 		double r;
 
 		if (EOF == (read = gerb_fgetc(fd))) {
@@ -492,7 +498,10 @@ parse_drillfile(gerb_file_t *fd, gerbv_HID_Attribute *attr_list, int n_attr, int
 		    curr_net->stop_y /= 25.4;
 		}
 
-		r = image->aperture[state->current_tool]->parameter[0]/2;
+		/* An undefined tool drills nothing beyond the line */
+		aperture = gerbv_image_get_aperture(image,
+				state->current_tool);
+		r = (aperture != NULL) ? aperture->parameter[0]/2 : 0.0;
 
 		/* Update boundingBox with drilled slot stop_x,y coords */
 		bbox->left   = MIN(bbox->left,   curr_net->stop_x - r);
@@ -532,8 +541,8 @@ parse_drillfile(gerb_file_t *fd, gerbv_HID_Attribute *attr_list, int n_attr, int
 
 	    case DRILL_G_UNKNOWN:
 		tmps = get_line(fd);
-		gerbv_stats_printf(stats->error_list,
-			GERBV_MESSAGE_ERROR, -1,
+		gerbv_stats_printf_line(stats->error_list,
+			GERBV_MESSAGE_ERROR, -1, file_line,
 			_("Unrecognized string \"%s\" found "
 			    "at line %ld in file \"%s\""),
 			tmps, file_line, fd->filename);
@@ -542,7 +551,8 @@ parse_drillfile(gerb_file_t *fd, gerbv_HID_Attribute *attr_list, int n_attr, int
 
 	    default:
 		eat_line(fd);
-		gerbv_stats_printf(stats->error_list, GERBV_MESSAGE_ERROR, -1,
+		gerbv_stats_printf_line(stats->error_list,
+			GERBV_MESSAGE_ERROR, -1, file_line,
 			_("Unsupported G%02d (%s) code "
 			    "at line %ld in file \"%s\""),
 			g_code, drill_g_code_name(g_code),
@@ -563,8 +573,8 @@ parse_drillfile(gerb_file_t *fd, gerbv_HID_Attribute *attr_list, int n_attr, int
 		break;
 
 	    tmps = get_line(fd);
-	    gerbv_stats_printf(stats->error_list,
-		    GERBV_MESSAGE_ERROR, -1,
+	    gerbv_stats_printf_line(stats->error_list,
+		    GERBV_MESSAGE_ERROR, -1, file_line,
 		    _("Unrecognized string \"%s\" found "
 			"at line %ld in file \"%s\""),
 		    tmps, file_line, fd->filename);
@@ -591,8 +601,8 @@ parse_drillfile(gerb_file_t *fd, gerbv_HID_Attribute *attr_list, int n_attr, int
 
 		       XXX We should probably ask the user. */
 
-		    gerbv_stats_printf(stats->error_list,
-			    GERBV_MESSAGE_ERROR, -1,
+		    gerbv_stats_printf_line(stats->error_list,
+			    GERBV_MESSAGE_ERROR, -1, file_line,
 			    _("End of Excellon header reached "
 				"but no leading/trailing zero "
 				"handling specified "
@@ -608,10 +618,13 @@ parse_drillfile(gerb_file_t *fd, gerbv_HID_Attribute *attr_list, int n_attr, int
 	    case DRILL_M_METRIC :
 		if (state->unit == GERBV_UNIT_UNSPECIFIED
 		&&  state->curr_section != DRILL_HEADER) {
+		    gerbv_aperture_iter_t iter;
+		    gerbv_aperture_t *aperture;
+		    int tool_num;
 		    double size;
 
-		    gerbv_stats_printf(stats->error_list,
-			    GERBV_MESSAGE_WARNING, -1,
+		    gerbv_stats_printf_line(stats->error_list,
+			    GERBV_MESSAGE_WARNING, -1, file_line,
 			    _("M71 code found but no METRIC "
 				"specification in header "
 				"at line %ld in file \"%s\""),
@@ -622,12 +635,13 @@ parse_drillfile(gerb_file_t *fd, gerbv_HID_Attribute *attr_list, int n_attr, int
 			    fd->filename);
 
 		    stats = image->drill_stats;
-		    for (int tool_num = TOOL_MIN; tool_num < TOOL_MAX;
-			    tool_num++) {
-			if (image->aperture && image->aperture[tool_num]) {
+		    gerbv_image_aperture_iter_init(&iter, image);
+		    while (gerbv_image_aperture_iter_next(&iter, &tool_num,
+					    &aperture)) {
+			if (tool_num >= TOOL_MIN && tool_num < TOOL_MAX) {
 			    /* First update stats.   Do this before changing drill dias.
 			     * Maybe also put error into stats? */
-			    size = image->aperture[tool_num]->parameter[0];
+			    size = aperture->parameter[0];
 			    drill_stats_modify_drill_list(stats->drill_list, 
 							  tool_num, 
 							  size, 
@@ -635,7 +649,7 @@ parse_drillfile(gerb_file_t *fd, gerbv_HID_Attribute *attr_list, int n_attr, int
 			    /* Now go back and update all tool dias, since
 			     * tools are displayed in inch units
 			     */
-			    image->aperture[tool_num]->parameter[0] /= 25.4;
+			    aperture->parameter[0] /= 25.4;
 			}
 		    }
 		}
@@ -658,7 +672,8 @@ parse_drillfile(gerb_file_t *fd, gerbv_HID_Attribute *attr_list, int n_attr, int
 	    case DRILL_M_CANNEDTEXTX :
 	    case DRILL_M_CANNEDTEXTY :
 		tmps = get_line(fd);
-		gerbv_stats_printf(stats->error_list, GERBV_MESSAGE_NOTE, -1,
+		gerbv_stats_printf_line(stats->error_list,
+			GERBV_MESSAGE_NOTE, -1, file_line,
 			_("Canned text \"%s\" "
 			    "at line %ld in drill file \"%s\""),
 			tmps, file_line, fd->filename);
@@ -667,7 +682,8 @@ parse_drillfile(gerb_file_t *fd, gerbv_HID_Attribute *attr_list, int n_attr, int
 	    case DRILL_M_MESSAGELONG :
 	    case DRILL_M_MESSAGE :
 		tmps = get_line(fd);
-		gerbv_stats_printf(stats->error_list, GERBV_MESSAGE_NOTE, -1,
+		gerbv_stats_printf_line(stats->error_list,
+			GERBV_MESSAGE_NOTE, -1, file_line,
 			_("Message \"%s\" embedded "
 			    "at line %ld in drill file \"%s\""),
 			tmps, file_line, fd->filename);
@@ -693,8 +709,8 @@ parse_drillfile(gerb_file_t *fd, gerbv_HID_Attribute *attr_list, int n_attr, int
 
 		stats->M_unknown++;
 		tmps = get_line(fd);
-		gerbv_stats_printf(stats->error_list,
-			GERBV_MESSAGE_ERROR, -1,
+		gerbv_stats_printf_line(stats->error_list,
+			GERBV_MESSAGE_ERROR, -1, file_line,
 			_("Unrecognized string \"%s\" found "
 			    "at line %ld in file \"%s\""),
 			tmps, file_line, fd->filename);
@@ -704,7 +720,8 @@ parse_drillfile(gerb_file_t *fd, gerbv_HID_Attribute *attr_list, int n_attr, int
 
 	    default:
 		stats->M_unknown++;
-		gerbv_stats_printf(stats->error_list, GERBV_MESSAGE_ERROR, -1,
+		gerbv_stats_printf_line(stats->error_list,
+			GERBV_MESSAGE_ERROR, -1, file_line,
 			_("Unsupported M%02d (%s) code found "
 			    "at line %ld in file \"%s\""),
 			m_code, _(drill_m_code_name(m_code)),
@@ -718,7 +735,8 @@ parse_drillfile(gerb_file_t *fd, gerbv_HID_Attribute *attr_list, int n_attr, int
 	case 'R':
 	    if (state->curr_section == DRILL_HEADER) {
 		stats->unknown++;
-		gerbv_stats_printf(stats->error_list, GERBV_MESSAGE_ERROR, -1,
+		gerbv_stats_printf_line(stats->error_list,
+			GERBV_MESSAGE_ERROR, -1, file_line,
 			_("Not allowed 'R' code in the header "
 			    "at line %ld in file \"%s\""),
 			file_line, fd->filename);
@@ -778,13 +796,15 @@ parse_drillfile(gerb_file_t *fd, gerbv_HID_Attribute *attr_list, int n_attr, int
 	    }
 
 	case 'S':
-	    gerbv_stats_printf(stats->error_list, GERBV_MESSAGE_NOTE, -1,
+	    gerbv_stats_printf_line(stats->error_list,
+		    GERBV_MESSAGE_NOTE, -1, file_line,
 		    _("Ignoring setting spindle speed "
 			"at line %ld in drill file \"%s\""),
 		    file_line, fd->filename);
 	    eat_line(fd);
 	    break;
 	case 'T':
+	    gerb_parse_stats_code(image, 'T', 0);
 	    drill_parse_T_code(fd, state, image, file_line);
 	    break;
 	case 'V' :
@@ -792,7 +812,8 @@ parse_drillfile(gerb_file_t *fd, gerbv_HID_Attribute *attr_list, int n_attr, int
 	    tmps = get_line (fd);
 	    /* Silently ignore VER,1.  Not sure what others are allowed */
 	    if (0 != strcmp (tmps, "VER,1")) {
-		gerbv_stats_printf(stats->error_list, GERBV_MESSAGE_NOTE, -1,
+		gerbv_stats_printf_line(stats->error_list,
+			GERBV_MESSAGE_NOTE, -1, file_line,
 			_("Undefined string \"%s\" in header "
 			    "at line %ld in file \"%s\""),
 			tmps, file_line, fd->filename);
@@ -839,7 +860,8 @@ parse_drillfile(gerb_file_t *fd, gerbv_HID_Attribute *attr_list, int n_attr, int
 	    stats->unknown++;
 
 	    if (DRILL_HEADER == state->curr_section) {
-		gerbv_stats_printf(stats->error_list, GERBV_MESSAGE_ERROR, -1,
+		gerbv_stats_printf_line(stats->error_list,
+			GERBV_MESSAGE_ERROR, -1, file_line,
 			_("Undefined code '%s' (0x%x) found in header "
 			    "at line %ld in file \"%s\""),
 			gerbv_escape_char(read), read,
@@ -848,13 +870,15 @@ parse_drillfile(gerb_file_t *fd, gerbv_HID_Attribute *attr_list, int n_attr, int
 
 		/* Unrecognised crap in the header is thrown away */
 		tmps = get_line(fd);
-		gerbv_stats_printf(stats->error_list, GERBV_MESSAGE_WARNING, -1,
+		gerbv_stats_printf_line(stats->error_list,
+			GERBV_MESSAGE_WARNING, -1, file_line,
 			_("Unrecognised string \"%s\" in header "
 			    "at line %ld in file \"%s\""),
 			tmps, file_line, fd->filename);
 	  	g_free (tmps);
 	    } else {
-		gerbv_stats_printf(stats->error_list, GERBV_MESSAGE_ERROR, -1,
+		gerbv_stats_printf_line(stats->error_list,
+			GERBV_MESSAGE_ERROR, -1, file_line,
 			_("Ignoring undefined character '%s' (0x%x) "
 			    "found inside data at line %ld in file \"%s\""),
 			gerbv_escape_char(read), read, file_line, fd->filename);
@@ -919,137 +943,12 @@ drill_parse_end:
     }
 
     g_free(state);
+    gerb_parse_stats_end(image);
 
     return image;
 } /* parse_drillfile */
 
 
-/* -------------------------------------------------------------- */
-/*
- * Checks for signs that this is a drill file
- * Returns TRUE if it is, FALSE if not.
- */
-gboolean
-drill_file_p(gerb_file_t *fd, gboolean *returnFoundBinary)
-{
-    char *buf=NULL, *tbuf;
-    int len = 0;
-    char *letter;
-    int ascii;
-    int zero = 48; /* ascii 0 */
-    int nine = 57; /* ascii 9 */
-    int i;
-    gboolean found_binary = FALSE;
-    gboolean found_M48 = FALSE;
-    gboolean found_M30 = FALSE;
-    gboolean found_percent = FALSE;
-    gboolean found_T = FALSE;
-    gboolean found_X = FALSE;
-    gboolean found_Y = FALSE;
-    gboolean end_comments=FALSE;
- 
-    tbuf = g_malloc(MAXL);
-    if (tbuf == NULL) 
-	GERB_FATAL_ERROR(
-		"malloc buf failed while checking for drill file in %s()",
-		__FUNCTION__);
-
-    while (fgets(tbuf, MAXL, fd->fd) != NULL) {
-	len = strlen(tbuf);
-	buf = tbuf;
-	/* check for comments at top of file.  */
-	if(!end_comments){
-		if(g_strstr_len(buf, len, ";")!=NULL){/* comments at top of file  */
-			for (i = 0; i < len-1; ++i) {
-				if (buf[i] == '\n'
-				&&  buf[i+1] != ';'
-				&&  buf[i+1] != '\r'
-				&&  buf[i+1] != '\n') {
-					end_comments = TRUE;
-					/* Set rest of parser to end of
-					 * comments */
-					buf = &tbuf[i+1];
-					
-				}
-			}
-			if(!end_comments)
-				continue;
-		}			
-		else 
-			end_comments=TRUE;
-	}
-
-	/* First look through the file for indications of its type */
-	len = strlen(buf);
-	/* check that file is not binary (non-printing chars) */
-	for (i = 0; i < len; i++) {
-	    ascii = (int) buf[i];
-	    if ((ascii > 128) || (ascii < 0)) {
-		found_binary = TRUE;
-	    }
-	}
-
-	/* Check for M48 = start of drill header */
-	if (g_strstr_len(buf, len, "M48")) {
-	    found_M48 = TRUE; 
-	}
-
-	/* Check for M30 = end of drill program */
-	if (g_strstr_len(buf, len, "M30")) {
-	    if (found_percent) {
-		found_M30 = TRUE; /* Found M30 after % = good */
-	    }
-	}
-
-	/* Check for % on its own line at end of header */
-	if ((letter = g_strstr_len(buf, len, "%")) != NULL) {
-	    if ((letter[1] ==  '\r') || (letter[1] ==  '\n'))
-		found_percent = TRUE;
-	}
-
-	/* Check for T<number> */
-	if ((letter = g_strstr_len(buf, len, "T")) != NULL) {
-	    if (!found_T && (found_X || found_Y)) {
-		found_T = FALSE;  /* Found first T after X or Y */
-	    } else {
-		if (isdigit( (int) letter[1])) { /* verify next char is digit */
-		    found_T = TRUE;
-		}
-	    }
-	}
-
-	/* look for X<number> or Y<number> */
-	if ((letter = g_strstr_len(buf, len, "X")) != NULL) {
-	    ascii = (int) letter[1]; /* grab char after X */
-	    if ((ascii >= zero) && (ascii <= nine)) {
-		found_X = TRUE;
-	    }
-	}
-	if ((letter = g_strstr_len(buf, len, "Y")) != NULL) {
-	    ascii = (int) letter[1]; /* grab char after Y */
-	    if ((ascii >= zero) && (ascii <= nine)) {
-		found_Y = TRUE;
-	    }
-	}
-    } /* while (fgets(buf, MAXL, fd->fd) */
-
-    rewind(fd->fd);
-    g_free(tbuf);
-    *returnFoundBinary = found_binary;
-    
-    /* Now form logical expression determining if this is a drill file */
-    if ( ((found_X || found_Y) && found_T) && 
-	 (found_M48 || (found_percent && found_M30)) ) 
-	return TRUE;
-    else if (found_M48 && found_T && found_percent && found_M30)
-	/* Pathological case of drill file with valid header 
-	   and EOF but no drill XY locations. */
-	return TRUE;
-    else 
-	return FALSE;
-} /* drill_file_p */
-
-
 /* -------------------------------------------------------------- */
 /* Parse tool definition. This can get a bit tricky since it can
    appear in the header and/or data section.
@@ -1081,7 +980,8 @@ drill_parse_T_code(gerb_file_t *fd, drill_state_t *state,
     	    if (gerb_fgetc(fd) == 'T' ){
     	  	fd->ptr -= 4;
     	  	tmps = get_line(fd++);
-    	  	gerbv_stats_printf(stats->error_list, GERBV_MESSAGE_NOTE, -1,
+    	  	gerbv_stats_printf_line(stats->error_list,
+			GERBV_MESSAGE_NOTE, -1, file_line,
 			_("Tool change stop switch found \"%s\" "
 			    "at line %ld in file \"%s\""),
 			tmps, file_line, fd->filename);
@@ -1099,7 +999,8 @@ drill_parse_T_code(gerb_file_t *fd, drill_state_t *state,
 	    gerbv_stats_printf(stats->error_list, GERBV_MESSAGE_ERROR, -1,
 		   _("OrCAD bug: Junk text found in place of tool definition"));
 	    tmps = get_line(fd);
-	    gerbv_stats_printf(stats->error_list, GERBV_MESSAGE_WARNING, -1,
+	    gerbv_stats_printf_line(stats->error_list,
+		    GERBV_MESSAGE_WARNING, -1, file_line,
 		    _("Junk text \"%s\" "
 			"at line %ld in file \"%s\""),
 		    tmps, file_line, fd->filename);
@@ -1118,7 +1019,8 @@ drill_parse_T_code(gerb_file_t *fd, drill_state_t *state,
 	return tool_num; /* T00 is a command to unload the drill */
 
     if (tool_num < TOOL_MIN || tool_num >= TOOL_MAX) {
-	gerbv_stats_printf(stats->error_list, GERBV_MESSAGE_ERROR, -1,
+	gerbv_stats_printf_line(stats->error_list,
+		GERBV_MESSAGE_ERROR, -1, file_line,
 		_("Out of bounds drill number %d "
 		    "at line %ld in file \"%s\""),
 		tool_num, file_line, fd->filename);
@@ -1127,7 +1029,7 @@ drill_parse_T_code(gerb_file_t *fd, drill_state_t *state,
 
     /* Set the current tool to the correct one */
     state->current_tool = tool_num;
-    apert = image->aperture[tool_num];
+    apert = gerbv_image_get_aperture(image, tool_num);
 
     /* Check for a size definition */
     temp = gerb_fgetc(fd);
@@ -1149,7 +1051,8 @@ drill_parse_T_code(gerb_file_t *fd, drill_state_t *state,
 		   I've ever seen used is 0,3mm(about 12mil). Half of that
 		   seemed a bit too small a margin, so a third it is */
 
-		gerbv_stats_printf(stats->error_list, GERBV_MESSAGE_ERROR, -1,
+		gerbv_stats_printf_line(stats->error_list,
+			GERBV_MESSAGE_ERROR, -1, file_line,
 			_("Read a drill of diameter %g inches "
 			    "at line %ld in file \"%s\""),
 			    size, file_line, fd->filename);
@@ -1159,7 +1062,8 @@ drill_parse_T_code(gerb_file_t *fd, drill_state_t *state,
 	    }
 
 	    if (size <= 0. || size >= 10000.) {
-		gerbv_stats_printf(stats->error_list, GERBV_MESSAGE_ERROR, -1,
+		gerbv_stats_printf_line(stats->error_list,
+			GERBV_MESSAGE_ERROR, -1, file_line,
 			_("Unreasonable drill size %g found for drill %d "
 			    "at line %ld in file \"%s\""),
 			    size, tool_num, file_line, fd->filename);
@@ -1174,15 +1078,15 @@ drill_parse_T_code(gerb_file_t *fd, drill_state_t *state,
 		    ||  apert->nuf_parameters != 1
 		    ||  apert->unit != GERBV_UNIT_INCH) {
 
-			gerbv_stats_printf(stats->error_list,
-				GERBV_MESSAGE_ERROR, -1,
+			gerbv_stats_printf_line(stats->error_list,
+				GERBV_MESSAGE_ERROR, -1, file_line,
 				_("Found redefinition of drill %d "
 				"at line %ld in file \"%s\""),
 				tool_num, file_line, fd->filename);
 		    }
 		} else {
-		    apert = image->aperture[tool_num] =
-						g_new0(gerbv_aperture_t, 1);
+		    apert = gerbv_image_new_aperture(image, 1);
+		    gerbv_image_set_aperture(image, tool_num, apert);
 		    if (apert == NULL)
 			GERB_FATAL_ERROR("malloc tool failed in %s()",
 					__FUNCTION__);
@@ -1239,7 +1143,8 @@ drill_parse_T_code(gerb_file_t *fd, drill_state_t *state,
     if (apert == NULL) {
         double dia;
 
-	apert = image->aperture[tool_num] = g_new0(gerbv_aperture_t, 1);
+	apert = gerbv_image_new_aperture(image, 1);
+	gerbv_image_set_aperture(image, tool_num, apert);
 	if (apert == NULL)
 	    GERB_FATAL_ERROR("malloc tool failed in %s()", __FUNCTION__);
 
@@ -1257,7 +1162,8 @@ drill_parse_T_code(gerb_file_t *fd, drill_state_t *state,
              * tool definitions inside the file never seem to use T00 at all.
              */
             if (tool_num != 0) {
-		gerbv_stats_printf(stats->error_list, GERBV_MESSAGE_ERROR, -1,
+		gerbv_stats_printf_line(stats->error_list,
+			GERBV_MESSAGE_ERROR, -1, file_line,
 			_("Tool %02d used without being defined "
 			    "at line %ld in file \"%s\""),
 			tool_num, file_line, fd->filename);
@@ -1283,7 +1189,7 @@ drill_parse_T_code(gerb_file_t *fd, drill_state_t *state,
 					  string);
 	    g_free(string);
 	}
-    } /* if(image->aperture[tool_num] == NULL) */	
+    } /* if(apert == NULL) */	
     
     dprintf("<----  ...leaving %s()\n", __FUNCTION__);
 
@@ -1316,6 +1222,7 @@ drill_parse_M_code(gerb_file_t *fd, drill_state_t *state,
     }
 
     dprintf("  Compare M-code \"%s\" at line %ld\n", op, file_line);
+    gerb_parse_stats_code(image, 'M', atoi(op));
 
     switch (m_code = atoi(op)) {
     case 0:
@@ -1515,8 +1422,8 @@ header_junk:
 	    gerb_ungetc(fd);
 	    eat_line(fd);
 
-	    gerbv_stats_printf(stats->error_list,
-		    GERBV_MESSAGE_WARNING, -1,
+	    gerbv_stats_printf_line(stats->error_list,
+		    GERBV_MESSAGE_WARNING, -1, file_line,
 		    _("Found junk after METRIC command "
 			"at line %ld in file \"%s\""),
 		    file_line, fd->filename);
@@ -1547,7 +1454,8 @@ drill_parse_header_is_metric_comment(gerb_file_t *fd, drill_state_t *state,
 
   switch (file_check_str(fd, "FILE_FORMAT")) {
     case -1:
-      gerbv_stats_printf(stats->error_list, GERBV_MESSAGE_ERROR, -1,
+      gerbv_stats_printf_line(stats->error_list,
+                         GERBV_MESSAGE_ERROR, -1, file_line,
                          _("Unexpected EOF found while parsing \"%s\" string "
                            "in file \"%s\" on line %ld"),
                          "FILE_FORMAT", fd->filename, file_line);
@@ -1558,7 +1466,8 @@ drill_parse_header_is_metric_comment(gerb_file_t *fd, drill_state_t *state,
 
   eat_whitespace(fd);
   if (file_check_str(fd, "=") != 1) {
-    gerbv_stats_printf(stats->error_list, GERBV_MESSAGE_ERROR, -1,
+    gerbv_stats_printf_line(stats->error_list,
+                       GERBV_MESSAGE_ERROR, -1, file_line,
                        _("Expected '=' while parsing \"%s\" string "
                          "in file \"%s\" on line %ld"),
                        "FILE_FORMAT", fd->filename, file_line);
@@ -1569,8 +1478,8 @@ drill_parse_header_is_metric_comment(gerb_file_t *fd, drill_state_t *state,
   gerb_fgetint(fd, &len);
   if (len < 1) {
     /* We've failed to read a number. */
-    gerbv_stats_printf(
-        stats->error_list, GERBV_MESSAGE_ERROR, -1,
+    gerbv_stats_printf_line(
+        stats->error_list, GERBV_MESSAGE_ERROR, -1, file_line,
         _("Expected integer after '=' while parsing \"%s\" string "
           "in file \"%s\" on line %ld"),
         "FILE_FORMAT", fd->filename, file_line);
@@ -1578,7 +1487,8 @@ drill_parse_header_is_metric_comment(gerb_file_t *fd, drill_state_t *state,
   }
   eat_whitespace(fd);
   if (file_check_str(fd, ":") != 1) {
-    gerbv_stats_printf(stats->error_list, GERBV_MESSAGE_ERROR, -1,
+    gerbv_stats_printf_line(stats->error_list,
+                       GERBV_MESSAGE_ERROR, -1, file_line,
                        _("Expected ':' while parsing \"%s\" string "
                          "in file \"%s\" on line %ld"),
                        "FILE_FORMAT", fd->filename, file_line);
@@ -1588,8 +1498,8 @@ drill_parse_header_is_metric_comment(gerb_file_t *fd, drill_state_t *state,
   len = -1;
   int digits_after = gerb_fgetint(fd, &len);
   if (len < 1) {
-    gerbv_stats_printf(
-        stats->error_list, GERBV_MESSAGE_ERROR, -1,
+    gerbv_stats_printf_line(
+        stats->error_list, GERBV_MESSAGE_ERROR, -1, file_line,
         _("Expected integer after ':' while parsing \"%s\" string "
           "in file \"%s\" on line %ld"),
         "FILE_FORMAT", fd->filename, file_line);
@@ -1653,8 +1563,8 @@ drill_parse_header_is_inch(gerb_file_t *fd, drill_state_t *state,
 		break;
 
 	    default:
-		gerbv_stats_printf(stats->error_list,
-			GERBV_MESSAGE_WARNING, -1,
+		gerbv_stats_printf_line(stats->error_list,
+			GERBV_MESSAGE_WARNING, -1, file_line,
 			_("Found junk '%s' after "
 			    "INCH command "
 			    "at line %ld in file \"%s\""),
@@ -1663,8 +1573,8 @@ drill_parse_header_is_inch(gerb_file_t *fd, drill_state_t *state,
 		break;
 	    }
 	} else {
-	    gerbv_stats_printf(stats->error_list,
-		    GERBV_MESSAGE_WARNING, -1,
+	    gerbv_stats_printf_line(stats->error_list,
+		    GERBV_MESSAGE_WARNING, -1, file_line,
 		    _("Found junk '%s' after INCH command "
 			"at line %ld in file \"%s\""),
 		    gerbv_escape_char(c),
@@ -1735,6 +1645,7 @@ drill_parse_G_code(gerb_file_t *fd, gerbv_image_t *image, ssize_t file_line)
     }
 
     dprintf("  Compare G-code \"%s\" at line %ld\n", op, file_line);
+    gerb_parse_stats_code(image, 'G', atoi(op));
 
     switch (g_code = atoi(op)) {
     case 0:
@@ -1829,7 +1740,8 @@ drill_parse_coordinate(gerb_file_t *fd, char firstchar,
         state->curr_y += y;
       }
     } else {
-      gerbv_stats_printf(stats->error_list, GERBV_MESSAGE_ERROR, -1,
+      gerbv_stats_printf_line(stats->error_list,
+                         GERBV_MESSAGE_ERROR, -1, file_line,
                          _("Coordinate mode is not absolute and not incremental "
                            "at line %ld in file \"%s\""),
                          file_line, fd->filename);
@@ -1900,10 +1812,10 @@ read_double(gerb_file_t *fd, number_fmt_t fmt, gerbv_omit_zeros_t omit_zeros, in
     gerb_ungetc(fd);
 
     if (decimal_point) {
-	result = strtod(temp, NULL);
+	result = gerb_strtod(temp, NULL);
     } else {
 	unsigned int wantdigits;
-	double scale;
+	double divisor;
 	char tmp2[DRILL_READ_DOUBLE_SIZE];
 
 	memset(tmp2, 0, sizeof(tmp2));
@@ -1972,7 +1884,7 @@ read_double(gerb_file_t *fd, number_fmt_t fmt, gerbv_omit_zeros_t omit_zeros, in
 	      tmp2[i] = temp[i-1];
 	    }
 	    dprintf("%s():  After dealing with trailing zero suppression, convert \"%s\"\n", __FUNCTION__, tmp2);
-	    scale = 1.0;
+	    divisor = 1.0;
 	    
 	    for (i = 0 ; i <= strlen(tmp2) && i < sizeof (temp) ; i++) {
 	      temp[i] = tmp2[i];
@@ -1982,24 +1894,25 @@ read_double(gerb_file_t *fd, number_fmt_t fmt, gerbv_omit_zeros_t omit_zeros, in
 
 	  /*
 	   * figure out the scale factor when we are not suppressing
-	   * trailing zeros.
+	   * trailing zeros.  Dividing by an exact power of ten rounds
+	   * once, multiplying by an inexact 1E-4 would not.
 	   */
 	  switch (fmt) {
 	  case FMT_00_0000:
-	    scale = 1E-4;
+	    divisor = 1E4;
 	    break;
 	    
 	  case FMT_000_000:
-	    scale = 1E-3;
+	    divisor = 1E3;
 	    break;
 	    
 	  case FMT_000_00:
 	  case FMT_0000_00:
-	    scale = 1E-2;
+	    divisor = 1E2;
 	    break;
 	    
 	  case FMT_USER:
-	    scale = pow (10.0, -1.0*decimals);
+	    divisor = pow (10.0, decimals);
 	    break;
 	    
 	  default:
@@ -2009,7 +1922,7 @@ read_double(gerb_file_t *fd, number_fmt_t fmt, gerbv_omit_zeros_t omit_zeros, in
 	  }
 	}
 
-	result = strtod(temp, NULL) * scale;
+	result = gerb_strtod(temp, NULL) / divisor;
     }
 
     dprintf("    %s()=%f: fmt=%d, omit_zeros=%d, decimals=%d \n",
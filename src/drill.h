@@ -42,7 +42,10 @@ extern "C" {
 
 gerbv_image_t *parse_drillfile(gerb_file_t *fd, gerbv_HID_Attribute *attr_list,
 				int n_attr, int reload);
-gboolean drill_file_p(gerb_file_t *fd, gboolean *returnFoundBinary);
+
+/* A copy of the default attributes of drill files, as parse_drillfile()
+ * starts from; n_attr gets their number */
+gerbv_HID_Attribute *drill_attribute_list_new(int *n_attr);
 
 /* NOTE: keep drill_g_code_t in actual G code order. */
 typedef enum {
@@ -76,6 +76,8 @@ void
 gerbv_drill_destroy_error_list (gerbv_error_list_t *errorList) {
 	gerbv_error_list_t *nextError=errorList,*tempError;
 	
+	if (errorList)
+		gerb_stats_index_destroy (errorList->index);
 	while (nextError) {
 		tempError = nextError->next;
 		g_free (nextError->error_text);
@@ -88,6 +90,8 @@ void
 gerbv_drill_destroy_drill_list (gerbv_drill_list_t *apertureList) {
 	gerbv_drill_list_t *nextAperture=apertureList,*tempAperture;
 	
+	if (apertureList)
+		gerb_stats_index_destroy (apertureList->index);
 	while (nextAperture) {
 		tempAperture = nextAperture->next;
 		g_free(nextAperture->drill_unit);
@@ -112,7 +116,6 @@ gerbv_drill_stats_add_layer(gerbv_drill_stats_t *accum_stats,
 		      int this_layer) {
 
     gerbv_drill_list_t *drill;
-    gerbv_error_list_t *error;
     char *tmps, *tmps2;
 
     dprintf("--->  Entering gerbv_drill_stats_add_layer ..... \n");
@@ -175,11 +178,8 @@ gerbv_drill_stats_add_layer(gerbv_drill_stats_t *accum_stats,
     }
 
     /* ==== Now deal with the error list ==== */
-    for (error = input_stats->error_list; error != NULL; error = error->next) {
-	if (error->error_text != NULL)
-	    gerbv_stats_printf(accum_stats->error_list, error->type,
-		    this_layer, "%s", error->error_text);
-    }
+    gerb_stats_merge_errors(accum_stats->error_list,
+			    input_stats->error_list, this_layer);
 
     /* ==== Now deal with the misc header stuff ==== */
     tmps = NULL;
@@ -205,15 +205,6 @@ gerbv_drill_stats_add_layer(gerbv_drill_stats_t *accum_stats,
 	accum_stats->detect = tmps;
     }
 
-    for (error = input_stats->error_list;
-         error != NULL;
-	 error = error->next) {
-	if (error->error_text != NULL) {
-	    gerbv_stats_printf(accum_stats->error_list, error->type,
-			    this_layer, "%s", error->error_text);
-	}
-    }
-
 
     dprintf("<---  .... Leaving gerbv_drill_stats_add_layer.\n");
 	    
@@ -222,17 +213,40 @@ gerbv_drill_stats_add_layer(gerbv_drill_stats_t *accum_stats,
 
 
 /* ------------------------------------------------------- */
-gboolean
-drill_stats_in_drill_list(gerbv_drill_list_t *drill_list_in,
-			  int drill_num_in) {
+/*! The index of list by drill number, built on first use */
+static struct gerb_stats_index *
+drill_list_index(gerbv_drill_list_t *list)
+{
     gerbv_drill_list_t *drill;
-    for(drill = drill_list_in; drill != NULL; drill = drill->next) {
-	if (drill_num_in == drill->drill_num) {
-	    return TRUE;
-	}
+
+    if (list->index != NULL)
+	return list->index;
+
+    list->index = gerb_stats_index_new();
+    for (drill = list; drill != NULL; drill = drill->next) {
+	if (drill->drill_num != -1)
+	    gerb_stats_index_insert(list->index, drill->drill_num, 0, drill);
+	list->index->last = drill;
     }
-    return FALSE;
 
+    return list->index;
+}
+
+/* ------------------------------------------------------- */
+static gerbv_drill_list_t *
+drill_list_lookup(gerbv_drill_list_t *list, int drill_num)
+{
+    if (list == NULL)
+	return NULL;
+
+    return gerb_stats_index_lookup(drill_list_index(list), drill_num, 0);
+}
+
+/* ------------------------------------------------------- */
+gboolean
+drill_stats_in_drill_list(gerbv_drill_list_t *drill_list_in,
+			  int drill_num_in) {
+    return drill_list_lookup(drill_list_in, drill_num_in) != NULL;
 }
 
 /* ------------------------------------------------------- */
@@ -250,6 +264,7 @@ gerbv_drill_stats_new_drill_list() {
     drill_list->drill_size = 0.0;
     drill_list->drill_unit = NULL;
     drill_list->next = NULL;
+    drill_list->index = NULL;
     return drill_list;
 } 
 
@@ -260,9 +275,8 @@ drill_stats_add_to_drill_list(gerbv_drill_list_t *drill_list_in,
 			      int drill_num_in, double drill_size_in,
 			      char *drill_unit_in) {
 
+    struct gerb_stats_index *index;
     gerbv_drill_list_t *drill_list_new;
-    gerbv_drill_list_t *drill;
-    gerbv_drill_list_t *drill_last = NULL;
 
     dprintf ("%s(%p, %d, %g, \"%s\")\n", __FUNCTION__, drill_list_in, drill_num_in,
 	     drill_size_in, drill_unit_in);
@@ -270,6 +284,8 @@ drill_stats_add_to_drill_list(gerbv_drill_list_t *drill_list_in,
     dprintf("   ---> Entering drill_stats_add_to_drill_list, first drill_num in list = %d ...\n", 
 	    drill_list_in->drill_num);
 
+    index = drill_list_index(drill_list_in);
+
     /* First check for empty list.  If empty, then just add this drill */
     if (drill_list_in->drill_num == -1) {
 	dprintf("    .... In drill_stats_add_to_drill_list, adding first drill, no %d\n", 
@@ -279,24 +295,18 @@ drill_stats_add_to_drill_list(gerbv_drill_list_t *drill_list_in,
 	drill_list_in->drill_count = 0;
 	drill_list_in->drill_unit = g_strdup_printf("%s", drill_unit_in);
 	drill_list_in->next = NULL;
+	gerb_stats_index_insert(index, drill_num_in, 0, drill_list_in);
 	return;
     }
     /* Else check to see if this drill is already in the list */
-    for(drill = drill_list_in; 
-	drill != NULL; 
-	drill = (gerbv_drill_list_t *) drill->next) {
-	dprintf("checking this drill_num %d against that in list %d.\n", 
-		drill_num_in, drill->drill_num);
-	if (drill_num_in == drill->drill_num) {
-	    dprintf("   .... In drill_stats_add_to_drill_list, drill no %d already in list\n", 
-		    drill_num_in);
-	    return;  /* Found it in list, so return */
-	}
-	drill_last = drill;
+    if (gerb_stats_index_lookup(index, drill_num_in, 0) != NULL) {
+	dprintf("   .... In drill_stats_add_to_drill_list, drill no %d already in list\n", 
+		drill_num_in);
+	return;  /* Found it in list, so return */
     }
 
     /* Now malloc space for new drill list element */
-    if (NULL == (drill_list_new = g_new(gerbv_drill_list_t, 1))) {
+    if (NULL == (drill_list_new = g_new0(gerbv_drill_list_t, 1))) {
 	GERB_FATAL_ERROR("malloc format failed in %s()", __FUNCTION__);
     }
 
@@ -308,7 +318,9 @@ drill_stats_add_to_drill_list(gerbv_drill_list_t *drill_list_in,
     drill_list_new->drill_count = 0;
     drill_list_new->drill_unit = g_strdup_printf("%s", drill_unit_in);
     drill_list_new->next = NULL;
-    drill_last->next = drill_list_new;
+    ((gerbv_drill_list_t *)index->last)->next = drill_list_new;
+    index->last = drill_list_new;
+    gerb_stats_index_insert(index, drill_num_in, 0, drill_list_new);
 
     dprintf("   <---- ... leaving drill_stats_add_to_drill_list.\n");
     return;
@@ -326,20 +338,15 @@ drill_stats_modify_drill_list(gerbv_drill_list_t *drill_list_in,
 	    drill_list_in->drill_num);
 
     /* Look for this drill num in list */
-    for(drill = drill_list_in; 
-	drill != NULL; 
-	drill = (gerbv_drill_list_t *) drill->next) {
-	dprintf("checking this drill_num %d against that in list %d.\n", 
-		drill_num_in, drill->drill_num);
-	if (drill_num_in == drill->drill_num) {
-	    dprintf("   .... Found it, now update it ....\n");
-	    drill->drill_size = drill_size_in;
-	    if (drill->drill_unit) 
-		g_free(drill->drill_unit);
-	    drill->drill_unit = g_strdup_printf("%s", drill_unit_in);
-	    dprintf("   <---- ... Modified drill.  leaving drill_stats_modify_drill_list.\n");
-	    return;
-	}
+    drill = drill_list_lookup(drill_list_in, drill_num_in);
+    if (drill != NULL) {
+	dprintf("   .... Found it, now update it ....\n");
+	drill->drill_size = drill_size_in;
+	if (drill->drill_unit) 
+	    g_free(drill->drill_unit);
+	drill->drill_unit = g_strdup_printf("%s", drill_unit_in);
+	dprintf("   <---- ... Modified drill.  leaving drill_stats_modify_drill_list.\n");
+	return;
     }
     dprintf("   <---- ... Did not find drill.  leaving drill_stats_modify_drill_list.\n");
     return;
@@ -352,15 +359,13 @@ drill_stats_increment_drill_counter(gerbv_drill_list_t *drill_list_in,
 
     dprintf("   ----> Entering drill_stats_increment_drill_counter......\n");
     /* First check to see if this drill is already in the list */
-    gerbv_drill_list_t *drill;
-    for(drill = drill_list_in; drill != NULL; drill = drill->next) {
-	if (drill_num_in == drill->drill_num) {
-	    drill->drill_count++;
-	    dprintf("         .... incrementing drill count.  drill_num = %d, drill_count = %d.\n",
-		    drill_list_in->drill_num, drill->drill_count);
-	    dprintf("   <---- .... Leaving drill_stats_increment_drill_counter after incrementing counter.\n");
-	    return;
-	}
+    gerbv_drill_list_t *drill = drill_list_lookup(drill_list_in, drill_num_in);
+    if (drill != NULL) {
+	drill->drill_count++;
+	dprintf("         .... incrementing drill count.  drill_num = %d, drill_count = %d.\n",
+		drill_list_in->drill_num, drill->drill_count);
+	dprintf("   <---- .... Leaving drill_stats_increment_drill_counter after incrementing counter.\n");
+	return;
     }
     dprintf("   <---- .... Leaving drill_stats_increment_drill_counter without incrementing any counter.\n");
 
@@ -372,13 +377,10 @@ drill_stats_add_to_drill_counter(gerbv_drill_list_t *drill_list_in,
 				 int drill_num_in, 
 				 int increment) {
 
-    gerbv_drill_list_t *drill;
-    for(drill = drill_list_in; drill != NULL; drill = drill->next) {
-	if (drill_num_in == drill->drill_num) {
-	    dprintf("    In drill_stats_add_to_drill_counter, adding increment = %d drills to drill list\n", increment);
-	    drill->drill_count += increment;
-	    return;
-	}
+    gerbv_drill_list_t *drill = drill_list_lookup(drill_list_in, drill_num_in);
+    if (drill != NULL) {
+	dprintf("    In drill_stats_add_to_drill_counter, adding increment = %d drills to drill list\n", increment);
+	drill->drill_count += increment;
     }
 }
 
@@ -396,6 +398,8 @@ gerbv_drill_stats_new_error_list() {
     error_list->layer = -1;
     error_list->error_text = NULL;
     error_list->next = NULL;
+    error_list->count = 0;
+    error_list->index = NULL;
     return error_list;
 } 
 
@@ -61,14 +61,15 @@ gerbv_export_drill_file_from_image (const gchar *filename, gerbv_image_t *inputI
 	fprintf(fd, "INCH,TZ\n");
 
 	/* define all apertures */
+	gerbv_aperture_iter_t iter;
 	gerbv_aperture_t *aperture;
+	int i;
 
 	/* the image should already have been cleaned by a duplicate_image call, so we can safely
 	   assume the aperture range is correct */
-	for (int i = APERTURE_MIN; i < APERTURE_MAX; i++) {
-		aperture = image->aperture[i];
-		
-		if (!aperture)
+	gerbv_image_aperture_iter_init (&iter, image);
+	while (gerbv_image_aperture_iter_next (&iter, &i, &aperture)) {
+		if (i < APERTURE_MIN)
 			continue;
 
 		switch (aperture->type) {
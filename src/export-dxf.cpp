@@ -179,7 +179,7 @@ gerbv_export_dxf_file_from_image(const gchar *file_name,
 #endif
 
 	for (net = img->netlist; net != NULL; net = net->next) {
-		apert = img->aperture[net->aperture];
+		apert = gerbv_image_get_aperture(img, net->aperture);
 		if (!apert)
 			continue;
 
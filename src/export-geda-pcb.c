@@ -142,7 +142,7 @@ gerbv_export_geda_pcb_file_from_image(const gchar *file_name,
 	/* Write all apertures as elements with single pad, before layer
 	 * definition */
 	for (net = img->netlist; net != NULL; net = net->next) {
-		apert = img->aperture[net->aperture];
+		apert = gerbv_image_get_aperture(img, net->aperture);
 		if (!apert)
 			continue;
 
@@ -223,7 +223,7 @@ gerbv_export_geda_pcb_file_from_image(const gchar *file_name,
 	fputs("Layer(1 \"top\")\n(\n", fd);
 
 	for (net = img->netlist; net != NULL; net = net->next) {
-		apert = img->aperture[net->aperture];
+		apert = gerbv_image_get_aperture(img, net->aperture);
 		if (!apert)
 			continue;
 
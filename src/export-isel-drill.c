@@ -93,14 +93,15 @@ gerbv_export_isel_drill_file_from_image (const gchar *filename, gerbv_image_t *i
 		"\r\n");
 
 	/* define all apertures */
+	gerbv_aperture_iter_t iter;
 	gerbv_aperture_t *currentAperture;
+	int i;
 
 	/* the image should already have been cleaned by a duplicate_image call, so we can safely
 	   assume the aperture range is correct */
-	for (int i=APERTURE_MIN; i<APERTURE_MAX; i++) {
-		currentAperture = image->aperture[i];
-
-		if (!currentAperture)
+	gerbv_image_aperture_iter_init (&iter, image);
+	while (gerbv_image_aperture_iter_next (&iter, &i, &currentAperture)) {
+		if (i < APERTURE_MIN)
 			continue;
 
 		switch (currentAperture->type) {
@@ -111,17 +111,17 @@ export_rs274x_write_macro (FILE *fd, gerbv_aperture_t *currentAperture,
 
 void
 export_rs274x_write_apertures (FILE *fd, gerbv_image_t *image) {
+	gerbv_aperture_iter_t iter;
 	gerbv_aperture_t *currentAperture;
 	gint numberOfRequiredParameters=0,numberOfOptionalParameters=0,i,j;
 	
 	/* the image should already have been cleaned by a duplicate_image call, so we can safely
 	   assume the aperture range is correct */
-	for (i=APERTURE_MIN; i<APERTURE_MAX; i++) {
+	gerbv_image_aperture_iter_init (&iter, image);
+	while (gerbv_image_aperture_iter_next (&iter, &i, &currentAperture)) {
 		gboolean writeAperture=TRUE;
 		
-		currentAperture = image->aperture[i];
-		
-		if (!currentAperture)
+		if (i < APERTURE_MIN)
 			continue;
 		
 		switch (currentAperture->type) {
@@ -300,7 +300,7 @@ gerbv_export_rs274x_file_from_image (const gchar *filename, gerbv_image_t *input
 		/* also, make sure the aperture number is a valid one, since sometimes
 		   the loaded file may refer to invalid apertures */
 		if ((currentNet->aperture != currentAperture)&&
-			(image->aperture[currentNet->aperture] != NULL)) {
+			(gerbv_image_get_aperture (image, currentNet->aperture) != NULL)) {
 			fprintf(fd, "G54D%02d*\n",currentNet->aperture);
 			currentAperture = currentNet->aperture;
 		}
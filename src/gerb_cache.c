@@ -0,0 +1,1061 @@
+/*
+ * gEDA - GNU Electronic Design Automation
+ * This file is a part of gerbv.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111 USA
+ */
+
+/** \file gerb_cache.c
+    \brief Keeping parsed images in a cache directory
+    \ingroup libgerbv
+
+    A cache file holds the images parsed from one input file, named after
+    a hash of the input and of the arguments it was parsed with.  All
+    numbers are stored as they are in memory, so a cache file is only read
+    back on a host of the same byte order and by the gerbv version that
+    wrote it.
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#include <glib/gstdio.h>
+
+#include "common.h"
+#include "gerbv.h"
+#include "gerb_image.h"
+#include "drill.h"
+#include "gerb_cache.h"
+
+/* DEBUG printing.  #define DEBUG 1 in config.h to use this fcn. */
+#define dprintf if(DEBUG) printf
+
+#define CACHE_MAGIC "gerbvimg"
+#define CACHE_SUFFIX ".gvi"
+
+/* Where parsed images are kept, see gerbv_set_image_cache_dir() */
+static gchar *cache_dir = NULL;
+
+typedef struct {
+    char magic[8];		/* CACHE_MAGIC */
+    guint32 version;		/* GERB_CACHE_VERSION */
+    guint32 byte_order;		/* G_BYTE_ORDER of the writer */
+    char gerbv_version[32];	/* VERSION of the writer */
+    guint32 n_images;		/* 1, or 2 for both sides of a PNP file */
+    guint32 is_pnp;
+} cache_header_t;
+
+/* One net; the layer and state are indices in the lists of the image,
+ * the cirsegs and labels follow all nets in the order of their nets */
+typedef struct {
+    double start_x;
+    double start_y;
+    double stop_x;
+    double stop_y;
+    gerbv_render_size_t boundingBox;
+    gint32 aperture;
+    guint32 layer;
+    guint32 state;
+    guint8 aperture_state;
+    guint8 interpolation;
+    guint8 has_cirseg;
+    guint8 has_label;
+} cache_net_t;
+
+typedef struct {
+    const guchar *p;
+    const guchar *end;
+    gboolean failed;
+} cache_reader_t;
+
+/* ------------------------------------------------------------------ */
+void
+gerbv_set_image_cache_dir (gchar const *dir)
+{
+    g_free (cache_dir);
+    cache_dir = g_strdup (dir);
+}
+
+/* ------------------------------------------------------------------ */
+gboolean
+gerb_cache_enabled (void)
+{
+    return cache_dir != NULL;
+}
+
+/* ------------------------------------------------------------------ */
+/* The input is hashed together with the arguments it is parsed with */
+static void
+cache_hash_attributes (GChecksum *checksum, gerbv_HID_Attribute *attr_list,
+		int n_attr)
+{
+    int i;
+
+    for (i = 0; i < n_attr; i++) {
+	gerbv_HID_Attribute *attr = &attr_list[i];
+
+	g_checksum_update (checksum, (const guchar *)attr->name,
+			strlen (attr->name) + 1);
+	g_checksum_update (checksum, (const guchar *)&attr->type,
+			sizeof (attr->type));
+	/* Only the field a type uses has been set */
+	switch (attr->type) {
+	case HID_Integer:
+	case HID_Boolean:
+	case HID_Enum:
+	    g_checksum_update (checksum,
+			    (const guchar *)&attr->default_val.int_value,
+			    sizeof (int));
+	    break;
+	case HID_Real:
+	case HID_Mixed:
+	    g_checksum_update (checksum,
+			    (const guchar *)&attr->default_val.real_value,
+			    sizeof (double));
+	    break;
+	default:
+	    if (attr->default_val.str_value != NULL)
+		g_checksum_update (checksum,
+				(const guchar *)attr->default_val.str_value,
+				strlen (attr->default_val.str_value) + 1);
+	}
+    }
+} /* cache_hash_attributes */
+
+/* ------------------------------------------------------------------ */
+gchar *
+gerb_cache_path (gchar const *hash, gerbv_HID_Attribute *attr_list,
+		int n_attr, int reload, gboolean forceLoadFile)
+{
+    GChecksum *checksum;
+    gchar *name, *path;
+    const gint32 version = GERB_CACHE_VERSION;
+
+    /* A reload keeps the attributes the user edited, parse those */
+    if (cache_dir == NULL || reload || hash == NULL)
+	return NULL;
+
+    checksum = g_checksum_new (G_CHECKSUM_SHA256);
+    g_checksum_update (checksum, (const guchar *)VERSION, strlen (VERSION));
+    g_checksum_update (checksum, (const guchar *)&version, sizeof (version));
+    g_checksum_update (checksum, (const guchar *)&forceLoadFile,
+		    sizeof (forceLoadFile));
+    cache_hash_attributes (checksum, attr_list, n_attr);
+    g_checksum_update (checksum, (const guchar *)hash, strlen (hash));
+
+    name = g_strconcat (g_checksum_get_string (checksum), CACHE_SUFFIX,
+		    NULL);
+    path = g_build_filename (cache_dir, name, NULL);
+    g_free (name);
+    g_checksum_free (checksum);
+
+    return path;
+} /* gerb_cache_path */
+
+/* ------------------------------------------------------------------ */
+static void
+cache_put_int (GByteArray *out, gint32 value)
+{
+    g_byte_array_append (out, (const guint8 *)&value, sizeof (value));
+}
+
+static void
+cache_put_int64 (GByteArray *out, gint64 value)
+{
+    g_byte_array_append (out, (const guint8 *)&value, sizeof (value));
+}
+
+static void
+cache_put_double (GByteArray *out, double value)
+{
+    g_byte_array_append (out, (const guint8 *)&value, sizeof (value));
+}
+
+/* A -1 length for NULL */
+static void
+cache_put_string (GByteArray *out, const gchar *str)
+{
+    if (str == NULL) {
+	cache_put_int (out, -1);
+	return;
+    }
+    cache_put_int (out, strlen (str));
+    g_byte_array_append (out, (const guint8 *)str, strlen (str));
+}
+
+/* Plain data whose size is checked when it is read */
+static void
+cache_put_block (GByteArray *out, gconstpointer data, gsize len)
+{
+    cache_put_int (out, len);
+    g_byte_array_append (out, data, len);
+}
+
+/* ------------------------------------------------------------------ */
+static gconstpointer
+cache_get (cache_reader_t *in, gsize len)
+{
+    const guchar *p = in->p;
+
+    if (in->failed || (gsize)(in->end - in->p) < len) {
+	in->failed = TRUE;
+	return NULL;
+    }
+    in->p += len;
+
+    return p;
+}
+
+static gint32
+cache_get_int (cache_reader_t *in)
+{
+    gconstpointer p = cache_get (in, sizeof (gint32));
+    gint32 value = 0;
+
+    if (p != NULL)
+	memcpy (&value, p, sizeof (value));
+
+    return value;
+}
+
+static gint64
+cache_get_int64 (cache_reader_t *in)
+{
+    gconstpointer p = cache_get (in, sizeof (gint64));
+    gint64 value = 0;
+
+    if (p != NULL)
+	memcpy (&value, p, sizeof (value));
+
+    return value;
+}
+
+static double
+cache_get_double (cache_reader_t *in)
+{
+    gconstpointer p = cache_get (in, sizeof (double));
+    double value = 0;
+
+    if (p != NULL)
+	memcpy (&value, p, sizeof (value));
+
+    return value;
+}
+
+static gchar *
+cache_get_string (cache_reader_t *in)
+{
+    gint32 len = cache_get_int (in);
+    gconstpointer p;
+
+    if (len < 0) {
+	if (len != -1)
+	    in->failed = TRUE;
+	return NULL;
+    }
+    p = cache_get (in, len);
+
+    return p == NULL ? NULL : g_strndup (p, len);
+}
+
+static void
+cache_get_block (cache_reader_t *in, gpointer data, gsize len)
+{
+    gconstpointer p;
+
+    if ((gsize)cache_get_int (in) != len) {
+	in->failed = TRUE;
+	return;
+    }
+    if ((p = cache_get (in, len)) != NULL)
+	memcpy (data, p, len);
+}
+
+/* A number of records of at least record_len bytes each which are left */
+static gint32
+cache_get_count (cache_reader_t *in, gsize record_len)
+{
+    gint32 n = cache_get_int (in);
+
+    if (n < 0 || (gsize)n > (gsize)(in->end - in->p) / record_len) {
+	in->failed = TRUE;
+	return 0;
+    }
+
+    return n;
+}
+
+/* ------------------------------------------------------------------ */
+static void
+cache_put_error_list (GByteArray *out, gerbv_error_list_t *list)
+{
+    gerbv_error_list_t *error;
+    int n = 0;
+
+    for (error = list; error != NULL; error = error->next)
+	n++;
+    cache_put_int (out, n);
+    for (error = list; error != NULL; error = error->next) {
+	cache_put_int (out, error->layer);
+	cache_put_int (out, error->type);
+	cache_put_string (out, error->error_text);
+	cache_put_int (out, error->count);
+	cache_put_int64 (out, error->first_line);
+	cache_put_int64 (out, error->last_line);
+    }
+}
+
+static gerbv_error_list_t *
+cache_get_error_list (cache_reader_t *in)
+{
+    gerbv_error_list_t *list = NULL, **tail = &list;
+    int i, n = cache_get_count (in,
+	    4 * sizeof (gint32) + 2 * sizeof (gint64));
+
+    for (i = 0; i < n && !in->failed; i++) {
+	gerbv_error_list_t *error = g_new0 (gerbv_error_list_t, 1);
+
+	error->layer = cache_get_int (in);
+	error->type = cache_get_int (in);
+	error->error_text = cache_get_string (in);
+	error->count = cache_get_int (in);
+	error->first_line = cache_get_int64 (in);
+	error->last_line = cache_get_int64 (in);
+	*tail = error;
+	tail = &error->next;
+    }
+
+    return list;
+}
+
+static void
+cache_put_aperture_list (GByteArray *out, gerbv_aperture_list_t *list)
+{
+    gerbv_aperture_list_t *aperture;
+    int n = 0;
+
+    for (aperture = list; aperture != NULL; aperture = aperture->next)
+	n++;
+    cache_put_int (out, n);
+    for (aperture = list; aperture != NULL; aperture = aperture->next) {
+	cache_put_int (out, aperture->number);
+	cache_put_int (out, aperture->layer);
+	cache_put_int (out, aperture->count);
+	cache_put_int (out, aperture->type);
+	cache_put_block (out, aperture->parameter,
+			sizeof (aperture->parameter));
+    }
+}
+
+static gerbv_aperture_list_t *
+cache_get_aperture_list (cache_reader_t *in)
+{
+    gerbv_aperture_list_t *list = NULL, **tail = &list;
+    int i, n = cache_get_count (in, 5 * sizeof (gint32));
+
+    for (i = 0; i < n && !in->failed; i++) {
+	gerbv_aperture_list_t *aperture = g_new0 (gerbv_aperture_list_t, 1);
+
+	aperture->number = cache_get_int (in);
+	aperture->layer = cache_get_int (in);
+	aperture->count = cache_get_int (in);
+	aperture->type = cache_get_int (in);
+	cache_get_block (in, aperture->parameter,
+			sizeof (aperture->parameter));
+	*tail = aperture;
+	tail = &aperture->next;
+    }
+
+    return list;
+}
+
+/* The counters of the stats are the ints from layer_count on */
+#define STATS_COUNTERS_OFFSET G_STRUCT_OFFSET (gerbv_stats_t, layer_count)
+#define STATS_COUNTERS_LEN (sizeof (gerbv_stats_t) - STATS_COUNTERS_OFFSET)
+/* and of the drill stats the ones from comment to detect */
+#define DRILL_COUNTERS_OFFSET G_STRUCT_OFFSET (gerbv_drill_stats_t, comment)
+#define DRILL_COUNTERS_LEN \
+	(G_STRUCT_OFFSET (gerbv_drill_stats_t, detect) - DRILL_COUNTERS_OFFSET)
+
+static void
+cache_put_stats (GByteArray *out, gerbv_stats_t *stats)
+{
+    cache_put_int (out, stats != NULL);
+    if (stats == NULL)
+	return;
+
+    cache_put_block (out, G_STRUCT_MEMBER_P (stats, STATS_COUNTERS_OFFSET),
+		    STATS_COUNTERS_LEN);
+    cache_put_error_list (out, stats->error_list);
+    cache_put_aperture_list (out, stats->aperture_list);
+    cache_put_aperture_list (out, stats->D_code_list);
+}
+
+static gerbv_stats_t *
+cache_get_stats (cache_reader_t *in)
+{
+    gerbv_stats_t *stats;
+
+    if (!cache_get_int (in))
+	return NULL;
+
+    stats = g_new0 (gerbv_stats_t, 1);
+    cache_get_block (in, G_STRUCT_MEMBER_P (stats, STATS_COUNTERS_OFFSET),
+		    STATS_COUNTERS_LEN);
+    stats->error_list = cache_get_error_list (in);
+    stats->aperture_list = cache_get_aperture_list (in);
+    stats->D_code_list = cache_get_aperture_list (in);
+
+    return stats;
+}
+
+static void
+cache_put_drill_stats (GByteArray *out, gerbv_drill_stats_t *stats)
+{
+    gerbv_drill_list_t *drill;
+    int n = 0;
+
+    cache_put_int (out, stats != NULL);
+    if (stats == NULL)
+	return;
+
+    cache_put_int (out, stats->layer_count);
+    cache_put_block (out, G_STRUCT_MEMBER_P (stats, DRILL_COUNTERS_OFFSET),
+		    DRILL_COUNTERS_LEN);
+    cache_put_error_list (out, stats->error_list);
+
+    for (drill = stats->drill_list; drill != NULL; drill = drill->next)
+	n++;
+    cache_put_int (out, n);
+    for (drill = stats->drill_list; drill != NULL; drill = drill->next) {
+	cache_put_int (out, drill->drill_num);
+	cache_put_double (out, drill->drill_size);
+	cache_put_string (out, drill->drill_unit);
+	cache_put_int (out, drill->drill_count);
+    }
+
+    cache_put_string (out, stats->detect);
+}
+
+static gerbv_drill_stats_t *
+cache_get_drill_stats (cache_reader_t *in)
+{
+    gerbv_drill_stats_t *stats;
+    gerbv_drill_list_t **tail;
+    int i, n;
+
+    if (!cache_get_int (in))
+	return NULL;
+
+    stats = g_new0 (gerbv_drill_stats_t, 1);
+    stats->layer_count = cache_get_int (in);
+    cache_get_block (in, G_STRUCT_MEMBER_P (stats, DRILL_COUNTERS_OFFSET),
+		    DRILL_COUNTERS_LEN);
+    stats->error_list = cache_get_error_list (in);
+
+    tail = &stats->drill_list;
+    n = cache_get_count (in, 3 * sizeof (gint32) + sizeof (double));
+    for (i = 0; i < n && !in->failed; i++) {
+	gerbv_drill_list_t *drill = g_new0 (gerbv_drill_list_t, 1);
+
+	drill->drill_num = cache_get_int (in);
+	drill->drill_size = cache_get_double (in);
+	drill->drill_unit = cache_get_string (in);
+	drill->drill_count = cache_get_int (in);
+	*tail = drill;
+	tail = &drill->next;
+    }
+
+    stats->detect = cache_get_string (in);
+
+    return stats;
+}
+
+/* ------------------------------------------------------------------ */
+static void
+cache_put_parameters (GByteArray *out, double *parameter, int nuf_parameters)
+{
+    int n = MAX (nuf_parameters, APERTURE_PARAMETERS_MIN);
+
+    cache_put_int (out, nuf_parameters);
+    g_byte_array_append (out, (const guint8 *)parameter,
+		    n * sizeof (double));
+}
+
+/* Parameters as gerb_image_new_parameters() allocates them */
+static double *
+cache_get_parameters (cache_reader_t *in, gerbv_image_t *image,
+		int *nuf_parameters)
+{
+    int n = cache_get_int (in);
+    gconstpointer p;
+    double *parameter;
+
+    if (n < 0 || n > APERTURE_PARAMETERS_MAX)
+	in->failed = TRUE;
+    if (in->failed)
+	n = 0;
+
+    *nuf_parameters = n;
+    parameter = gerb_image_new_parameters (image, n);
+    n = MAX (n, APERTURE_PARAMETERS_MIN);
+    if ((p = cache_get (in, n * sizeof (double))) != NULL)
+	memcpy (parameter, p, n * sizeof (double));
+
+    return parameter;
+}
+
+/* TRUE if the nuf_parameters of parameter hold all a simplified macro of
+ * this type is drawn from, as the parser gives them */
+static gboolean
+cache_simplified_valid (int type, const double *parameter,
+		int nuf_parameters)
+{
+    switch (type) {
+    case GERBV_APTYPE_MACRO_CIRCLE:
+	return nuf_parameters >= 4;
+    case GERBV_APTYPE_MACRO_OUTLINE:
+	/* The rotation follows the last point */
+	return nuf_parameters >= OUTLINE_ROTATION + 1
+	    && parameter[OUTLINE_NUMBER_OF_POINTS] >= 0
+	    && parameter[OUTLINE_NUMBER_OF_POINTS] <= APERTURE_PARAMETERS_MAX
+	    && OUTLINE_ROTATION_IDX (parameter) < nuf_parameters;
+    case GERBV_APTYPE_MACRO_POLYGON:
+	return nuf_parameters >= 6;
+    case GERBV_APTYPE_MACRO_MOIRE:
+	return nuf_parameters >= 9;
+    case GERBV_APTYPE_MACRO_THERMAL:
+	return nuf_parameters >= 6;
+    case GERBV_APTYPE_MACRO_LINE20:
+	return nuf_parameters >= 7;
+    case GERBV_APTYPE_MACRO_LINE21:
+    case GERBV_APTYPE_MACRO_LINE22:
+	return nuf_parameters >= 6;
+    default:
+	return FALSE;
+    }
+}
+
+/* ------------------------------------------------------------------ */
+/* Append image to out; FALSE if it holds something which can't be
+ * stored */
+static gboolean
+cache_put_image (GByteArray *out, gerbv_image_t *image)
+{
+    gerbv_image_info_t *info = image->info;
+    gerbv_format_t *format = image->format;
+    GHashTable *layers, *states;
+    gerbv_layer_t *layer;
+    gerbv_netstate_t *state;
+    gerbv_aperture_iter_t apertures;
+    gerbv_aperture_t *aperture;
+    gerbv_net_t *net;
+    gboolean ok = TRUE;
+    int i, n;
+
+    /* Only drill files have attributes, of numbers */
+    if (info->n_attr > 0 && image->layertype != GERBV_LAYERTYPE_DRILL)
+	return FALSE;
+    for (i = 0; i < info->n_attr; i++)
+	if (info->attr_list[i].default_val.str_value != NULL)
+	    return FALSE;
+
+    cache_put_int (out, image->layertype);
+
+    cache_put_string (out, info->name);
+    cache_put_string (out, info->type);
+    cache_put_string (out, info->plotterFilm);
+    cache_put_int (out, info->polarity);
+    cache_put_double (out, info->min_x);
+    cache_put_double (out, info->min_y);
+    cache_put_double (out, info->max_x);
+    cache_put_double (out, info->max_y);
+    cache_put_double (out, info->offsetA);
+    cache_put_double (out, info->offsetB);
+    cache_put_int (out, info->encoding);
+    cache_put_double (out, info->imageRotation);
+    cache_put_int (out, info->imageJustifyTypeA);
+    cache_put_int (out, info->imageJustifyTypeB);
+    cache_put_double (out, info->imageJustifyOffsetA);
+    cache_put_double (out, info->imageJustifyOffsetB);
+    cache_put_double (out, info->imageJustifyOffsetActualA);
+    cache_put_double (out, info->imageJustifyOffsetActualB);
+    cache_put_int (out, info->n_attr);
+    for (i = 0; i < info->n_attr; i++) {
+	cache_put_int (out, info->attr_list[i].default_val.int_value);
+	cache_put_double (out, info->attr_list[i].default_val.real_value);
+    }
+
+    cache_put_int (out, format != NULL);
+    if (format != NULL) {
+	cache_put_int (out, format->omit_zeros);
+	cache_put_int (out, format->coordinate);
+	cache_put_int (out, format->x_int);
+	cache_put_int (out, format->x_dec);
+	cache_put_int (out, format->y_int);
+	cache_put_int (out, format->y_dec);
+	cache_put_int (out, format->lim_seqno);
+	cache_put_int (out, format->lim_gf);
+	cache_put_int (out, format->lim_pf);
+	cache_put_int (out, format->lim_mf);
+    }
+
+    /* Layers and states, with their index for the nets */
+    layers = g_hash_table_new (NULL, NULL);
+    for (n = 0, layer = image->layers; layer != NULL; layer = layer->next)
+	g_hash_table_insert (layers, layer, GINT_TO_POINTER (++n));
+    cache_put_int (out, n);
+    for (layer = image->layers; layer != NULL; layer = layer->next) {
+	cache_put_int (out, layer->stepAndRepeat.X);
+	cache_put_int (out, layer->stepAndRepeat.Y);
+	cache_put_double (out, layer->stepAndRepeat.dist_X);
+	cache_put_double (out, layer->stepAndRepeat.dist_Y);
+	cache_put_int (out, layer->knockout.firstInstance);
+	cache_put_int (out, layer->knockout.type);
+	cache_put_int (out, layer->knockout.polarity);
+	cache_put_double (out, layer->knockout.lowerLeftX);
+	cache_put_double (out, layer->knockout.lowerLeftY);
+	cache_put_double (out, layer->knockout.width);
+	cache_put_double (out, layer->knockout.height);
+	cache_put_double (out, layer->knockout.border);
+	cache_put_double (out, layer->rotation);
+	cache_put_int (out, layer->polarity);
+	cache_put_string (out, layer->name);
+    }
+
+    states = g_hash_table_new (NULL, NULL);
+    for (n = 0, state = image->states; state != NULL; state = state->next)
+	g_hash_table_insert (states, state, GINT_TO_POINTER (++n));
+    cache_put_int (out, n);
+    for (state = image->states; state != NULL; state = state->next) {
+	cache_put_int (out, state->axisSelect);
+	cache_put_int (out, state->mirrorState);
+	cache_put_int (out, state->unit);
+	cache_put_double (out, state->offsetA);
+	cache_put_double (out, state->offsetB);
+	cache_put_double (out, state->scaleA);
+	cache_put_double (out, state->scaleB);
+    }
+
+    /* The defined apertures by number, -1 after the last; shared
+     * simplified macros are stored with each aperture */
+    gerbv_image_aperture_iter_init (&apertures, image);
+    while (gerbv_image_aperture_iter_next (&apertures, &i, &aperture)) {
+	gerbv_simplified_amacro_t *sam;
+
+	cache_put_int (out, i);
+	cache_put_int (out, aperture->type);
+	cache_put_int (out, aperture->unit);
+	cache_put_parameters (out, aperture->parameter,
+			aperture->nuf_parameters);
+	for (n = 0, sam = aperture->simplified; sam != NULL; sam = sam->next)
+	    n++;
+	cache_put_int (out, n);
+	for (sam = aperture->simplified; sam != NULL; sam = sam->next) {
+	    cache_put_int (out, sam->type);
+	    cache_put_parameters (out, sam->parameter, sam->nuf_parameters);
+	}
+    }
+    cache_put_int (out, -1);
+
+    /* The nets as one block of records, then their cirsegs and labels */
+    for (n = 0, net = image->netlist; net != NULL; net = net->next)
+	n++;
+    cache_put_int (out, n);
+    for (net = image->netlist; net != NULL && ok; net = net->next) {
+	cache_net_t record;
+
+	memset (&record, 0, sizeof (record));
+	record.start_x = net->start_x;
+	record.start_y = net->start_y;
+	record.stop_x = net->stop_x;
+	record.stop_y = net->stop_y;
+	record.boundingBox = net->boundingBox;
+	record.aperture = net->aperture;
+	record.layer = GPOINTER_TO_INT (g_hash_table_lookup (layers,
+				net->layer));
+	record.state = GPOINTER_TO_INT (g_hash_table_lookup (states,
+				net->state));
+	record.aperture_state = net->aperture_state;
+	record.interpolation = net->interpolation;
+	record.has_cirseg = (net->cirseg != NULL);
+	record.has_label = (net->label != NULL);
+
+	/* Not one of the image's own (or none at all) */
+	if (record.layer-- == 0 || record.state-- == 0)
+	    ok = FALSE;
+	/* Not a D code, so it could not be read back */
+	if (!gerb_image_aperture_number_valid (net->aperture))
+	    ok = FALSE;
+
+	g_byte_array_append (out, (const guint8 *)&record, sizeof (record));
+    }
+    for (net = image->netlist; net != NULL && ok; net = net->next)
+	if (net->cirseg != NULL)
+	    g_byte_array_append (out, (const guint8 *)net->cirseg,
+			    sizeof (gerbv_cirseg_t));
+    for (net = image->netlist; net != NULL && ok; net = net->next)
+	if (net->label != NULL)
+	    cache_put_string (out, net->label->str);
+
+    g_hash_table_destroy (layers);
+    g_hash_table_destroy (states);
+
+    cache_put_stats (out, image->gerbv_stats);
+    cache_put_drill_stats (out, image->drill_stats);
+
+    return ok;
+} /* cache_put_image */
+
+/* ------------------------------------------------------------------ */
+/* The next image in, or NULL if it is damaged */
+static gerbv_image_t *
+cache_get_image (cache_reader_t *in)
+{
+    gerbv_image_t *image;
+    gerbv_image_info_t *info;
+    gerbv_layer_t **layers = NULL;
+    gerbv_netstate_t **states = NULL;
+    gerbv_net_t *net = NULL;
+    const cache_net_t *records;
+    int i, n, n_layers, n_states, number;
+
+    image = gerbv_create_image (NULL, NULL);
+    if (image == NULL)
+	return NULL;
+    info = image->info;
+
+    image->layertype = cache_get_int (in);
+    if (image->layertype < GERBV_LAYERTYPE_RS274X
+	    || image->layertype > GERBV_LAYERTYPE_PICKANDPLACE_BOT)
+	in->failed = TRUE;
+
+    info->name = cache_get_string (in);
+    g_free (info->type);
+    info->type = cache_get_string (in);
+    info->plotterFilm = cache_get_string (in);
+    info->polarity = cache_get_int (in);
+    info->min_x = cache_get_double (in);
+    info->min_y = cache_get_double (in);
+    info->max_x = cache_get_double (in);
+    info->max_y = cache_get_double (in);
+    info->offsetA = cache_get_double (in);
+    info->offsetB = cache_get_double (in);
+    info->encoding = cache_get_int (in);
+    info->imageRotation = cache_get_double (in);
+    info->imageJustifyTypeA = cache_get_int (in);
+    info->imageJustifyTypeB = cache_get_int (in);
+    info->imageJustifyOffsetA = cache_get_double (in);
+    info->imageJustifyOffsetB = cache_get_double (in);
+    info->imageJustifyOffsetActualA = cache_get_double (in);
+    info->imageJustifyOffsetActualB = cache_get_double (in);
+    n = cache_get_count (in, sizeof (gint32) + sizeof (double));
+    if (n > 0) {
+	/* The values of the attributes parse_drillfile() started from */
+	info->attr_list = drill_attribute_list_new (&info->n_attr);
+	if (n != info->n_attr)
+	    in->failed = TRUE;
+	for (i = 0; i < n && !in->failed; i++) {
+	    info->attr_list[i].default_val.int_value = cache_get_int (in);
+	    info->attr_list[i].default_val.real_value =
+		cache_get_double (in);
+	}
+    }
+
+    if (cache_get_int (in)) {
+	image->format = g_new0 (gerbv_format_t, 1);
+	image->format->omit_zeros = cache_get_int (in);
+	image->format->coordinate = cache_get_int (in);
+	image->format->x_int = cache_get_int (in);
+	image->format->x_dec = cache_get_int (in);
+	image->format->y_int = cache_get_int (in);
+	image->format->y_dec = cache_get_int (in);
+	image->format->lim_seqno = cache_get_int (in);
+	image->format->lim_gf = cache_get_int (in);
+	image->format->lim_pf = cache_get_int (in);
+	image->format->lim_mf = cache_get_int (in);
+    }
+
+    /* The first layer and state come with the image */
+    n_layers = cache_get_count (in, sizeof (gint32));
+    if (n_layers == 0)
+	in->failed = TRUE;
+    layers = g_new0 (gerbv_layer_t *, MAX (n_layers, 1));
+    layers[0] = image->layers;
+    for (i = 0; i < n_layers && !in->failed; i++) {
+	gerbv_layer_t *layer = layers[i];
+
+	if (i > 0) {
+	    layer = layers[i] = g_new0 (gerbv_layer_t, 1);
+	    layers[i - 1]->next = layer;
+	}
+	layer->stepAndRepeat.X = cache_get_int (in);
+	layer->stepAndRepeat.Y = cache_get_int (in);
+	layer->stepAndRepeat.dist_X = cache_get_double (in);
+	layer->stepAndRepeat.dist_Y = cache_get_double (in);
+	layer->knockout.firstInstance = cache_get_int (in);
+	layer->knockout.type = cache_get_int (in);
+	layer->knockout.polarity = cache_get_int (in);
+	layer->knockout.lowerLeftX = cache_get_double (in);
+	layer->knockout.lowerLeftY = cache_get_double (in);
+	layer->knockout.width = cache_get_double (in);
+	layer->knockout.height = cache_get_double (in);
+	layer->knockout.border = cache_get_double (in);
+	layer->rotation = cache_get_double (in);
+	layer->polarity = cache_get_int (in);
+	layer->name = cache_get_string (in);
+    }
+
+    n_states = cache_get_count (in, sizeof (gint32));
+    if (n_states == 0)
+	in->failed = TRUE;
+    states = g_new0 (gerbv_netstate_t *, MAX (n_states, 1));
+    states[0] = image->states;
+    for (i = 0; i < n_states && !in->failed; i++) {
+	gerbv_netstate_t *state = states[i];
+
+	if (i > 0) {
+	    state = states[i] = g_new0 (gerbv_netstate_t, 1);
+	    states[i - 1]->next = state;
+	}
+	state->axisSelect = cache_get_int (in);
+	state->mirrorState = cache_get_int (in);
+	state->unit = cache_get_int (in);
+	state->offsetA = cache_get_double (in);
+	state->offsetB = cache_get_double (in);
+	state->scaleA = cache_get_double (in);
+	state->scaleB = cache_get_double (in);
+    }
+
+    while (!in->failed && (number = cache_get_int (in)) != -1) {
+	gerbv_aperture_t *aperture;
+	gerbv_simplified_amacro_t **tail;
+	int type, unit, nuf_parameters;
+
+	if (!gerb_image_aperture_number_valid (number)
+		|| gerbv_image_get_aperture (image, number) != NULL) {
+	    in->failed = TRUE;
+	    break;
+	}
+	type = cache_get_int (in);
+	unit = cache_get_int (in);
+	if (type < GERBV_APTYPE_NONE || type > GERBV_APTYPE_MACRO_LINE22
+		|| unit < GERBV_UNIT_INCH || unit > GERBV_UNIT_UNSPECIFIED) {
+	    in->failed = TRUE;
+	    break;
+	}
+	aperture = g_new0 (gerbv_aperture_t, 1);
+	aperture->type = type;
+	aperture->unit = unit;
+	aperture->parameter = cache_get_parameters (in, image,
+			&aperture->nuf_parameters);
+	gerbv_image_set_aperture (image, number, aperture);
+
+	tail = &aperture->simplified;
+	n = cache_get_count (in, 2 * sizeof (gint32));
+	for (i = 0; i < n && !in->failed; i++) {
+	    gerbv_simplified_amacro_t *sam =
+		g_new0 (gerbv_simplified_amacro_t, 1);
+
+	    sam->type = cache_get_int (in);
+	    sam->parameter = cache_get_parameters (in, image,
+			    &nuf_parameters);
+	    sam->nuf_parameters = nuf_parameters;
+	    *tail = sam;
+	    tail = &sam->next;
+
+	    if (!cache_simplified_valid (sam->type, sam->parameter,
+				    nuf_parameters))
+		in->failed = TRUE;
+	}
+    }
+
+    /* The first net comes with the image too */
+    n = cache_get_count (in, sizeof (cache_net_t));
+    if (n == 0)
+	in->failed = TRUE;
+    records = cache_get (in, n * sizeof (cache_net_t));
+    for (i = 0; i < n && !in->failed; i++) {
+	cache_net_t record;
+
+	memcpy (&record, records + i, sizeof (record));
+	if (record.layer >= (guint32)n_layers
+		|| record.state >= (guint32)n_states
+		|| !gerb_image_aperture_number_valid (record.aperture)
+		|| record.aperture_state > GERBV_APERTURE_STATE_FLASH
+		|| record.interpolation > GERBV_INTERPOLATION_DELETED) {
+	    in->failed = TRUE;
+	    break;
+	}
+
+	if (i == 0) {
+	    net = image->netlist;
+	} else {
+	    net->next = gerb_image_new_net (image);
+	    net = net->next;
+	}
+	net->start_x = record.start_x;
+	net->start_y = record.start_y;
+	net->stop_x = record.stop_x;
+	net->stop_y = record.stop_y;
+	net->boundingBox = record.boundingBox;
+	net->aperture = record.aperture;
+	net->aperture_state = record.aperture_state;
+	net->interpolation = record.interpolation;
+	net->layer = layers[record.layer];
+	net->state = states[record.state];
+    }
+
+    /* Their cirsegs and labels, in the same order */
+    for (i = 0, net = image->netlist; i < n && !in->failed;
+	    i++, net = net->next) {
+	cache_net_t record;
+	gconstpointer p;
+
+	memcpy (&record, records + i, sizeof (record));
+	if (record.has_cirseg
+		&& (p = cache_get (in, sizeof (gerbv_cirseg_t))) != NULL) {
+	    net->cirseg = gerb_image_new_cirseg (image);
+	    memcpy (net->cirseg, p, sizeof (gerbv_cirseg_t));
+	}
+    }
+    for (i = 0, net = image->netlist; i < n && !in->failed;
+	    i++, net = net->next) {
+	cache_net_t record;
+	gchar *str;
+
+	memcpy (&record, records + i, sizeof (record));
+	if (record.has_label && (str = cache_get_string (in)) != NULL) {
+	    net->label = gerb_image_new_label (image, str);
+	    g_free (str);
+	}
+    }
+
+    g_free (layers);
+    g_free (states);
+
+    image->gerbv_stats = cache_get_stats (in);
+    image->drill_stats = cache_get_drill_stats (in);
+
+    if (in->failed || info->type == NULL) {
+	gerbv_destroy_image (image);
+	return NULL;
+    }
+
+    return image;
+} /* cache_get_image */
+
+/* ------------------------------------------------------------------ */
+gboolean
+gerb_cache_load (gchar const *path, gerbv_image_t **image,
+		gerbv_image_t **image2, gboolean *isPnpFile)
+{
+    GMappedFile *file;
+    cache_reader_t in;
+    const cache_header_t *header;
+    gerbv_image_t *images[2] = {NULL, NULL};
+    guint i, n_images = 0;
+
+    file = g_mapped_file_new (path, FALSE, NULL);
+    if (file == NULL)
+	return FALSE;
+
+    in.p = (const guchar *)g_mapped_file_get_contents (file);
+    in.end = in.p + g_mapped_file_get_length (file);
+    in.failed = FALSE;
+
+    header = cache_get (&in, sizeof (cache_header_t));
+    if (header != NULL
+	    && memcmp (header->magic, CACHE_MAGIC, sizeof (header->magic)) == 0
+	    && header->version == GERB_CACHE_VERSION
+	    && header->byte_order == G_BYTE_ORDER
+	    && strncmp (header->gerbv_version, VERSION,
+			sizeof (header->gerbv_version)) == 0
+	    && header->n_images >= 1 && header->n_images <= 2) {
+	n_images = header->n_images;
+	*isPnpFile = header->is_pnp;
+    } else {
+	in.failed = TRUE;
+    }
+
+    for (i = 0; i < n_images && !in.failed; i++)
+	if ((images[i] = cache_get_image (&in)) == NULL)
+	    in.failed = TRUE;
+
+    g_mapped_file_unref (file);
+
+    if (in.failed || in.p != in.end) {
+	dprintf("%s(): %s is damaged or out of date\n", __func__, path);
+	gerbv_destroy_image (images[0]);
+	gerbv_destroy_image (images[1]);
+	*isPnpFile = FALSE;
+	return FALSE;
+    }
+
+    dprintf("%s(): read %s\n", __func__, path);
+    *image = images[0];
+    *image2 = images[1];
+
+    return TRUE;
+} /* gerb_cache_load */
+
+/* ------------------------------------------------------------------ */
+void
+gerb_cache_store (gchar const *path, gerbv_image_t *image,
+		gerbv_image_t *image2, gboolean isPnpFile)
+{
+    GByteArray *out;
+    cache_header_t header;
+    GError *error = NULL;
+    gchar *dir;
+
+    if (image == NULL)
+	return;
+
+    memset (&header, 0, sizeof (header));
+    memcpy (header.magic, CACHE_MAGIC, sizeof (header.magic));
+    header.version = GERB_CACHE_VERSION;
+    header.byte_order = G_BYTE_ORDER;
+    strncpy (header.gerbv_version, VERSION,
+		    sizeof (header.gerbv_version) - 1);
+    header.n_images = (image2 != NULL) ? 2 : 1;
+    header.is_pnp = isPnpFile;
+
+    out = g_byte_array_new ();
+    g_byte_array_append (out, (const guint8 *)&header, sizeof (header));
+
+    if (!cache_put_image (out, image)
+	    || (image2 != NULL && !cache_put_image (out, image2))) {
+	dprintf("%s(): %s can't be cached\n", __func__, path);
+	g_byte_array_free (out, TRUE);
+	return;
+    }
+
+    /* Written to a temporary file and renamed, so other processes
+     * sharing the directory never map half a file */
+    dir = g_path_get_dirname (path);
+    g_mkdir_with_parents (dir, 0755);
+    g_free (dir);
+    if (!g_file_set_contents (path, (const gchar *)out->data, out->len,
+			    &error)) {
+	dprintf("%s(): %s\n", __func__, error->message);
+	g_error_free (error);
+    }
+
+    g_byte_array_free (out, TRUE);
+} /* gerb_cache_store */
@@ -0,0 +1,56 @@
+/*
+ * gEDA - GNU Electronic Design Automation
+ * This file is a part of gerbv.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111 USA
+ */
+
+/** \file gerb_cache.h
+    \brief Header info for keeping parsed images in a cache directory
+    \ingroup libgerbv
+*/
+
+#ifndef GERB_CACHE_H
+#define GERB_CACHE_H
+
+#include <glib.h>
+
+/* Bump this whenever the layout of a cache file changes */
+#define GERB_CACHE_VERSION 4
+
+/* TRUE if a cache directory is set, so gerb_cache_path() needs a hash */
+gboolean gerb_cache_enabled(void);
+
+/*
+ * The cache file for a file with the contents hash (its gerb_fchecksum())
+ * parsed with these arguments.  NULL if no cache directory is set or the
+ * file can't be cached: it is being reloaded, or hash is NULL because it
+ * includes other files, which may change without it changing.
+ */
+gchar *gerb_cache_path(gchar const *hash, gerbv_HID_Attribute *attr_list,
+		       int n_attr, int reload, gboolean forceLoadFile);
+
+/*
+ * Map the cache file at path and rebuild the images stored in it, as
+ * parse_image_from_fd() returns them.  FALSE if there is no usable file.
+ */
+gboolean gerb_cache_load(gchar const *path, gerbv_image_t **image,
+			 gerbv_image_t **image2, gboolean *isPnpFile);
+
+/* Write image (and image2, if not NULL) to the cache file at path */
+void gerb_cache_store(gchar const *path, gerbv_image_t *image,
+		      gerbv_image_t *image2, gboolean isPnpFile);
+
+#endif /* GERB_CACHE_H */
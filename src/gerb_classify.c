@@ -0,0 +1,272 @@
+/*
+ * gEDA - GNU Electronic Design Automation
+ * This file is a part of gerbv.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111 USA
+ */
+
+/** \file gerb_classify.c
+    \brief Telling RS-274X, drill, pick-and-place and RS-274D files apart
+    \ingroup libgerbv
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "common.h"
+#include "gerbv.h"
+#include "gerb_classify.h"
+
+/* DEBUG printing.  #define DEBUG 1 in config.h to use this fcn. */
+#define dprintf if(DEBUG) printf
+
+/* Files are looked at in lines of at most this many chars */
+#define CLASSIFY_LINE_MAX 200
+
+/* The signs of each file type seen so far */
+typedef struct {
+    /* RS-274X and RS-274D */
+    guint binary;
+    gboolean found_ADD;
+    gboolean found_D0;
+    gboolean found_D2;
+    gboolean found_M0;
+    gboolean found_M2;
+    gboolean found_star;
+    gboolean found_X;
+    gboolean found_Y;
+
+    /* Drill files, which may start with comments of any chars */
+    gboolean end_comments;
+    guint drill_binary;
+    gboolean found_M48;
+    gboolean found_M30;
+    gboolean found_percent;
+    gboolean found_T;
+    gboolean drill_X;
+    gboolean drill_Y;
+
+    /* Pick-and-place files */
+    gboolean found_G54;
+    gboolean found_M00;
+    gboolean found_M02;
+    gboolean found_G02;
+    gboolean found_any_ADD;
+    gboolean found_comma;
+    gboolean found_refdes;
+    gboolean found_boardside;
+} classify_t;
+
+/* The GERB_FILE_BINARY_* kinds of the bytes of buf */
+static guint
+classify_binary(const char *buf, int len)
+{
+    const guchar *p = (const guchar *)buf;
+    guint binary = 0;
+    int i;
+
+    for (i = 0; i < len; i++) {
+	if (p[i] >= 0x80)
+	    binary |= GERB_FILE_BINARY_HIGH;
+	else if (!isprint(p[i]) && p[i] != '\r' && p[i] != '\n'
+		&& p[i] != '\t')
+	    binary |= GERB_FILE_BINARY_CONTROL;
+    }
+
+    return binary;
+} /* classify_binary */
+
+/* TRUE if the first letter in buf is followed by a digit */
+static gboolean
+classify_letter_digit(const char *buf, int len, const char *letter)
+{
+    const char *p = g_strstr_len(buf, len, letter);
+
+    return p != NULL && isdigit((int) p[1]);
+} /* classify_letter_digit */
+
+static void
+classify_line(classify_t *c, char *buf, int len)
+{
+    const char *letter;
+
+    /* RS-274X and RS-274D */
+    c->binary |= classify_binary(buf, len);
+    if (g_strstr_len(buf, len, "%ADD"))
+	c->found_ADD = TRUE;
+    if (g_strstr_len(buf, len, "D0"))
+	c->found_D0 = TRUE;
+    if (g_strstr_len(buf, len, "D2"))
+	c->found_D2 = TRUE;
+    if (g_strstr_len(buf, len, "M0"))
+	c->found_M0 = TRUE;
+    if (g_strstr_len(buf, len, "M2"))
+	c->found_M2 = TRUE;
+    if (memchr(buf, '*', len))
+	c->found_star = TRUE;
+    if (classify_letter_digit(buf, len, "X"))
+	c->found_X = TRUE;
+    if (classify_letter_digit(buf, len, "Y"))
+	c->found_Y = TRUE;
+
+    /* Pick-and-place; a semicolon can be the separator too */
+    if (g_strstr_len(buf, len, "G54"))
+	c->found_G54 = TRUE;
+    if (g_strstr_len(buf, len, "M00"))
+	c->found_M00 = TRUE;
+    if (g_strstr_len(buf, len, "M02"))
+	c->found_M02 = TRUE;
+    if (g_strstr_len(buf, len, "G02"))
+	c->found_G02 = TRUE;
+    if (g_strstr_len(buf, len, "ADD"))
+	c->found_any_ADD = TRUE;
+    if (memchr(buf, ',', len) || memchr(buf, ';', len))
+	c->found_comma = TRUE;
+    /* Look for refdes -- This is dumb, but what else can we do? */
+    if (classify_letter_digit(buf, len, "R")
+	    || classify_letter_digit(buf, len, "C")
+	    || classify_letter_digit(buf, len, "U"))
+	c->found_refdes = TRUE;
+    /* Board side, or "Layer" in the header, required by many vendors */
+    if (g_strstr_len(buf, len, "top") || g_strstr_len(buf, len, "Top")
+	    || g_strstr_len(buf, len, "TOP")
+	    || g_strstr_len(buf, len, "ayer")
+	    || g_strstr_len(buf, len, "AYER"))
+	c->found_boardside = TRUE;
+
+    /* Drill; lines with a ';' at the top of the file are comments */
+    if (!c->end_comments) {
+	if (memchr(buf, ';', len))
+	    return;
+	c->end_comments = TRUE;
+    }
+
+    c->drill_binary |= classify_binary(buf, len) & GERB_FILE_BINARY_HIGH;
+
+    /* M48 starts the drill header, M30 after % ends the program */
+    if (g_strstr_len(buf, len, "M48"))
+	c->found_M48 = TRUE;
+    if (g_strstr_len(buf, len, "M30") && c->found_percent)
+	c->found_M30 = TRUE;
+
+    /* Check for % on its own line at end of header */
+    if ((letter = memchr(buf, '%', len)) != NULL) {
+	if ((letter[1] == '\r') || (letter[1] == '\n'))
+	    c->found_percent = TRUE;
+    }
+
+    /* T<number>, but not the first T after X or Y */
+    if ((letter = memchr(buf, 'T', len)) != NULL) {
+	if (!c->found_T && (c->drill_X || c->drill_Y))
+	    c->found_T = FALSE;
+	else if (isdigit((int) letter[1]))
+	    c->found_T = TRUE;
+    }
+
+    if (classify_letter_digit(buf, len, "X"))
+	c->drill_X = TRUE;
+    if (classify_letter_digit(buf, len, "Y"))
+	c->drill_Y = TRUE;
+} /* classify_line */
+
+/* The tail of a file is only looked at for the codes ending a program */
+static void
+classify_tail_line(classify_t *c, char *buf, int len)
+{
+    if (g_strstr_len(buf, len, "M0"))
+	c->found_M0 = TRUE;
+    if (g_strstr_len(buf, len, "M2"))
+	c->found_M2 = TRUE;
+    if (g_strstr_len(buf, len, "M00"))
+	c->found_M00 = TRUE;
+    if (g_strstr_len(buf, len, "M02"))
+	c->found_M02 = TRUE;
+    if (g_strstr_len(buf, len, "M30") && c->found_percent)
+	c->found_M30 = TRUE;
+} /* classify_tail_line */
+
+gerb_file_type_t
+gerb_classify(gerb_file_t *fd, gboolean *foundBinary, guint *binaryMask)
+{
+    classify_t c;
+    char buf[CLASSIFY_LINE_MAX];
+    goffset head_end;
+    int len;
+
+    memset(&c, 0, sizeof(c));
+    gerb_frewind(fd);
+
+    while (fd->ptr < GERB_CLASSIFY_HEAD
+	    && gerb_fgets(buf, sizeof(buf), fd) != NULL) {
+	len = strlen(buf);
+	classify_line(&c, buf, len);
+    }
+    head_end = fd->ptr;
+
+    if (head_end < fd->datalen) {
+	/* Start at a line in the tail, or where the head ended */
+	if (head_end < fd->datalen - GERB_CLASSIFY_TAIL) {
+	    int ch;
+
+	    gerb_fseek(fd, fd->datalen - GERB_CLASSIFY_TAIL);
+	    while ((ch = gerb_fgetc(fd)) != EOF && ch != '\n')
+		;
+	}
+	while (gerb_fgets(buf, sizeof(buf), fd) != NULL) {
+	    len = strlen(buf);
+	    classify_tail_line(&c, buf, len);
+	}
+    }
+
+    gerb_frewind(fd);
+    gerb_fbinary_watch(fd, head_end);
+
+    dprintf("%s(): looked at %ld of %ld bytes\n", __func__,
+	    (long)head_end, (long)fd->datalen);
+
+    *binaryMask = GERB_FILE_BINARY_CONTROL | GERB_FILE_BINARY_HIGH;
+    *foundBinary = (c.binary != 0);
+
+    if ((c.found_D0 || c.found_D2 || c.found_M0 || c.found_M2)
+	    && c.found_ADD && c.found_star && (c.found_X || c.found_Y))
+	return GERB_FILE_TYPE_RS274X;
+
+    /* Drill XY locations, or a valid header and EOF without them */
+    if (((c.drill_X || c.drill_Y) && c.found_T
+		&& (c.found_M48 || (c.found_percent && c.found_M30)))
+	    || (c.found_M48 && c.found_T && c.found_percent
+		&& c.found_M30)) {
+	*binaryMask = GERB_FILE_BINARY_HIGH;
+	*foundBinary = (c.drill_binary != 0);
+	return GERB_FILE_TYPE_DRILL;
+    }
+
+    if (!c.found_G54 && !c.found_M00 && !c.found_M02 && !c.found_G02
+	    && !c.found_any_ADD && c.found_comma && c.found_refdes
+	    && c.found_boardside)
+	return GERB_FILE_TYPE_PICKANDPLACE;
+
+    if ((c.found_D0 || c.found_D2 || c.found_M0 || c.found_M2)
+	    && !c.found_ADD && c.found_star && (c.found_X || c.found_Y)
+	    && !c.binary)
+	return GERB_FILE_TYPE_RS274D;
+
+    return GERB_FILE_TYPE_UNKNOWN;
+} /* gerb_classify */
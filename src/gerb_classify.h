@@ -0,0 +1,54 @@
+/*
+ * gEDA - GNU Electronic Design Automation
+ * This file is a part of gerbv.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111 USA
+ */
+
+/** \file gerb_classify.h
+    \brief Header info for telling the types of input files apart
+    \ingroup libgerbv
+*/
+
+#ifndef GERB_CLASSIFY_H
+#define GERB_CLASSIFY_H
+
+#include <glib.h>
+
+#include "gerb_file.h"
+
+typedef enum {
+    GERB_FILE_TYPE_UNKNOWN,
+    GERB_FILE_TYPE_RS274X,
+    GERB_FILE_TYPE_DRILL,
+    GERB_FILE_TYPE_PICKANDPLACE,
+    GERB_FILE_TYPE_RS274D,
+} gerb_file_type_t;
+
+/* Only this much of the start and of the end of a file is looked at */
+#define GERB_CLASSIFY_HEAD (1 << 20)
+#define GERB_CLASSIFY_TAIL 4096
+
+/*
+ * Tell the type of fd from the signs of each type in its head (and the end
+ * of program codes in its tail), all in one pass.  foundBinary is set if
+ * the head holds bytes a file of that type should not have; binaryMask gets
+ * the GERB_FILE_BINARY_* kinds those are.  fd is rewound, and the bytes
+ * after the head are watched for binary ones while they are parsed.
+ */
+gerb_file_type_t gerb_classify(gerb_file_t *fd, gboolean *foundBinary,
+			       guint *binaryMask);
+
+#endif /* GERB_CLASSIFY_H */
@@ -44,6 +44,9 @@
 #endif
 #include <errno.h>
 #include <glib/gstdio.h>
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
 
 #include "common.h"
 #include "gerbv.h"
@@ -52,18 +55,105 @@
 /* DEBUG printing.  #define DEBUG 1 in config.h to use this fcn. */
 #define dprintf if(DEBUG) printf
 
+/* Size of the pieces the file is cut into for gerb_fprelex_start() */
+#define PRELEX_CHUNK_SIZE (1 << 20)
+
+typedef struct {
+    guint32 offset;	/* From the start of the chunk */
+    gint32 value;	/* The number after a word letter */
+    gchar code;		/* See gerb_token_t */
+    guint8 size;	/* Bytes the token takes up */
+    gint16 len;		/* gerb_fgetint()'s len of value, -1 if the number
+			   is left to gerb_fgetint() */
+} prelex_token_t;
+
+typedef struct {
+    goffset start;	/* Chunk is data[start..end) and ends after a '*' */
+    goffset end;
+    GArray *tokens;	/* prelex_token_t, in the order of the file */
+    guint binary;	/* GERB_FILE_BINARY_* found in the watched bytes */
+    gboolean done;
+} prelex_chunk_t;
+
+struct gerb_prelex {
+    gerb_file_t *fd;
+    const char *words;	/* The letters a number follows */
+    goffset binary_from; /* Bytes from here on are checked for binary ones */
+    GThreadPool *pool;
+    GMutex lock;
+    GCond done_cond;
+    prelex_chunk_t *chunks;
+    int n_chunks;
+    int next_queued;	/* First chunk not yet handed to the pool */
+    int current;	/* Chunk holding the read position */
+    gboolean current_done;
+    guint cursor;	/* Next token in the current chunk */
+};
+
+static gboolean gerb_fwindow(gerb_file_t *fd, goffset offset);
+static gboolean gerb_fread_stream(gerb_file_t *fd, const char *head,
+				  gsize head_len);
+#ifdef HAVE_ZLIB
+static gboolean gerb_fread_gzip(gerb_file_t *fd, const char *head,
+				gsize head_len, goffset size);
+#endif
+static const char *gerb_fpeek(gerb_file_t *fd, char *tail);
+static void gerb_fcheck_binary(gerb_file_t *fd);
+
+/* Streams and compressed files are read in pieces of this size */
+#define GERB_FILE_STREAM_CHUNK (64 << 10)
+
+/* The most deflate can expand its input by */
+#define GERB_FILE_DEFLATE_RATIO 1032
+
+/* Files which can not be held in memory as a whole are read through a
+ * window of this size */
+#define GERB_FILE_WINDOW_SIZE (64 << 20)
+
+/* Part of the window kept before the read position when it moves, so that
+ * gerb_ungetc() and short look-backs stay inside it */
+#define GERB_FILE_WINDOW_BACK 4096
+
+/* Binary bytes are looked for this far ahead of the read position, so
+ * the bytes are still in the cache when the parser gets to them */
+#define GERB_FILE_BINARY_AHEAD (64 << 10)
+
+/* The number readers need this much of the file after the read position
+ * in memory.  No coordinate or parameter in a sane file is longer. */
+#define GERB_FILE_NUMBER_MAX 128
+
+/* Contents of an included file, kept for the load going on */
+typedef struct {
+    char *data;
+    gsize len;
+} include_t;
+
+/* The include_t of each included path while gerb_include_cache_begin()
+ * is in force, NULL otherwise.  Loads parse on several threads. */
+static GHashTable *include_cache = NULL;
+static int include_cache_users = 0;
+static GMutex include_cache_lock;
+
+/* TRUE if the byte at offset in the file is in fd->data */
+#define GERB_FILE_IN_WINDOW(fd, offset) \
+	((offset) >= (fd)->window \
+	 && (guint64)((offset) - (fd)->window) < (fd)->window_len)
+
 gerb_file_t *
 gerb_fopen(char const * filename)
 {
     gerb_file_t *fd;
     struct stat statinfo;
+    unsigned char head[2];
+    size_t head_len;
     
     dprintf("---> Entering gerb_fopen, filename = %s\n", filename);
 
-    fd = g_new(gerb_file_t, 1);
+    fd = g_new0(gerb_file_t, 1);
     if (fd == NULL) {
 	return NULL;
     }
+    fd->binary_checked = G_MAXINT64;
 
     dprintf("     Doing fopen\n");
     /* fopen() can't open files with non ASCII filenames on windows */
@@ -83,7 +173,7 @@ gerb_fopen(char const * filename)
     }
 
     dprintf("     Checking S_ISREG\n");
-    if (!S_ISREG(statinfo.st_mode)) {
+    if (S_ISDIR(statinfo.st_mode)) {
 	fclose(fd->fd);
 	g_free(fd);
 	errno = EISDIR;
@@ -91,51 +181,497 @@ gerb_fopen(char const * filename)
     }
 
     dprintf("     Checking statinfo.st_size\n");
-    if ((int)statinfo.st_size == 0) {
+    if (S_ISREG(statinfo.st_mode) && statinfo.st_size == 0) {
 	fclose(fd->fd);
 	g_free(fd);
 	errno = EIO; /* More compatible with the world outside Linux */
 	return NULL;
     }
 
+    /* Look at the start of the file for the gzip magic.  A pipe can't be
+     * rewound, so these bytes are handed on to whatever reads it. */
+    head_len = fread(head, 1, sizeof(head), fd->fd);
+
+#ifdef HAVE_ZLIB
+    if (head_len == sizeof(head) && head[0] == 0x1f && head[1] == 0x8b) {
+	dprintf("     Inflating a gzip file\n");
+	if (!gerb_fread_gzip(fd, (char *)head, head_len,
+		    S_ISREG(statinfo.st_mode) ? statinfo.st_size : 0)) {
+	    fclose(fd->fd);
+	    g_free(fd->data);
+	    g_free(fd);
+	    return NULL;
+	}
+	dprintf("<--- Leaving gerb_fopen\n");
+	return fd;
+    }
+#endif
+
+    /* Pipes, FIFOs and devices have no size and can't be mapped or
+     * windowed: read them into memory as they come */
+    if (!S_ISREG(statinfo.st_mode)) {
+	dprintf("     Reading a stream\n");
+	if (!gerb_fread_stream(fd, (char *)head, head_len)) {
+	    fclose(fd->fd);
+	    g_free(fd->data);
+	    g_free(fd);
+	    return NULL;
+	}
+	dprintf("<--- Leaving gerb_fopen\n");
+	return fd;
+    }
+    rewind(fd->fd);
+
+    fd->datalen = statinfo.st_size;
+
 #ifdef HAVE_SYS_MMAN_H
 
     dprintf("     Doing mmap\n");
-    fd->datalen = (int)statinfo.st_size;
-    fd->data = (char *)mmap(0, statinfo.st_size, PROT_READ, MAP_PRIVATE, 
+    if ((guint64)statinfo.st_size <= G_MAXSIZE) {
+	fd->data = (char *)mmap(0, statinfo.st_size, PROT_READ, MAP_PRIVATE, 
 			    fd->fileno, 0);
-    if(fd->data == MAP_FAILED) {
-	fclose(fd->fd);
-	g_free(fd);
-	fd = NULL;
+	if (fd->data != MAP_FAILED) {
+	    fd->window_len = statinfo.st_size;
+	    fd->mapped = TRUE;
+	} else {
+	    fd->data = NULL;
+	}
     }
 
 #else
     /* all systems without mmap, not only MINGW32 */
 
-    dprintf("     Doing calloc\n");
-    fd->datalen = (int)statinfo.st_size;
-    fd->data = calloc(1, statinfo.st_size + 1);
-    if (fd->data == NULL) {
-        fclose(fd->fd);
-        g_free(fd);
-        return NULL;
-    }
-    if (fread((void*)fd->data, 1, statinfo.st_size, fd->fd) != statinfo.st_size) {
-        fclose(fd->fd);
-	g_free(fd->data);
-        g_free(fd);
-	return NULL;
+    if (statinfo.st_size <= GERB_FILE_WINDOW_SIZE) {
+	dprintf("     Doing calloc\n");
+	fd->data = g_try_malloc(statinfo.st_size + 1);
+	if (fd->data == NULL) {
+	    fclose(fd->fd);
+	    g_free(fd);
+	    return NULL;
+	}
+	if (fread((void*)fd->data, 1, statinfo.st_size, fd->fd) != statinfo.st_size) {
+	    fclose(fd->fd);
+	    g_free(fd->data);
+	    g_free(fd);
+	    return NULL;
+	}
+	fd->data[statinfo.st_size] = '\0';
+	fd->window_len = statinfo.st_size;
+	rewind (fd->fd);
     }
-    rewind (fd->fd);
 
 #endif
 
+    /* Too big to be held in memory (or in the address space): only keep
+     * a window of it and move it as the file is read */
+    if (fd->data == NULL) {
+	dprintf("     Using a window of %d bytes\n", GERB_FILE_WINDOW_SIZE);
+	if (!gerb_fwindow(fd, 0)) {
+	    fclose(fd->fd);
+	    g_free(fd->data);
+	    g_free(fd);
+	    return NULL;
+	}
+    }
+
     dprintf("<--- Leaving gerb_fopen\n");
     return fd;
 } /* gerb_fopen */
 
 
+/* Read the rest of a stream which can't be stat()ed for its size.  The
+ * head_len bytes at head were already read from it. */
+static gboolean
+gerb_fread_stream(gerb_file_t *fd, const char *head, gsize head_len)
+{
+    gsize alloc = GERB_FILE_STREAM_CHUNK, n;
+
+    fd->data = g_try_malloc(alloc + 1);
+    if (fd->data == NULL)
+	return FALSE;
+
+    memcpy(fd->data, head, head_len);
+    fd->datalen = head_len;
+
+    while ((n = fread(fd->data + fd->datalen, 1, alloc - fd->datalen,
+		    fd->fd)) > 0) {
+	fd->datalen += n;
+	if ((gsize)fd->datalen == alloc) {
+	    char *data;
+
+	    alloc *= 2;
+	    data = g_try_realloc(fd->data, alloc + 1);
+	    if (data == NULL)
+		return FALSE;
+	    fd->data = data;
+	}
+    }
+
+    if (ferror(fd->fd))
+	return FALSE;
+
+    if (fd->datalen == 0) {
+	errno = EIO; /* Same as for an empty file */
+	return FALSE;
+    }
+
+    fd->data[fd->datalen] = '\0';
+    fd->window_len = fd->datalen;
+
+    return TRUE;
+} /* gerb_fread_stream */
+
+
+#ifdef HAVE_ZLIB
+/* The size a gzip file of size bytes inflates to, as its trailer tells,
+ * or 0 if it can't be told.  The trailer holds the size of the last
+ * member modulo 2^32 only, so this is a guess to allocate for. */
+static gsize
+gerb_fgzip_size(gerb_file_t *fd, gsize head_len, goffset size)
+{
+    unsigned char isize[4];
+    guint32 len;
+
+    /* The smallest gzip file is a header of 10 and a trailer of 8 */
+    if (size < 18 || fseek(fd->fd, -4, SEEK_END) != 0)
+	return 0;
+    if (fread(isize, 1, sizeof(isize), fd->fd) != sizeof(isize)) {
+	clearerr(fd->fd);
+	len = 0;
+    } else {
+	len = isize[0] | isize[1] << 8 | isize[2] << 16
+	    | (guint32)isize[3] << 24;
+    }
+    /* Back to where the head ended */
+    if (fseek(fd->fd, head_len, SEEK_SET) != 0) {
+	errno = EIO;
+	return G_MAXSIZE;
+    }
+
+    /* A damaged trailer asks for no more than the data could give, and
+     * one smaller than the file is of the last of several members */
+    if ((guint64)len > (guint64)size * GERB_FILE_DEFLATE_RATIO
+	    || (goffset)len < size)
+	return 0;
+
+    return len;
+}
+
+/* Inflate the rest of a gzip file into memory while it is read, so that
+ * the compressed data is never held as a whole.  The head_len bytes at
+ * head were already read from it.  The buffer is allocated at the size
+ * the trailer of a regular file of size bytes tells, if any, and
+ * doubled only if the data turns out larger. */
+static gboolean
+gerb_fread_gzip(gerb_file_t *fd, const char *head, gsize head_len,
+		goffset size)
+{
+    z_stream zs;
+    unsigned char *in;
+    gsize alloc = 0;
+    gboolean in_member = FALSE, ok = TRUE;
+    int ret = Z_OK;
+
+    if (size > 0) {
+	alloc = gerb_fgzip_size(fd, head_len, size);
+	if (alloc == G_MAXSIZE)
+	    return FALSE;
+    }
+    if (alloc == 0)
+	alloc = GERB_FILE_STREAM_CHUNK;
+
+    memset(&zs, 0, sizeof(zs));
+    /* 16 + MAX_WBITS: expect a gzip header */
+    if (inflateInit2(&zs, 16 + MAX_WBITS) != Z_OK) {
+	errno = ENOMEM;
+	return FALSE;
+    }
+
+    in = g_try_malloc(GERB_FILE_STREAM_CHUNK);
+    fd->data = g_try_malloc(alloc + 1);
+    if (fd->data == NULL && alloc > GERB_FILE_STREAM_CHUNK) {
+	/* Try growing from a chunk instead */
+	alloc = GERB_FILE_STREAM_CHUNK;
+	fd->data = g_try_malloc(alloc + 1);
+    }
+    if (in == NULL || fd->data == NULL) {
+	inflateEnd(&zs);
+	g_free(in);
+	errno = ENOMEM;
+	return FALSE;
+    }
+
+    memcpy(in, head, head_len);
+    zs.next_in = in;
+    zs.avail_in = head_len;
+
+    for (;;) {
+	if (zs.avail_in == 0) {
+	    zs.avail_in = fread(in, 1, GERB_FILE_STREAM_CHUNK, fd->fd);
+	    zs.next_in = in;
+	    if (zs.avail_in == 0)
+		break;
+	}
+	in_member = TRUE;
+
+	/* Grow only once inflate has stopped for want of room: with the
+	 * size from the trailer the buffer is full before the trailer is
+	 * read */
+	if ((gsize)fd->datalen == alloc && ret == Z_BUF_ERROR) {
+	    char *data;
+
+	    alloc *= 2;
+	    data = g_try_realloc(fd->data, alloc + 1);
+	    if (data == NULL) {
+		errno = ENOMEM;
+		ok = FALSE;
+		break;
+	    }
+	    fd->data = data;
+	}
+
+	zs.next_out = (unsigned char *)fd->data + fd->datalen;
+	zs.avail_out = MIN(alloc - fd->datalen, G_MAXUINT);
+	ret = inflate(&zs, Z_NO_FLUSH);
+	fd->datalen = (char *)zs.next_out - fd->data;
+
+	if (ret == Z_STREAM_END) {
+	    /* gzip files may hold several members one after the other */
+	    in_member = FALSE;
+	    inflateReset(&zs);
+	} else if (ret != Z_OK && ret != Z_BUF_ERROR) {
+	    dprintf("     inflate: %s\n", zs.msg ? zs.msg : "?");
+	    errno = EIO;
+	    ok = FALSE;
+	    break;
+	}
+    }
+
+    inflateEnd(&zs);
+    g_free(in);
+
+    if (ok && (ferror(fd->fd) || in_member || fd->datalen == 0)) {
+	/* Unreadable, cut short or empty */
+	errno = EIO;
+	ok = FALSE;
+    }
+
+    if (ok) {
+	fd->data[fd->datalen] = '\0';
+	fd->window_len = fd->datalen;
+    }
+
+    return ok;
+} /* gerb_fread_gzip */
+#endif
+
+
+/* Read from len bytes at data instead of a file.  They are not copied, so
+ * they must stay around until gerb_fclose() */
+gerb_file_t *
+gerb_fopen_buffer(char const * data, gsize len)
+{
+    gerb_file_t *fd;
+
+    dprintf("---> Entering gerb_fopen_buffer, len = %lu\n", (unsigned long)len);
+
+    if (len == 0) {
+	errno = EIO;
+	return NULL;
+    }
+
+    fd = g_new0(gerb_file_t, 1);
+    fd->fd = NULL;
+    fd->fileno = -1;
+    fd->data = (char *)data;
+    fd->datalen = len;
+    fd->window_len = len;
+    fd->borrowed = TRUE;
+    fd->binary_checked = G_MAXINT64;
+
+    return fd;
+} /* gerb_fopen_buffer */
+
+
+static void
+include_free(gpointer data)
+{
+    include_t *include = data;
+
+    g_free(include->data);
+    g_free(include);
+} /* include_free */
+
+
+void
+gerb_include_cache_begin(void)
+{
+    g_mutex_lock(&include_cache_lock);
+    if (include_cache_users++ == 0)
+	include_cache = g_hash_table_new_full(g_str_hash, g_str_equal,
+					      g_free, include_free);
+    g_mutex_unlock(&include_cache_lock);
+} /* gerb_include_cache_begin */
+
+
+void
+gerb_include_cache_end(void)
+{
+    g_mutex_lock(&include_cache_lock);
+    if (--include_cache_users == 0) {
+	g_hash_table_destroy(include_cache);
+	include_cache = NULL;
+    }
+    g_mutex_unlock(&include_cache_lock);
+} /* gerb_include_cache_end */
+
+
+/* Read all of filename into memory, NULL if it can't be opened or is too
+ * big to be kept */
+static include_t *
+include_read(char const *filename)
+{
+    gerb_file_t *fd;
+    include_t *include;
+    const char *block;
+    gsize len;
+
+    fd = gerb_fopen(filename);
+    if (fd == NULL)
+	return NULL;
+    if (fd->datalen > GERB_FILE_WINDOW_SIZE) {
+	gerb_fclose(fd);
+	return NULL;
+    }
+
+    include = g_new(include_t, 1);
+    include->data = g_malloc(fd->datalen + 1);
+    include->len = 0;
+    while ((block = gerb_fblock(fd, include->len, &len)) != NULL) {
+	memcpy(include->data + include->len, block, len);
+	include->len += len;
+    }
+    include->data[include->len] = '\0';
+    gerb_fclose(fd);
+
+    return include;
+} /* include_read */
+
+
+gerb_file_t *
+gerb_fopen_include(char const *filename)
+{
+    include_t *include, *other;
+
+    g_mutex_lock(&include_cache_lock);
+    if (include_cache == NULL) {
+	g_mutex_unlock(&include_cache_lock);
+	return gerb_fopen(filename);
+    }
+    include = g_hash_table_lookup(include_cache, filename);
+    g_mutex_unlock(&include_cache_lock);
+
+    if (include == NULL) {
+	/* Not under the lock, the other threads go on parsing meanwhile */
+	include = include_read(filename);
+	if (include == NULL)
+	    return gerb_fopen(filename);
+
+	g_mutex_lock(&include_cache_lock);
+	other = g_hash_table_lookup(include_cache, filename);
+	if (other != NULL) {
+	    include_free(include);
+	    include = other;
+	} else {
+	    g_hash_table_insert(include_cache, g_strdup(filename), include);
+	}
+	g_mutex_unlock(&include_cache_lock);
+    } else {
+	dprintf("%s(): %s read before\n", __func__, filename);
+    }
+
+    /* Left alone until the cache goes, after all parsing is done */
+    return gerb_fopen_buffer(include->data, include->len);
+} /* gerb_fopen_include */
+
+
+/* Move the window so that it holds the byte at offset */
+static gboolean
+gerb_fwindow(gerb_file_t *fd, goffset offset)
+{
+    goffset start = MAX(offset - GERB_FILE_WINDOW_BACK, 0);
+    gsize len;
+
+#ifdef HAVE_SYS_MMAN_H
+    start -= start % sysconf(_SC_PAGESIZE);
+    len = MIN(GERB_FILE_WINDOW_SIZE, fd->datalen - start);
+
+    if (fd->mapped)
+	munmap(fd->data, fd->window_len);
+    fd->data = (char *)mmap(0, len, PROT_READ, MAP_PRIVATE,
+			    fd->fileno, start);
+    if (fd->data == MAP_FAILED) {
+	fd->data = NULL;
+	fd->window_len = 0;
+	fd->mapped = FALSE;
+	return FALSE;
+    }
+    fd->mapped = TRUE;
+#else
+    len = MIN(GERB_FILE_WINDOW_SIZE, fd->datalen - start);
+
+    if (fd->data == NULL)
+	fd->data = g_try_malloc(GERB_FILE_WINDOW_SIZE + 1);
+    if (fd->data == NULL)
+	return FALSE;
+
+# ifdef G_OS_WIN32
+    if (_fseeki64(fd->fd, start, SEEK_SET) != 0
+# else
+    if (fseeko(fd->fd, start, SEEK_SET) != 0
+# endif
+	    || fread(fd->data, 1, len, fd->fd) != len) {
+	fd->window_len = 0;
+	return FALSE;
+    }
+    fd->data[len] = '\0';
+#endif
+
+    fd->window = start;
+    fd->window_len = len;
+
+    return TRUE;
+} /* gerb_fwindow */
+
+
+/* Return the file at the read position with at least GERB_FILE_NUMBER_MAX
+ * bytes (or the rest of the file) after it in memory.  Neither a mapped
+ * file nor a caller's buffer has to end in a '\0' for strtol() to stop at,
+ * so the last bytes are copied to tail (GERB_FILE_NUMBER_MAX + 1 long) and
+ * terminated there. */
+static const char *
+gerb_fpeek(gerb_file_t *fd, char *tail)
+{
+    goffset rest = fd->datalen - fd->ptr;
+    goffset need = MIN(fd->ptr + GERB_FILE_NUMBER_MAX, fd->datalen) - 1;
+    const char *start;
+
+    if (!GERB_FILE_IN_WINDOW(fd, fd->ptr) || !GERB_FILE_IN_WINDOW(fd, need)) {
+	if (!gerb_fwindow(fd, fd->ptr))
+	    return NULL;
+    }
+
+    start = fd->data + (fd->ptr - fd->window);
+    if (rest < GERB_FILE_NUMBER_MAX) {
+	memcpy(tail, start, rest);
+	tail[rest] = '\0';
+	return tail;
+    }
+
+    return start;
+} /* gerb_fpeek */
+
+
 int
 gerb_fgetc(gerb_file_t *fd)
 {
@@ -143,28 +679,435 @@ gerb_fgetc(gerb_file_t *fd)
     if (fd->ptr >= fd->datalen)
 	return EOF;
 
-    return (int) fd->data[fd->ptr++];
+    if (!GERB_FILE_IN_WINDOW(fd, fd->ptr) && !gerb_fwindow(fd, fd->ptr))
+	return EOF;
+
+    if (fd->ptr >= fd->binary_checked) {
+	gerb_fcheck_binary(fd);
+	/* Checking a gap moves the window */
+	if (!GERB_FILE_IN_WINDOW(fd, fd->ptr))
+	    return EOF;
+    }
+
+    return (int) fd->data[fd->ptr++ - fd->window];
 } /* gerb_fgetc */
 
 
+/* Same as fgets(), for the file type checks */
+char *
+gerb_fgets(char *buf, int size, gerb_file_t *fd)
+{
+    int i = 0, c;
+
+    while (i < size - 1 && (c = gerb_fgetc(fd)) != EOF) {
+	buf[i++] = (char)c;
+	if (c == '\n')
+	    break;
+    }
+
+    if (i == 0)
+	return NULL;
+
+    buf[i] = '\0';
+
+    return buf;
+} /* gerb_fgets */
+
+
+void
+gerb_frewind(gerb_file_t *fd)
+{
+    fd->ptr = 0;
+} /* gerb_frewind */
+
+
+void
+gerb_fseek(gerb_file_t *fd, goffset offset)
+{
+    fd->ptr = CLAMP(offset, 0, fd->datalen);
+} /* gerb_fseek */
+
+
+const char *
+gerb_fblock(gerb_file_t *fd, goffset offset, gsize *len)
+{
+    *len = 0;
+
+    if (offset < 0 || offset >= fd->datalen)
+	return NULL;
+
+    if (!GERB_FILE_IN_WINDOW(fd, offset) && !gerb_fwindow(fd, offset))
+	return NULL;
+
+    *len = fd->window_len - (offset - fd->window);
+
+    return fd->data + (offset - fd->window);
+} /* gerb_fblock */
+
+
+gchar *
+gerb_fchecksum(gerb_file_t *fd)
+{
+    GChecksum *checksum = g_checksum_new(G_CHECKSUM_SHA256);
+    const char *block;
+    gchar *hash = NULL;
+    goffset offset = 0;
+    gsize len;
+
+    while ((block = gerb_fblock(fd, offset, &len)) != NULL) {
+	g_checksum_update(checksum, (const guchar *)block, len);
+	offset += len;
+    }
+    gerb_frewind(fd);
+
+    if (offset == fd->datalen)
+	hash = g_strdup(g_checksum_get_string(checksum));
+    g_checksum_free(checksum);
+
+    return hash;
+} /* gerb_fchecksum */
+
+
+gboolean
+gerb_fincludes(gerb_file_t *fd)
+{
+    const char *block;
+    goffset offset = 0;
+    gsize len, i;
+    /* The last char and the last one other than white space before it */
+    char last = '\0', sign = '\0';
+
+    /* %IF, maybe after other parameters of the block */
+    while ((block = gerb_fblock(fd, offset, &len)) != NULL) {
+	for (i = 0; i < len; i++) {
+	    if (block[i] == 'F' && last == 'I'
+		    && (sign == '%' || sign == '*')) {
+		gerb_frewind(fd);
+		return TRUE;
+	    }
+	    if (last != ' ' && last != '\t' && last != '\r' && last != '\n')
+		sign = last;
+	    last = block[i];
+	}
+	offset += len;
+    }
+    gerb_frewind(fd);
+
+    return FALSE;
+} /* gerb_fincludes */
+
+
+/* ------------------------------------------------------------------ */
+/* The GERB_FILE_BINARY_* found in the len bytes at p */
+static guint
+gerb_binary_bytes(const guchar *p, gsize len)
+{
+    const guchar *stop = p + len;
+    guint binary = 0;
+
+    for (; p < stop; p++) {
+	if (*p >= 0x80)
+	    binary |= GERB_FILE_BINARY_HIGH;
+	else if ((*p < 0x20 && *p != '\t' && *p != '\r' && *p != '\n')
+		|| *p == 0x7f)
+	    binary |= GERB_FILE_BINARY_CONTROL;
+    }
+
+    return binary;
+} /* gerb_binary_bytes */
+
+
+/* Check the bytes from offset up to end wherever the window is, then
+ * move the window back to the read position */
+static void
+gerb_fcheck_binary_range(gerb_file_t *fd, goffset offset, goffset end)
+{
+    const char *block;
+    gsize len;
+
+    while (offset < end
+	    && (block = gerb_fblock(fd, offset, &len)) != NULL) {
+	len = MIN(len, (gsize)(end - offset));
+	fd->binary |= gerb_binary_bytes((const guchar *)block, len);
+	offset += len;
+    }
+
+    if (fd->ptr < fd->datalen && !GERB_FILE_IN_WINDOW(fd, fd->ptr))
+	gerb_fwindow(fd, fd->ptr);
+} /* gerb_fcheck_binary_range */
+
+
+void
+gerb_fbinary_watch(gerb_file_t *fd, goffset offset)
+{
+    fd->binary = 0;
+    fd->binary_checked = offset;
+} /* gerb_fbinary_watch */
+
+
+guint
+gerb_fbinary(gerb_file_t *fd)
+{
+    /* The parse may have stopped before the end of the file */
+    if (fd->binary_checked < fd->datalen) {
+	gerb_fcheck_binary_range(fd, fd->binary_checked, fd->datalen);
+	fd->binary_checked = fd->datalen;
+    }
+
+    return fd->binary;
+} /* gerb_fbinary */
+
+
+/* Check the window from where the last check stopped to a bit ahead of
+ * the read position.  If the window moved past where the check stopped,
+ * the bytes skipped up to the read position are checked first. */
+static void
+gerb_fcheck_binary(gerb_file_t *fd)
+{
+    goffset end;
+
+    if (fd->binary_checked < fd->window) {
+	gerb_fcheck_binary_range(fd, fd->binary_checked, fd->ptr);
+	fd->binary_checked = fd->ptr;
+	if (!GERB_FILE_IN_WINDOW(fd, fd->ptr))
+	    return;
+    }
+
+    end = MIN(fd->ptr + GERB_FILE_BINARY_AHEAD,
+	      fd->window + (goffset)fd->window_len);
+    if (end > fd->binary_checked) {
+	fd->binary |= gerb_binary_bytes((const guchar *)fd->data
+		+ (fd->binary_checked - fd->window),
+		end - fd->binary_checked);
+	fd->binary_checked = end;
+    }
+} /* gerb_fcheck_binary */
+
+
+/* ------------------------------------------------------------------ */
+/* Coordinates are short runs of decimal digits, so they are converted
+ * here instead of by strtol()/strtod(), which have to handle locales,
+ * bases and errno on every call. */
+
+/* A digit run is accumulated while it fits; the rest only counted */
+#define LEX_ACC_MAX ((G_MAXUINT64 - 9) / 10)
+#define LEX_ACC8_MAX ((G_MAXUINT64 - 99999999) / 100000000)
+
+/* Powers of ten which a double holds exactly */
+static const double lex_pow10[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+/* Value of 8 digits loaded little endian into v, first digit lowest */
+static inline guint32
+lex_8digits(guint64 v)
+{
+    v -= G_GUINT64_CONSTANT(0x3030303030303030);
+    v = (v * 10 + (v >> 8)) & G_GUINT64_CONSTANT(0x00ff00ff00ff00ff);
+    v = (v * 100 + (v >> 16)) & G_GUINT64_CONSTANT(0x0000ffff0000ffff);
+    return (guint32)((v * 10000 + (v >> 32)) & 0xffffffff);
+} /* lex_8digits */
+
+/* Add the digits at p (up to end) to *acc.  Digits which don't fit are
+ * counted in *dropped.  Returns the first byte which is not a digit. */
+static const char *
+lex_digits(const char *p, const char *end, guint64 *acc, int *dropped)
+{
+    /* Eight at a time, in one 64 bit word */
+    while (end - p >= 8 && *acc <= LEX_ACC8_MAX) {
+	guint64 v;
+
+	memcpy(&v, p, 8);
+	v = GUINT64_FROM_LE(v);
+	/* All bytes in '0'..'9': high nibble 3, and no carry into it
+	 * when adding 6 */
+	if ((v & G_GUINT64_CONSTANT(0xf0f0f0f0f0f0f0f0))
+		    != G_GUINT64_CONSTANT(0x3030303030303030)
+		|| ((v + G_GUINT64_CONSTANT(0x0606060606060606))
+		    & G_GUINT64_CONSTANT(0xf0f0f0f0f0f0f0f0))
+		    != G_GUINT64_CONSTANT(0x3030303030303030))
+	    break;
+
+	*acc = *acc * 100000000 + lex_8digits(v);
+	p += 8;
+    }
+
+    for (; p < end && g_ascii_isdigit(*p); p++) {
+	if (*acc <= LEX_ACC_MAX)
+	    *acc = *acc * 10 + (*p - '0');
+	else
+	    (*dropped)++;
+    }
+
+    return p;
+} /* lex_digits */
+
+/* Read a decimal integer like strtol(start, &end, 10) would.  FALSE if
+ * it can't be done here: the number runs up to limit, which isn't the
+ * end of the file, or it doesn't fit in a long. */
+static gboolean
+lex_long(const char *start, const char *limit, gboolean at_eof,
+	 long *value, const char **end)
+{
+    const char *p = start, *digits;
+    gboolean negative = FALSE;
+    guint64 acc = 0;
+    int dropped = 0;
+
+    while (p < limit && g_ascii_isspace(*p))
+	p++;
+    if (p < limit && (*p == '+' || *p == '-')) {
+	negative = (*p == '-');
+	p++;
+    }
+
+    digits = p;
+    p = lex_digits(p, limit, &acc, &dropped);
+    if (p == limit && !at_eof)
+	return FALSE;
+
+    if (p == digits) {
+	/* No number, nothing is consumed */
+	*value = 0;
+	*end = start;
+	return TRUE;
+    }
+
+    if (dropped || acc > (guint64)G_MAXLONG + negative)
+	return FALSE;
+
+    *value = negative ? (long)(0 - acc) : (long)acc;
+    *end = p;
+
+    return TRUE;
+} /* lex_long */
+
+/* Read a decimal number like strtod(start, &end) would.  FALSE if it
+ * can't be done exactly here; hex, infinity and NaN are also left to
+ * strtod(). */
+static gboolean
+lex_double(const char *start, const char *limit, gboolean at_eof,
+	   double *value, const char **end)
+{
+    const char *p = start, *digits, *point;
+    gboolean negative = FALSE;
+    guint64 acc = 0;
+    int dropped = 0, exp10 = 0, ndigits;
+
+    while (p < limit && g_ascii_isspace(*p))
+	p++;
+    if (p < limit && (*p == '+' || *p == '-')) {
+	negative = (*p == '-');
+	p++;
+    }
+
+    digits = p;
+    p = lex_digits(p, limit, &acc, &dropped);
+    ndigits = p - digits;
+    if (p < limit && *p == '.') {
+	point = ++p;
+	p = lex_digits(p, limit, &acc, &dropped);
+	exp10 = -(int)(p - point);
+	ndigits -= exp10;
+    }
+    /* No digits (or a lone '.') and more than 19 significant digits are
+     * left to strtod() */
+    if (ndigits == 0 || dropped)
+	return FALSE;
+    if (p < limit && (*p == 'x' || *p == 'X'))
+	return FALSE;
+
+    if (p < limit && (*p == 'e' || *p == 'E')) {
+	const char *q = p + 1;
+	gboolean exp_negative = FALSE;
+	guint64 exp_acc = 0;
+	int exp_dropped = 0;
+
+	if (q < limit && (*q == '+' || *q == '-')) {
+	    exp_negative = (*q == '-');
+	    q++;
+	}
+	digits = q;
+	q = lex_digits(q, limit, &exp_acc, &exp_dropped);
+	if (q != digits) {
+	    if (exp_dropped || exp_acc > 1000)
+		return FALSE;
+	    exp10 += exp_negative ? -(int)exp_acc : (int)exp_acc;
+	    p = q;
+	}
+    }
+
+    if (p == limit && !at_eof)
+	return FALSE;
+
+    /* Both the mantissa and the power of ten are exact doubles, so one
+     * multiplication or division rounds correctly */
+    if (acc > (G_GUINT64_CONSTANT(1) << 53)
+	    || exp10 < -22 || exp10 > 22)
+	return FALSE;
+
+    if (exp10 < 0)
+	*value = (double)acc / lex_pow10[-exp10];
+    else
+	*value = (double)acc * lex_pow10[exp10];
+    if (negative)
+	*value = -*value;
+    *end = p;
+
+    return TRUE;
+} /* lex_double */
+
+
+double
+gerb_strtod(char const *str, char **end)
+{
+    const char *lex_end;
+    double result;
+
+    if (lex_double(str, str + strlen(str), TRUE, &result, &lex_end)) {
+	if (end)
+	    *end = (char *)lex_end;
+	return result;
+    }
+
+    return g_ascii_strtod(str, end);
+} /* gerb_strtod */
+
+
 int
 gerb_fgetint(gerb_file_t *fd, int *len)
 {
     long int result;
+    const char *start, *lex_end;
     char *end;
+    char tail[GERB_FILE_NUMBER_MAX + 1];
+    goffset rest;
     
-    errno = 0;
-    result = strtol(fd->data + fd->ptr, &end, 10);
-    if (errno) {
-	GERB_COMPILE_ERROR(_("Failed to read integer"));
+    if (fd->ptr >= fd->datalen || (start = gerb_fpeek(fd, tail)) == NULL) {
+	if (len)
+	    *len = 0;
 	return 0;
     }
 
+    rest = MIN(fd->datalen - fd->ptr, GERB_FILE_NUMBER_MAX);
+    if (lex_long(start, start + rest, fd->ptr + rest >= fd->datalen,
+		&result, &lex_end)) {
+	end = (char *)lex_end;
+    } else {
+	errno = 0;
+	result = strtol(start, &end, 10);
+	if (errno) {
+	    GERB_COMPILE_ERROR(_("Failed to read integer"));
+	    return 0;
+	}
+    }
+
     if (len) {
-	*len = end - (fd->data + fd->ptr);
+	*len = end - start;
     }
 
-    fd->ptr = end - fd->data;
+    fd->ptr += end - start;
 
     if (len && (result < 0))
 	*len -= 1;
@@ -177,16 +1120,28 @@ double
 gerb_fgetdouble(gerb_file_t *fd)
 {
     double result;
+    const char *start, *lex_end;
     char *end;
+    char tail[GERB_FILE_NUMBER_MAX + 1];
+    goffset rest;
 
-    errno = 0;    
-    result = strtod(fd->data + fd->ptr, &end);
-    if (errno) {
-	GERB_COMPILE_ERROR(_("Failed to read double"));
+    if (fd->ptr >= fd->datalen || (start = gerb_fpeek(fd, tail)) == NULL)
 	return 0.0;
+
+    rest = MIN(fd->datalen - fd->ptr, GERB_FILE_NUMBER_MAX);
+    if (lex_double(start, start + rest, fd->ptr + rest >= fd->datalen,
+		&result, &lex_end)) {
+	end = (char *)lex_end;
+    } else {
+	errno = 0;
+	result = g_ascii_strtod(start, &end);
+	if (errno) {
+	    GERB_COMPILE_ERROR(_("Failed to read double"));
+	    return 0.0;
+	}
     }
 
-    fd->ptr = end - fd->data;
+    fd->ptr += end - start;
 
     return result;
 } /* gerb_fgetdouble */
@@ -195,30 +1150,30 @@ gerb_fgetdouble(gerb_file_t *fd)
 char *
 gerb_fgetstring(gerb_file_t *fd, char term)
 {
-    char *strend = NULL;
     char *newstr;
-    char *i, *iend;
-    int len;
+    goffset i;
+    gsize len, n;
 
-    iend = fd->data + fd->datalen;
-    for (i = fd->data + fd->ptr; i < iend; i++) {
-	if (*i == term) {
-	    strend = i;
+    for (i = fd->ptr; i < fd->datalen; i++) {
+	if (!GERB_FILE_IN_WINDOW(fd, i) && !gerb_fwindow(fd, i))
+	    return NULL;
+	if (fd->data[i - fd->window] == term)
 	    break;
-	}
     }
 
-    if (strend == NULL)
+    if (i >= fd->datalen)
 	return NULL;
 
-    len = strend - (fd->data + fd->ptr);
+    len = i - fd->ptr;
 
-    newstr = (char *)g_malloc(len + 1);
+    newstr = (char *)g_try_malloc(len + 1);
     if (newstr == NULL)
 	return NULL;
-    strncpy(newstr, fd->data + fd->ptr, len);
+
+    /* The string may start before the current window */
+    for (n = 0; n < len; n++)
+	newstr[n] = (char)gerb_fgetc(fd);
     newstr[len] = '\0';
-    fd->ptr += len;
 
     return newstr;
 } /* gerb_fgetstring */
@@ -238,13 +1193,14 @@ void
 gerb_fclose(gerb_file_t *fd)
 {
     if (fd) {
+	gerb_fprelex_stop(fd);
 #ifdef HAVE_SYS_MMAN_H
-	if (munmap(fd->data, fd->datalen) < 0)
+	if (fd->mapped && munmap(fd->data, fd->window_len) < 0)
 	    GERB_FATAL_ERROR("munmap: %s", strerror(errno));
-#else
-	g_free(fd->data);
-#endif   
-	if (fclose(fd->fd) == EOF)
+#endif
+	if (!fd->mapped && !fd->borrowed)
+	    g_free(fd->data);
+	if (fd->fd && fclose(fd->fd) == EOF)
 	    GERB_FATAL_ERROR("fclose: %s", strerror(errno));
 	g_free(fd);
     }
@@ -253,6 +1209,284 @@ gerb_fclose(gerb_file_t *fd)
 } /* gerb_fclose */
 
 
+/* ------------------------------------------------------------------ */
+/* Worker: cut a chunk into tokens.  A word letter takes the number after
+ * it along if gerb_fgetint() would read it without strtol(). */
+static void
+prelex_chunk(gpointer data, gpointer user_data)
+{
+    prelex_chunk_t *chunk = data;
+    gerb_prelex_t *prelex = user_data;
+    const char *buf = prelex->fd->data;
+    goffset datalen = prelex->fd->datalen;
+    goffset i;
+
+    for (i = chunk->start; i < chunk->end; ) {
+	prelex_token_t token;
+	char c = buf[i];
+
+	if (c == ' ' || c == '\t' || c == '\0') {
+	    i++;
+	    continue;
+	}
+
+	token.offset = i - chunk->start;
+	token.value = 0;
+	token.code = c;
+	token.size = 1;
+	token.len = -1;
+
+	if (c == '\n' || c == '\r') {
+	    /* Chunks end with a '*', so a pair never spans two */
+	    if (i + 1 < datalen && buf[i + 1] == (c == '\n' ? '\r' : '\n'))
+		token.size = 2;
+	} else if (strchr(prelex->words, c) != NULL) {
+	    const char *start = buf + i + 1, *end;
+	    goffset rest = MIN(datalen - (i + 1), GERB_FILE_NUMBER_MAX);
+	    long value;
+
+	    /* The same bytes gerb_fgetint() would look at */
+	    if (lex_long(start, start + rest, i + 1 + rest >= datalen,
+			&value, &end)) {
+		token.value = (int)value;
+		token.len = (end - start) - (value < 0);
+		token.size += end - start;
+	    }
+	}
+
+	g_array_append_val(chunk->tokens, token);
+	i += token.size;
+    }
+
+    /* Done here for the bytes the parser skips over */
+    i = MAX(chunk->start, prelex->binary_from);
+    if (i < chunk->end)
+	chunk->binary |= gerb_binary_bytes((const guchar *)buf + i,
+		chunk->end - i);
+
+    g_mutex_lock(&prelex->lock);
+    chunk->done = TRUE;
+    g_cond_broadcast(&prelex->done_cond);
+    g_mutex_unlock(&prelex->lock);
+} /* prelex_chunk */
+
+
+/* Wait for the current chunk to be lexed and take over its binary check */
+static void
+prelex_enter(gerb_prelex_t *prelex, prelex_chunk_t *chunk)
+{
+    gerb_file_t *fd = prelex->fd;
+
+    g_mutex_lock(&prelex->lock);
+    while (!chunk->done)
+	g_cond_wait(&prelex->done_cond, &prelex->lock);
+    g_mutex_unlock(&prelex->lock);
+
+    fd->binary |= chunk->binary;
+    if (fd->binary_checked < chunk->end)
+	fd->binary_checked = chunk->end;
+
+    prelex->current_done = TRUE;
+    prelex->cursor = 0;
+} /* prelex_enter */
+
+
+static void
+prelex_queue_next(gerb_prelex_t *prelex)
+{
+    if (prelex->next_queued < prelex->n_chunks)
+	g_thread_pool_push(prelex->pool,
+		&prelex->chunks[prelex->next_queued++], NULL);
+} /* prelex_queue_next */
+
+
+/* The first token of chunk at or after offset rel */
+static guint
+prelex_find(prelex_chunk_t *chunk, guint cursor, goffset rel)
+{
+    prelex_token_t *tokens = (prelex_token_t *)chunk->tokens->data;
+    guint lo = 0, hi = chunk->tokens->len, steps;
+
+    if (cursor > 0 && tokens[cursor - 1].offset >= rel) {
+	/* Back, after gerb_ungetc() */
+	hi = cursor - 1;
+    } else {
+	/* The parser mostly reads on from the last token */
+	for (steps = 0; cursor < hi && steps < 8; cursor++, steps++) {
+	    if (tokens[cursor].offset >= rel)
+		return cursor;
+	}
+	lo = cursor;
+    }
+
+    while (lo < hi) {
+	guint mid = lo + (hi - lo) / 2;
+
+	if (tokens[mid].offset < rel)
+	    lo = mid + 1;
+	else
+	    hi = mid;
+    }
+
+    return lo;
+} /* prelex_find */
+
+
+gboolean
+gerb_fprelex_next(gerb_file_t *fd, gerb_token_t *token)
+{
+    gerb_prelex_t *prelex = fd->prelex;
+    prelex_chunk_t *chunk;
+    prelex_token_t *tokens, *t;
+    goffset rel;
+    guint n;
+
+    while (TRUE) {
+	/* The parser reads forward, so chunks behind the read position
+	 * are released and new ones queued as it goes; only a window of
+	 * chunks is held in memory */
+	while (prelex->current < prelex->n_chunks
+		&& prelex->chunks[prelex->current].end <= fd->ptr) {
+	    chunk = &prelex->chunks[prelex->current];
+	    if (!prelex->current_done)
+		prelex_enter(prelex, chunk);
+	    g_array_free(chunk->tokens, TRUE);
+	    chunk->tokens = NULL;
+
+	    prelex->current++;
+	    prelex->current_done = FALSE;
+	    prelex_queue_next(prelex);
+	}
+
+	if (prelex->current >= prelex->n_chunks)
+	    return FALSE;
+
+	chunk = &prelex->chunks[prelex->current];
+	if (fd->ptr < chunk->start)
+	    return FALSE;
+	if (!prelex->current_done)
+	    prelex_enter(prelex, chunk);
+
+	tokens = (prelex_token_t *)chunk->tokens->data;
+	n = chunk->tokens->len;
+	rel = fd->ptr - chunk->start;
+	prelex->cursor = prelex_find(chunk, prelex->cursor, rel);
+
+	/* Somewhere inside a token, which a reader of its own stopped in;
+	 * only blanks are between tokens */
+	if (prelex->cursor > 0) {
+	    t = &tokens[prelex->cursor - 1];
+	    if (t->offset + t->size > rel)
+		return FALSE;
+	}
+
+	if (prelex->cursor < n)
+	    break;
+
+	/* Nothing but blanks up to the end of the chunk */
+	fd->ptr = chunk->end;
+    }
+
+    t = &tokens[prelex->cursor++];
+    token->code = t->code;
+    token->value = t->value;
+    token->len = MAX(t->len, 0);
+    token->has_value = (t->len >= 0);
+    fd->ptr = chunk->start + t->offset + t->size;
+
+    return TRUE;
+} /* gerb_fprelex_next */
+
+
+void
+gerb_fprelex_start(gerb_file_t *fd, const char *words)
+{
+    gerb_prelex_t *prelex;
+    GArray *chunks;
+    goffset start, end;
+    int n_threads;
+    guint i;
+
+    /* The workers need all of the file in memory */
+    if (fd->prelex != NULL || fd->datalen <= 0
+	    || fd->window != 0 || (goffset)fd->window_len != fd->datalen)
+	return;
+
+    /* Cut the data just after a '*' so that no token spans two chunks */
+    chunks = g_array_new(FALSE, TRUE, sizeof(prelex_chunk_t));
+    for (start = 0; start < fd->datalen; start = end) {
+	prelex_chunk_t chunk = {0};
+	const char *star;
+
+	end = MIN(start + PRELEX_CHUNK_SIZE, fd->datalen);
+	star = memchr(fd->data + end - 1, '*', fd->datalen - (end - 1));
+	end = (star != NULL) ? (star - fd->data + 1) : fd->datalen;
+
+	chunk.start = start;
+	chunk.end = end;
+	g_array_append_val(chunks, chunk);
+
+	/* Token offsets are 32 bits; such a file is no Gerber anyway */
+	if (end - start > G_MAXUINT32) {
+	    g_array_free(chunks, TRUE);
+	    return;
+	}
+    }
+
+    /* About four bytes of a typical file make a token */
+    for (i = 0; i < chunks->len; i++) {
+	prelex_chunk_t *chunk = &g_array_index(chunks, prelex_chunk_t, i);
+
+	chunk->tokens = g_array_sized_new(FALSE, FALSE,
+		sizeof(prelex_token_t), (chunk->end - chunk->start) / 4);
+    }
+
+    prelex = g_new0(gerb_prelex_t, 1);
+    prelex->fd = fd;
+    prelex->words = words;
+    prelex->binary_from = fd->binary_checked;
+    g_mutex_init(&prelex->lock);
+    g_cond_init(&prelex->done_cond);
+    prelex->n_chunks = chunks->len;
+    prelex->chunks = (prelex_chunk_t *)g_array_free(chunks, FALSE);
+
+    n_threads = g_get_num_processors();
+    prelex->pool = g_thread_pool_new(prelex_chunk, prelex,
+	    n_threads, FALSE, NULL);
+
+    /* Keep every thread busy while the parser works through a chunk */
+    while (prelex->next_queued < MIN(2*n_threads, prelex->n_chunks))
+	prelex_queue_next(prelex);
+
+    fd->prelex = prelex;
+} /* gerb_fprelex_start */
+
+
+void
+gerb_fprelex_stop(gerb_file_t *fd)
+{
+    gerb_prelex_t *prelex = fd->prelex;
+    int i;
+
+    if (prelex == NULL)
+	return;
+
+    /* Drop queued chunks and wait for the running ones */
+    g_thread_pool_free(prelex->pool, TRUE, TRUE);
+
+    for (i = 0; i < prelex->n_chunks; i++) {
+	if (prelex->chunks[i].tokens != NULL)
+	    g_array_free(prelex->chunks[i].tokens, TRUE);
+    }
+    g_free(prelex->chunks);
+    g_mutex_clear(&prelex->lock);
+    g_cond_clear(&prelex->done_cond);
+    g_free(prelex);
+
+    fd->prelex = NULL;
+} /* gerb_fprelex_stop */
+
+
 char *
 gerb_find_file(char const * filename, char **paths)
 {
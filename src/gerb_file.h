@@ -30,26 +30,87 @@
 #define GERB_FILE_H
 
 #include <stdio.h>
+#include <glib.h>
+
+typedef struct gerb_prelex gerb_prelex_t;
 
 typedef struct file {
     FILE *fd;     /* File descriptor */
     int   fileno; /* The integer version of fd */
-    char *data;   /* Pointer to data mmaped in. May not be changed, use ptr */
-    int   datalen;/* Length of mmaped data ie file length */
-    int   ptr;    /* Index in data where we are reading */
+    char *data;   /* Part of the file in memory (all of it if it fits), holds
+		     the file from offset window on.  Use ptr to read it */
+    goffset datalen; /* Length of the file */
+    goffset ptr;     /* Offset in the file where we are reading */
+    goffset window;  /* Offset in the file of data[0] */
+    gsize window_len;/* Number of bytes of the file in data */
+    gboolean mapped; /* data is mmaped, else allocated */
+    gboolean borrowed; /* data belongs to the caller of gerb_fopen_buffer() */
     char *filename;  /* File name */
+    gerb_prelex_t *prelex; /* Tokens lexed on worker threads, or NULL */
+    goffset binary_checked; /* Bytes before this were checked for binary
+			       ones, G_MAXINT64 when not watching */
+    guint binary; /* GERB_FILE_BINARY_* found in the checked bytes */
 } gerb_file_t;
 
+/* Kinds of bytes which make a file binary instead of text */
+#define GERB_FILE_BINARY_CONTROL 1 /* Control chars other than \t, \r, \n */
+#define GERB_FILE_BINARY_HIGH 2    /* Bytes above 127 */
+
 
 gerb_file_t *gerb_fopen(char const* filename);
+gerb_file_t *gerb_fopen_buffer(char const* data, gsize len);
+/* Like gerb_fopen(), for files included by others.  Between
+ * gerb_include_cache_begin() and the matching gerb_include_cache_end()
+ * each file is read once, later opens share its contents in memory. */
+gerb_file_t *gerb_fopen_include(char const* filename);
+void gerb_include_cache_begin(void);
+void gerb_include_cache_end(void);
 int gerb_fgetc(gerb_file_t *fd);
+char *gerb_fgets(char *buf, int size, gerb_file_t *fd); /* Like fgets() */
+void gerb_frewind(gerb_file_t *fd);
 int gerb_fgetint(gerb_file_t *fd, int *len); /* If len != NULL, returns number
 						of chars parsed in len */
 double gerb_fgetdouble(gerb_file_t *fd);
 char *gerb_fgetstring(gerb_file_t *fd, char term);
+double gerb_strtod(char const *str, char **end); /* Like g_ascii_strtod() */
 void gerb_ungetc(gerb_file_t *fd);
+void gerb_fseek(gerb_file_t *fd, goffset offset);
+/* The bytes of fd from offset on which are in memory, moving the window
+ * there if need be.  *len gets their number; NULL at the end or on errors */
+const char *gerb_fblock(gerb_file_t *fd, goffset offset, gsize *len);
+/* SHA-256 of the contents of fd as a hex string, NULL if they can't be
+ * read.  fd is left rewound. */
+gchar *gerb_fchecksum(gerb_file_t *fd);
+/* TRUE if fd includes other files (%IF), so its image may change without
+ * fd changing.  fd is left rewound. */
+gboolean gerb_fincludes(gerb_file_t *fd);
 void gerb_fclose(gerb_file_t *fd);
 
+/* Check the bytes from offset on for binary ones as they are read, instead
+ * of in a pass of their own.  gerb_fbinary() checks the bytes left unread
+ * and returns what was found. */
+void gerb_fbinary_watch(gerb_file_t *fd, goffset offset);
+guint gerb_fbinary(gerb_file_t *fd);
+
+/* A token of a file lexed ahead by gerb_fprelex_start() */
+typedef struct {
+    int code;	/* Its first char, as gerb_fgetc() returns it.  A '\n' or
+		   '\r' includes the other char of a <LF><CR> or <CR><LF>
+		   pair; blanks (' ', '\t', '\0') make no token */
+    int value;	/* For a word letter, the number after it and its len */
+    int len;	/* as gerb_fgetint() returns them, if has_value */
+    gboolean has_value;
+} gerb_token_t;
+
+/* Start cutting fd into tokens on worker threads.  Each char of words is
+ * a letter a number follows.  Stopped by gerb_fclose(). */
+void gerb_fprelex_start(gerb_file_t *fd, const char *words);
+void gerb_fprelex_stop(gerb_file_t *fd);
+/* The token at the read position, moving past it and the blanks before
+ * it.  FALSE at the end, or where only gerb_fgetc() can go on: the read
+ * position is inside a token or before the part of the file lexed. */
+gboolean gerb_fprelex_next(gerb_file_t *fd, gerb_token_t *token);
+
 /** Search for files in directories pointed out by paths, a NULL terminated
  * list of directories to search. If a string in paths starts with a $, then
  * characters to / (or string end if no /) is interpreted as a environment
@@ -0,0 +1,1039 @@
+/*
+ * gEDA - GNU Electronic Design Automation
+ * This file is a part of gerbv.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111 USA
+ */
+
+/** \file gerb_hit.c
+    \brief Finding the nets under a click or a dragged box
+    \ingroup libgerbv
+
+    Each shape draw.c makes of a net is tested here directly: a point
+    against the distance to a stroke or the crossings of a fill, a box
+    against the extents of the shape.  Only the nets the index of the
+    image finds near the click or the box are tested.
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <math.h>
+
+#include "common.h"
+#include "gerbv.h"
+#include "gerb_hit.h"
+#include "gerb_index.h"
+#include "selection.h"
+
+/* DEBUG printing.  #define DEBUG 1 in config.h to use this fcn. */
+#define dprintf if(DEBUG) printf
+
+/* Elliptical arcs are tested as lines at least this fine */
+#define HIT_ARC_STEP (M_PI / 64)
+#define HIT_ARC_STEPS_MAX 1024
+
+/* What the shapes of a net are tested with */
+typedef struct {
+    gboolean point;		/* TRUE to test (x, y), FALSE to grow box */
+    double x, y;		/* The point, in the coordinates of the net */
+    cairo_matrix_t frame;	/* From the shape to the net coordinates */
+    gerbv_render_size_t box;	/* The extents, in the net coordinates */
+} hit_probe_t;
+
+/* An edge of a filled path */
+typedef struct {
+    gboolean arc;
+    double x1, y1, x2, y2;	/* A line */
+    double cx, cy, r, lo, hi;	/* An arc, through angles lo to hi */
+} hit_edge_t;
+
+/* ------------------------------------------------------------------ */
+/* The point in the coordinates of the shape being tested */
+static gboolean
+hit_local_point (const hit_probe_t *probe, double *x, double *y)
+{
+    cairo_matrix_t inverse = probe->frame;
+
+    if (cairo_matrix_invert (&inverse) != CAIRO_STATUS_SUCCESS)
+	return FALSE;
+
+    *x = probe->x;
+    *y = probe->y;
+    cairo_matrix_transform_point (&inverse, x, y);
+
+    return TRUE;
+}
+
+/* ------------------------------------------------------------------ */
+static void
+hit_grow_box (hit_probe_t *probe, double left, double bottom,
+	      double right, double top)
+{
+    double corners[4][2] = {
+	{left, bottom}, {right, bottom}, {left, top}, {right, top},
+    };
+    int i;
+
+    for (i = 0; i < 4; i++) {
+	double x = corners[i][0], y = corners[i][1];
+
+	cairo_matrix_transform_point (&probe->frame, &x, &y);
+	probe->box.left = MIN(probe->box.left, x);
+	probe->box.right = MAX(probe->box.right, x);
+	probe->box.bottom = MIN(probe->box.bottom, y);
+	probe->box.top = MAX(probe->box.top, y);
+    }
+}
+
+/* ------------------------------------------------------------------ */
+/* How many times the arc through angles lo to hi passes angle */
+static int
+hit_arc_covers (double angle, double lo, double hi)
+{
+    double first = ceil ((lo - angle) / (2 * M_PI));
+    double last = floor ((hi - angle) / (2 * M_PI));
+
+    return (last >= first) ? (int) (last - first) + 1 : 0;
+}
+
+/* ------------------------------------------------------------------ */
+/* Grow the box by the ellipse arc through angles lo to hi, widened by hw */
+static void
+hit_grow_arc (hit_probe_t *probe, double cx, double cy, double rx, double ry,
+	      double lo, double hi, double hw)
+{
+    double angles[6] = {lo, hi, 0, M_PI_2, M_PI, 3 * M_PI_2};
+    int i;
+
+    for (i = 0; i < 6; i++) {
+	double x, y;
+
+	if (i >= 2 && !hit_arc_covers (angles[i], lo, hi))
+	    continue;
+
+	x = cx + rx * cos (angles[i]);
+	y = cy + ry * sin (angles[i]);
+	hit_grow_box (probe, x - hw, y - hw, x + hw, y + hw);
+    }
+}
+
+/* ------------------------------------------------------------------ */
+/* Add the crossings of the ray from (x, y) to the right with an edge */
+static int
+hit_edge_crossings (const hit_edge_t *edge, double x, double y)
+{
+    double dy, dx;
+    int crossings = 0;
+
+    if (!edge->arc) {
+	if ((edge->y1 > y) != (edge->y2 > y)
+	&&  x < edge->x1 + (y - edge->y1) * (edge->x2 - edge->x1)
+				/ (edge->y2 - edge->y1))
+	    crossings++;
+
+	return crossings;
+    }
+
+    dy = y - edge->cy;
+    if (fabs (dy) >= edge->r)
+	return 0;
+
+    dx = sqrt (edge->r * edge->r - dy * dy);
+    if (edge->cx + dx > x)
+	crossings += hit_arc_covers (atan2 (dy, dx), edge->lo, edge->hi);
+    if (edge->cx - dx > x)
+	crossings += hit_arc_covers (atan2 (dy, -dx), edge->lo, edge->hi);
+
+    return crossings;
+}
+
+/* ------------------------------------------------------------------ */
+/* A path of edges filled with the even-odd rule */
+static gboolean
+hit_in_edges (hit_probe_t *probe, const hit_edge_t *edges, guint n)
+{
+    double x, y;
+    int crossings = 0;
+    guint i;
+
+    if (!probe->point) {
+	for (i = 0; i < n; i++) {
+	    if (edges[i].arc)
+		hit_grow_arc (probe, edges[i].cx, edges[i].cy,
+			edges[i].r, edges[i].r, edges[i].lo, edges[i].hi, 0);
+	    else
+		hit_grow_box (probe,
+			MIN(edges[i].x1, edges[i].x2),
+			MIN(edges[i].y1, edges[i].y2),
+			MAX(edges[i].x1, edges[i].x2),
+			MAX(edges[i].y1, edges[i].y2));
+	}
+
+	return FALSE;
+    }
+
+    if (!hit_local_point (probe, &x, &y))
+	return FALSE;
+
+    for (i = 0; i < n; i++)
+	crossings += hit_edge_crossings (&edges[i], x, y);
+
+    return crossings % 2;
+}
+
+/* ------------------------------------------------------------------ */
+/* A closed polygon through n points, filled with the even-odd rule */
+static gboolean
+hit_in_polygon (hit_probe_t *probe, const double *xy, guint n)
+{
+    double x, y;
+    gboolean inside = FALSE;
+    guint i, j;
+
+    if (n == 0)
+	return FALSE;
+
+    if (!probe->point) {
+	for (i = 0; i < n; i++)
+	    hit_grow_box (probe, xy[2*i], xy[2*i + 1],
+			  xy[2*i], xy[2*i + 1]);
+
+	return FALSE;
+    }
+
+    if (!hit_local_point (probe, &x, &y))
+	return FALSE;
+
+    for (i = 0, j = n - 1; i < n; j = i++) {
+	double xi = xy[2*i], yi = xy[2*i + 1];
+	double xj = xy[2*j], yj = xy[2*j + 1];
+
+	if ((yi > y) != (yj > y) && x < xi + (y - yi) * (xj - xi) / (yj - yi))
+	    inside = !inside;
+    }
+
+    return inside;
+}
+
+/* ------------------------------------------------------------------ */
+static gboolean
+hit_in_rectangle (hit_probe_t *probe, double left, double bottom,
+		  double width, double height)
+{
+    double xy[8] = {
+	left, bottom, left + width, bottom,
+	left + width, bottom + height, left, bottom + height,
+    };
+
+    return hit_in_polygon (probe, xy, 4);
+}
+
+/* ------------------------------------------------------------------ */
+static gboolean
+hit_in_circle (hit_probe_t *probe, double cx, double cy, double r)
+{
+    double x, y;
+
+    if (!probe->point) {
+	hit_grow_box (probe, cx - r, cy - r, cx + r, cy + r);
+	return FALSE;
+    }
+
+    if (!hit_local_point (probe, &x, &y))
+	return FALSE;
+
+    return hypot (x - cx, y - cy) <= r;
+}
+
+/* ------------------------------------------------------------------ */
+/* The regular polygon of gerbv_draw_polygon(), and its hole rotated with
+ * it; as draw.c does, the hole is a circle of diameter holeX, or a
+ * rectangle if holeY is given */
+static gboolean
+hit_in_regular_polygon (hit_probe_t *probe, double diameter, double sides,
+			double degrees, double holeX, double holeY)
+{
+    cairo_matrix_t frame = probe->frame;
+    guint i, n = MAX((int) sides, 0);
+    double *xy = g_new (double, 2 * MAX(n, 1));
+    gboolean inside;
+
+    cairo_matrix_rotate (&probe->frame, DEG2RAD(degrees));
+    for (i = 0; i < n; i++) {
+	xy[2*i] = cos (i * 2 * M_PI / n) * diameter / 2;
+	xy[2*i + 1] = sin (i * 2 * M_PI / n) * diameter / 2;
+    }
+    inside = hit_in_polygon (probe, xy, n);
+    g_free (xy);
+
+    if (probe->point && holeX) {
+	if (holeY)
+	    inside ^= hit_in_rectangle (probe, -holeX/2, -holeY/2,
+					holeX, holeY);
+	else
+	    inside ^= hit_in_circle (probe, 0, 0, holeX/2);
+    }
+    probe->frame = frame;
+
+    return inside;
+}
+
+/* ------------------------------------------------------------------ */
+/* The hole of a flash, which is not filled */
+static gboolean
+hit_in_hole (hit_probe_t *probe, double holeX, double holeY)
+{
+    if (!probe->point || !holeX)
+	return FALSE;
+
+    if (holeY)
+	return hit_in_rectangle (probe, -holeX/2, -holeY/2, holeX, holeY);
+
+    return hit_in_circle (probe, 0, 0, holeX/2);
+}
+
+/* ------------------------------------------------------------------ */
+/* The cap at (px, py) of a stroke of half width hw leaving it in the
+ * direction (tx, ty) */
+static gboolean
+hit_in_cap (double x, double y, double px, double py, double tx, double ty,
+	    double hw, cairo_line_cap_t cap)
+{
+    double length = hypot (tx, ty), along, across;
+
+    switch (cap) {
+    case CAIRO_LINE_CAP_ROUND:
+	return hypot (x - px, y - py) <= hw;
+    case CAIRO_LINE_CAP_SQUARE:
+	if (length == 0)
+	    return fabs (x - px) <= hw && fabs (y - py) <= hw;
+	along = ((x - px) * tx + (y - py) * ty) / length;
+	across = ((x - px) * ty - (y - py) * tx) / length;
+	return along >= 0 && along <= hw && fabs (across) <= hw;
+    default:
+	return FALSE;
+    }
+}
+
+/* ------------------------------------------------------------------ */
+/* The line from (x1, y1) to (x2, y2) stroked hw to each side */
+static gboolean
+hit_in_stroked_line (hit_probe_t *probe, double x1, double y1,
+		     double x2, double y2, double hw, cairo_line_cap_t cap)
+{
+    double x, y, dx = x2 - x1, dy = y2 - y1, length, along;
+
+    if (!probe->point) {
+	hit_grow_box (probe, MIN(x1, x2) - hw, MIN(y1, y2) - hw,
+		      MAX(x1, x2) + hw, MAX(y1, y2) + hw);
+	return FALSE;
+    }
+
+    if (!hit_local_point (probe, &x, &y))
+	return FALSE;
+
+    length = hypot (dx, dy);
+    if (length == 0)
+	return hit_in_cap (x, y, x1, y1, 0, 0, hw, cap);
+
+    along = ((x - x1) * dx + (y - y1) * dy) / length;
+    if (along >= 0 && along <= length
+    &&  fabs ((x - x1) * dy - (y - y1) * dx) / length <= hw)
+	return TRUE;
+
+    return hit_in_cap (x, y, x1, y1, -dx, -dy, hw, cap)
+	|| hit_in_cap (x, y, x2, y2, dx, dy, hw, cap);
+}
+
+/* ------------------------------------------------------------------ */
+/* The ellipse arc from angle a1 to a2 (in radians, through the smaller
+ * angles first if a2 < a1) stroked hw to each side */
+static gboolean
+hit_in_stroked_arc (hit_probe_t *probe, double cx, double cy,
+		    double rx, double ry, double a1, double a2,
+		    double hw, cairo_line_cap_t cap)
+{
+    double lo = MIN(a1, a2), hi = MAX(a1, a2);
+    double x, y, direction = (a2 >= a1) ? 1 : -1;
+    gboolean body = FALSE;
+
+    if (!probe->point) {
+	hit_grow_arc (probe, cx, cy, rx, ry, lo, hi, hw);
+	return FALSE;
+    }
+
+    if (!hit_local_point (probe, &x, &y))
+	return FALSE;
+
+    if (rx == ry) {
+	body = fabs (hypot (x - cx, y - cy) - rx) <= hw
+	    && hit_arc_covers (atan2 (y - cy, x - cx), lo, hi);
+    } else {
+	/* Along short lines, joined round as cairo does closely enough */
+	guint i, steps = CLAMP((guint) ceil ((hi - lo) / HIT_ARC_STEP),
+			       1, HIT_ARC_STEPS_MAX);
+	double px = cx + rx * cos (lo), py = cy + ry * sin (lo);
+
+	for (i = 1; i <= steps && !body; i++) {
+	    double angle = lo + (hi - lo) * i / steps;
+	    double qx = cx + rx * cos (angle), qy = cy + ry * sin (angle);
+	    double dx = qx - px, dy = qy - py, length = hypot (dx, dy);
+	    double along = (length > 0)
+		    ? ((x - px) * dx + (y - py) * dy) / length : -1;
+
+	    if ((along >= 0 && along <= length
+		&& fabs ((x - px) * dy - (y - py) * dx) / length <= hw)
+	    ||  (i < steps && hypot (x - qx, y - qy) <= hw))
+		body = TRUE;
+	    px = qx;
+	    py = qy;
+	}
+    }
+    if (body)
+	return TRUE;
+
+    if (hi - lo >= 2 * M_PI)
+	return FALSE;
+
+    return hit_in_cap (x, y, cx + rx * cos (a1), cy + ry * sin (a1),
+		direction * rx * sin (a1), -direction * ry * cos (a1),
+		hw, cap)
+	|| hit_in_cap (x, y, cx + rx * cos (a2), cy + ry * sin (a2),
+		-direction * rx * sin (a2), direction * ry * cos (a2),
+		hw, cap);
+}
+
+/* ------------------------------------------------------------------ */
+static void
+hit_add_line_edge (GArray *edges, double x1, double y1, double x2, double y2)
+{
+    hit_edge_t edge = {FALSE, x1, y1, x2, y2, 0, 0, 0, 0, 0};
+
+    if (x1 != x2 || y1 != y2)
+	g_array_append_val (edges, edge);
+}
+
+/* ------------------------------------------------------------------ */
+/* The arc cairo_arc() or cairo_arc_negative() adds from the current point
+ * (x, y), which is moved to its end */
+static void
+hit_add_arc_edge (GArray *edges, double *x, double *y,
+		  double cx, double cy, double r, double a1, double a2)
+{
+    hit_edge_t edge = {TRUE, 0, 0, 0, 0, cx, cy, r, MIN(a1, a2), MAX(a1, a2)};
+
+    hit_add_line_edge (edges, *x, *y, cx + r * cos (a1), cy + r * sin (a1));
+    g_array_append_val (edges, edge);
+    *x = cx + r * cos (a2);
+    *y = cy + r * sin (a2);
+}
+
+/* ------------------------------------------------------------------ */
+/* The polygon area starting at net, as draw_render_polygon_object()
+ * draws it */
+static gboolean
+hit_in_polygon_area (hit_probe_t *probe, gerbv_net_t *net)
+{
+    GArray *edges = g_array_new (FALSE, FALSE, sizeof (hit_edge_t));
+    double x = 0, y = 0, firstX = 0, firstY = 0;
+    gboolean started = FALSE, inside = FALSE;
+
+    for (net = net->next; net != NULL; net = net->next) {
+	if (!started) {
+	    firstX = x = net->stop_x;
+	    firstY = y = net->stop_y;
+	    started = TRUE;
+	    continue;
+	}
+
+	switch (net->interpolation) {
+	case GERBV_INTERPOLATION_LINEARx1 :
+	case GERBV_INTERPOLATION_LINEARx10 :
+	case GERBV_INTERPOLATION_LINEARx01 :
+	case GERBV_INTERPOLATION_LINEARx001 :
+	    hit_add_line_edge (edges, x, y, net->stop_x, net->stop_y);
+	    x = net->stop_x;
+	    y = net->stop_y;
+	    break;
+	case GERBV_INTERPOLATION_CW_CIRCULAR :
+	case GERBV_INTERPOLATION_CCW_CIRCULAR :
+	    hit_add_arc_edge (edges, &x, &y,
+		    net->cirseg->cp_x, net->cirseg->cp_y,
+		    net->cirseg->width/2.0,
+		    DEG2RAD(net->cirseg->angle1),
+		    DEG2RAD(net->cirseg->angle2));
+	    break;
+	case GERBV_INTERPOLATION_PAREA_END :
+	    hit_add_line_edge (edges, x, y, firstX, firstY);
+	    inside = hit_in_edges (probe, (hit_edge_t *) edges->data,
+				   edges->len);
+	    g_array_free (edges, TRUE);
+	    return inside;
+	default :
+	    break;
+	}
+    }
+
+    /* Not closed, so never filled */
+    g_array_free (edges, TRUE);
+
+    return FALSE;
+}
+
+/* ------------------------------------------------------------------ */
+/* One quarter of a thermal, between the arcs draw.c fills */
+static gboolean
+hit_in_thermal_quarter (hit_probe_t *probe, double inside, double outside,
+			double startAngle1, double endAngle1,
+			double startAngle2, double endAngle2)
+{
+    GArray *edges = g_array_new (FALSE, FALSE, sizeof (hit_edge_t));
+    double x = inside * cos (startAngle1), y = inside * sin (startAngle1);
+    double firstX = x, firstY = y;
+    gboolean hit;
+
+    hit_add_arc_edge (edges, &x, &y, 0, 0, inside, startAngle1, endAngle1);
+    hit_add_arc_edge (edges, &x, &y, 0, 0, outside, startAngle2, endAngle2);
+    hit_add_line_edge (edges, x, y, firstX, firstY);
+    hit = hit_in_edges (probe, (hit_edge_t *) edges->data, edges->len);
+    g_array_free (edges, TRUE);
+
+    return hit;
+}
+
+/* ------------------------------------------------------------------ */
+/* Any primitive of the aperture macro s, as gerbv_draw_amacro() draws
+ * them; clear primitives count as much as dark ones */
+static gboolean
+hit_in_macro (hit_probe_t *probe, gerbv_simplified_amacro_t *s,
+	      double pixelWidth)
+{
+    gerbv_simplified_amacro_t *ls;
+    gboolean hit = FALSE;
+
+    for (ls = s; ls != NULL && !hit; ls = ls->next) {
+	cairo_matrix_t frame = probe->frame;
+	double *p = ls->parameter;
+
+	switch (ls->type) {
+	case GERBV_APTYPE_MACRO_CIRCLE:
+	    hit = hit_in_circle (probe, p[CIRCLE_CENTER_X],
+		    p[CIRCLE_CENTER_Y], p[CIRCLE_DIAMETER]/2.0);
+	    break;
+
+	case GERBV_APTYPE_MACRO_OUTLINE: {
+	    guint n = 1 + MAX((int) p[OUTLINE_NUMBER_OF_POINTS], 0);
+
+	    cairo_matrix_rotate (&probe->frame,
+		    DEG2RAD(p[OUTLINE_ROTATION_IDX(p)]));
+	    hit = hit_in_polygon (probe, &p[OUTLINE_FIRST_X], n);
+	    break;
+	}
+	case GERBV_APTYPE_MACRO_POLYGON:
+	    cairo_matrix_translate (&probe->frame,
+		    p[POLYGON_CENTER_X], p[POLYGON_CENTER_Y]);
+	    hit = hit_in_regular_polygon (probe, p[POLYGON_DIAMETER],
+		    p[POLYGON_NUMBER_OF_POINTS], p[POLYGON_ROTATION], 0, 0);
+	    break;
+
+	case GERBV_APTYPE_MACRO_MOIRE: {
+	    double diameter = p[MOIRE_OUTSIDE_DIAMETER]
+			    - p[MOIRE_CIRCLE_THICKNESS];
+	    double difference = 2*(p[MOIRE_GAP_WIDTH]
+			    + p[MOIRE_CIRCLE_THICKNESS]);
+	    double crosshair = p[MOIRE_CROSSHAIR_LENGTH] / 2.0;
+
+	    cairo_matrix_translate (&probe->frame,
+		    p[MOIRE_CENTER_X], p[MOIRE_CENTER_Y]);
+	    cairo_matrix_rotate (&probe->frame, DEG2RAD(p[MOIRE_ROTATION]));
+	    for (int circle = 0; circle < (int) p[MOIRE_NUMBER_OF_CIRCLES]
+		    && !hit; circle++) {
+		double dia = diameter - difference * circle;
+
+		if (dia > 0)
+		    hit = hit_in_stroked_arc (probe, 0, 0, dia/2, dia/2,
+			    0, 2*M_PI, p[MOIRE_CIRCLE_THICKNESS]/2,
+			    CAIRO_LINE_CAP_BUTT);
+	    }
+	    hit = hit
+		|| hit_in_stroked_line (probe, -crosshair, 0, crosshair, 0,
+			p[MOIRE_CROSSHAIR_THICKNESS]/2, CAIRO_LINE_CAP_BUTT)
+		|| hit_in_stroked_line (probe, 0, -crosshair, 0, crosshair,
+			p[MOIRE_CROSSHAIR_THICKNESS]/2, CAIRO_LINE_CAP_BUTT);
+	    break;
+	}
+	case GERBV_APTYPE_MACRO_THERMAL: {
+	    double startAngle1, startAngle2, endAngle1, endAngle2;
+
+	    cairo_matrix_translate (&probe->frame,
+		    p[THERMAL_CENTER_X], p[THERMAL_CENTER_Y]);
+	    cairo_matrix_rotate (&probe->frame,
+		    DEG2RAD(p[THERMAL_ROTATION]));
+	    startAngle1 = asin (p[THERMAL_CROSSHAIR_THICKNESS]/
+		    p[THERMAL_INSIDE_DIAMETER]);
+	    endAngle1 = M_PI_2 - startAngle1;
+	    endAngle2 = asin (p[THERMAL_CROSSHAIR_THICKNESS]/
+		    p[THERMAL_OUTSIDE_DIAMETER]);
+	    startAngle2 = M_PI_2 - endAngle2;
+
+	    for (int i = 0; i < 4 && !hit; i++) {
+		hit = hit_in_thermal_quarter (probe,
+			p[THERMAL_INSIDE_DIAMETER]/2.0,
+			p[THERMAL_OUTSIDE_DIAMETER]/2.0,
+			startAngle1, endAngle1, startAngle2, endAngle2);
+		cairo_matrix_rotate (&probe->frame, M_PI_2);
+	    }
+	    break;
+	}
+	case GERBV_APTYPE_MACRO_LINE20:
+	    cairo_matrix_rotate (&probe->frame,
+		    DEG2RAD(p[LINE20_ROTATION]));
+	    hit = hit_in_stroked_line (probe,
+		    p[LINE20_START_X], p[LINE20_START_Y],
+		    p[LINE20_END_X], p[LINE20_END_Y],
+		    MAX(p[LINE20_LINE_WIDTH], pixelWidth)/2,
+		    CAIRO_LINE_CAP_BUTT);
+	    break;
+
+	case GERBV_APTYPE_MACRO_LINE21:
+	    cairo_matrix_rotate (&probe->frame,
+		    DEG2RAD(p[LINE21_ROTATION]));
+	    cairo_matrix_translate (&probe->frame,
+		    p[LINE21_CENTER_X], p[LINE21_CENTER_Y]);
+	    hit = hit_in_rectangle (probe,
+		    -MAX(p[LINE21_WIDTH]/2.0, pixelWidth),
+		    -MAX(p[LINE21_HEIGHT]/2.0, pixelWidth),
+		    MAX(p[LINE21_WIDTH], pixelWidth),
+		    MAX(p[LINE21_HEIGHT], pixelWidth));
+	    break;
+
+	case GERBV_APTYPE_MACRO_LINE22:
+	    cairo_matrix_rotate (&probe->frame,
+		    DEG2RAD(p[LINE22_ROTATION]));
+	    cairo_matrix_translate (&probe->frame,
+		    p[LINE22_LOWER_LEFT_X], p[LINE22_LOWER_LEFT_Y]);
+	    hit = hit_in_rectangle (probe, 0, 0,
+		    MAX(p[LINE22_WIDTH], pixelWidth),
+		    MAX(p[LINE22_HEIGHT], pixelWidth));
+	    break;
+
+	default:
+	    break;
+	}
+
+	probe->frame = frame;
+    }
+
+    return hit;
+}
+
+/* ------------------------------------------------------------------ */
+/* What draw_image_to_cairo_target() draws of net, in the coordinates of
+ * the net and without step and repeat */
+static gboolean
+hit_in_net (hit_probe_t *probe, gerbv_image_t *image, gerbv_net_t *net,
+	    double pixelWidth, gboolean limitLineWidth)
+{
+    gerbv_aperture_t *aperture;
+    double *p, lineWidth;
+    gboolean hit = FALSE;
+
+    cairo_matrix_init_identity (&probe->frame);
+
+    if (net->interpolation == GERBV_INTERPOLATION_PAREA_START)
+	return hit_in_polygon_area (probe, net);
+    if (net->interpolation == GERBV_INTERPOLATION_DELETED)
+	return FALSE;
+
+    aperture = gerbv_image_get_aperture (image, net->aperture);
+    if (aperture == NULL)
+	return FALSE;
+    p = aperture->parameter;
+
+    switch (net->aperture_state) {
+    case GERBV_APERTURE_STATE_ON :
+	/* Lines are at least a pixel wide */
+	lineWidth = (limitLineWidth && p[0] < pixelWidth) ? pixelWidth : p[0];
+
+	switch (net->interpolation) {
+	case GERBV_INTERPOLATION_LINEARx1 :
+	case GERBV_INTERPOLATION_LINEARx10 :
+	case GERBV_INTERPOLATION_LINEARx01 :
+	case GERBV_INTERPOLATION_LINEARx001 :
+	    if (aperture->type == GERBV_APTYPE_RECTANGLE) {
+		double x1 = net->start_x, y1 = net->start_y;
+		double x2 = net->stop_x, y2 = net->stop_y;
+		double dx = (x1 > x2) ? -p[0]/2 : p[0]/2;
+		double dy = (y1 > y2) ? -p[1]/2 : p[1]/2;
+		double xy[12] = {
+		    x1 - dx, y1 - dy, x1 - dx, y1 + dy,
+		    x2 - dx, y2 + dy, x2 + dx, y2 + dy,
+		    x2 + dx, y2 - dy, x1 + dx, y1 - dy,
+		};
+
+		hit = hit_in_polygon (probe, xy, 6);
+	    } else if (aperture->type == GERBV_APTYPE_CIRCLE
+		   ||  aperture->type == GERBV_APTYPE_OVAL
+		   ||  aperture->type == GERBV_APTYPE_POLYGON) {
+		hit = hit_in_stroked_line (probe,
+			net->start_x, net->start_y,
+			net->stop_x, net->stop_y,
+			lineWidth/2, CAIRO_LINE_CAP_ROUND);
+	    }
+	    break;
+	case GERBV_INTERPOLATION_CW_CIRCULAR :
+	case GERBV_INTERPOLATION_CCW_CIRCULAR :
+	    hit = hit_in_stroked_arc (probe,
+		    net->cirseg->cp_x, net->cirseg->cp_y,
+		    net->cirseg->width/2, net->cirseg->height/2,
+		    DEG2RAD(net->cirseg->angle1),
+		    DEG2RAD(net->cirseg->angle2), lineWidth/2,
+		    (aperture->type == GERBV_APTYPE_RECTANGLE)
+			? CAIRO_LINE_CAP_SQUARE : CAIRO_LINE_CAP_ROUND);
+	    break;
+	default :
+	    break;
+	}
+	break;
+
+    case GERBV_APERTURE_STATE_FLASH :
+	cairo_matrix_translate (&probe->frame, net->stop_x, net->stop_y);
+
+	switch (aperture->type) {
+	case GERBV_APTYPE_CIRCLE :
+	    hit = hit_in_circle (probe, 0, 0, p[0]/2)
+		^ hit_in_hole (probe, p[1], p[2]);
+	    break;
+	case GERBV_APTYPE_RECTANGLE : {
+	    double width = p[0], height = p[1];
+
+	    /* Thin flashes are drawn at least a pixel wide */
+	    if (limitLineWidth && width < pixelWidth)
+		width = pixelWidth;
+	    if (limitLineWidth && height < pixelWidth)
+		height = pixelWidth;
+	    hit = hit_in_rectangle (probe, -width/2, -height/2, width, height)
+		^ hit_in_hole (probe, p[2], p[3]);
+	    break;
+	}
+	case GERBV_APTYPE_OVAL : {
+	    double r = MIN(p[0], p[1]) / 2;
+	    double dx = MAX(p[0] - p[1], 0) / 2, dy = MAX(p[1] - p[0], 0) / 2;
+
+	    hit = hit_in_stroked_line (probe, -dx, -dy, dx, dy, r,
+			CAIRO_LINE_CAP_ROUND)
+		^ hit_in_hole (probe, p[2], p[3]);
+	    break;
+	}
+	case GERBV_APTYPE_POLYGON :
+	    hit = hit_in_regular_polygon (probe, p[0], p[1], p[2], p[3], p[4]);
+	    break;
+	case GERBV_APTYPE_MACRO :
+	    hit = hit_in_macro (probe, aperture->simplified, pixelWidth);
+	    break;
+	default :
+	    break;
+	}
+	break;
+
+    default :
+	break;
+    }
+
+    return hit;
+}
+
+/* ------------------------------------------------------------------ */
+/* As draw_apply_netstate_transformation() */
+static void
+hit_apply_netstate (cairo_matrix_t *matrix, gerbv_netstate_t *state)
+{
+    cairo_matrix_scale (matrix, state->scaleA, state->scaleB);
+    cairo_matrix_translate (matrix, state->offsetA, state->offsetB);
+    switch (state->mirrorState) {
+    case GERBV_MIRROR_STATE_FLIPA:
+	cairo_matrix_scale (matrix, -1, 1);
+	break;
+    case GERBV_MIRROR_STATE_FLIPB:
+	cairo_matrix_scale (matrix, 1, -1);
+	break;
+    case GERBV_MIRROR_STATE_FLIPAB:
+	cairo_matrix_scale (matrix, -1, -1);
+	break;
+    default:
+	break;
+    }
+    if (state->axisSelect == GERBV_AXIS_SELECT_SWAPAB) {
+	cairo_matrix_rotate (matrix, M_PI + M_PI_2);
+	cairo_matrix_scale (matrix, 1, -1);
+    }
+}
+
+/* ------------------------------------------------------------------ */
+/* The bounding boxes of the nets are where the parser placed them.  The
+ * renderers step and repeat a net before rotating or mirroring it, so
+ * the boxes widened by the repeats only bound them when neither is done */
+static gboolean
+hit_boxes_bound_repeats (gerbv_image_t *image)
+{
+    gerbv_layer_t *layer;
+    gerbv_netstate_t *state;
+    gboolean repeats = FALSE, rotated = (image->info->imageRotation != 0);
+
+    for (layer = image->layers; layer != NULL; layer = layer->next) {
+	if (layer->stepAndRepeat.X > 1 || layer->stepAndRepeat.Y > 1)
+	    repeats = TRUE;
+	if (layer->rotation != 0)
+	    rotated = TRUE;
+    }
+    if (!repeats)
+	return TRUE;
+    if (rotated)
+	return FALSE;
+
+    for (state = image->states; state != NULL; state = state->next) {
+	if (state->scaleA != 1 || state->scaleB != 1
+	||  state->mirrorState != GERBV_MIRROR_STATE_NOMIRROR
+	||  state->axisSelect != GERBV_AXIS_SELECT_NOSELECT)
+	    return FALSE;
+    }
+
+    return TRUE;
+}
+
+/* ------------------------------------------------------------------ */
+/* Whether net is under the point or inside the box of selectionInfo,
+ * with matrix from the net to pixels */
+static gboolean
+hit_net_is_selected (gerbv_image_t *image, gerbv_net_t *net,
+		     const cairo_matrix_t *matrix,
+		     const gerbv_selection_info_t *selectionInfo,
+		     double pixelWidth, gboolean limitLineWidth)
+{
+    gerbv_step_and_repeat_t *sr = &net->layer->stepAndRepeat;
+    gerbv_render_size_t empty = {HUGE_VAL, -HUGE_VAL, HUGE_VAL, -HUGE_VAL};
+    hit_probe_t probe;
+    double x, y;
+    int ix, iy;
+
+    if (selectionInfo->type == GERBV_SELECTION_POINT_CLICK) {
+	cairo_matrix_t inverse = *matrix;
+
+	if (cairo_matrix_invert (&inverse) != CAIRO_STATUS_SUCCESS)
+	    return FALSE;
+	x = selectionInfo->lowerLeftX;
+	y = selectionInfo->lowerLeftY;
+	cairo_matrix_transform_point (&inverse, &x, &y);
+
+	probe.point = TRUE;
+	for (ix = 0; ix < sr->X; ix++) {
+	    for (iy = 0; iy < sr->Y; iy++) {
+		probe.x = x - ix * sr->dist_X;
+		probe.y = y - iy * sr->dist_Y;
+		if (hit_in_net (&probe, image, net,
+				pixelWidth, limitLineWidth))
+		    return TRUE;
+	    }
+	}
+
+	return FALSE;
+    }
+
+    probe.point = FALSE;
+    probe.box = empty;
+    hit_in_net (&probe, image, net, pixelWidth, limitLineWidth);
+    if (probe.box.left > probe.box.right || probe.box.bottom > probe.box.top)
+	return FALSE;
+
+    for (ix = 0; ix < sr->X; ix++) {
+	for (iy = 0; iy < sr->Y; iy++) {
+	    double corners[4][2] = {
+		{probe.box.left, probe.box.bottom},
+		{probe.box.right, probe.box.bottom},
+		{probe.box.left, probe.box.top},
+		{probe.box.right, probe.box.top},
+	    };
+	    gboolean inside = TRUE;
+	    int i;
+
+	    for (i = 0; i < 4 && inside; i++) {
+		x = corners[i][0] + ix * sr->dist_X;
+		y = corners[i][1] + iy * sr->dist_Y;
+		cairo_matrix_transform_point (matrix, &x, &y);
+		inside = x > selectionInfo->lowerLeftX
+		      && x < selectionInfo->upperRightX
+		      && y > selectionInfo->lowerLeftY
+		      && y < selectionInfo->upperRightY;
+	    }
+	    if (inside)
+		return TRUE;
+	}
+    }
+
+    return FALSE;
+}
+
+/* ------------------------------------------------------------------ */
+/* Add the nets found to the selection, or remove those already in it */
+static void
+hit_update_selection (gerbv_selection_info_t *selectionInfo,
+		      gerbv_image_t *image, GPtrArray *found, gboolean toggle)
+{
+    GHashTable *drop = g_hash_table_new (NULL, NULL);
+    GPtrArray *add = g_ptr_array_new ();
+    gerbv_selection_item_t item = {image, NULL};
+    guint i;
+
+    /* Nets belong to one image, so a selected net is one of image */
+    for (i = 0; i < found->len; i++) {
+	gpointer net = g_ptr_array_index (found, i);
+
+	if (selection_contains_net (selectionInfo, net)) {
+	    if (toggle)
+		g_hash_table_add (drop, net);
+	} else {
+	    g_ptr_array_add (add, net);
+	}
+    }
+
+    if (g_hash_table_size (drop) > 0)
+	selection_clear_nets (selectionInfo, drop);
+
+    for (i = 0; i < add->len; i++) {
+	item.net = g_ptr_array_index (add, i);
+	selection_add_item (selectionInfo, &item);
+    }
+
+    g_ptr_array_free (add, TRUE);
+    g_hash_table_destroy (drop);
+}
+
+/* ------------------------------------------------------------------ */
+void
+gerb_hit_find_selections (gerbv_image_t *image,
+			  gerbv_selection_info_t *selectionInfo,
+			  const gerbv_render_info_t *renderInfo,
+			  const gerbv_user_transformation_t *transform,
+			  gboolean toggle)
+{
+    cairo_matrix_t base, toBoxes, layerMatrix, netMatrix;
+    double scaleX = transform->scaleX, scaleY = transform->scaleY;
+    double pixelWidth = 1.0/MAX(renderInfo->scaleFactorX,
+				renderInfo->scaleFactorY);
+    gboolean limitLineWidth = (scaleX == 1 && scaleY == 1);
+    gerbv_render_size_t window = {HUGE_VAL, -HUGE_VAL, HUGE_VAL, -HUGE_VAL};
+    gboolean useWindow;
+    gerbv_layer_t *oldLayer;
+    gerbv_netstate_t *oldState;
+    gerb_index_iter_t iter;
+    GPtrArray *found;
+    gerbv_net_t *net;
+    int i;
+
+    if (image == NULL || image->netlist == NULL)
+	return;
+
+    if (transform->mirrorAroundX)
+	scaleY = -scaleY;
+    if (transform->mirrorAroundY)
+	scaleX = -scaleX;
+
+    /* From the scene to pixels, as gerbv_render_cairo_set_scale_and_translation()
+     * does, then the transformations of draw_image_to_cairo_target() */
+    cairo_matrix_init_translate (&base,
+	    -renderInfo->lowerLeftX * renderInfo->scaleFactorX,
+	    renderInfo->lowerLeftY * renderInfo->scaleFactorY
+		    + renderInfo->displayHeight);
+    cairo_matrix_scale (&base, renderInfo->scaleFactorX,
+	    -renderInfo->scaleFactorY);
+    cairo_matrix_translate (&base, transform->translateX,
+	    transform->translateY);
+    cairo_matrix_scale (&base, scaleX, scaleY);
+    cairo_matrix_rotate (&base, transform->rotation);
+    cairo_matrix_translate (&base, image->info->imageJustifyOffsetActualA,
+	    image->info->imageJustifyOffsetActualB);
+    toBoxes = base;
+    cairo_matrix_translate (&base, image->info->offsetA,
+	    image->info->offsetB);
+    cairo_matrix_rotate (&base, image->info->imageRotation);
+
+    /* The nets to test are found by their bounding boxes, which are in
+     * the coordinates before the offset of the image */
+    useWindow = hit_boxes_bound_repeats (image)
+	    && cairo_matrix_invert (&toBoxes) == CAIRO_STATUS_SUCCESS;
+    if (useWindow) {
+	double corners[4][2];
+
+	if (selectionInfo->type == GERBV_SELECTION_POINT_CLICK) {
+	    /* A pixel around the click, the least width lines are drawn */
+	    double x = selectionInfo->lowerLeftX, y = selectionInfo->lowerLeftY;
+
+	    corners[0][0] = corners[2][0] = x - 1;
+	    corners[1][0] = corners[3][0] = x + 1;
+	    corners[0][1] = corners[1][1] = y - 1;
+	    corners[2][1] = corners[3][1] = y + 1;
+	} else {
+	    corners[0][0] = corners[2][0] = selectionInfo->lowerLeftX;
+	    corners[1][0] = corners[3][0] = selectionInfo->upperRightX;
+	    corners[0][1] = corners[1][1] = selectionInfo->lowerLeftY;
+	    corners[2][1] = corners[3][1] = selectionInfo->upperRightY;
+	}
+
+	for (i = 0; i < 4; i++) {
+	    cairo_matrix_transform_point (&toBoxes,
+		    &corners[i][0], &corners[i][1]);
+	    window.left = MIN(window.left, corners[i][0]);
+	    window.right = MAX(window.right, corners[i][0]);
+	    window.bottom = MIN(window.bottom, corners[i][1]);
+	    window.top = MAX(window.top, corners[i][1]);
+	}
+    }
+
+    found = g_ptr_array_new ();
+
+    /* As draw_image_to_cairo_target(), the transformation of a layer and
+     * netstate applies from the first net not in the first ones */
+    oldLayer = image->layers;
+    oldState = image->states;
+    layerMatrix = netMatrix = base;
+
+    gerb_index_iter_init (&iter, image, useWindow ? &window : NULL);
+    while ((net = gerb_index_iter_next (&iter)) != NULL) {
+	if (net->layer != oldLayer) {
+	    layerMatrix = base;
+	    cairo_matrix_rotate (&layerMatrix, net->layer->rotation);
+	    netMatrix = layerMatrix;
+	    hit_apply_netstate (&netMatrix, net->state);
+	    oldLayer = net->layer;
+	}
+	if (net->state != oldState) {
+	    netMatrix = layerMatrix;
+	    hit_apply_netstate (&netMatrix, net->state);
+	    oldState = net->state;
+	}
+
+	if (hit_net_is_selected (image, net, &netMatrix, selectionInfo,
+				 pixelWidth, limitLineWidth))
+	    g_ptr_array_add (found, net);
+    }
+    gerb_index_iter_clear (&iter);
+
+    dprintf ("%u nets found\n", found->len);
+
+    hit_update_selection (selectionInfo, image, found, toggle);
+    g_ptr_array_free (found, TRUE);
+}
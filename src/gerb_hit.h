@@ -0,0 +1,44 @@
+/*
+ * gEDA - GNU Electronic Design Automation
+ * This file is a part of gerbv.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111 USA
+ */
+
+/** \file gerb_hit.h
+    \brief Header info for finding the nets under a click or a dragged box
+    \ingroup libgerbv
+*/
+
+#ifndef GERB_HIT_H
+#define GERB_HIT_H
+
+#include <glib.h>
+
+/*
+ * Update the selection buffer of selectionInfo with the nets of image under
+ * its point or inside its box, given in pixels of a scene drawn with
+ * renderInfo and the layer drawn with transform.  A net is under a point
+ * when the point is within what draw_image_to_cairo_target() fills or
+ * strokes for it, and inside a box when all of that is.  Nets found are
+ * added, or with toggle removed if they were already selected.
+ */
+void gerb_hit_find_selections(gerbv_image_t *image,
+			      gerbv_selection_info_t *selectionInfo,
+			      const gerbv_render_info_t *renderInfo,
+			      const gerbv_user_transformation_t *transform,
+			      gboolean toggle);
+
+#endif /* GERB_HIT_H */
@@ -34,6 +34,7 @@
 
 #include "common.h"
 #include "gerb_image.h"
+#include "gerb_index.h"
 #include "gerber.h"
 #include "amacro.h"
 
@@ -42,6 +43,288 @@ typedef struct {
     int newAperture;
 } gerb_translation_entry_t;
 
+/* Nets are allocated in chunks of growing size, up to this */
+#define ARENA_CHUNK_MIN (16 << 10)
+#define ARENA_CHUNK_MAX (4 << 20)
+/* Alignment of the allocations, enough for doubles and pointers */
+#define ARENA_ALIGN 16
+#define ARENA_ROUND(n) (((n) + ARENA_ALIGN - 1) & ~(gsize)(ARENA_ALIGN - 1))
+
+typedef struct gerb_arena_chunk {
+    struct gerb_arena_chunk *next;
+    gsize size;		/* Bytes of data after the header */
+    gsize used;
+} gerb_arena_chunk_t;
+
+#define ARENA_HEADER ARENA_ROUND(sizeof(gerb_arena_chunk_t))
+
+struct gerb_image_arena {
+    gerb_arena_chunk_t *chunks; /* The one being filled first */
+    gsize next_size;
+};
+
+static struct gerb_image_arena *
+arena_new (void)
+{
+    struct gerb_image_arena *arena = g_new0 (struct gerb_image_arena, 1);
+
+    arena->next_size = ARENA_CHUNK_MIN;
+
+    return arena;
+}
+
+/* Zeroed memory of size bytes which lives as long as the arena */
+static gpointer
+arena_alloc (struct gerb_image_arena *arena, gsize size)
+{
+    gerb_arena_chunk_t *chunk = arena->chunks;
+    gpointer mem;
+
+    size = ARENA_ROUND(size);
+    if (chunk == NULL || chunk->size - chunk->used < size) {
+	gsize chunk_size = MAX(arena->next_size, size);
+
+	chunk = g_malloc0 (ARENA_HEADER + chunk_size);
+	chunk->size = chunk_size;
+	chunk->next = arena->chunks;
+	arena->chunks = chunk;
+	arena->next_size = MIN(arena->next_size * 2, ARENA_CHUNK_MAX);
+    }
+
+    mem = (char *)chunk + ARENA_HEADER + chunk->used;
+    chunk->used += size;
+
+    return mem;
+}
+
+static void
+arena_destroy (struct gerb_image_arena *arena)
+{
+    gerb_arena_chunk_t *chunk, *next;
+
+    for (chunk = arena->chunks; chunk != NULL; chunk = next) {
+	next = chunk->next;
+	g_free (chunk);
+    }
+    g_free (arena);
+}
+
+gsize
+gerb_image_arena_size (gerbv_image_t *image)
+{
+    gerb_arena_chunk_t *chunk;
+    gsize size = 0;
+
+    if (image->arena == NULL)
+	return 0;
+
+    for (chunk = image->arena->chunks; chunk != NULL; chunk = chunk->next)
+	size += ARENA_HEADER + chunk->size;
+
+    return size;
+}
+
+gerbv_net_t *
+gerb_image_new_net (gerbv_image_t *image)
+{
+    if (image->arena == NULL)
+	return g_new0 (gerbv_net_t, 1);
+
+    return arena_alloc (image->arena, sizeof (gerbv_net_t));
+}
+
+gerbv_cirseg_t *
+gerb_image_new_cirseg (gerbv_image_t *image)
+{
+    if (image->arena == NULL)
+	return g_new0 (gerbv_cirseg_t, 1);
+
+    return arena_alloc (image->arena, sizeof (gerbv_cirseg_t));
+}
+
+double *
+gerb_image_new_parameters (gerbv_image_t *image, int nuf_parameters)
+{
+    gsize n = MAX (nuf_parameters, APERTURE_PARAMETERS_MIN);
+
+    if (image->arena == NULL)
+	return g_new0 (double, n);
+
+    return arena_alloc (image->arena, n * sizeof (double));
+}
+
+gerbv_aperture_t *
+gerbv_image_new_aperture (gerbv_image_t *image, int nuf_parameters)
+{
+    gerbv_aperture_t *aperture = g_new0 (gerbv_aperture_t, 1);
+
+    aperture->parameter = gerb_image_new_parameters (image, nuf_parameters);
+    aperture->nuf_parameters = nuf_parameters;
+
+    return aperture;
+}
+
+/* The apertures are kept in pages of APERTURE_PAGE_SIZE D codes, each
+ * made when the first of its D codes is defined, so looking one up takes
+ * two reads however far apart the D codes are.  The defined D codes are
+ * also kept in order, to step through them without the empty ones. */
+#define APERTURE_PAGE_BITS 8
+#define APERTURE_PAGE_SIZE (1 << APERTURE_PAGE_BITS)
+#define APERTURE_PAGES ((APERTURE_MAX >> APERTURE_PAGE_BITS) + 1)
+
+struct gerb_aperture_table {
+    gerbv_aperture_t **page[APERTURE_PAGES];
+    GArray *numbers;	/* The defined D codes (gint), increasing */
+};
+
+static void
+aperture_table_destroy (struct gerb_aperture_table *table)
+{
+    int i;
+
+    if (table == NULL)
+	return;
+
+    for (i = 0; i < APERTURE_PAGES; i++)
+	g_free (table->page[i]);
+    g_array_free (table->numbers, TRUE);
+    g_free (table);
+}
+
+/* Where number is in the defined D codes, or would go.  TRUE if it is
+ * there. */
+static gboolean
+aperture_table_find (const struct gerb_aperture_table *table, int number,
+		guint *position)
+{
+    guint low = 0, high = table->numbers->len;
+
+    while (low < high) {
+	guint middle = low + (high - low) / 2;
+
+	if (g_array_index (table->numbers, gint, middle) < number)
+	    low = middle + 1;
+	else
+	    high = middle;
+    }
+    *position = low;
+
+    return low < table->numbers->len
+	&& g_array_index (table->numbers, gint, low) == number;
+}
+
+/* The highest defined D code, 0 if there is none */
+static int
+aperture_table_last_number (const struct gerb_aperture_table *table)
+{
+    if (table == NULL || table->numbers->len == 0)
+	return 0;
+
+    return g_array_index (table->numbers, gint, table->numbers->len - 1);
+}
+
+gboolean
+gerb_image_aperture_number_valid (int number)
+{
+    return number >= 0 && number <= APERTURE_MAX;
+}
+
+gerbv_aperture_t *
+gerbv_image_get_aperture (gerbv_image_t *image, int number)
+{
+    gerbv_aperture_t **page;
+
+    if (image->apertures == NULL || !gerb_image_aperture_number_valid (number))
+	return NULL;
+
+    page = image->apertures->page[number >> APERTURE_PAGE_BITS];
+    if (page == NULL)
+	return NULL;
+
+    return page[number & (APERTURE_PAGE_SIZE - 1)];
+}
+
+gboolean
+gerbv_image_set_aperture (gerbv_image_t *image, int number,
+		gerbv_aperture_t *aperture)
+{
+    struct gerb_aperture_table *table;
+    gerbv_aperture_t ***page;
+    guint position;
+
+    if (!gerb_image_aperture_number_valid (number))
+	return FALSE;
+
+    if (image->apertures == NULL) {
+	image->apertures = g_new0 (struct gerb_aperture_table, 1);
+	image->apertures->numbers = g_array_new (FALSE, FALSE, sizeof (gint));
+    }
+    table = image->apertures;
+    page = &table->page[number >> APERTURE_PAGE_BITS];
+
+    if (aperture_table_find (table, number, &position)) {
+	if (aperture == NULL)
+	    g_array_remove_index (table->numbers, position);
+    } else {
+	if (aperture == NULL)
+	    return TRUE;
+	g_array_insert_val (table->numbers, position, number);
+    }
+
+    if (*page == NULL)
+	*page = g_new0 (gerbv_aperture_t *, APERTURE_PAGE_SIZE);
+    (*page)[number & (APERTURE_PAGE_SIZE - 1)] = aperture;
+
+    return TRUE;
+}
+
+void
+gerbv_image_aperture_iter_init (gerbv_aperture_iter_t *iter,
+		const gerbv_image_t *image)
+{
+    iter->image = image;
+    iter->position = 0;
+}
+
+gboolean
+gerbv_image_aperture_iter_next (gerbv_aperture_iter_t *iter, int *number,
+		gerbv_aperture_t **aperture)
+{
+    const struct gerb_aperture_table *table = iter->image->apertures;
+    int n;
+
+    if (table == NULL || iter->position >= table->numbers->len)
+	return FALSE;
+
+    n = g_array_index (table->numbers, gint, iter->position++);
+    if (number != NULL)
+	*number = n;
+    if (aperture != NULL)
+	*aperture = table->page[n >> APERTURE_PAGE_BITS]
+			[n & (APERTURE_PAGE_SIZE - 1)];
+
+    return TRUE;
+}
+
+GString *
+gerb_image_new_label (gerbv_image_t *image, const gchar *str)
+{
+    GString *label;
+    gsize len;
+
+    if (image->arena == NULL)
+	return g_string_new (str);
+
+    len = strlen (str);
+    label = arena_alloc (image->arena, sizeof (GString));
+    label->str = arena_alloc (image->arena, len + 1);
+    memcpy (label->str, str, len + 1);
+    label->len = len;
+    label->allocated_len = len + 1;
+
+    return label;
+}
+
 gerbv_image_t *
 gerbv_create_image(gerbv_image_t *image, const gchar *type)
 {
@@ -52,15 +335,13 @@ gerbv_create_image(gerbv_image_t *image, const gchar *type)
 	return NULL;
     }
 
-    /* Malloc space for image->netlist */
-    if (NULL == (image->netlist = g_new0(gerbv_net_t, 1))) {
-	g_free(image);
-	return NULL;
-    }
+    /* Nets and what belongs to them are freed with the image */
+    image->arena = arena_new();
+    image->netlist = gerb_image_new_net(image);
 
     /* Malloc space for image->info */
     if (NULL == (image->info = g_new0(gerbv_image_info_t, 1))) {
-	g_free(image->netlist);
+	arena_destroy(image->arena);
 	g_free(image);
 	return NULL;
     }
@@ -105,7 +386,8 @@ gerbv_create_image(gerbv_image_t *image, const gchar *type)
 void
 gerbv_destroy_image(gerbv_image_t *image)
 {
-    int i;
+    gerbv_aperture_iter_t iter;
+    gerbv_aperture_t *aperture;
     gerbv_net_t *net, *tmp;
     gerbv_layer_t *layer;
     gerbv_netstate_t *state;
@@ -115,19 +397,25 @@ gerbv_destroy_image(gerbv_image_t *image)
         return;
         
     /*
-     * Free apertures
+     * Free apertures, the cached simplified macros only once
      */
-    for (i = 0; i < APERTURE_MAX; i++) 
-	if (image->aperture[i] != NULL) {
-	    for (sam = image->aperture[i]->simplified; sam != NULL; ){
+    gerber_destroy_amacro_cache(image);
+    gerbv_image_aperture_iter_init (&iter, image);
+    while (gerbv_image_aperture_iter_next (&iter, NULL, &aperture)) {
+	    for (sam = aperture->simplified; sam != NULL; ){
 	      sam2 = sam->next;
+	    	if (image->arena == NULL)
+		    g_free (sam->parameter);
 	    	g_free (sam);
 	    	sam = sam2;
 	    }
 
-	    g_free(image->aperture[i]);
-	    image->aperture[i] = NULL;
+	    if (image->arena == NULL)
+		g_free(aperture->parameter);
+	    g_free(aperture);
 	}
+    aperture_table_destroy(image->apertures);
+    image->apertures = NULL;
 
     /*
      * Free aperture macro
@@ -156,6 +444,11 @@ gerbv_destroy_image(gerbv_image_t *image)
     /*
      * Free netlist
      */
+    if (image->arena) {
+	/* All in one go */
+	arena_destroy(image->arena);
+	image->netlist = NULL;
+    }
     for (net = image->netlist; net != NULL; ) {
 	tmp = net; 
 	net = net->next; 
@@ -184,6 +477,8 @@ gerbv_destroy_image(gerbv_image_t *image)
     }
     gerbv_stats_destroy(image->gerbv_stats);
     gerbv_drill_stats_destroy(image->drill_stats);
+    g_free(image->parse_stats);
+    gerb_index_destroy(image->net_index);
 
     /*
      * Free and reset the final image
@@ -209,7 +504,8 @@ gerb_verify_error_t
 gerbv_image_verify(gerbv_image_t const* image)
 {
     gerb_verify_error_t error = GERB_IMAGE_OK;
-    int i, n_nets;;
+    gerbv_aperture_iter_t iter;
+    int n_nets;
     gerbv_net_t *net;
 
     if (image->netlist == NULL) error |= GERB_IMAGE_MISSING_NETLIST;
@@ -226,8 +522,9 @@ gerbv_image_verify(gerbv_image_t const* image)
 
     /* If we have nets but no apertures are defined, then complain */
     if( n_nets > 0) {
-      for (i = 0; i < APERTURE_MAX && image->aperture[i] == NULL; i++);
-      if (i == APERTURE_MAX) error |= GERB_IMAGE_MISSING_APERTURES;
+      gerbv_image_aperture_iter_init (&iter, image);
+      if (!gerbv_image_aperture_iter_next (&iter, NULL, NULL))
+	error |= GERB_IMAGE_MISSING_APERTURES;
     }
 
     return error;
@@ -256,16 +553,16 @@ void
 gerbv_image_dump(gerbv_image_t const* image)
 {
     int i, j;
-    gerbv_aperture_t * const* aperture;
+    gerbv_aperture_iter_t iter;
+    gerbv_aperture_t *aperture;
     gerbv_net_t const * net;
 
     /* Apertures */
     printf(_("Apertures:\n"));
-    aperture = image->aperture;
-    for (i = 0; i < APERTURE_MAX; i++) {
-	if (aperture[i]) {
+    gerbv_image_aperture_iter_init (&iter, image);
+    while (gerbv_image_aperture_iter_next (&iter, &i, &aperture)) {
 	    printf(_(" Aperture no:%d is an "), i);
-	    switch(aperture[i]->type) {
+	    switch(aperture->type) {
 	    case GERBV_APTYPE_CIRCLE:
 		printf(_("circle"));
 		break;
@@ -284,11 +581,10 @@ gerbv_image_dump(gerbv_image_t const* image)
 	    default:
 		printf(_("unknown"));
 	    }
-	    for (j = 0; j < aperture[i]->nuf_parameters; j++) {
-		printf(" %f", aperture[i]->parameter[j]);
+	    for (j = 0; j < aperture->nuf_parameters; j++) {
+		printf(" %f", aperture->parameter[j]);
 	    }
 	    printf("\n");
-	}
     }
 
     /* Netlist */
@@ -340,6 +636,7 @@ gerbv_image_duplicate_layer (gerbv_layer_t *oldLayer) {
     
     *newLayer = *oldLayer;
     newLayer->name = g_strdup (oldLayer->name);
+    newLayer->next = NULL;
     return newLayer;
 }
 
@@ -349,16 +646,32 @@ gerbv_image_duplicate_state (gerbv_netstate_t *oldState)
 	gerbv_netstate_t *newState = g_new (gerbv_netstate_t, 1);
 
 	*newState = *oldState;
+	newState->next = NULL;
 	return newState;
 }
 
+static double *
+gerbv_image_duplicate_parameters (gerbv_image_t *destImage,
+		const double *parameter, int nuf_parameters)
+{
+    double *newParameter = gerb_image_new_parameters (destImage, nuf_parameters);
+
+    if (parameter != NULL)
+	memcpy (newParameter, parameter, sizeof (double) *
+		MAX (nuf_parameters, APERTURE_PARAMETERS_MIN));
+    return newParameter;
+}
+
 static gerbv_aperture_t *
-gerbv_image_duplicate_aperture (gerbv_aperture_t *oldAperture)
+gerbv_image_duplicate_aperture (gerbv_image_t *destImage,
+		gerbv_aperture_t *oldAperture)
 {
     gerbv_aperture_t *newAperture = g_new0 (gerbv_aperture_t,1);
     gerbv_simplified_amacro_t *simplifiedMacro, *tempSimplified;
 
     *newAperture = *oldAperture;
+    newAperture->parameter = gerbv_image_duplicate_parameters (destImage,
+		    oldAperture->parameter, oldAperture->nuf_parameters);
 
     /* delete the amacro section, since we really don't need it anymore
     now that we have the simplified section */
@@ -370,6 +683,9 @@ gerbv_image_duplicate_aperture (gerbv_aperture_t *oldAperture)
     for (simplifiedMacro = oldAperture->simplified; simplifiedMacro != NULL; simplifiedMacro = simplifiedMacro->next) {
 	gerbv_simplified_amacro_t *newSimplified = g_new0 (gerbv_simplified_amacro_t,1);
 	*newSimplified = *simplifiedMacro;
+	newSimplified->parameter = gerbv_image_duplicate_parameters (destImage,
+		simplifiedMacro->parameter, simplifiedMacro->nuf_parameters);
+	newSimplified->next = NULL;
 	if (tempSimplified)
 	  tempSimplified->next = newSimplified;
 	else
@@ -391,7 +707,7 @@ gerbv_image_copy_all_nets (gerbv_image_t *sourceImage,
 
 	gerbv_net_t *currentNet, *newNet;
 	gerbv_aperture_type_t aper_type;
-	gerbv_aperture_t *aper;
+	gerbv_aperture_t *aper, *netAper;
 	gerbv_simplified_amacro_t *sam;
 	int *trans_apers = NULL; /* Transformed apertures */
 	int aper_last_id = 0;
@@ -422,11 +738,7 @@ gerbv_image_copy_all_nets (gerbv_image_t *sourceImage,
 	if (trans) {
 		/* Find last used aperture to add transformed apertures if
 		 * needed */
-		for (aper_last_id = APERTURE_MAX - 1; aper_last_id > 0;
-						aper_last_id--) {
-			if (destImage->aperture[aper_last_id] != NULL)
-				break;
-		}
+		aper_last_id = aperture_table_last_number (destImage->apertures);
 
 		trans_apers = g_new (int, aper_last_id + 1);
 		/* Initialize trans_apers array */
@@ -452,16 +764,17 @@ gerbv_image_copy_all_nets (gerbv_image_t *sourceImage,
 		}
 
 		/* Create and copy the actual net over */
-		newNet = g_new (gerbv_net_t, 1);
+		newNet = gerb_image_new_net (destImage);
 		*newNet = *currentNet;
 
 		if (currentNet->cirseg) {
-			newNet->cirseg = g_new (gerbv_cirseg_t, 1);
+			newNet->cirseg = gerb_image_new_cirseg (destImage);
 			*(newNet->cirseg) = *(currentNet->cirseg);
 		}
 
 		if (currentNet->label)
-			newNet->label = g_string_new (currentNet->label->str);
+			newNet->label = gerb_image_new_label (destImage,
+					currentNet->label->str);
 		else
 			newNet->label = NULL;
 
@@ -509,7 +822,8 @@ gerbv_image_copy_all_nets (gerbv_image_t *sourceImage,
 				&newNet->cirseg->cp_y, trans);
 		}
 
-		if (destImage->aperture[newNet->aperture] == NULL)
+		netAper = gerbv_image_get_aperture (destImage, newNet->aperture);
+		if (netAper == NULL)
 			continue;
 
 		if (trans->scaleX == 1.0 && trans->scaleY == 1.0
@@ -523,7 +837,7 @@ gerbv_image_copy_all_nets (gerbv_image_t *sourceImage,
 		}
 
 		/* Transforming apertures */
-		aper_type = destImage->aperture[newNet->aperture]->type;
+		aper_type = netAper->type;
 		switch (aper_type) {
 		case GERBV_APTYPE_NONE:
 		case GERBV_APTYPE_POLYGON:
@@ -536,13 +850,13 @@ gerbv_image_copy_all_nets (gerbv_image_t *sourceImage,
 			}
 
 			if (trans->scaleX == trans->scaleY) {
-				aper = gerbv_image_duplicate_aperture (
-						destImage->aperture[
-							newNet->aperture]);
+				aper = gerbv_image_duplicate_aperture (destImage,
+						netAper);
 				aper->parameter[0] *= trans->scaleX;
 
 				trans_apers[newNet->aperture] = ++aper_last_id;
-				destImage->aperture[aper_last_id] = aper;
+				gerbv_image_set_aperture (destImage,
+						aper_last_id, aper);
 				newNet->aperture = aper_last_id;
 			} else {
 				err_scale_circle++;
@@ -556,8 +870,8 @@ gerbv_image_copy_all_nets (gerbv_image_t *sourceImage,
 						< GERBV_PRECISION_ANGLE_RAD)
 				break;
 
-			aper = gerbv_image_duplicate_aperture (
-					destImage->aperture[newNet->aperture]);
+			aper = gerbv_image_duplicate_aperture (destImage,
+					netAper);
 			aper->parameter[0] *= trans->scaleX;
 			aper->parameter[1] *= trans->scaleY;
 
@@ -578,14 +892,14 @@ gerbv_image_copy_all_nets (gerbv_image_t *sourceImage,
 			}
 
 			trans_apers[newNet->aperture] = ++aper_last_id;
-			destImage->aperture[aper_last_id] = aper;
+			gerbv_image_set_aperture (destImage, aper_last_id, aper);
 			newNet->aperture = aper_last_id;
 
 			break;
 
 		case GERBV_APTYPE_MACRO:
-			aper = gerbv_image_duplicate_aperture (
-					destImage->aperture[newNet->aperture]);
+			aper = gerbv_image_duplicate_aperture (destImage,
+					netAper);
 			sam = aper->simplified;
 
 			for (; sam != NULL; sam = sam->next) {
@@ -796,7 +1110,7 @@ selection_add_item (&screen.selectionInfo, &sItem);
 			}
 
 			trans_apers[newNet->aperture] = ++aper_last_id;
-			destImage->aperture[aper_last_id] = aper;
+			gerbv_image_set_aperture (destImage, aper_last_id, aper);
 			newNet->aperture = aper_last_id;
 
 			break;
@@ -867,45 +1181,71 @@ selection_add_item (&screen.selectionInfo, &sItem);
 	g_free (trans_apers);
 }
 
+/* Parameter j of aperture, zero beyond those allocated */
+static double
+aperture_parameter (const gerbv_aperture_t *aperture, int j)
+{
+    if (j >= MAX (aperture->nuf_parameters, APERTURE_PARAMETERS_MIN))
+	return 0.0;
+
+    return aperture->parameter[j];
+}
+
 gint
 gerbv_image_find_existing_aperture_match (gerbv_aperture_t *checkAperture, gerbv_image_t *imageToSearch) {
-    int i,j;
+    gerbv_aperture_iter_t iter;
+    gerbv_aperture_t *aperture;
+    int i,j,n;
     gboolean isMatch;
     
-    for (i = 0; i < APERTURE_MAX; i++) {
-	if (imageToSearch->aperture[i] != NULL) {
-	  if ((imageToSearch->aperture[i]->type == checkAperture->type) &&
-	      (imageToSearch->aperture[i]->simplified == NULL) &&
-	      (imageToSearch->aperture[i]->unit == checkAperture->unit)) {
-	    /* check all parameters match too */
+    gerbv_image_aperture_iter_init (&iter, imageToSearch);
+    while (gerbv_image_aperture_iter_next (&iter, &i, &aperture)) {
+	  if ((aperture->type == checkAperture->type) &&
+	      (aperture->simplified == NULL) &&
+	      (aperture->unit == checkAperture->unit)) {
+	    /* check all parameters match too, missing ones count as zero */
 	    isMatch=TRUE;
-	    for (j=0; j<APERTURE_PARAMETERS_MAX; j++){
-	      if (imageToSearch->aperture[i]->parameter[j] != checkAperture->parameter[j])
+	    n = MAX (MAX (aperture->nuf_parameters,
+				    checkAperture->nuf_parameters),
+			    APERTURE_PARAMETERS_MIN);
+	    for (j=0; j<n; j++){
+	      if (aperture_parameter (aperture, j)
+			      != aperture_parameter (checkAperture, j))
 	        isMatch = FALSE;
 	    }
 	    if (isMatch)
 	      return i;
 	  }	      
-	}
     }
     return 0;
 }
 
 int
 gerbv_image_find_unused_aperture_number (int startIndex, gerbv_image_t *image){
-    int i;
+    const struct gerb_aperture_table *table = image->apertures;
+    guint position;
+    int i = startIndex;
     
-    for (i = startIndex; i < APERTURE_MAX; i++) {
-	if (image->aperture[i] == NULL) {
-	  return i;
-	}
-    }
-    return -1;
+    if (!gerb_image_aperture_number_valid (i))
+	return (i < 0) ? i : -1;
+    if (table == NULL)
+	return i;
+
+    /* Step over the defined D codes following startIndex */
+    aperture_table_find (table, i, &position);
+    for (; position < table->numbers->len
+	    && g_array_index (table->numbers, gint, position) == i;
+	    position++)
+	i++;
+
+    return gerb_image_aperture_number_valid (i) ? i : -1;
 }
 
 gerbv_image_t *
 gerbv_image_duplicate_image (gerbv_image_t *sourceImage, gerbv_user_transformation_t *transform) {
     gerbv_image_t *newImage = gerbv_create_image(NULL, sourceImage->info->type);
+    gerbv_aperture_iter_t iter;
+    gerbv_aperture_t *aperture;
     int i;
     int lastUsedApertureNumber = APERTURE_MIN - 1;
     GArray *apertureNumberTable = g_array_new(FALSE,FALSE,sizeof(gerb_translation_entry_t));
@@ -921,17 +1261,16 @@ gerbv_image_duplicate_image (gerbv_image_t *sourceImage, gerbv_user_transformati
     
     /* copy apertures over, compressing all the numbers down for a cleaner output, and
        moving and apertures less than 10 up to the correct range */
-    for (i = 0; i < APERTURE_MAX; i++) {
-	if (sourceImage->aperture[i] != NULL) {
-	  gerbv_aperture_t *newAperture = gerbv_image_duplicate_aperture (sourceImage->aperture[i]);
+    gerbv_image_aperture_iter_init (&iter, sourceImage);
+    while (gerbv_image_aperture_iter_next (&iter, &i, &aperture)) {
+	  gerbv_aperture_t *newAperture = gerbv_image_duplicate_aperture (newImage, aperture);
 
 	  lastUsedApertureNumber = gerbv_image_find_unused_aperture_number (lastUsedApertureNumber + 1, newImage);
 	  /* store the aperture numbers (new and old) in the translation table */
 	  gerb_translation_entry_t translationEntry={i,lastUsedApertureNumber};
 	  g_array_append_val (apertureNumberTable,translationEntry);
 
-	  newImage->aperture[lastUsedApertureNumber] = newAperture;
-	}
+	  gerbv_image_set_aperture (newImage, lastUsedApertureNumber, newAperture);
     }
     
     /* step through all nets and create new layers and states on the fly, since
@@ -944,13 +1283,15 @@ gerbv_image_duplicate_image (gerbv_image_t *sourceImage, gerbv_user_transformati
 void
 gerbv_image_copy_image (gerbv_image_t *sourceImage, gerbv_user_transformation_t *transform, gerbv_image_t *destinationImage) {
     int lastUsedApertureNumber = APERTURE_MIN - 1;
+    gerbv_aperture_iter_t iter;
+    gerbv_aperture_t *aperture;
     int i;
     GArray *apertureNumberTable = g_array_new(FALSE,FALSE,sizeof(gerb_translation_entry_t));
     
     /* copy apertures over */
-    for (i = 0; i < APERTURE_MAX; i++) {
-	if (sourceImage->aperture[i] != NULL) {
-	  gint existingAperture = gerbv_image_find_existing_aperture_match (sourceImage->aperture[i], destinationImage);
+    gerbv_image_aperture_iter_init (&iter, sourceImage);
+    while (gerbv_image_aperture_iter_next (&iter, &i, &aperture)) {
+	  gint existingAperture = gerbv_image_find_existing_aperture_match (aperture, destinationImage);
 	  
 	  /* if we already have an existing aperture in the destination image that matches what
 	     we want, just use it instead */
@@ -960,16 +1301,15 @@ gerbv_image_copy_image (gerbv_image_t *sourceImage, gerbv_user_transformation_t
 	  }
 	  /* else, create a new aperture and put it in the destination image */
 	  else {
-	  	gerbv_aperture_t *newAperture = gerbv_image_duplicate_aperture (sourceImage->aperture[i]);
+	  	gerbv_aperture_t *newAperture = gerbv_image_duplicate_aperture (destinationImage, aperture);
 	  
 	  	lastUsedApertureNumber = gerbv_image_find_unused_aperture_number (lastUsedApertureNumber + 1, destinationImage);
 	  	/* store the aperture numbers (new and old) in the translation table */
 	  	gerb_translation_entry_t translationEntry={i,lastUsedApertureNumber};
 	  	g_array_append_val (apertureNumberTable,translationEntry);
 
-	  	destinationImage->aperture[lastUsedApertureNumber] = newAperture;
+	  	gerbv_image_set_aperture (destinationImage, lastUsedApertureNumber, newAperture);
 	  }
-	}
     }
     /* find the last layer, state, and net in the linked chains */
     gerbv_netstate_t *lastState;
@@ -1024,11 +1364,11 @@ gerbv_image_create_rectangle_object (gerbv_image_t *image, gdouble coordinateX,
 	for (currentNet = image->netlist; currentNet->next; currentNet = currentNet->next){}
 	
 	/* create the polygon start node */
-	currentNet = gerber_create_new_net (currentNet, NULL, NULL);
+	currentNet = gerber_create_new_net (image, currentNet, NULL, NULL);
 	currentNet->interpolation = GERBV_INTERPOLATION_PAREA_START;
 	
 	/* go to start point (we need this to create correct RS274X export code) */
-	currentNet = gerber_create_new_net (currentNet, NULL, NULL);
+	currentNet = gerber_create_new_net (image, currentNet, NULL, NULL);
 	currentNet->interpolation = GERBV_INTERPOLATION_LINEARx1;
 	currentNet->aperture_state = GERBV_APERTURE_STATE_OFF;
 	currentNet->start_x = coordinateX;
@@ -1037,7 +1377,7 @@ gerbv_image_create_rectangle_object (gerbv_image_t *image, gdouble coordinateX,
 	currentNet->stop_y = coordinateY;
 	
 	/* draw the 4 corners */
-	currentNet = gerber_create_new_net (currentNet, NULL, NULL);
+	currentNet = gerber_create_new_net (image, currentNet, NULL, NULL);
 	currentNet->interpolation = GERBV_INTERPOLATION_LINEARx1;
 	currentNet->aperture_state = GERBV_APERTURE_STATE_ON;
 	currentNet->start_x = coordinateX;
@@ -1048,7 +1388,7 @@ gerbv_image_create_rectangle_object (gerbv_image_t *image, gdouble coordinateX,
 		0,0,0,0);
 	gerber_update_image_min_max (&currentNet->boundingBox, 0, 0, image);
 		
-	currentNet = gerber_create_new_net (currentNet, NULL, NULL);
+	currentNet = gerber_create_new_net (image, currentNet, NULL, NULL);
 	currentNet->interpolation = GERBV_INTERPOLATION_LINEARx1;
 	currentNet->aperture_state = GERBV_APERTURE_STATE_ON;
 	currentNet->stop_x = coordinateX + width;
@@ -1057,7 +1397,7 @@ gerbv_image_create_rectangle_object (gerbv_image_t *image, gdouble coordinateX,
 		0,0,0,0);
 	gerber_update_image_min_max (&currentNet->boundingBox, 0, 0, image);
 	
-	currentNet = gerber_create_new_net (currentNet, NULL, NULL);
+	currentNet = gerber_create_new_net (image, currentNet, NULL, NULL);
 	currentNet->interpolation = GERBV_INTERPOLATION_LINEARx1;
 	currentNet->aperture_state = GERBV_APERTURE_STATE_ON;
 	currentNet->stop_x = coordinateX;
@@ -1066,7 +1406,7 @@ gerbv_image_create_rectangle_object (gerbv_image_t *image, gdouble coordinateX,
 		0,0,0,0);
 	gerber_update_image_min_max (&currentNet->boundingBox, 0, 0, image);
 	
-	currentNet = gerber_create_new_net (currentNet, NULL, NULL);
+	currentNet = gerber_create_new_net (image, currentNet, NULL, NULL);
 	currentNet->interpolation = GERBV_INTERPOLATION_LINEARx1;
 	currentNet->aperture_state = GERBV_APERTURE_STATE_ON;
 	currentNet->stop_x = coordinateX;
@@ -1076,7 +1416,7 @@ gerbv_image_create_rectangle_object (gerbv_image_t *image, gdouble coordinateX,
 	gerber_update_image_min_max (&currentNet->boundingBox, 0, 0, image);
 	
 	/* create the polygon end node */
-	currentNet = gerber_create_new_net (currentNet, NULL, NULL);
+	currentNet = gerber_create_new_net (image, currentNet, NULL, NULL);
 	currentNet->interpolation = GERBV_INTERPOLATION_PAREA_END;
 	
 	return;
@@ -1085,21 +1425,21 @@ gerbv_image_create_rectangle_object (gerbv_image_t *image, gdouble coordinateX,
 gerbv_net_t *
 gerb_image_return_aperture_index (gerbv_image_t *image, gdouble lineWidth, int *apertureIndex){
 	gerbv_net_t *currentNet;
-	gerbv_aperture_t *aperture=NULL;
+	gerbv_aperture_iter_t iter;
+	gerbv_aperture_t *aperture=NULL, *candidate;
 	int i;
 		
 	/* run through and find last net pointer */
 	for (currentNet = image->netlist; currentNet->next; currentNet = currentNet->next){}
 	
 	/* try to find an existing aperture that matches the requested width and type */
-	for (i = 0; i < APERTURE_MAX; i++) {
-		if (image->aperture[i] != NULL) {
-			if ((image->aperture[i]->type == GERBV_APTYPE_CIRCLE) && 
-				(fabs (image->aperture[i]->parameter[0] - lineWidth) < 0.001)){
-				aperture = image->aperture[i];
-				*apertureIndex = i;
-				break;
-			}
+	gerbv_image_aperture_iter_init (&iter, image);
+	while (gerbv_image_aperture_iter_next (&iter, &i, &candidate)) {
+		if ((candidate->type == GERBV_APTYPE_CIRCLE) && 
+			(fabs (candidate->parameter[0] - lineWidth) < 0.001)){
+			aperture = candidate;
+			*apertureIndex = i;
+			break;
 		}
 	}
 
@@ -1128,7 +1468,7 @@ gerbv_image_create_arc_object (gerbv_image_t *image, gdouble centerX, gdouble ce
 		return;
 	
 	/* draw the arc */
-	currentNet = gerber_create_new_net (currentNet, NULL, NULL);
+	currentNet = gerber_create_new_net (image, currentNet, NULL, NULL);
 	currentNet->interpolation = GERBV_INTERPOLATION_CCW_CIRCULAR;
 	currentNet->aperture_state = GERBV_APERTURE_STATE_ON;
 	currentNet->aperture = apertureIndex;
@@ -1136,7 +1476,7 @@ gerbv_image_create_arc_object (gerbv_image_t *image, gdouble centerX, gdouble ce
 	currentNet->start_y = centerY + (sin(DEG2RAD(startAngle)) * radius);
 	currentNet->stop_x = centerX + (cos(DEG2RAD(endAngle)) * radius);
 	currentNet->stop_y = centerY + (sin(DEG2RAD(endAngle)) * radius);
-	currentNet->cirseg = g_new0 (gerbv_cirseg_t,1);
+	currentNet->cirseg = gerb_image_new_cirseg (image);
 	*(currentNet->cirseg) = cirSeg;
 	
 	gdouble angleDiff = currentNet->cirseg->angle2 - currentNet->cirseg->angle1;
@@ -1169,7 +1509,7 @@ gerbv_image_create_line_object (gerbv_image_t *image, gdouble startX, gdouble st
 		return;
 	
 	/* draw the line */
-	currentNet = gerber_create_new_net (currentNet, NULL, NULL);
+	currentNet = gerber_create_new_net (image, currentNet, NULL, NULL);
 	currentNet->interpolation = GERBV_INTERPOLATION_LINEARx1;
 	
 	/* if the start and end coordinates are the same, use a "flash" aperture state */
@@ -1256,11 +1596,12 @@ gerbv_image_reduce_area_of_selected_objects (GArray *selectionArray,
 		case GERBV_INTERPOLATION_LINEARx01:
 		case GERBV_INTERPOLATION_LINEARx001: {
 			gdouble dx=0,dy=0;
-			gerbv_aperture_t *apert =
-				image->aperture[currentNet->aperture];
+			gerbv_aperture_t *apert = gerbv_image_get_aperture (
+					image, currentNet->aperture);
 
 			/* figure out the overall size of this element */
-			switch (apert->type) {
+			switch ((apert != NULL) ? apert->type
+						: GERBV_APTYPE_NONE) {
 			case GERBV_APTYPE_CIRCLE :
 			case GERBV_APTYPE_OVAL :
 			case GERBV_APTYPE_POLYGON :
@@ -1357,17 +1698,134 @@ gerbv_image_return_next_renderable_object (gerbv_net_t *oldNet) {
 	}
 }
 
+/* Index of the layer or state p in table, added if it isn't there yet */
+static guint32
+net_columns_index (GHashTable *index, GPtrArray *table, gpointer p)
+{
+	gpointer value;
+
+	if (g_hash_table_lookup_extended (index, p, NULL, &value))
+		return GPOINTER_TO_UINT (value);
+
+	g_hash_table_insert (index, p, GUINT_TO_POINTER (table->len));
+	g_ptr_array_add (table, p);
+
+	return table->len - 1;
+}
+
+gerbv_net_columns_t *
+gerbv_image_create_net_columns (gerbv_image_t *image)
+{
+	gerbv_net_columns_t *columns = g_new0 (gerbv_net_columns_t, 1);
+	GHashTable *layerIndex, *stateIndex;
+	GPtrArray *layers, *states;
+	gerbv_layer_t *lastLayer = NULL;
+	gerbv_netstate_t *lastState = NULL;
+	guint32 layerNo = 0, stateNo = 0;
+	gerbv_net_t *net;
+	guint i, n = 0;
+
+	if (image->netlist != NULL) {
+		for (net = image->netlist->next; net != NULL; net = net->next)
+			n++;
+	}
+
+	columns->n_nets = n;
+	columns->start_x = g_new (gdouble, n);
+	columns->start_y = g_new (gdouble, n);
+	columns->stop_x = g_new (gdouble, n);
+	columns->stop_y = g_new (gdouble, n);
+	columns->left = g_new (gdouble, n);
+	columns->right = g_new (gdouble, n);
+	columns->bottom = g_new (gdouble, n);
+	columns->top = g_new (gdouble, n);
+	columns->aperture = g_new (guint16, n);
+	columns->aperture_state = g_new (guint8, n);
+	columns->interpolation = g_new (guint8, n);
+	columns->layer = g_new (guint32, n);
+	columns->state = g_new (guint32, n);
+	columns->net = g_new (gerbv_net_t *, n);
+
+	layerIndex = g_hash_table_new (NULL, NULL);
+	stateIndex = g_hash_table_new (NULL, NULL);
+	layers = g_ptr_array_new ();
+	states = g_ptr_array_new ();
+
+	for (i = 0, net = n ? image->netlist->next : NULL; net != NULL;
+			i++, net = net->next) {
+		columns->start_x[i] = net->start_x;
+		columns->start_y[i] = net->start_y;
+		columns->stop_x[i] = net->stop_x;
+		columns->stop_y[i] = net->stop_y;
+		columns->left[i] = net->boundingBox.left;
+		columns->right[i] = net->boundingBox.right;
+		columns->bottom[i] = net->boundingBox.bottom;
+		columns->top[i] = net->boundingBox.top;
+		columns->aperture[i] = net->aperture;
+		columns->aperture_state[i] = net->aperture_state;
+		columns->interpolation[i] = net->interpolation;
+		columns->net[i] = net;
+
+		/* Nets come in long runs of the same layer and state */
+		if (net->layer != lastLayer || i == 0) {
+			lastLayer = net->layer;
+			layerNo = net_columns_index (layerIndex, layers, lastLayer);
+		}
+		if (net->state != lastState || i == 0) {
+			lastState = net->state;
+			stateNo = net_columns_index (stateIndex, states, lastState);
+		}
+		columns->layer[i] = layerNo;
+		columns->state[i] = stateNo;
+	}
+
+	g_hash_table_destroy (layerIndex);
+	g_hash_table_destroy (stateIndex);
+	columns->n_layers = layers->len;
+	columns->layers = (gerbv_layer_t **) g_ptr_array_free (layers, FALSE);
+	columns->n_states = states->len;
+	columns->states = (gerbv_netstate_t **) g_ptr_array_free (states, FALSE);
+
+	return columns;
+}
+
+void
+gerbv_image_destroy_net_columns (gerbv_net_columns_t *columns)
+{
+	if (columns == NULL)
+		return;
+
+	g_free (columns->start_x);
+	g_free (columns->start_y);
+	g_free (columns->stop_x);
+	g_free (columns->stop_y);
+	g_free (columns->left);
+	g_free (columns->right);
+	g_free (columns->bottom);
+	g_free (columns->top);
+	g_free (columns->aperture);
+	g_free (columns->aperture_state);
+	g_free (columns->interpolation);
+	g_free (columns->layer);
+	g_free (columns->state);
+	g_free (columns->layers);
+	g_free (columns->states);
+	g_free (columns->net);
+	g_free (columns);
+}
+
 void
 gerbv_image_create_dummy_apertures (gerbv_image_t *parsed_image) {
 	gerbv_net_t *currentNet;
 		
 	/* run through and find last net pointer */
 	for (currentNet = parsed_image->netlist; currentNet->next; currentNet = currentNet->next){
-		if (parsed_image->aperture[currentNet->aperture] == NULL) {
-			parsed_image->aperture[currentNet->aperture] = g_new0 (gerbv_aperture_t, 1);
-			parsed_image->aperture[currentNet->aperture]->type = GERBV_APTYPE_CIRCLE;
-			parsed_image->aperture[currentNet->aperture]->parameter[0] = 0;
-			parsed_image->aperture[currentNet->aperture]->parameter[1] = 0;
+		if (gerbv_image_get_aperture (parsed_image, currentNet->aperture) == NULL
+				&& gerb_image_aperture_number_valid (currentNet->aperture)) {
+			gerbv_aperture_t *aperture = gerbv_image_new_aperture (parsed_image, 2);
+
+			aperture->type = GERBV_APTYPE_CIRCLE;
+			gerbv_image_set_aperture (parsed_image, currentNet->aperture, aperture);
 		}
 	}
 }
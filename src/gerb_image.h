@@ -69,6 +69,27 @@ gerbv_image_return_new_layer (gerbv_layer_t *previousLayer);
 gerbv_netstate_t *
 gerbv_image_return_new_netstate (gerbv_netstate_t *previousState);
 
+/* Nets, cirsegs and labels are allocated from a per-image arena and freed
+ * all at once by gerbv_destroy_image().  They are zeroed, and must not be
+ * freed on their own.  Images without an arena (not made by
+ * gerbv_create_image()) get them from g_new0() as before. */
+gerbv_net_t *gerb_image_new_net (gerbv_image_t *image);
+gerbv_cirseg_t *gerb_image_new_cirseg (gerbv_image_t *image);
+/* The label must not be changed with the g_string_*() functions */
+GString *gerb_image_new_label (gerbv_image_t *image, const gchar *str);
+/* Whether an aperture can be stored under D code number, that is whether
+ * it is between 0 and APERTURE_MAX */
+gboolean gerb_image_aperture_number_valid (int number);
+/* The first D code from startIndex on with no aperture, -1 if there is
+ * none up to APERTURE_MAX */
+int gerbv_image_find_unused_aperture_number (int startIndex,
+					     gerbv_image_t *image);
+/* Zeroed room for nuf_parameters aperture parameters, but never less than
+ * APERTURE_PARAMETERS_MIN, from the same arena */
+double *gerb_image_new_parameters (gerbv_image_t *image, int nuf_parameters);
+/* Bytes held by the arena of image, 0 if it has none */
+gsize gerb_image_arena_size (gerbv_image_t *image);
+
 
 #ifdef __cplusplus
 }
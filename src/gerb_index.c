@@ -0,0 +1,461 @@
+/*
+ * gEDA - GNU Electronic Design Automation
+ * This file is a part of gerbv.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111 USA
+ */
+
+/** \file gerb_index.c
+    \brief Finding the nets of an image in a window
+    \ingroup libgerbv
+
+    The index is a uniform grid over the bounding boxes of the nets, made
+    the first time an image is drawn with a window.  Each cell lists the
+    nets overlapping it; nets spanning many cells are kept apart and tested
+    one by one.  A query marks the nets found in a bitmap, which is then
+    read in net order, so the nets are returned in the order they are drawn.
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <math.h>
+#include <string.h>
+
+#include "common.h"
+#include "gerbv.h"
+#include "gerb_index.h"
+
+/* DEBUG printing.  #define DEBUG 1 in config.h to use this fcn. */
+#define dprintf if(DEBUG) printf
+
+/* Nets per cell the grid is sized for, and at most this many cells */
+#define INDEX_NETS_PER_CELL 2
+#define INDEX_CELLS_MAX (1 << 22)
+/* Nets overlapping more cells than this are tested one by one */
+#define INDEX_LARGE_CELLS 64
+
+#define INDEX_WORD_BITS (8 * sizeof (gulong))
+
+struct gerb_net_index {
+    guint n_nets;
+    gerbv_net_t **nets;		/* The renderable nets, in drawing order */
+    gerbv_net_t *last;		/* The last of them; the nets after it are
+				   returned by every query */
+
+    /* The grid, cell (col, row) covering left + col * cell_w and
+     * bottom + row * cell_h */
+    double left, bottom, cell_w, cell_h;
+    guint cols, rows;
+    guint32 *cell_start;	/* cols * rows + 1 offsets into cell_nets */
+    guint32 *cell_nets;		/* The nets overlapping each cell */
+
+    guint n_large;
+    guint32 *large;		/* The nets not in the grid */
+    gerbv_render_size_t *large_box;
+
+    guint n_switches;
+    guint32 *switches;		/* The nets starting a layer or netstate */
+};
+
+/* ------------------------------------------------------------------ */
+/* The box net i of columns is drawn in with all the step and repeat
+ * copies of its layer.  FALSE if it has no box, which the renderers never
+ * draw when they are culling. */
+static gboolean
+index_net_box (const gerbv_net_columns_t *columns, guint i,
+	       gerbv_render_size_t *box)
+{
+    const gerbv_step_and_repeat_t *sr =
+	    &columns->layers[columns->layer[i]]->stepAndRepeat;
+    double sr_x = (sr->X - 1) * sr->dist_X;
+    double sr_y = (sr->Y - 1) * sr->dist_Y;
+
+    if (columns->left[i] > columns->right[i]
+    ||  columns->bottom[i] > columns->top[i])
+	return FALSE;
+
+    box->left = columns->left[i] + MIN(sr_x, 0.0);
+    box->right = columns->right[i] + MAX(sr_x, 0.0);
+    box->bottom = columns->bottom[i] + MIN(sr_y, 0.0);
+    box->top = columns->top[i] + MAX(sr_y, 0.0);
+
+    return TRUE;
+} /* index_net_box */
+
+/* ------------------------------------------------------------------ */
+static gboolean
+index_box_is_finite (const gerbv_render_size_t *box)
+{
+    return isfinite (box->left) && isfinite (box->right)
+	&& isfinite (box->bottom) && isfinite (box->top);
+}
+
+/* ------------------------------------------------------------------ */
+/* The cells from min to max cover, clamped to the n cells from start */
+static void
+index_cell_range (double min, double max, double start, double size,
+		  guint n, guint *first, guint *last)
+{
+    double a = floor ((min - start) / size);
+    double b = floor ((max - start) / size);
+
+    *first = (guint) CLAMP(a, 0.0, (double) (n - 1));
+    *last = (guint) CLAMP(b, 0.0, (double) (n - 1));
+}
+
+/* ------------------------------------------------------------------ */
+static struct gerb_net_index *
+index_build (gerbv_image_t *image)
+{
+    struct gerb_net_index *index = g_new0 (struct gerb_net_index, 1);
+    gerbv_render_size_t extent = {HUGE_VAL, -HUGE_VAL, HUGE_VAL, -HUGE_VAL};
+    gerbv_render_size_t box;
+    gerbv_layer_t *layer = image->layers;
+    gerbv_netstate_t *state = image->states;
+    GArray *large, *large_box, *switches;
+    gerbv_net_columns_t *columns;
+    guint32 *column;
+    guint8 *in_grid;
+    gboolean inPolygon = FALSE;
+    guint i, j, n = 0, cells;
+    double width, height;
+
+    /* The boxes are read from one array per side rather than net by net,
+     * and twice more below to place the nets in the grid */
+    columns = gerbv_image_create_net_columns (image);
+    index->nets = g_new (gerbv_net_t *, MAX(columns->n_nets, 1));
+    column = g_new (guint32, MAX(columns->n_nets, 1));
+    in_grid = g_new0 (guint8, MAX(columns->n_nets, 1));
+    large = g_array_new (FALSE, FALSE, sizeof (guint32));
+    large_box = g_array_new (FALSE, FALSE, sizeof (gerbv_render_size_t));
+    switches = g_array_new (FALSE, FALSE, sizeof (guint32));
+
+    for (j = 0; j < columns->n_nets; j++) {
+	gerbv_layer_t *netLayer = columns->layers[columns->layer[j]];
+	gerbv_netstate_t *netState = columns->states[columns->state[j]];
+	guint32 seq;
+
+	/* Step over the insides of polygons, as
+	 * gerbv_image_return_next_renderable_object() does */
+	if (inPolygon) {
+	    if (columns->interpolation[j] == GERBV_INTERPOLATION_PAREA_END)
+		inPolygon = FALSE;
+	    continue;
+	}
+	if (columns->interpolation[j] == GERBV_INTERPOLATION_PAREA_START)
+	    inPolygon = TRUE;
+
+	seq = i = n++;
+	index->nets[i] = columns->net[j];
+	index->last = columns->net[j];
+	column[i] = j;
+
+	if (netLayer != layer || netState != state) {
+	    g_array_append_val (switches, seq);
+	    layer = netLayer;
+	    state = netState;
+	}
+
+	if (!index_net_box (columns, j, &box))
+	    continue;
+
+	if (!index_box_is_finite (&box)) {
+	    g_array_append_val (large, seq);
+	    g_array_append_val (large_box, box);
+	    continue;
+	}
+
+	in_grid[i] = 1;
+	extent.left = MIN(extent.left, box.left);
+	extent.right = MAX(extent.right, box.right);
+	extent.bottom = MIN(extent.bottom, box.bottom);
+	extent.top = MAX(extent.top, box.top);
+    }
+
+    /* Size the cells to the extent of the nets, about square */
+    cells = CLAMP(n / INDEX_NETS_PER_CELL, 1, INDEX_CELLS_MAX);
+    width = extent.right - extent.left;
+    height = extent.top - extent.bottom;
+    if (!(width > 0.0))
+	width = 0.0;
+    if (!(height > 0.0))
+	height = 0.0;
+    if (width > 0.0 && height > 0.0) {
+	index->cols = CLAMP((guint) sqrt (cells * width / height), 1, cells);
+	index->rows = MAX(cells / index->cols, 1);
+    } else if (width > 0.0) {
+	index->cols = cells;
+	index->rows = 1;
+    } else {
+	index->cols = 1;
+	index->rows = (height > 0.0) ? cells : 1;
+    }
+    index->left = extent.left;
+    index->bottom = extent.bottom;
+    index->cell_w = (width > 0.0) ? width / index->cols : 1.0;
+    index->cell_h = (height > 0.0) ? height / index->rows : 1.0;
+
+    /* Count the nets of each cell, then place them */
+    index->cell_start = g_new0 (guint32, index->cols * index->rows + 1);
+    for (int pass = 0; pass < 2; pass++) {
+	guint32 *fill = NULL;
+
+	if (pass == 1) {
+	    guint c, total = 0;
+
+	    for (c = 0; c < index->cols * index->rows; c++) {
+		guint count = index->cell_start[c];
+
+		index->cell_start[c] = total;
+		total += count;
+	    }
+	    index->cell_start[c] = total;
+	    index->cell_nets = g_new (guint32, MAX(total, 1));
+	    fill = g_new (guint32, index->cols * index->rows);
+	    memcpy (fill, index->cell_start,
+		    sizeof (guint32) * (index->cols * index->rows));
+	}
+
+	for (i = 0; i < n; i++) {
+	    guint c0, c1, r0, r1, c, r;
+	    guint32 seq = i;
+
+	    if (!in_grid[i])
+		continue;
+
+	    index_net_box (columns, column[i], &box);
+	    index_cell_range (box.left, box.right, index->left,
+			      index->cell_w, index->cols, &c0, &c1);
+	    index_cell_range (box.bottom, box.top, index->bottom,
+			      index->cell_h, index->rows, &r0, &r1);
+
+	    if ((gsize) (c1 - c0 + 1) * (r1 - r0 + 1) > INDEX_LARGE_CELLS) {
+		if (pass == 0) {
+		    in_grid[i] = 0;
+		    g_array_append_val (large, seq);
+		    g_array_append_val (large_box, box);
+		}
+		continue;
+	    }
+
+	    for (r = r0; r <= r1; r++) {
+		for (c = c0; c <= c1; c++) {
+		    guint cell = r * index->cols + c;
+
+		    if (pass == 0)
+			index->cell_start[cell]++;
+		    else
+			index->cell_nets[fill[cell]++] = seq;
+		}
+	    }
+	}
+	g_free (fill);
+    }
+
+    index->n_nets = n;
+    index->nets = g_renew (gerbv_net_t *, index->nets, MAX(n, 1));
+    index->n_large = large->len;
+    index->large = (guint32 *) g_array_free (large, FALSE);
+    index->large_box = (gerbv_render_size_t *) g_array_free (large_box, FALSE);
+    index->n_switches = switches->len;
+    index->switches = (guint32 *) g_array_free (switches, FALSE);
+    g_free (in_grid);
+    g_free (column);
+    gerbv_image_destroy_net_columns (columns);
+
+    dprintf ("Indexed %u nets in %u x %u cells, %u apart\n",
+	    n, index->cols, index->rows, index->n_large);
+
+    return index;
+} /* index_build */
+
+/* ------------------------------------------------------------------ */
+void
+gerb_index_destroy (struct gerb_net_index *index)
+{
+    if (index == NULL)
+	return;
+
+    g_free (index->nets);
+    g_free (index->cell_start);
+    g_free (index->cell_nets);
+    g_free (index->large);
+    g_free (index->large_box);
+    g_free (index->switches);
+    g_free (index);
+}
+
+/* ------------------------------------------------------------------ */
+static inline void
+index_mark (gulong *visible, guint32 seq)
+{
+    visible[seq / INDEX_WORD_BITS] |= 1UL << (seq % INDEX_WORD_BITS);
+}
+
+/* ------------------------------------------------------------------ */
+void
+gerb_index_iter_init (gerb_index_iter_t *iter, gerbv_image_t *image,
+		      const gerbv_render_size_t *window)
+{
+    struct gerb_net_index *index;
+    guint i, c, r, c0, c1, r0, r1;
+
+    memset (iter, 0, sizeof (*iter));
+
+    if (image == NULL || image->netlist == NULL)
+	return;
+
+    /* The labels of pick and place layers may stick out of their nets */
+    if (image->layertype == GERBV_LAYERTYPE_PICKANDPLACE_TOP
+    ||  image->layertype == GERBV_LAYERTYPE_PICKANDPLACE_BOT)
+	window = NULL;
+
+    if (window == NULL) {
+	iter->tail = TRUE;
+	iter->next_tail = image->netlist->next;
+	return;
+    }
+
+    if (image->net_index == NULL)
+	image->net_index = index_build (image);
+    index = image->net_index;
+
+    iter->index = index;
+    iter->next_tail = (index->last != NULL)
+	    ? gerbv_image_return_next_renderable_object (index->last)
+	    : image->netlist->next;
+    iter->visible = g_new0 (gulong,
+	    (index->n_nets + INDEX_WORD_BITS - 1) / INDEX_WORD_BITS + 1);
+
+    for (i = 0; i < index->n_switches; i++)
+	index_mark (iter->visible, index->switches[i]);
+
+    for (i = 0; i < index->n_large; i++) {
+	const gerbv_render_size_t *box = &index->large_box[i];
+
+	/* The test the renderers cull each net with */
+	if (!(box->right < window->left || box->left > window->right
+	||  box->top < window->bottom || box->bottom > window->top))
+	    index_mark (iter->visible, index->large[i]);
+    }
+
+    if (index->cell_nets == NULL
+    ||  window->right < index->left
+    ||  window->left > index->left + index->cols * index->cell_w
+    ||  window->top < index->bottom
+    ||  window->bottom > index->bottom + index->rows * index->cell_h)
+	return;
+
+    index_cell_range (window->left, window->right, index->left,
+		      index->cell_w, index->cols, &c0, &c1);
+    index_cell_range (window->bottom, window->top, index->bottom,
+		      index->cell_h, index->rows, &r0, &r1);
+    for (r = r0; r <= r1; r++) {
+	for (c = c0; c <= c1; c++) {
+	    guint cell = r * index->cols + c;
+
+	    for (i = index->cell_start[cell]; i < index->cell_start[cell + 1];
+		    i++)
+		index_mark (iter->visible, index->cell_nets[i]);
+	}
+    }
+} /* gerb_index_iter_init */
+
+/* ------------------------------------------------------------------ */
+gerbv_net_t *
+gerb_index_iter_next (gerb_index_iter_t *iter)
+{
+    if (!iter->tail) {
+	struct gerb_net_index *index = iter->index;
+	guint n_words = (index->n_nets + INDEX_WORD_BITS - 1) / INDEX_WORD_BITS;
+
+	for (; iter->word < n_words; iter->word++) {
+	    gulong bits = iter->visible[iter->word];
+	    gint bit;
+
+	    if (bits == 0)
+		continue;
+
+	    bit = g_bit_nth_lsf (bits, -1);
+	    iter->visible[iter->word] &= ~(1UL << bit);
+	    iter->net = index->nets[iter->word * INDEX_WORD_BITS + bit];
+
+	    return iter->net;
+	}
+
+	iter->tail = TRUE;
+	iter->net = NULL;
+    }
+
+    if (iter->net == NULL)
+	iter->net = iter->next_tail;
+    else
+	iter->net = gerbv_image_return_next_renderable_object (iter->net);
+    iter->next_tail = NULL;
+
+    return iter->net;
+} /* gerb_index_iter_next */
+
+/* ------------------------------------------------------------------ */
+void
+gerb_index_iter_clear (gerb_index_iter_t *iter)
+{
+    g_free (iter->visible);
+    iter->visible = NULL;
+}
+
+/* ------------------------------------------------------------------ */
+gboolean
+gerb_index_untransform_window (gerbv_render_size_t *window,
+			       const gerbv_user_transformation_t *transform)
+{
+    double scaleX = transform->scaleX, scaleY = transform->scaleY;
+    double c = cos (transform->rotation), s = sin (transform->rotation);
+    double corners[4][2] = {
+	{window->left, window->bottom}, {window->right, window->bottom},
+	{window->left, window->top}, {window->right, window->top},
+    };
+    gerbv_render_size_t result = {HUGE_VAL, -HUGE_VAL, HUGE_VAL, -HUGE_VAL};
+    int i;
+
+    if (transform->mirrorAroundX)
+	scaleY = -scaleY;
+    if (transform->mirrorAroundY)
+	scaleX = -scaleX;
+
+    if (fabs (scaleX) < GERBV_PRECISION_LINEAR_INCH
+    ||  fabs (scaleY) < GERBV_PRECISION_LINEAR_INCH)
+	return FALSE;
+
+    /* The layer is drawn translated, then scaled, then rotated: undo
+     * these in the opposite order */
+    for (i = 0; i < 4; i++) {
+	double x = (corners[i][0] - transform->translateX) / scaleX;
+	double y = (corners[i][1] - transform->translateY) / scaleY;
+	double ux = c * x + s * y;
+	double uy = -s * x + c * y;
+
+	result.left = MIN(result.left, ux);
+	result.right = MAX(result.right, ux);
+	result.bottom = MIN(result.bottom, uy);
+	result.top = MAX(result.top, uy);
+    }
+
+    *window = result;
+
+    return TRUE;
+} /* gerb_index_untransform_window */
@@ -0,0 +1,70 @@
+/*
+ * gEDA - GNU Electronic Design Automation
+ * This file is a part of gerbv.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111 USA
+ */
+
+/** \file gerb_index.h
+    \brief Header info for finding the nets of an image in a window
+    \ingroup libgerbv
+*/
+
+#ifndef GERB_INDEX_H
+#define GERB_INDEX_H
+
+#include <glib.h>
+
+/*
+ * The renderable nets of an image (those gerbv_image_return_next_renderable_object()
+ * steps through) which may be in a window, in the order they are drawn.
+ */
+typedef struct {
+    gerbv_net_t *net;		/* The last net returned */
+    gerbv_net_t *next_tail;	/* The first net after the indexed ones */
+    struct gerb_net_index *index; /* NULL to step through all nets */
+    gulong *visible;		/* A bit for each indexed net to return */
+    guint word;			/* The word of visible being returned */
+    gboolean tail;		/* Past the indexed nets */
+} gerb_index_iter_t;
+
+/*
+ * Start stepping through the nets of image which may be drawn in window,
+ * building the index of the image first if needed.  With window NULL,
+ * all nets are returned.  Besides the nets whose bounding box (repeated
+ * by the step and repeat of their layer) is near window, every net
+ * starting a new layer or netstate is returned, so a caller switching
+ * transformations at them sees the same switches as without the window.
+ * Nets added to the image after the index was built are all returned.
+ */
+void gerb_index_iter_init(gerb_index_iter_t *iter, gerbv_image_t *image,
+			  const gerbv_render_size_t *window);
+
+/* The next net, or NULL after the last */
+gerbv_net_t *gerb_index_iter_next(gerb_index_iter_t *iter);
+
+void gerb_index_iter_clear(gerb_index_iter_t *iter);
+
+void gerb_index_destroy(struct gerb_net_index *index);
+
+/*
+ * Map window, in the coordinates a layer is displayed at, back through
+ * transform to those of its image.  The result is the bounding box of the
+ * mapped window.  FALSE if transform scales by (nearly) 0.
+ */
+gboolean gerb_index_untransform_window(gerbv_render_size_t *window,
+		const gerbv_user_transformation_t *transform);
+
+#endif /* GERB_INDEX_H */
@@ -33,10 +33,23 @@
 #include <math.h>
 
 #include "common.h"
+#include "gerb_image.h"
 #include "gerb_stats.h"
 
 #define dprintf if(DEBUG) printf
 
+typedef struct {
+    gerbv_message_sink_t func;
+    gpointer user_data;
+} message_sink_t;
+
+/* Set before parsing starts; parses running on other threads only read it */
+static gboolean parse_stats_enabled = FALSE;
+static guint error_list_limit = 1000;
+
+/* Each thread (and so each parse running on it) may have its own sink */
+static GPrivate message_sink_key = G_PRIVATE_INIT (g_free);
+
 /* ------------------------------------------------------- */
 /** Allocates a new gerbv_stats structure
    @return gerbv_stats pointer on success, NULL on ERROR */
@@ -78,6 +91,8 @@ void
 gerbv_destroy_error_list (gerbv_error_list_t *errorList) {
 	gerbv_error_list_t *nextError=errorList,*tempError;
 	
+	if (errorList)
+		gerb_stats_index_destroy (errorList->index);
 	while (nextError) {
 		tempError = nextError->next;
 		g_free (nextError->error_text);
@@ -90,6 +105,8 @@ void
 gerbv_destroy_aperture_list (gerbv_aperture_list_t *apertureList) {
 	gerbv_aperture_list_t *nextAperture=apertureList,*tempAperture;
 	
+	if (apertureList)
+		gerb_stats_index_destroy (apertureList->index);
 	while (nextAperture) {
 		tempAperture = nextAperture->next;
 		g_free (nextAperture);
@@ -123,7 +140,6 @@ gerbv_stats_add_layer(gerbv_stats_t *accum_stats,
     
     dprintf("---> Entering gerbv_stats_add_layer ... \n");
 
-    gerbv_error_list_t *error;
     gerbv_aperture_list_t *aperture;
     gerbv_aperture_list_t *D_code;
 
@@ -185,16 +201,8 @@ gerbv_stats_add_layer(gerbv_stats_t *accum_stats,
     accum_stats->unknown += input_stats->unknown;
 
     /* ==== Now deal with the error list ==== */
-    for (error = input_stats->error_list;
-         error != NULL;
-         error = error->next) {
-        if (error->error_text != NULL) {
-            gerbv_stats_add_error(accum_stats->error_list,
-                                  this_layer,
-                                  error->error_text,
-                                  error->type);
-        }
-    }
+    gerb_stats_merge_errors(accum_stats->error_list,
+			    input_stats->error_list, this_layer);
 
     /* ==== Now deal with the aperture list ==== */
     for (aperture = input_stats->aperture_list;
@@ -227,22 +235,243 @@ gerbv_stats_new_error_list() {
     error_list->layer = -1;
     error_list->error_text = NULL;
     error_list->next = NULL;
+    error_list->count = 0;
+    error_list->index = NULL;
     return error_list;
 }
 
+/* ------------------------------------------------------- */
+void
+gerbv_set_error_list_limit(guint limit)
+{
+    error_list_limit = limit;
+}
+
+/* ------------------------------------------------------- */
+void
+gerbv_set_message_sink(gerbv_message_sink_t func, gpointer user_data)
+{
+    message_sink_t *sink = g_private_get (&message_sink_key);
+
+    if (sink == NULL) {
+        if (func == NULL)
+            return;
+
+        sink = g_new (message_sink_t, 1);
+        g_private_set (&message_sink_key, sink);
+    }
+
+    sink->func = func;
+    sink->user_data = user_data;
+}
+
+/* ------------------------------------------------------- */
+/* Messages are the same if they have the same text, on the same layer */
+static guint
+error_hash(gconstpointer data)
+{
+    const gerbv_error_list_t *error = data;
+
+    return g_str_hash(error->error_text)
+	    ^ ((guint)error->layer * 31) ^ ((guint)error->type << 24);
+}
+
+static gboolean
+error_equal(gconstpointer a, gconstpointer b)
+{
+    const gerbv_error_list_t *error_a = a, *error_b = b;
+
+    return error_a->layer == error_b->layer && error_a->type == error_b->type
+	&& strcmp(error_a->error_text, error_b->error_text) == 0;
+}
+
+/* ------------------------------------------------------- */
+/* The index of list, built on first use */
+static struct gerb_stats_index *
+error_list_index(gerbv_error_list_t *list)
+{
+    gerbv_error_list_t *error;
+
+    if (list->index != NULL)
+	return list->index;
+
+    list->index = g_new0(struct gerb_stats_index, 1);
+    list->index->table = g_hash_table_new(error_hash, error_equal);
+    for (error = list; error != NULL; error = error->next) {
+	if (error->error_text != NULL
+	&&  !g_hash_table_contains(list->index->table, error))
+	    g_hash_table_add(list->index->table, error);
+	list->index->last = error;
+    }
+
+    return list->index;
+}
+
+/* ------------------------------------------------------- */
+static gerbv_error_list_t *
+error_list_lookup(gerbv_error_list_t *list, int layer,
+		  gerbv_message_type_t type, const gchar *text)
+{
+    gerbv_error_list_t key;
+
+    key.layer = layer;
+    key.type = type;
+    key.error_text = (gchar *)text;
+
+    return g_hash_table_lookup(error_list_index(list)->table, &key);
+}
+
+/* ------------------------------------------------------- */
+static void
+error_count(gerbv_error_list_t *error, int count,
+	    long first_line, long last_line)
+{
+    error->count += count;
+    if (error->first_line == 0)
+	error->first_line = first_line;
+    if (last_line != 0)
+	error->last_line = last_line;
+}
+
+/* ------------------------------------------------------- */
+static gboolean
+error_list_full(gerbv_error_list_t *list)
+{
+    return error_list_limit != 0
+	&& g_hash_table_size(error_list_index(list)->table) >= error_list_limit;
+}
+
+/* ------------------------------------------------------- */
+/* Log text, or send it to the message sink of this thread */
+static void
+error_emit(gerbv_message_type_t type, const char *text)
+{
+    message_sink_t *sink = g_private_get (&message_sink_key);
+
+    /* Replace embedded error messages */
+    if (type != GERBV_MESSAGE_FATAL && sink != NULL && sink->func != NULL) {
+        sink->func (type, text, sink->user_data);
+    } else {
+        switch (type) {
+            case GERBV_MESSAGE_FATAL:
+                GERB_FATAL_ERROR("%s",text);
+                break;
+            case GERBV_MESSAGE_ERROR:
+                GERB_COMPILE_ERROR("%s",text);
+                break;
+            case GERBV_MESSAGE_WARNING:
+                GERB_COMPILE_WARNING("%s",text);
+                break;
+            case GERBV_MESSAGE_NOTE:
+                break;
+        }
+    }
+}
+
+/* ------------------------------------------------------- */
+/* Count a message, which is only stored and logged the first time.
+ * Past error_list_limit messages a new one is counted in a last message
+ * saying so. */
+static void
+error_list_add(gerbv_error_list_t *list, int layer,
+	       gerbv_message_type_t type, const gchar *text,
+	       int count, long first_line, long last_line)
+{
+    struct gerb_stats_index *index = error_list_index(list);
+    gerbv_error_list_t *error;
+
+    error = error_list_lookup(list, layer, type, text);
+    if (error != NULL) {
+	error_count(error, count, first_line, last_line);
+	return;
+    }
+
+    if (error_list_full(list)) {
+	type = GERBV_MESSAGE_WARNING;
+	text = _("Further messages were only counted");
+	error = error_list_lookup(list, layer, type, text);
+	if (error != NULL) {
+	    error_count(error, count, first_line, last_line);
+	    return;
+	}
+    }
+
+    error_emit(type, text);
+
+    /* First handle case where this is the first list element */
+    if (list->error_text == NULL) {
+	error = list;
+    } else {
+	/* Now malloc space for new error list element */
+	if (NULL == (error = g_new0(gerbv_error_list_t, 1))) {
+	    GERB_FATAL_ERROR("malloc error_list failed in %s()", __FUNCTION__);
+	}
+	((gerbv_error_list_t *)index->last)->next = error;
+	index->last = error;
+    }
+
+    /* Set member elements */
+    error->layer = layer;
+    error->error_text = g_strdup(text);
+    error->type = type;
+    error->next = NULL;
+    error->count = 0;
+    error->first_line = 0;
+    error->last_line = 0;
+    error_count(error, count, first_line, last_line);
+    g_hash_table_add(index->table, error);
+}
+
+/* ------------------------------------------------------- */
+static void
+stats_vprintf(gerbv_error_list_t *list, gerbv_message_type_t type,
+	      int layer, long line, const char *text, va_list args)
+{
+    gchar *str = g_strdup_vprintf(text, args);
+
+    /* Repeated messages are counted without printing them again */
+    error_list_add(list, layer, type, str, 1, line, line);
+    g_free(str);
+}
+
 /* ------------------------------------------------------- */
 void
 gerbv_stats_printf(gerbv_error_list_t *list, gerbv_message_type_t type,
 			int layer, const char *text, ...)
 {
-    gchar *str;
     va_list args;
 
     va_start(args, text);
-    str = g_strdup_vprintf(text, args);
+    stats_vprintf(list, type, layer, 0, text, args);
     va_end(args);
-    gerbv_stats_add_error(list, layer, str, type);
-    g_free(str);
+}
+
+/* ------------------------------------------------------- */
+/*! Like gerbv_stats_printf(), for a message about line of the file */
+void
+gerbv_stats_printf_line(gerbv_error_list_t *list, gerbv_message_type_t type,
+			int layer, long line, const char *text, ...)
+{
+    va_list args;
+
+    va_start(args, text);
+    stats_vprintf(list, type, layer, line, text, args);
+    va_end(args);
+}
+
+/* ------------------------------------------------------- */
+/*! Add the messages of input to accum, as those of layer */
+void
+gerb_stats_merge_errors(gerbv_error_list_t *accum, gerbv_error_list_t *input,
+			int layer)
+{
+    gerbv_error_list_t *error;
+
+    for (error = input; error != NULL; error = error->next) {
+	if (error->error_text != NULL)
+	    error_list_add(accum, layer, error->type, error->error_text, MAX(error->count, 1),
+			   error->first_line, error->last_line);
+    }
 }
 
 /** Escape special ASCII char ('\n', '\0'). Return C string with escaped
@@ -302,57 +531,7 @@ gerbv_stats_add_error(gerbv_error_list_t *error_list_in,
                       int layer, const char *error_text,
                       gerbv_message_type_t type) {
 
-    gerbv_error_list_t *error_list_new;
-    gerbv_error_list_t *error_last = NULL;
-    gerbv_error_list_t *error;
-
-    /* Replace embedded error messages */
-    switch (type) {
-        case GERBV_MESSAGE_FATAL:
-            GERB_FATAL_ERROR("%s",error_text);
-            break;
-        case GERBV_MESSAGE_ERROR:
-            GERB_COMPILE_ERROR("%s",error_text);
-            break;
-        case GERBV_MESSAGE_WARNING:
-            GERB_COMPILE_WARNING("%s",error_text);
-            break;
-        case GERBV_MESSAGE_NOTE:
-            break;
-    }
-
-    /* First handle case where this is the first list element */
-    if (error_list_in->error_text == NULL) {
-        error_list_in->layer = layer;
-        error_list_in->error_text = g_strdup_printf("%s", error_text);
-        error_list_in->type = type;
-        error_list_in->next = NULL;
-        return;
-    }
-
-    /* Next check to see if this error is already in the list */
-    for(error = error_list_in; error != NULL; error = error->next) {
-        if ((strcmp(error->error_text, error_text) == 0) &&
-            (error->layer == layer) ) {
-            return;  /* This error text is already in the error list */
-        }
-        error_last = error;  /* point to last element in error list */
-    }
-    /* This error text is unique.  Therefore, add it to the list */
-
-    /* Now malloc space for new error list element */
-    if (NULL == (error_list_new = g_new(gerbv_error_list_t, 1))) {
-        GERB_FATAL_ERROR("malloc error_list failed in %s()", __FUNCTION__);
-    }
-
-    /* Set member elements */
-    error_list_new->layer = layer;
-    error_list_new->error_text = g_strdup_printf("%s", error_text);
-    error_list_new->type = type;
-    error_list_new->next = NULL;
-    error_last->next = error_list_new;
-
-    return;
+    error_list_add(error_list_in, layer, type, error_text, 1, 0, 0);
 }
 
 /* ------------------------------------------------------- */
@@ -376,23 +555,104 @@ gerbv_stats_new_aperture_list() {
 	aperture_list->parameter[i] = 0.0;
     }
     aperture_list->next = NULL;
+    aperture_list->index = NULL;
     return aperture_list;
 }
 
 
+/* ------------------------------------------------------- */
+struct gerb_stats_index *
+gerb_stats_index_new(void)
+{
+    struct gerb_stats_index *index = g_new0(struct gerb_stats_index, 1);
+
+    index->table = g_hash_table_new_full(g_int64_hash, g_int64_equal,
+					 g_free, NULL);
+
+    return index;
+}
+
+/* ------------------------------------------------------- */
+void
+gerb_stats_index_destroy(struct gerb_stats_index *index)
+{
+    if (index == NULL)
+	return;
+    g_hash_table_destroy(index->table);
+    g_free(index);
+}
+
+/* ------------------------------------------------------- */
+static gint64
+gerb_stats_index_key(int number, int layer)
+{
+    return (gint64)(((guint64)(guint32)layer << 32) | (guint32)number);
+}
+
+/* ------------------------------------------------------- */
+/*! The element with number (and layer), or NULL */
+gpointer
+gerb_stats_index_lookup(struct gerb_stats_index *index, int number, int layer)
+{
+    gint64 key = gerb_stats_index_key(number, layer);
+
+    return g_hash_table_lookup(index->table, &key);
+}
+
+/* ------------------------------------------------------- */
+/*! Add element to index; the first one added for a key is kept, as
+ * walking the list would find it first */
+void
+gerb_stats_index_insert(struct gerb_stats_index *index,
+			int number, int layer, gpointer element)
+{
+    gint64 key = gerb_stats_index_key(number, layer);
+    gint64 *stored;
+
+    if (g_hash_table_contains(index->table, &key))
+	return;
+
+    stored = g_new(gint64, 1);
+    *stored = key;
+    g_hash_table_insert(index->table, stored, element);
+}
+
+/* ------------------------------------------------------- */
+/*! The index of list, built on first use.  The apertures are looked up
+ * by number and layer, the D codes only by number. */
+static struct gerb_stats_index *
+aperture_list_index(gerbv_aperture_list_t *list, gboolean byLayer)
+{
+    gerbv_aperture_list_t *aperture;
+
+    if (list->index != NULL)
+	return list->index;
+
+    list->index = gerb_stats_index_new();
+    for (aperture = list; aperture != NULL; aperture = aperture->next) {
+	if (aperture->number != -1)
+	    gerb_stats_index_insert(list->index, aperture->number,
+				    byLayer ? aperture->layer : 0, aperture);
+	list->index->last = aperture;
+    }
+
+    return list->index;
+}
+
 /* ------------------------------------------------------- */
 void
 gerbv_stats_add_aperture(gerbv_aperture_list_t *aperture_list_in,
 			int layer, int number, gerbv_aperture_type_t type,
 			double parameter[5]) {
 
+    struct gerb_stats_index *index;
     gerbv_aperture_list_t *aperture_list_new;
-    gerbv_aperture_list_t *aperture_last = NULL;
-    gerbv_aperture_list_t *aperture;
     int i;
 
     dprintf("   --->  Entering gerbv_stats_add_aperture ....\n"); 
 
+    index = aperture_list_index(aperture_list_in, TRUE);
+
     /* First handle case where this is the first list element */
     if (aperture_list_in->number == -1) {
 	dprintf("     .... Adding first aperture to aperture list ... \n"); 
@@ -404,28 +664,23 @@ gerbv_stats_add_aperture(gerbv_aperture_list_t *aperture_list_in,
 	    aperture_list_in->parameter[i] = parameter[i];
 	}
         aperture_list_in->next = NULL;
+	gerb_stats_index_insert(index, number, layer, aperture_list_in);
 	dprintf("   <---  .... Leaving gerbv_stats_add_aperture.\n"); 
         return;
     }
 
     /* Next check to see if this aperture is already in the list */
-    for(aperture = aperture_list_in; 
-	aperture != NULL; 
-	aperture = aperture->next) {
-        if ((aperture->number == number) &&
-            (aperture->layer == layer) ) {
-	  dprintf("     .... This aperture is already in the list ... \n"); 
-	    dprintf("   <---  .... Leaving gerbv_stats_add_aperture.\n"); 
-            return;  
-        }
-        aperture_last = aperture;  /* point to last element in list */
+    if (gerb_stats_index_lookup(index, number, layer) != NULL) {
+	dprintf("     .... This aperture is already in the list ... \n"); 
+	dprintf("   <---  .... Leaving gerbv_stats_add_aperture.\n"); 
+	return;  
     }
     /* This aperture number is unique.  Therefore, add it to the list */
     dprintf("     .... Adding another aperture to list ... \n"); 
     dprintf("     .... Aperture type = %d ... \n", type); 
 	
     /* Now malloc space for new aperture list element */
-    if (NULL == (aperture_list_new = g_new(gerbv_aperture_list_t, 1))) {
+    if (NULL == (aperture_list_new = g_new0(gerbv_aperture_list_t, 1))) {
         GERB_FATAL_ERROR("malloc aperture_list failed in %s()", __FUNCTION__);
     }
 
@@ -437,7 +692,9 @@ gerbv_stats_add_aperture(gerbv_aperture_list_t *aperture_list_in,
     for(i=0; i<5; i++) { 
 	aperture_list_new->parameter[i] = parameter[i];
     }
-    aperture_last->next = aperture_list_new;
+    ((gerbv_aperture_list_t *)index->last)->next = aperture_list_new;
+    index->last = aperture_list_new;
+    gerb_stats_index_insert(index, number, layer, aperture_list_new);
 
     dprintf("   <---  .... Leaving gerbv_stats_add_aperture.\n"); 
 
@@ -449,12 +706,13 @@ void
 gerbv_stats_add_to_D_list(gerbv_aperture_list_t *D_list_in,
 			 int number) {
   
-  gerbv_aperture_list_t *D_list;
-  gerbv_aperture_list_t *D_list_last=NULL;
-  gerbv_aperture_list_t *D_list_new;
+    struct gerb_stats_index *index;
+    gerbv_aperture_list_t *D_list_new;
 
     dprintf("   ----> Entering add_to_D_list, numbr = %d\n", number);
 
+    index = aperture_list_index(D_list_in, FALSE);
+
     /* First handle case where this is the first list element */
     if (D_list_in->number == -1) {
 	dprintf("     .... Adding first D code to D code list ... \n"); 
@@ -462,27 +720,23 @@ gerbv_stats_add_to_D_list(gerbv_aperture_list_t *D_list_in,
         D_list_in->number = number;
 	D_list_in->count = 0;
         D_list_in->next = NULL;
+	gerb_stats_index_insert(index, number, 0, D_list_in);
 	dprintf("   <---  .... Leaving add_to_D_list.\n"); 
         return;
     }
 
     /* Look to see if this is already in list */
-    for(D_list = D_list_in; 
-	D_list != NULL; 
-	D_list = D_list->next) {
-        if (D_list->number == number) {
-  	    dprintf("    .... Found in D list .... \n");
-	    dprintf("   <---  .... Leaving add_to_D_list.\n"); 
-            return;  
-        }
-        D_list_last = D_list;  /* point to last element in list */
+    if (gerb_stats_index_lookup(index, number, 0) != NULL) {
+	dprintf("    .... Found in D list .... \n");
+	dprintf("   <---  .... Leaving add_to_D_list.\n"); 
+	return;  
     }
 
     /* This aperture number is unique.  Therefore, add it to the list */
     dprintf("     .... Adding another D code to D code list ... \n"); 
 	
     /* Malloc space for new aperture list element */
-    if (NULL == (D_list_new = g_new(gerbv_aperture_list_t, 1))) {
+    if (NULL == (D_list_new = g_new0(gerbv_aperture_list_t, 1))) {
         GERB_FATAL_ERROR("malloc D_list failed in %s()", __FUNCTION__);
     }
 
@@ -490,7 +744,9 @@ gerbv_stats_add_to_D_list(gerbv_aperture_list_t *D_list_in,
     D_list_new->number = number;
     D_list_new->count = 0;
     D_list_new->next = NULL;
-    D_list_last->next = D_list_new;
+    ((gerbv_aperture_list_t *)index->last)->next = D_list_new;
+    index->last = D_list_new;
+    gerb_stats_index_insert(index, number, 0, D_list_new);
 
     dprintf("   <---  .... Leaving add_to_D_list.\n"); 
 
@@ -509,15 +765,15 @@ gerbv_stats_increment_D_list_count(gerbv_aperture_list_t *D_list_in,
     dprintf("   Entering inc_D_list_count, code = D%d, input count to add = %d\n", number, count);
 
     /* Find D code in list and increment it */
-    for(D_list = D_list_in; 
-	D_list != NULL; 
-	D_list = D_list->next) {
-        if (D_list->number == number) {
-	    dprintf("    old count = %d\n", D_list->count);
-	    D_list->count += count;  /* Add to this aperture count, then return */
-	    dprintf("    updated count = %d\n", D_list->count);
-            return 0;  /* Return 0 for success */  
-        }
+    D_list = NULL;
+    if (D_list_in != NULL)
+	D_list = gerb_stats_index_lookup(aperture_list_index(D_list_in, FALSE),
+					 number, 0);
+    if (D_list != NULL) {
+	dprintf("    old count = %d\n", D_list->count);
+	D_list->count += count;  /* Add to this aperture count, then return */
+	dprintf("    updated count = %d\n", D_list->count);
+	return 0;  /* Return 0 for success */  
     }
 
     /* This D number is not defined.  Therefore, flag error */
@@ -529,4 +785,87 @@ gerbv_stats_increment_D_list_count(gerbv_aperture_list_t *D_list_in,
 
     return -1;  /* Return -1 for failure */
 }
+/* ------------------------------------------------------- */
+void
+gerbv_set_parse_stats(gboolean enabled)
+{
+    parse_stats_enabled = enabled;
+}
 
+/* ------------------------------------------------------- */
+/*! Start counting how image is parsed from a file of bytes bytes, if
+ * gerbv_set_parse_stats() is on.  start is the g_get_monotonic_time()
+ * when parsing started.  */
+void
+gerb_parse_stats_begin(gerbv_image_t *image, goffset bytes, gint64 start)
+{
+    gerbv_parse_stats_t *stats;
+
+    if (!parse_stats_enabled || image == NULL || image->parse_stats != NULL)
+	return;
+
+    stats = g_new0(gerbv_parse_stats_t, 1);
+    stats->bytes = bytes;
+    stats->mark = start;
+    stats->current = &stats->other_usec;
+    image->parse_stats = stats;
+}
+
+/* ------------------------------------------------------- */
+/*! Charge the time since the last code to it, and time code from now.
+ * letter is 'G', 'D' or 'M'; the time of anything else is other_usec. */
+void
+gerb_parse_stats_switch(gerbv_parse_stats_t *stats, char letter, int code)
+{
+    gint64 now = g_get_monotonic_time();
+
+    *stats->current += now - stats->mark;
+    stats->mark = now;
+
+    code = CLAMP(code, 0, GERBV_PARSE_STATS_CODES - 1);
+    switch (letter) {
+    case 'G':
+	stats->current = &stats->G_usec[code];
+	break;
+    case 'D':
+	stats->current = &stats->D_usec[code];
+	break;
+    case 'M':
+	stats->current = &stats->M_usec[code];
+	break;
+    default:
+	stats->current = &stats->other_usec;
+    }
+}
+
+/* ------------------------------------------------------- */
+/*! Stop the clock of image and count what it holds */
+void
+gerb_parse_stats_end(gerbv_image_t *image)
+{
+    gerbv_parse_stats_t *stats;
+    gerbv_net_t *net;
+    gint64 now;
+
+    if (image == NULL || image->parse_stats == NULL)
+	return;
+
+    stats = image->parse_stats;
+    now = g_get_monotonic_time();
+    *stats->current += now - stats->mark;
+    stats->mark = now;
+    stats->current = &stats->other_usec;
+
+    stats->usec = stats->other_usec;
+    for (int i = 0; i < GERBV_PARSE_STATS_CODES; i++)
+	stats->usec += stats->G_usec[i] + stats->D_usec[i] + stats->M_usec[i];
+
+    /* The first net is the empty one every image starts with */
+    stats->nets = 0;
+    for (net = image->netlist; net != NULL; net = net->next)
+	stats->nets++;
+    if (stats->nets > 0)
+	stats->nets--;
+
+    stats->peak_alloc = gerb_image_arena_size(image);
+}
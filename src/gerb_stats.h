@@ -29,6 +29,14 @@
 #ifndef gerb_stats_H
 #define gerb_stats_H
 
+/* Lookup of the elements of an aperture, D code or drill list by number
+ * (and layer), kept on the first element of the list.  The lists are
+ * still what the stats report; this only spares walking them for every
+ * aperture defined and every flash or drill hit counted. */
+struct gerb_stats_index {
+    GHashTable *table;	/* The key of each element -> the element */
+    gpointer last;	/* The last element, to append after */
+};
 
 
 /* ===================  Prototypes ================ */
@@ -36,9 +44,15 @@ gerbv_error_list_t *gerbv_stats_new_error_list(void);
 void gerbv_stats_printf(gerbv_error_list_t *list, gerbv_message_type_t type,
 			int layer, const char *text, ...)
 					__attribute__ ((format (printf, 4, 5)));
+void gerbv_stats_printf_line(gerbv_error_list_t *list,
+			gerbv_message_type_t type, int layer, long line,
+			const char *text, ...)
+					__attribute__ ((format (printf, 5, 6)));
 void gerbv_stats_add_error(gerbv_error_list_t *error_list_in,
                            int layer, const char *error_text,
                            gerbv_message_type_t type);
+void gerb_stats_merge_errors(gerbv_error_list_t *accum,
+			     gerbv_error_list_t *input, int layer);
 #define gerbv_escape_char(c) \
 	((char*)(int[]){gerbv_escape_char_return_int((c))})
 int gerbv_escape_char_return_int(char c);
@@ -54,4 +68,21 @@ int gerbv_stats_increment_D_list_count(gerbv_aperture_list_t *D_list_in,
 				       int count,
 				       gerbv_error_list_t *error); 
 
+struct gerb_stats_index *gerb_stats_index_new(void);
+void gerb_stats_index_destroy(struct gerb_stats_index *index);
+gpointer gerb_stats_index_lookup(struct gerb_stats_index *index,
+				 int number, int layer);
+void gerb_stats_index_insert(struct gerb_stats_index *index,
+			     int number, int layer, gpointer element);
+
+void gerb_parse_stats_begin(gerbv_image_t *image, goffset bytes, gint64 start);
+void gerb_parse_stats_switch(gerbv_parse_stats_t *stats, char letter, int code);
+void gerb_parse_stats_end(gerbv_image_t *image);
+/* Time the code just read, if image is counting */
+#define gerb_parse_stats_code(image, letter, code) \
+	do { \
+	    if ((image)->parse_stats != NULL) \
+		gerb_parse_stats_switch((image)->parse_stats, (letter), (code)); \
+	} while (0)
+
 #endif /* gerb_stats_H */
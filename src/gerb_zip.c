@@ -0,0 +1,296 @@
+/*
+ * gEDA - GNU Electronic Design Automation
+ * This file is a part of gerbv.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111 USA
+ */
+
+/** \file gerb_zip.c
+    \brief Reading the files in a zip archive
+    \ingroup libgerbv
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <glib/gstdio.h>
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+#include "common.h"
+#include "gerbv.h"
+#include "gerb_zip.h"
+
+/* DEBUG printing.  #define DEBUG 1 in config.h to use this fcn. */
+#define dprintf if(DEBUG) printf
+
+/* Signatures and sizes of the zip records used here */
+#define ZIP_LOCAL_SIG	0x04034b50
+#define ZIP_LOCAL_LEN	30
+#define ZIP_CENTRAL_SIG	0x02014b50
+#define ZIP_CENTRAL_LEN	46
+#define ZIP_END_SIG	0x06054b50
+#define ZIP_END_LEN	22
+
+#define ZIP_STORED	0
+#define ZIP_DEFLATED	8
+
+/* Zip numbers are little endian, whatever the host */
+#define ZIP_U16(p) ((guint16)((const guchar *)(p))[0] \
+		| (guint16)((const guchar *)(p))[1] << 8)
+#define ZIP_U32(p) ((guint32)ZIP_U16(p) | (guint32)ZIP_U16((p) + 2) << 16)
+
+gboolean
+gerb_zip_p(char const *filename)
+{
+#ifdef HAVE_ZLIB
+    unsigned char head[4];
+    gboolean is_zip;
+    GStatBuf statinfo;
+    FILE *fp;
+
+    /* Don't eat the start of a pipe */
+    if (g_stat(filename, &statinfo) != 0 || !S_ISREG(statinfo.st_mode))
+	return FALSE;
+
+    fp = g_fopen(filename, "rb");
+    if (fp == NULL)
+	return FALSE;
+
+    is_zip = (fread(head, 1, sizeof(head), fp) == sizeof(head)
+	    && ZIP_U32(head) == ZIP_LOCAL_SIG);
+    fclose(fp);
+
+    return is_zip;
+#else
+    return FALSE;
+#endif
+} /* gerb_zip_p */
+
+
+gerb_zip_t *
+gerb_zip_open(char const *filename)
+{
+#ifdef HAVE_ZLIB
+    gerb_zip_t *zip;
+    const char *data, *p;
+    goffset len, end, pos;
+    guint n_entries, i;
+
+    dprintf("---> Entering gerb_zip_open, filename = %s\n", filename);
+
+    zip = g_new0(gerb_zip_t, 1);
+    zip->members = g_array_new(FALSE, FALSE, sizeof(gerb_zip_member_t));
+
+    zip->fd = gerb_fopen(filename);
+    if (zip->fd == NULL)
+	goto error;
+
+    /* The members are unpacked on several threads at once, so the window
+     * must never move */
+    data = zip->fd->data;
+    len = zip->fd->datalen;
+    if (zip->fd->window != 0 || (goffset)zip->fd->window_len != len
+	    || len < ZIP_END_LEN) {
+	errno = EFBIG;
+	goto error;
+    }
+
+    /* The end of central directory record is followed by a comment of at
+     * most 64k */
+    for (end = len - ZIP_END_LEN;
+	    end >= 0 && end >= len - ZIP_END_LEN - 0xffff; end--) {
+	if (ZIP_U32(data + end) == ZIP_END_SIG)
+	    break;
+    }
+    if (end < 0 || end < len - ZIP_END_LEN - 0xffff) {
+	dprintf("     No end of central directory\n");
+	errno = EINVAL;
+	goto error;
+    }
+
+    n_entries = ZIP_U16(data + end + 10);
+    pos = ZIP_U32(data + end + 16);
+
+    for (i = 0; i < n_entries; i++) {
+	gerb_zip_member_t member;
+	guint flags, name_len, extra_len, comment_len;
+	goffset local;
+
+	if (pos + ZIP_CENTRAL_LEN > end
+		|| ZIP_U32(data + pos) != ZIP_CENTRAL_SIG) {
+	    dprintf("     Bad central directory entry %u\n", i);
+	    errno = EINVAL;
+	    goto error;
+	}
+
+	p = data + pos;
+	flags = ZIP_U16(p + 8);
+	member.method = ZIP_U16(p + 10);
+	member.crc = ZIP_U32(p + 16);
+	member.size = ZIP_U32(p + 20);
+	member.length = ZIP_U32(p + 24);
+	name_len = ZIP_U16(p + 28);
+	extra_len = ZIP_U16(p + 30);
+	comment_len = ZIP_U16(p + 32);
+	local = ZIP_U32(p + 42);
+
+	if (pos + ZIP_CENTRAL_LEN + name_len > end) {
+	    errno = EINVAL;
+	    goto error;
+	}
+	member.name = g_strndup(p + ZIP_CENTRAL_LEN, name_len);
+	pos += ZIP_CENTRAL_LEN + name_len + extra_len + comment_len;
+
+	/* Skip directories, resource forks added by Mac OS, encrypted
+	 * files, zip64 entries and compression we can't undo */
+	if (name_len == 0 || member.name[name_len - 1] == '/'
+		|| g_str_has_prefix(member.name, "__MACOSX/")
+		|| (flags & 1)
+		|| member.size == 0xffffffff || member.length == 0xffffffff
+		|| (member.method != ZIP_STORED
+		    && member.method != ZIP_DEFLATED)
+		|| local + ZIP_LOCAL_LEN > len
+		|| ZIP_U32(data + local) != ZIP_LOCAL_SIG) {
+	    dprintf("     Skipping %s\n", member.name);
+	    g_free(member.name);
+	    continue;
+	}
+
+	/* The local header has its own name and extra field lengths */
+	member.offset = local + ZIP_LOCAL_LEN
+	    + ZIP_U16(data + local + 26) + ZIP_U16(data + local + 28);
+	if (member.offset + (goffset)member.size > len) {
+	    dprintf("     %s is cut short\n", member.name);
+	    g_free(member.name);
+	    continue;
+	}
+
+	g_array_append_val(zip->members, member);
+    }
+
+    dprintf("<--- Leaving gerb_zip_open, %u members\n", zip->members->len);
+    return zip;
+
+error:
+    gerb_zip_close(zip);
+    return NULL;
+#else
+    errno = ENOTSUP;
+    return NULL;
+#endif
+} /* gerb_zip_open */
+
+
+char *
+gerb_zip_inflate(gerb_zip_t *zip, guint i)
+{
+#ifdef HAVE_ZLIB
+    gerb_zip_member_t *member;
+    const char *in;
+    char *out;
+
+    g_return_val_if_fail(i < zip->members->len, NULL);
+
+    member = &g_array_index(zip->members, gerb_zip_member_t, i);
+    in = zip->fd->data + member->offset;
+
+    out = g_try_malloc(member->length + 1);
+    if (out == NULL)
+	return NULL;
+
+    if (member->method == ZIP_STORED) {
+	if (member->size != member->length) {
+	    g_free(out);
+	    return NULL;
+	}
+	memcpy(out, in, member->length);
+    } else {
+	z_stream zs;
+	int ret;
+
+	memset(&zs, 0, sizeof(zs));
+	/* -MAX_WBITS: raw deflate data, without a zlib header */
+	if (inflateInit2(&zs, -MAX_WBITS) != Z_OK) {
+	    g_free(out);
+	    return NULL;
+	}
+	zs.next_in = (unsigned char *)in;
+	zs.avail_in = member->size;
+	zs.next_out = (unsigned char *)out;
+	zs.avail_out = member->length;
+	ret = inflate(&zs, Z_FINISH);
+	inflateEnd(&zs);
+
+	if (ret != Z_STREAM_END || zs.total_out != member->length) {
+	    dprintf("     inflate of %s: %d\n", member->name, ret);
+	    g_free(out);
+	    return NULL;
+	}
+    }
+
+    if (crc32(crc32(0, NULL, 0), (unsigned char *)out, member->length)
+	    != member->crc) {
+	dprintf("     CRC of %s does not match\n", member->name);
+	g_free(out);
+	return NULL;
+    }
+
+    out[member->length] = '\0';
+
+    return out;
+#else
+    return NULL;
+#endif
+} /* gerb_zip_inflate */
+
+
+gint
+gerb_zip_find(gerb_zip_t *zip, char const *name)
+{
+    guint i;
+
+    for (i = 0; i < zip->members->len; i++) {
+	if (strcmp(g_array_index(zip->members, gerb_zip_member_t, i).name,
+		    name) == 0)
+	    return i;
+    }
+
+    return -1;
+} /* gerb_zip_find */
+
+
+void
+gerb_zip_close(gerb_zip_t *zip)
+{
+    guint i;
+
+    if (zip == NULL)
+	return;
+
+    for (i = 0; i < zip->members->len; i++)
+	g_free(g_array_index(zip->members, gerb_zip_member_t, i).name);
+    g_array_free(zip->members, TRUE);
+
+    if (zip->fd)
+	gerb_fclose(zip->fd);
+    g_free(zip);
+} /* gerb_zip_close */
@@ -0,0 +1,63 @@
+/*
+ * gEDA - GNU Electronic Design Automation
+ * This file is a part of gerbv.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111 USA
+ */
+
+/** \file gerb_zip.h
+    \brief Header info for reading the files in a zip archive
+    \ingroup libgerbv
+*/
+
+#ifndef GERB_ZIP_H
+#define GERB_ZIP_H
+
+#include <glib.h>
+
+#include "gerb_file.h"
+
+typedef struct {
+    char *name;		/* Path of the file in the archive */
+    goffset offset;	/* Offset of its (compressed) data in the archive */
+    gsize size;		/* Size of the compressed data */
+    gsize length;	/* Size of the file */
+    int method;		/* 0: stored, 8: deflated */
+    guint32 crc;
+} gerb_zip_member_t;
+
+typedef struct {
+    gerb_file_t *fd;	/* The archive, all of it in memory */
+    GArray *members;	/* gerb_zip_member_t, in the order of the archive */
+} gerb_zip_t;
+
+/* TRUE if filename is a zip archive which can be read */
+gboolean gerb_zip_p(char const *filename);
+
+/* Read the directory of a zip archive.  Directories and files which can't
+ * be unpacked (encrypted, unknown compression) are left out. */
+gerb_zip_t *gerb_zip_open(char const *filename);
+
+/* Unpack member i into a new buffer, terminated with a '\0' after
+ * member->length bytes.  Only reads zip, so several members can be
+ * unpacked on different threads at the same time.  NULL on errors. */
+char *gerb_zip_inflate(gerb_zip_t *zip, guint i);
+
+/* Index of the member with the given path, or -1 */
+gint gerb_zip_find(gerb_zip_t *zip, char const *name);
+
+void gerb_zip_close(gerb_zip_t *zip);
+
+#endif /* GERB_ZIP_H */
@@ -50,11 +50,14 @@
 #define MAXL 200
 
 /* Local function prototypes */
+static int gerber_token_int(gerb_file_t *fd, const gerb_token_t *token,
+			    int *len);
 static void parse_G_code(gerb_file_t *fd, gerb_state_t *state, 
-			 gerbv_image_t *image, long int *line_num_p);
+			 gerbv_image_t *image, int op_int,
+			 long int *line_num_p);
 static void parse_D_code(gerb_file_t *fd, gerb_state_t *state, 
-			 gerbv_image_t *image, long int *line_num_p);
-static int parse_M_code(gerb_file_t *fd, gerbv_image_t *image,
+			 gerbv_image_t *image, int a, long int *line_num_p);
+static int parse_M_code(gerb_file_t *fd, gerbv_image_t *image, int op_int,
 			long int *line_num_p);
 static void parse_rs274x(gint levelOfRecursion, gerb_file_t *fd, 
 			 gerbv_image_t *image, gerb_state_t *state, 
@@ -70,26 +73,31 @@ static void calc_cirseg_mq(struct gerbv_net *net, int cw,
 			   double delta_cp_x, double delta_cp_y);
 static void calc_cirseg_bbox(const gerbv_cirseg_t *cirseg,
 			double apert_size_x, double apert_size_y,
+			const cairo_matrix_t *matrix,
 			gerbv_render_size_t *bbox);
 
 static void gerber_update_any_running_knockout_measurements(
-							gerbv_image_t *image);
+							gerb_state_t *state);
+static void update_min_and_max(const cairo_matrix_t *matrix,
+			gerbv_render_size_t *boundingBox,
+			gdouble x, gdouble y, gdouble apertureSizeX1,
+			gdouble apertureSizeX2, gdouble apertureSizeY1,
+			gdouble apertureSizeY2);
 
 static void gerber_calculate_final_justify_effects (gerbv_image_t *image);
 
 static gboolean add_trailing_zeros_if_omitted(int *coord, int omitted_num,
 						gerbv_format_t *format);
 
-gboolean knockoutMeasure = FALSE;
-gdouble knockoutLimitXmin, knockoutLimitYmin,
-	knockoutLimitXmax, knockoutLimitYmax;
-gerbv_layer_t *knockoutLayer = NULL;
-cairo_matrix_t currentMatrix;
+/* RS-274X files of at least this size are cut into tokens on worker
+ * threads, see gerbv_set_parallel_parse_threshold() */
+static gsize parallel_parse_threshold = 0;
 
 /* --------------------------------------------------------- */
 gerbv_net_t *
-gerber_create_new_net (gerbv_net_t *currentNet, gerbv_layer_t *layer, gerbv_netstate_t *state){
-	gerbv_net_t *newNet = g_new0 (gerbv_net_t, 1);
+gerber_create_new_net (gerbv_image_t *image, gerbv_net_t *currentNet,
+		gerbv_layer_t *layer, gerbv_netstate_t *state){
+	gerbv_net_t *newNet = gerb_image_new_net (image);
 	
 	currentNet->next = newNet;
 	if (layer)
@@ -107,20 +115,21 @@ gerber_create_new_net (gerbv_net_t *currentNet, gerbv_layer_t *layer, gerbv_nets
 gboolean
 gerber_create_new_aperture (gerbv_image_t *image, int *indexNumber,
 		gerbv_aperture_type_t apertureType, gdouble parameter1, gdouble parameter2){
+	gerbv_aperture_t *aperture;
 	int i;
 	
 	/* search for an available aperture spot */
-	for (i = 0; i <= APERTURE_MAX; i++) {
-		if (image->aperture[i] == NULL) {
-			image->aperture[i] = g_new0 (gerbv_aperture_t, 1);
-			image->aperture[i]->type = apertureType;
-			image->aperture[i]->parameter[0] = parameter1;
-			image->aperture[i]->parameter[1] = parameter2;
-			*indexNumber = i;
-			return TRUE;
-		}
-	}
-	return FALSE;
+	i = gerbv_image_find_unused_aperture_number (0, image);
+	if (i < 0)
+		return FALSE;
+
+	aperture = gerbv_image_new_aperture (image, 2);
+	aperture->type = apertureType;
+	aperture->parameter[0] = parameter1;
+	aperture->parameter[1] = parameter2;
+	gerbv_image_set_aperture (image, i, aperture);
+	*indexNumber = i;
+	return TRUE;
 }
 
 /* --------------------------------------------------------- */
@@ -128,6 +137,9 @@ gerber_create_new_aperture (gerbv_image_t *image, int *indexNumber,
  *  for various Gerber codes (e.g. G, D, etc).  Once it reads 
  *  a code, it then dispatches control to one or another 
  *  bits of code which parse the individual code.
+ *  If the file was cut into tokens ahead (gerb_fprelex_start()),
+ *  it steps through those instead, and reads chars only where
+ *  the code parsed last stopped in the middle of a token.
  *  It also updates the state struct, which holds info about
  *  the current state of the hypothetical photoplotter
  *  (i.e. updates whether the aperture is on or off, updates
@@ -144,13 +156,25 @@ gerber_parse_file_segment (gint levelOfRecursion, gerbv_image_t *image,
     double delta_cp_x = 0.0, delta_cp_y = 0.0;
     double aperture_sizeX, aperture_sizeY;
     double scale;
+    gerbv_aperture_t *aperture;
     gboolean foundEOF = FALSE;
     gerbv_render_size_t boundingBoxNew = {HUGE_VAL,-HUGE_VAL,HUGE_VAL,-HUGE_VAL},
 			boundingBox = boundingBoxNew;
     gerbv_error_list_t *error_list = stats->error_list;
     long int line_num = 1;
+    gerb_token_t token;
+    gboolean lexed;
+
+    while (TRUE) {
+	lexed = (fd->prelex != NULL && gerb_fprelex_next(fd, &token));
+	if (lexed) {
+	    read = token.code;
+	} else {
+	    if ((read = gerb_fgetc(fd)) == EOF)
+		break;
+	    token.has_value = FALSE;
+	}
 
-    while ((read = gerb_fgetc(fd)) != EOF) {
         /* figure out the scale, since we need to normalize 
 	   all dimensions to inches */
         if (state->state->unit == GERBV_UNIT_MM)
@@ -160,30 +184,34 @@ gerber_parse_file_segment (gint levelOfRecursion, gerbv_image_t *image,
 	switch ((char)(read & 0xff)) {
 	case 'G':
 	    dprintf("... Found G code at line %ld\n", line_num);
-	    parse_G_code(fd, state, image, &line_num);
+	    parse_G_code(fd, state, image,
+		    gerber_token_int(fd, &token, NULL), &line_num);
 	    break;
 	case 'D':
 	    dprintf("... Found D code at line %ld\n", line_num);
-	    parse_D_code(fd, state, image, &line_num);
+	    parse_D_code(fd, state, image,
+		    gerber_token_int(fd, &token, NULL), &line_num);
 	    break;
 	case 'M':
 	    dprintf("... Found M code at line %ld\n", line_num);
 
-	    switch(parse_M_code(fd, image, &line_num)) {
+	    switch(parse_M_code(fd, image,
+			gerber_token_int(fd, &token, NULL), &line_num)) {
 	    case 1 :
 	    case 2 :
 	    case 3 :
 		foundEOF = TRUE;
 		break;
 	    default:
-		gerbv_stats_printf(error_list, GERBV_MESSAGE_ERROR, -1,
+		gerbv_stats_printf_line(error_list,
+			GERBV_MESSAGE_ERROR, -1, line_num,
 			_("Unknown M code found at line %ld in file \"%s\""),
 			line_num, fd->filename);
 	    } /* switch(parse_M_code) */
 	    break;
 	case 'X':
 	    stats->X++;
-	    coord = gerb_fgetint(fd, &len);
+	    coord = gerber_token_int(fd, &token, &len);
 	    if (image->format)
 		    add_trailing_zeros_if_omitted(&coord,
 			    image->format->x_int + image->format->x_dec - len,
@@ -200,7 +228,7 @@ gerber_parse_file_segment (gint levelOfRecursion, gerbv_image_t *image,
 
 	case 'Y':
 	    stats->Y++;
-	    coord = gerb_fgetint(fd, &len);
+	    coord = gerber_token_int(fd, &token, &len);
 	    if (image->format)
 		    add_trailing_zeros_if_omitted(&coord,
 			    image->format->y_int + image->format->y_dec - len,
@@ -217,7 +245,7 @@ gerber_parse_file_segment (gint levelOfRecursion, gerbv_image_t *image,
 
 	case 'I':
 	    stats->I++;
-	    coord = gerb_fgetint(fd, &len);
+	    coord = gerber_token_int(fd, &token, &len);
 	    if (image->format)
 		    add_trailing_zeros_if_omitted(&coord,
 			    image->format->x_int + image->format->x_dec - len,
@@ -229,7 +257,7 @@ gerber_parse_file_segment (gint levelOfRecursion, gerbv_image_t *image,
 
 	case 'J':
 	    stats->J++;
-	    coord = gerb_fgetint(fd, &len);
+	    coord = gerber_token_int(fd, &token, &len);
 	    if (image->format)
 		    add_trailing_zeros_if_omitted(&coord,
 			    image->format->y_int + image->format->y_dec - len,
@@ -302,7 +330,7 @@ gerber_parse_file_segment (gint levelOfRecursion, gerbv_image_t *image,
 		state->prev_y = state->curr_y;
 		break;
 	    }
-	    curr_net = gerber_create_new_net (curr_net, state->layer, state->state);
+	    curr_net = gerber_create_new_net (image, curr_net, state->layer, state->state);
 	    /*
 	     * Scale to given coordinate format
 	     * XXX only "omit leading zeros".
@@ -325,7 +353,9 @@ gerber_parse_file_segment (gint levelOfRecursion, gerbv_image_t *image,
 	    case GERBV_INTERPOLATION_CCW_CIRCULAR : {
 		int cw = (state->interpolation == GERBV_INTERPOLATION_CW_CIRCULAR);
 
-		curr_net->cirseg = g_new0 (gerbv_cirseg_t, 1);
+		curr_net->cirseg = gerb_image_new_cirseg (image);
+		if (image->parse_stats != NULL)
+		    image->parse_stats->arcs++;
 		if (state->mq_on) {
 		    calc_cirseg_mq(curr_net, cw, delta_cp_x, delta_cp_y);
 		} else {
@@ -336,8 +366,8 @@ gerber_parse_file_segment (gint levelOfRecursion, gerbv_image_t *image,
 		     * incremental distance must be unsigned.
 		     */
 		    if (delta_cp_x < 0 || delta_cp_y < 0) {
-			gerbv_stats_printf(error_list,
-				GERBV_MESSAGE_ERROR, -1, 
+			gerbv_stats_printf_line(error_list,
+				GERBV_MESSAGE_ERROR, -1, line_num, 
 				_("Signed incremental distance IxJy "
 				    "in single quadrant %s circular "
 				    "interpolation %s at line %ld "
@@ -363,7 +393,8 @@ gerber_parse_file_segment (gint levelOfRecursion, gerbv_image_t *image,
 		if (state->parea_start_node != NULL) {
 		    state->parea_start_node->boundingBox = boundingBox;
 		} else {
-		    gerbv_stats_printf(error_list, GERBV_MESSAGE_ERROR, -1,
+		    gerbv_stats_printf_line(error_list,
+			    GERBV_MESSAGE_ERROR, -1, line_num,
 			    _("End of polygon without start "
 				"at line %ld in file \"%s\""),
 			    line_num, fd->filename);
@@ -396,12 +427,12 @@ gerber_parse_file_segment (gint levelOfRecursion, gerbv_image_t *image,
 		&&  state->interpolation  != GERBV_INTERPOLATION_PAREA_START
 		&&  polygonPoints > 0) {
 		    curr_net->interpolation = GERBV_INTERPOLATION_PAREA_END;
-		    curr_net = gerber_create_new_net (curr_net, state->layer, state->state);
+		    curr_net = gerber_create_new_net (image, curr_net, state->layer, state->state);
 		    curr_net->interpolation = GERBV_INTERPOLATION_PAREA_START;
 		    state->parea_start_node->boundingBox = boundingBox;
 		    state->parea_start_node = curr_net;
 		    polygonPoints = 0;
-		    curr_net = gerber_create_new_net (curr_net, state->layer, state->state);		    
+		    curr_net = gerber_create_new_net (image, curr_net, state->layer, state->state);		    
 		    curr_net->start_x = (double)state->prev_x / x_scale;
 		    curr_net->start_y = (double)state->prev_y / y_scale;
 		    curr_net->stop_x = (double)state->curr_x / x_scale;
@@ -475,8 +506,8 @@ gerber_parse_file_segment (gint levelOfRecursion, gerbv_image_t *image,
 				stats->D_code_list, curr_net->aperture,
 				1, error_list);
 			if (retcode == -1) {
-			    gerbv_stats_printf(error_list,
-				    GERBV_MESSAGE_ERROR, -1,
+			    gerbv_stats_printf_line(error_list,
+				    GERBV_MESSAGE_ERROR, -1, line_num,
 				    _("Found undefined D code D%02d "
 					"at line %ld in file \"%s\""),
 				    curr_net->aperture, line_num, fd->filename);
@@ -497,34 +528,34 @@ gerber_parse_file_segment (gint levelOfRecursion, gerbv_image_t *image,
 		repeat_off_Y = (state->layer->stepAndRepeat.Y - 1) *
 		    state->layer->stepAndRepeat.dist_Y;
 		
-		cairo_matrix_init (&currentMatrix, 1, 0, 0, 1, 0, 0);
+		cairo_matrix_init (&state->matrix, 1, 0, 0, 1, 0, 0);
 		/* offset image */
-		cairo_matrix_translate (&currentMatrix, image->info->offsetA, 
+		cairo_matrix_translate (&state->matrix, image->info->offsetA, 
 					image->info->offsetB);
 		/* do image rotation */
-		cairo_matrix_rotate (&currentMatrix, image->info->imageRotation);
+		cairo_matrix_rotate (&state->matrix, image->info->imageRotation);
 		/* it's a new layer, so recalculate the new transformation 
 		 * matrix for it */
 		/* do any rotations */
-		cairo_matrix_rotate (&currentMatrix, state->layer->rotation);
+		cairo_matrix_rotate (&state->matrix, state->layer->rotation);
 			
 		/* calculate current layer and state transformation matrices */
 		/* apply scale factor */
-		cairo_matrix_scale (&currentMatrix, state->state->scaleA, 
+		cairo_matrix_scale (&state->matrix, state->state->scaleA, 
 				    state->state->scaleB);
 		/* apply offset */
-		cairo_matrix_translate (&currentMatrix, state->state->offsetA,
+		cairo_matrix_translate (&state->matrix, state->state->offsetA,
 					state->state->offsetB);
 		/* apply mirror */
 		switch (state->state->mirrorState) {
 		case GERBV_MIRROR_STATE_FLIPA:
-		    cairo_matrix_scale (&currentMatrix, -1, 1);
+		    cairo_matrix_scale (&state->matrix, -1, 1);
 		    break;
 		case GERBV_MIRROR_STATE_FLIPB:
-		    cairo_matrix_scale (&currentMatrix, 1, -1);
+		    cairo_matrix_scale (&state->matrix, 1, -1);
 		    break;
 		case GERBV_MIRROR_STATE_FLIPAB:
-		    cairo_matrix_scale (&currentMatrix, -1, -1);
+		    cairo_matrix_scale (&state->matrix, -1, -1);
 		    break;
 		default:
 		    break;
@@ -534,14 +565,15 @@ gerber_parse_file_segment (gint levelOfRecursion, gerbv_image_t *image,
 		    /* we do this by rotating 270 (counterclockwise, then 
 		     *  mirroring the Y axis 
 		     */
-		    cairo_matrix_rotate (&currentMatrix, M_PI + M_PI_2);
-		    cairo_matrix_scale (&currentMatrix, 1, -1);
+		    cairo_matrix_rotate (&state->matrix, M_PI + M_PI_2);
+		    cairo_matrix_scale (&state->matrix, 1, -1);
 		}
 		/* if it's a macro, step through all the primitive components
 		   and calculate the true bounding box */
-		if ((image->aperture[curr_net->aperture] != NULL) &&
-		    (image->aperture[curr_net->aperture]->type == GERBV_APTYPE_MACRO)) {
-		    gerbv_simplified_amacro_t *ls = image->aperture[curr_net->aperture]->simplified;
+		aperture = gerbv_image_get_aperture (image, curr_net->aperture);
+		if ((aperture != NULL) &&
+		    (aperture->type == GERBV_APTYPE_MACRO)) {
+		    gerbv_simplified_amacro_t *ls = aperture->simplified;
 	      
 		    while (ls != NULL) {
 			gdouble offsetx = 0, offsety = 0, widthx = 0, widthy = 0;
@@ -556,7 +588,7 @@ gerber_parse_file_segment (gint levelOfRecursion, gerbv_image_t *image,
 			    numberOfPoints = ls->parameter[OUTLINE_NUMBER_OF_POINTS] + 1;
 		
 			    for (pointCounter = 0; pointCounter < numberOfPoints; pointCounter++) {
-				gerber_update_min_and_max (&boundingBox,
+				update_min_and_max (&state->matrix, &boundingBox,
 							   curr_net->stop_x +
 							   ls->parameter[OUTLINE_X_IDX_OF_POINT(pointCounter)],
 							   curr_net->stop_y +
@@ -578,13 +610,13 @@ gerber_parse_file_segment (gint levelOfRecursion, gerbv_image_t *image,
 			    widthx = widthy = ls->parameter[THERMAL_OUTSIDE_DIAMETER];
 			} else if (ls->type == GERBV_APTYPE_MACRO_LINE20) {
 			    widthx = widthy = ls->parameter[LINE20_LINE_WIDTH];
-			    gerber_update_min_and_max (&boundingBox,
+			    update_min_and_max (&state->matrix, &boundingBox,
 						       curr_net->stop_x +
 						       ls->parameter[LINE20_START_X],
 						       curr_net->stop_y +
 						       ls->parameter[LINE20_START_Y], 
 						       widthx/2,widthx/2,widthy/2,widthy/2);
-			    gerber_update_min_and_max (&boundingBox,
+			    update_min_and_max (&state->matrix, &boundingBox,
 						       curr_net->stop_x +
 						       ls->parameter[LINE20_END_X],
 						       curr_net->stop_y +
@@ -609,7 +641,7 @@ gerber_parse_file_segment (gint levelOfRecursion, gerbv_image_t *image,
 			}
 	      	
 			if (!calculatedAlready) {
-			    gerber_update_min_and_max (&boundingBox,
+			    update_min_and_max (&state->matrix, &boundingBox,
 						       curr_net->stop_x + offsetx,
 						       curr_net->stop_y + offsety, 
 						       widthx/2,widthx/2,widthy/2,widthy/2);
@@ -617,10 +649,10 @@ gerber_parse_file_segment (gint levelOfRecursion, gerbv_image_t *image,
 	    		ls = ls->next;
 		    }
 		} else {
-		    if (image->aperture[curr_net->aperture] != NULL) {
-			aperture_sizeX = image->aperture[curr_net->aperture]->parameter[0];
-			if ((image->aperture[curr_net->aperture]->type == GERBV_APTYPE_RECTANGLE) || (image->aperture[curr_net->aperture]->type == GERBV_APTYPE_OVAL)) {
-				aperture_sizeY = image->aperture[curr_net->aperture]->parameter[1];
+		    if (aperture != NULL) {
+			aperture_sizeX = aperture->parameter[0];
+			if ((aperture->type == GERBV_APTYPE_RECTANGLE) || (aperture->type == GERBV_APTYPE_OVAL)) {
+				aperture_sizeY = aperture->parameter[1];
 			}
 			else
 				aperture_sizeY = aperture_sizeX;
@@ -638,19 +670,19 @@ gerber_parse_file_segment (gint levelOfRecursion, gerbv_image_t *image,
 					GERBV_INTERPOLATION_CCW_CIRCULAR)) {
 				calc_cirseg_bbox(curr_net->cirseg,
 						aperture_sizeX, aperture_sizeY,
-						&boundingBox);
+						&state->matrix, &boundingBox);
 		    } else {
 			    /* check both the start and stop of the aperture points against
 			       a running min/max counter */
 			    /* Note: only check start coordinate if this isn't a flash, 
 			       since the start point may be bogus if it is a flash */
 			    if (curr_net->aperture_state != GERBV_APERTURE_STATE_FLASH) {
-				gerber_update_min_and_max (&boundingBox,
+				update_min_and_max (&state->matrix, &boundingBox,
 							   curr_net->start_x, curr_net->start_y, 
 							   aperture_sizeX/2,aperture_sizeX/2,
 							   aperture_sizeY/2,aperture_sizeY/2);
 			    }
-			    gerber_update_min_and_max (&boundingBox,
+			    update_min_and_max (&state->matrix, &boundingBox,
 						       curr_net->stop_x, curr_net->stop_y, 
 						       aperture_sizeX/2,aperture_sizeX/2,
 						       aperture_sizeY/2,aperture_sizeY/2);
@@ -663,15 +695,17 @@ gerber_parse_file_segment (gint levelOfRecursion, gerbv_image_t *image,
 			gerber_update_image_min_max(&boundingBox, repeat_off_X, repeat_off_Y, image);
 		}
 		/* optionally update the knockout measurement box */
-		if (knockoutMeasure) {
-			if (boundingBox.left < knockoutLimitXmin)
-				knockoutLimitXmin = boundingBox.left;
-			if (boundingBox.right+repeat_off_X > knockoutLimitXmax)
-				knockoutLimitXmax = boundingBox.right+repeat_off_X;
-			if (boundingBox.bottom < knockoutLimitYmin)
-				knockoutLimitYmin = boundingBox.bottom;
-			if (boundingBox.top+repeat_off_Y > knockoutLimitYmax)
-				knockoutLimitYmax = boundingBox.top+repeat_off_Y;
+		if (state->knockout_measure) {
+			gerbv_render_size_t *ko = &state->knockout_limit;
+
+			if (boundingBox.left < ko->left)
+				ko->left = boundingBox.left;
+			if (boundingBox.right+repeat_off_X > ko->right)
+				ko->right = boundingBox.right+repeat_off_X;
+			if (boundingBox.bottom < ko->bottom)
+				ko->bottom = boundingBox.bottom;
+			if (boundingBox.top+repeat_off_Y > ko->top)
+				ko->top = boundingBox.top+repeat_off_Y;
 		}
 		/* if we're not in a polygon fill, then update the object bounding box */
 		if (!state->in_parea_fill) {
@@ -688,6 +722,8 @@ gerber_parse_file_segment (gint levelOfRecursion, gerbv_image_t *image,
 	    line_num++;
 
 	    /* Get <CR> char, if any, from <LF><CR> pair */
+	    if (lexed)
+		    break;
 	    read = gerb_fgetc(fd);
 	    if (read != '\r' && read != EOF)
 		    gerb_ungetc(fd);
@@ -697,6 +733,8 @@ gerber_parse_file_segment (gint levelOfRecursion, gerbv_image_t *image,
 	    line_num++;
 
 	    /* Get <LF> char, if any, from <CR><LF> pair */
+	    if (lexed)
+		    break;
 	    read = gerb_fgetc(fd);
 	    if (read != '\n' && read != EOF)
 		    gerb_ungetc(fd);
@@ -704,7 +742,8 @@ gerber_parse_file_segment (gint levelOfRecursion, gerbv_image_t *image,
 
 	default:
 	    stats->unknown++;
-	    gerbv_stats_printf(error_list, GERBV_MESSAGE_ERROR, -1,
+	    gerbv_stats_printf_line(error_list,
+		    GERBV_MESSAGE_ERROR, -1, line_num,
 		    _("Found unknown character '%s' (0x%x) "
 			"at line %ld in file \"%s\""),
 		    gerbv_escape_char(read), read,
@@ -730,13 +769,8 @@ parse_gerb(gerb_file_t *fd, gchar *directoryPath)
     gerbv_net_t *curr_net = NULL;
     gerbv_stats_t *stats;
     gboolean foundEOF = FALSE;
+    gint64 start = g_get_monotonic_time();
     
-    /* added by t.motylewski@bfad.de
-     * many locales redefine "." as "," and so on, 
-     * so sscanf and strtod has problems when
-     * reading files using %f format */
-    setlocale(LC_NUMERIC, "C" );
-
     /* 
      * Create new state.  This is used locally to keep track
      * of the photoplotter's state as the Gerber is read in.
@@ -756,6 +790,7 @@ parse_gerb(gerb_file_t *fd, gchar *directoryPath)
 	GERB_FATAL_ERROR("malloc gerbv_stats failed in %s()", __FUNCTION__);
 
     stats = image->gerbv_stats;
+    gerb_parse_stats_begin(image, fd->datalen, start);
 
     /* set active layer and netstate to point to first default one created */
     state->layer = image->layers;
@@ -766,221 +801,65 @@ parse_gerb(gerb_file_t *fd, gchar *directoryPath)
     /*
      * Start parsing
      */
+    if (parallel_parse_threshold > 0
+	    && (gsize)fd->datalen >= parallel_parse_threshold)
+	gerb_fprelex_start (fd, "GDMXYIJ");
+
     dprintf("In %s(), starting to parse file...\n", __func__);
     foundEOF = gerber_parse_file_segment (1, image, state, curr_net, stats,
 					  fd, directoryPath);
+    gerb_fprelex_stop (fd);
 
     if (!foundEOF) {
 	gerbv_stats_printf(stats->error_list, GERBV_MESSAGE_ERROR, -1,
 		_("Missing Gerber EOF code in file \"%s\""), fd->filename);
     }
-    g_free(state);
-    
     dprintf("               ... done parsing Gerber file\n");
-    gerber_update_any_running_knockout_measurements (image);
+    gerber_update_any_running_knockout_measurements (state);
+    g_free(state);
     gerber_calculate_final_justify_effects(image);
+    gerb_parse_stats_end(image);
 
     return image;
 } /* parse_gerb */
 
 
 /* ------------------------------------------------------------------- */
-/*! Checks for signs that this is a RS-274X file
- *  Returns TRUE if it is, FALSE if not.
- */
-gboolean
-gerber_is_rs274x_p(gerb_file_t *fd, gboolean *returnFoundBinary) 
+void
+gerbv_set_parallel_parse_threshold (gsize size)
 {
-    char *buf;
-    int len = 0;
-    char *letter;
-    int i;
-    gboolean found_binary = FALSE;
-    gboolean found_ADD = FALSE;
-    gboolean found_D0 = FALSE;
-    gboolean found_D2 = FALSE;
-    gboolean found_M0 = FALSE;
-    gboolean found_M2 = FALSE;
-    gboolean found_star = FALSE;
-    gboolean found_X = FALSE;
-    gboolean found_Y = FALSE;
-   
-    dprintf ("%s(%p, %p), fd->fd = %p\n",
-		    __func__, fd, returnFoundBinary, fd->fd); 
-    buf = (char *) g_malloc(MAXL);
-    if (buf == NULL) 
-	GERB_FATAL_ERROR("malloc buf failed while checking for rs274x in %s()",
-			__FUNCTION__);
-    
-    while (fgets(buf, MAXL, fd->fd) != NULL) {
-        dprintf ("buf = \"%s\"\n", buf);
-	len = strlen(buf);
-    
-	/* First look through the file for indications of its type by
-	 * checking that file is not binary (non-printing chars and white 
-	 * spaces)
-	 */
-	for (i = 0; i < len; i++) {
-	    if (!isprint((int) buf[i]) && (buf[i] != '\r') && 
-		(buf[i] != '\n') && (buf[i] != '\t')) {
-		found_binary = TRUE;
-                dprintf ("found_binary (%d)\n", buf[i]);
-	    }
-	}
-	if (g_strstr_len(buf, len, "%ADD")) {
-	    found_ADD = TRUE;
-            dprintf ("found_ADD\n");
-	}
-	if (g_strstr_len(buf, len, "D00") || g_strstr_len(buf, len, "D0")) {
-	    found_D0 = TRUE;
-            dprintf ("found_D0\n");
-	}
-	if (g_strstr_len(buf, len, "D02") || g_strstr_len(buf, len, "D2")) {
-	    found_D2 = TRUE;
-            dprintf ("found_D2\n");
-	}
-	if (g_strstr_len(buf, len, "M00") || g_strstr_len(buf, len, "M0")) {
-	    found_M0 = TRUE;
-            dprintf ("found_M0\n");
-	}
-	if (g_strstr_len(buf, len, "M02") || g_strstr_len(buf, len, "M2")) {
-	    found_M2 = TRUE;
-            dprintf ("found_M2\n");
-	}
-	if (g_strstr_len(buf, len, "*")) {
-	    found_star = TRUE;
-            dprintf ("found_star\n");
-	}
-	/* look for X<number> or Y<number> */
-	if ((letter = g_strstr_len(buf, len, "X")) != NULL) {
-	    if (isdigit((int) letter[1])) { /* grab char after X */
-		found_X = TRUE;
-                dprintf ("found_X\n");
-	    }
-	}
-	if ((letter = g_strstr_len(buf, len, "Y")) != NULL) {
-	    if (isdigit((int) letter[1])) { /* grab char after Y */
-		found_Y = TRUE;
-                dprintf ("found_Y\n");
-	    }
-	}
-    }
-    rewind(fd->fd);
-    free(buf);
-   
-    *returnFoundBinary = found_binary;
-
-    /* Now form logical expression determining if the file is RS-274X */
-    if ((found_D0 || found_D2 || found_M0 || found_M2) && 
-	found_ADD && found_star && (found_X || found_Y)) 
-	return TRUE;
-
-    
-    return FALSE;
-
-} /* gerber_is_rs274x */
-
+    parallel_parse_threshold = size;
+}
 
 /* ------------------------------------------------------------------- */
-/*! Checks for signs that this is a RS-274D file
- *  Returns TRUE if it is, FALSE if not.
- */
-gboolean
-gerber_is_rs274d_p(gerb_file_t *fd) 
+/* The number after the word letter read last, from token if it was lexed
+ * ahead, else read here */
+static int
+gerber_token_int(gerb_file_t *fd, const gerb_token_t *token, int *len)
 {
-    char *buf;
-    int len = 0;
-    char *letter;
-    int i;
-    gboolean found_binary = FALSE;
-    gboolean found_ADD = FALSE;
-    gboolean found_D0 = FALSE;
-    gboolean found_D2 = FALSE;
-    gboolean found_M0 = FALSE;
-    gboolean found_M2 = FALSE;
-    gboolean found_star = FALSE;
-    gboolean found_X = FALSE;
-    gboolean found_Y = FALSE;
-    
-    buf = malloc(MAXL);
-    if (buf == NULL) 
-	GERB_FATAL_ERROR("malloc buf failed while checking for rs274d in %s()",
-			__FUNCTION__);
-
-    while (fgets(buf, MAXL, fd->fd) != NULL) {
-	len = strlen(buf);
-    
-	/* First look through the file for indications of its type */
-    
-	/* check that file is not binary (non-printing chars */
-	for (i = 0; i < len; i++) {
-	    if (!isprint( (int) buf[i]) && (buf[i] != '\r') && 
-		(buf[i] != '\n') && (buf[i] != '\t')) {
-		found_binary = TRUE;
-	    }
-	}
-	
-	if (g_strstr_len(buf, len, "%ADD")) {
-	    found_ADD = TRUE;
-	}
-	if (g_strstr_len(buf, len, "D00") || g_strstr_len(buf, len, "D0")) {
-	    found_D0 = TRUE;
-	}
-	if (g_strstr_len(buf, len, "D02") || g_strstr_len(buf, len, "D2")) {
-	    found_D2 = TRUE;
-	}
-	if (g_strstr_len(buf, len, "M00") || g_strstr_len(buf, len, "M0")) {
-	    found_M0 = TRUE;
-	}
-	if (g_strstr_len(buf, len, "M02") || g_strstr_len(buf, len, "M2")) {
-	    found_M2 = TRUE;
-	}
-	if (g_strstr_len(buf, len, "*")) {
-	    found_star = TRUE;
-	}
-	/* look for X<number> or Y<number> */
-	if ((letter = g_strstr_len(buf, len, "X")) != NULL) {
-	    /* grab char after X */
-	    if (isdigit( (int) letter[1])) {
-		found_X = TRUE;
-	    }
-	}
-	if ((letter = g_strstr_len(buf, len, "Y")) != NULL) {
-	    /* grab char after Y */
-	    if (isdigit( (int) letter[1])) {
-		found_Y = TRUE;
-	    }
-	}
-    }
-    rewind(fd->fd);
-    free(buf);
-
-    /* Now form logical expression determining if the file is RS-274D */
-    if ((found_D0 || found_D2 || found_M0 || found_M2) && 
-	!found_ADD && found_star && (found_X || found_Y) && 
-	!found_binary) 
-	return TRUE;
+    if (!token->has_value)
+	return gerb_fgetint(fd, len);
 
-    return FALSE;
-
-} /* gerber_is_rs274d */
+    if (len)
+	*len = token->len;
 
+    return token->value;
+} /* gerber_token_int */
 
 /* ------------------------------------------------------------------- */
-/*! This function reads a G number and updates the current
+/*! This function takes a G number and updates the current
  *  state.  It also updates the G stats counters
  */
 static void 
 parse_G_code(gerb_file_t *fd, gerb_state_t *state,
-		gerbv_image_t *image, long int *line_num_p)
+		gerbv_image_t *image, int op_int, long int *line_num_p)
 {
-    int  op_int;
     gerbv_format_t *format = image->format;
     gerbv_stats_t *stats = image->gerbv_stats;
     gerbv_error_list_t *error_list = stats->error_list;
     int c;
 
-    op_int=gerb_fgetint(fd, NULL);
+    gerb_parse_stats_code(image, 'G', op_int);
 
     /* Emphasize text with new line '\n' in the beginning */
     dprintf("\n     Found G%02d at line %ld (%s)\n",
@@ -1008,7 +887,8 @@ parse_G_code(gerb_file_t *fd, gerb_state_t *state,
 	do {
 	    c = gerb_fgetc(fd);
             if (c == '\r' || c == '\n') {
-                gerbv_stats_printf(error_list, GERBV_MESSAGE_WARNING, -1,
+                gerbv_stats_printf_line(error_list,
+                                   GERBV_MESSAGE_WARNING, -1, *line_num_p,
                                    _("Found newline while parsing "
                                      "G04 code at line %ld in file \"%s\", "
                                      "maybe you forgot a \"*\"?"),
@@ -1046,16 +926,18 @@ parse_G_code(gerb_file_t *fd, gerb_state_t *state,
 	/* XXX Maybe uneccesary??? */
 	if (gerb_fgetc(fd) == 'D') {
 	    int a = gerb_fgetint(fd, NULL);
-	    if ((a >= 0) && (a <= APERTURE_MAX)) {
+	    if (gerb_image_aperture_number_valid(a)) {
 		state->curr_aperture = a;
 	    } else { 
-		gerbv_stats_printf(error_list, GERBV_MESSAGE_ERROR, -1, 
+		gerbv_stats_printf_line(error_list,
+			GERBV_MESSAGE_ERROR, -1, *line_num_p, 
 			_("Found aperture D%02d out of bounds while parsing "
 			    "G code at line %ld in file \"%s\""),
 			a, *line_num_p, fd->filename);
 	    }
 	} else {
-	    gerbv_stats_printf(error_list, GERBV_MESSAGE_ERROR, -1,
+	    gerbv_stats_printf_line(error_list,
+		    GERBV_MESSAGE_ERROR, -1, *line_num_p,
 		    _("Found unexpected code after G54 "
 			"at line %ld in file \"%s\""),
 		    *line_num_p, fd->filename);
@@ -1093,7 +975,8 @@ parse_G_code(gerb_file_t *fd, gerb_state_t *state,
 	stats->G91++;
 	break;
     default:
-	gerbv_stats_printf(error_list, GERBV_MESSAGE_ERROR, -1,
+	gerbv_stats_printf_line(error_list,
+		GERBV_MESSAGE_ERROR, -1, *line_num_p,
 		_("Encountered unknown G code G%02d "
 		    "at line %ld in file \"%s\""),
 		op_int, *line_num_p, fd->filename);
@@ -1110,23 +993,23 @@ parse_G_code(gerb_file_t *fd, gerb_state_t *state,
 
 
 /* ------------------------------------------------------------------ */
-/*! This function reads the numeric value of a D code and updates the 
+/*! This function takes the numeric value of a D code and updates the 
  *  state.  It also updates the D stats counters
  */
 static void 
 parse_D_code(gerb_file_t *fd, gerb_state_t *state,
-		gerbv_image_t *image, long int *line_num_p)
+		gerbv_image_t *image, int a, long int *line_num_p)
 {
-    int a;
     gerbv_stats_t *stats = image->gerbv_stats;
     gerbv_error_list_t *error_list = stats->error_list;
 
-    a = gerb_fgetint(fd, NULL);
+    gerb_parse_stats_code(image, 'D', a);
     dprintf("     Found D%02d code at line %ld\n", a, *line_num_p);
 
     switch(a) {
     case 0 : /* Invalid code */
-        gerbv_stats_printf(error_list, GERBV_MESSAGE_ERROR, -1,
+        gerbv_stats_printf_line(error_list,
+		GERBV_MESSAGE_ERROR, -1, *line_num_p,
 		_("Found invalid D00 code at line %ld in file \"%s\""),
 		*line_num_p, fd->filename);
         stats->D_error++;
@@ -1147,11 +1030,12 @@ parse_D_code(gerb_file_t *fd, gerb_state_t *state,
 	stats->D3++;
 	break;
     default: /* Aperture in use */
-	if ((a >= 0) && (a <= APERTURE_MAX)) {
+	if (gerb_image_aperture_number_valid(a)) {
 	    state->curr_aperture = a;
 	    
 	} else {
-	    gerbv_stats_printf(error_list, GERBV_MESSAGE_ERROR, -1,
+	    gerbv_stats_printf_line(error_list,
+		    GERBV_MESSAGE_ERROR, -1, *line_num_p,
 		    _("Found out of bounds aperture D%02d "
 			"at line %ld in file \"%s\""),
 		    a, *line_num_p, fd->filename);
@@ -1167,12 +1051,12 @@ parse_D_code(gerb_file_t *fd, gerb_state_t *state,
 
 /* ------------------------------------------------------------------ */
 static int
-parse_M_code(gerb_file_t *fd, gerbv_image_t *image, long int *line_num_p)
+parse_M_code(gerb_file_t *fd, gerbv_image_t *image, int op_int,
+		long int *line_num_p)
 {
-    int op_int;
     gerbv_stats_t *stats = image->gerbv_stats;
     
-    op_int=gerb_fgetint(fd, NULL);
+    gerb_parse_stats_code(image, 'M', op_int);
     
     switch (op_int) {
     case 0:  /* Program stop */
@@ -1185,7 +1069,8 @@ parse_M_code(gerb_file_t *fd, gerbv_image_t *image, long int *line_num_p)
 	stats->M2++;
 	return 3;
     default:
-	gerbv_stats_printf(stats->error_list, GERBV_MESSAGE_ERROR, -1,
+	gerbv_stats_printf_line(stats->error_list,
+		GERBV_MESSAGE_ERROR, -1, *line_num_p,
 		_("Encountered unknown M%02d code at line %ld in file \"%s\""),
 		op_int, *line_num_p, fd->filename);
 	gerbv_stats_printf(stats->error_list, GERBV_MESSAGE_WARNING, -1,
@@ -1213,6 +1098,7 @@ parse_rs274x(gint levelOfRecursion, gerb_file_t *fd, gerbv_image_t *image,
     if (state->state->unit == GERBV_UNIT_MM)
     	scale = 25.4;
     
+    gerb_parse_stats_code(image, '%', 0);
     op[0] = gerb_fgetc(fd);
     op[1] = gerb_fgetc(fd);
     
@@ -1270,7 +1156,8 @@ parse_rs274x(gint levelOfRecursion, gerb_file_t *fd, gerbv_image_t *image,
 	    image->format->omit_zeros = GERBV_OMIT_ZEROS_EXPLICIT;
 	    break;
 	default:
-	    gerbv_stats_printf(error_list, GERBV_MESSAGE_ERROR, -1,
+	    gerbv_stats_printf_line(error_list,
+		    GERBV_MESSAGE_ERROR, -1, *line_num_p,
 		    _("EagleCad bug detected: Undefined handling of zeros "
 			"in format code at line %ld in file \"%s\""),
 		    *line_num_p, fd->filename);
@@ -1288,7 +1175,8 @@ parse_rs274x(gint levelOfRecursion, gerb_file_t *fd, gerbv_image_t *image,
 	    image->format->coordinate = GERBV_COORDINATE_INCREMENTAL;
 	    break;
 	default:
-	    gerbv_stats_printf(error_list, GERBV_MESSAGE_ERROR, -1,
+	    gerbv_stats_printf_line(error_list,
+		    GERBV_MESSAGE_ERROR, -1, *line_num_p,
 		    _("Invalid coordinate type defined in format code "
 			"at line %ld in file \"%s\""),
 		    *line_num_p, fd->filename);
@@ -1318,7 +1206,8 @@ parse_rs274x(gint levelOfRecursion, gerb_file_t *fd, gerbv_image_t *image,
 	    case 'X' :
 		op[0] = gerb_fgetc(fd);
 		if ((op[0] < '0') || (op[0] > '6')) {
-		    gerbv_stats_printf(error_list, GERBV_MESSAGE_ERROR, -1,
+		    gerbv_stats_printf_line(error_list,
+			    GERBV_MESSAGE_ERROR, -1, *line_num_p,
 			    _("Illegal format size '%s' "
 				"at line %ld in file \"%s\""),
 			    gerbv_escape_char(op[0]),
@@ -1327,7 +1216,8 @@ parse_rs274x(gint levelOfRecursion, gerb_file_t *fd, gerbv_image_t *image,
 		image->format->x_int = op[0] - '0';
 		op[0] = gerb_fgetc(fd);
 		if ((op[0] < '0') || (op[0] > '6')) {
-		    gerbv_stats_printf(error_list, GERBV_MESSAGE_ERROR, -1,
+		    gerbv_stats_printf_line(error_list,
+			    GERBV_MESSAGE_ERROR, -1, *line_num_p,
 			    _("Illegal format size '%s' "
 				"at line %ld in file \"%s\""),
 			    gerbv_escape_char(op[0]),
@@ -1338,7 +1228,8 @@ parse_rs274x(gint levelOfRecursion, gerb_file_t *fd, gerbv_image_t *image,
 	    case 'Y':
 		op[0] = gerb_fgetc(fd);
 		if ((op[0] < '0') || (op[0] > '6')) {
-		    gerbv_stats_printf(error_list, GERBV_MESSAGE_ERROR, -1,
+		    gerbv_stats_printf_line(error_list,
+			    GERBV_MESSAGE_ERROR, -1, *line_num_p,
 			    _("Illegal format size '%s' "
 				"at line %ld in file \"%s\""),
 			    gerbv_escape_char(op[0]),
@@ -1347,7 +1238,8 @@ parse_rs274x(gint levelOfRecursion, gerb_file_t *fd, gerbv_image_t *image,
 		image->format->y_int = op[0] - '0';
 		op[0] = gerb_fgetc(fd);
 		if ((op[0] < '0') || (op[0] > '6')) {
-		    gerbv_stats_printf(error_list, GERBV_MESSAGE_ERROR, -1,
+		    gerbv_stats_printf_line(error_list,
+			    GERBV_MESSAGE_ERROR, -1, *line_num_p,
 			    _("Illegal format size '%s' "
 			       "at line %ld in file \"%s\""),
 			    gerbv_escape_char(op[0]),
@@ -1356,7 +1248,8 @@ parse_rs274x(gint levelOfRecursion, gerb_file_t *fd, gerbv_image_t *image,
 		image->format->y_dec = op[0] - '0';
 		break;
 	    default :
-		gerbv_stats_printf(error_list, GERBV_MESSAGE_ERROR, -1,
+		gerbv_stats_printf_line(error_list,
+			GERBV_MESSAGE_ERROR, -1, *line_num_p,
 			_("Illegal format statement '%s' "
 			   "at line %ld in file \"%s\""),
 			gerbv_escape_char(op[0]),
@@ -1393,7 +1286,8 @@ parse_rs274x(gint levelOfRecursion, gerb_file_t *fd, gerbv_image_t *image,
 		}
 		break;
 	    default :
-		gerbv_stats_printf(error_list, GERBV_MESSAGE_ERROR, -1,
+		gerbv_stats_printf_line(error_list,
+			GERBV_MESSAGE_ERROR, -1, *line_num_p,
 			_("Wrong character '%s' in mirror "
 			    "at line %ld in file \"%s\""),
 			gerbv_escape_char(op[0]), *line_num_p, fd->filename);
@@ -1419,7 +1313,8 @@ parse_rs274x(gint levelOfRecursion, gerb_file_t *fd, gerbv_image_t *image,
 	    state->state->unit = GERBV_UNIT_MM;
 	    break;
 	default:
-	    gerbv_stats_printf(error_list, GERBV_MESSAGE_ERROR, -1,
+	    gerbv_stats_printf_line(error_list,
+		    GERBV_MESSAGE_ERROR, -1, *line_num_p,
 		    _("Illegal unit '%s%s' at line %ld in file \"%s\""),
 		    gerbv_escape_char(op[0]), gerbv_escape_char(op[1]),
 		    *line_num_p, fd->filename);
@@ -1437,7 +1332,8 @@ parse_rs274x(gint levelOfRecursion, gerb_file_t *fd, gerbv_image_t *image,
 		state->state->offsetB = gerb_fgetdouble(fd) / scale;
 		break;
 	    default :
-		gerbv_stats_printf(error_list, GERBV_MESSAGE_ERROR, -1,
+		gerbv_stats_printf_line(error_list,
+			GERBV_MESSAGE_ERROR, -1, *line_num_p,
 			_("Wrong character '%s' in offset "
 			    "at line %ld in file \"%s\""),
 			gerbv_escape_char(op[0]), *line_num_p, fd->filename);
@@ -1459,12 +1355,15 @@ parse_rs274x(gint levelOfRecursion, gerb_file_t *fd, gerbv_image_t *image,
 		if (levelOfRecursion < 10) {
 		    gerb_file_t *includefd = NULL;
 		    
-		    includefd = gerb_fopen(fullPath);
+		    includefd = gerb_fopen_include(fullPath);
 		    if (includefd) {
+			if (image->parse_stats != NULL)
+			    image->parse_stats->bytes += includefd->datalen;
 			gerber_parse_file_segment (levelOfRecursion + 1, image, state, curr_net, stats, includefd, directoryPath);
 			gerb_fclose(includefd);
 		    } else {
-			gerbv_stats_printf(error_list, GERBV_MESSAGE_ERROR, -1,
+			gerbv_stats_printf_line(error_list,
+				GERBV_MESSAGE_ERROR, -1, *line_num_p,
 				_("Included file \"%s\" cannot be found "
 				    "at line %ld in file \"%s\""),
 				fullPath, *line_num_p, fd->filename);
@@ -1492,7 +1391,8 @@ parse_rs274x(gint levelOfRecursion, gerb_file_t *fd, gerbv_image_t *image,
 		image->info->offsetB = gerb_fgetdouble(fd) / scale;
 		break;
 	    default :
-		gerbv_stats_printf(error_list, GERBV_MESSAGE_ERROR, -1,
+		gerbv_stats_printf_line(error_list,
+			GERBV_MESSAGE_ERROR, -1, *line_num_p,
 			_("Wrong character '%s' in image offset "
 			    "at line %ld in file \"%s\""),
 			gerbv_escape_char(op[0]), *line_num_p, fd->filename);
@@ -1541,7 +1441,8 @@ parse_rs274x(gint levelOfRecursion, gerb_file_t *fd, gerbv_image_t *image,
 	    image->info->encoding = GERBV_ENCODING_EIA;
 	    break;
 	default:
-	    gerbv_stats_printf(error_list, GERBV_MESSAGE_ERROR, -1,
+	    gerbv_stats_printf_line(error_list,
+		    GERBV_MESSAGE_ERROR, -1, *line_num_p,
 		    _("Unknown input code (IC) '%s%s' "
 			"at line %ld in file \"%s\""),
 		    gerbv_escape_char(op[0]), gerbv_escape_char(op[1]),
@@ -1581,7 +1482,8 @@ parse_rs274x(gint levelOfRecursion, gerb_file_t *fd, gerbv_image_t *image,
 	    	}
 		break;
 	    default :
-		gerbv_stats_printf(error_list, GERBV_MESSAGE_ERROR, -1,
+		gerbv_stats_printf_line(error_list,
+			GERBV_MESSAGE_ERROR, -1, *line_num_p,
 			_("Wrong character '%s' in image justify "
 			    "at line %ld in file \"%s\""),
 			gerbv_escape_char(op[0]), *line_num_p, fd->filename);
@@ -1609,7 +1511,8 @@ parse_rs274x(gint levelOfRecursion, gerb_file_t *fd, gerbv_image_t *image,
 	else if (strncmp(str, "NEG", 3) == 0)
 	    image->info->polarity = GERBV_POLARITY_NEGATIVE;
 	else {
-	    gerbv_stats_printf(error_list, GERBV_MESSAGE_ERROR, -1,
+	    gerbv_stats_printf_line(error_list,
+		    GERBV_MESSAGE_ERROR, -1, *line_num_p,
 		    _("Unknown polarity '%s%s%s' "
 			"at line %ld in file \"%s\""),
 		    gerbv_escape_char(str[0]), gerbv_escape_char(str[1]),
@@ -1627,7 +1530,8 @@ parse_rs274x(gint levelOfRecursion, gerb_file_t *fd, gerbv_image_t *image,
 	else if (tmp == 270)
 	    image->info->imageRotation = M_PI + M_PI_2;
 	else {
-	    gerbv_stats_printf(error_list, GERBV_MESSAGE_ERROR, -1,
+	    gerbv_stats_printf_line(error_list,
+		    GERBV_MESSAGE_ERROR, -1, *line_num_p,
 		    _("Image rotation must be 0, 90, 180 or 270 "
 			"(is actually %d) at line %ld in file \"%s\""),
 		    tmp, *line_num_p, fd->filename);
@@ -1645,9 +1549,8 @@ parse_rs274x(gint levelOfRecursion, gerb_file_t *fd, gerbv_image_t *image,
 	if (ano == -1) {
 		/* error with line parse, so just quietly ignore */
 	}
-	else if ((ano >= 0) && (ano <= APERTURE_MAX)) {
+	else if (gerbv_image_set_aperture(image, ano, a)) {
 	    a->unit = state->state->unit;
-	    image->aperture[ano] = a;
 	    dprintf("     In %s(), adding new aperture to aperture list ...\n",
 			    __func__);
 	    gerbv_stats_add_aperture(stats->aperture_list,
@@ -1657,13 +1560,15 @@ parse_rs274x(gint levelOfRecursion, gerb_file_t *fd, gerbv_image_t *image,
 	    gerbv_stats_add_to_D_list(stats->D_code_list,
 				     ano);
 	    if (ano < APERTURE_MIN) {
-		    gerbv_stats_printf(error_list, GERBV_MESSAGE_ERROR, -1,
+		    gerbv_stats_printf_line(error_list,
+			    GERBV_MESSAGE_ERROR, -1, *line_num_p,
 			    _("Aperture number out of bounds %d "
 				"at line %ld in file \"%s\""),
 			    ano, *line_num_p, fd->filename);
 	    }
 	} else {
-	    gerbv_stats_printf(error_list, GERBV_MESSAGE_ERROR, -1,
+	    gerbv_stats_printf_line(error_list,
+		    GERBV_MESSAGE_ERROR, -1, *line_num_p,
 		    _("Aperture number out of bounds %d "
 		       "at line %ld in file \"%s\""),
 		    ano, *line_num_p, fd->filename);
@@ -1680,7 +1585,8 @@ parse_rs274x(gint levelOfRecursion, gerb_file_t *fd, gerbv_image_t *image,
 	    print_program(image->amacro);
 #endif
 	} else {
-	    gerbv_stats_printf(error_list, GERBV_MESSAGE_ERROR, -1,
+	    gerbv_stats_printf_line(error_list,
+		    GERBV_MESSAGE_ERROR, -1, *line_num_p,
 		    _("Failed to parse aperture macro "
 		       "at line %ld in file \"%s\""),
 		    *line_num_p, fd->filename);
@@ -1702,7 +1608,8 @@ parse_rs274x(gint levelOfRecursion, gerb_file_t *fd, gerbv_image_t *image,
 	    state->layer->polarity = GERBV_POLARITY_CLEAR;
 	    break;
 	default:
-	    gerbv_stats_printf(error_list, GERBV_MESSAGE_ERROR, -1,
+	    gerbv_stats_printf_line(error_list,
+		    GERBV_MESSAGE_ERROR, -1, *line_num_p,
 		    _("Unknown layer polarity '%s' "
 		       "at line %ld in file \"%s\""),
 		    gerbv_escape_char(op[0]), *line_num_p, fd->filename);
@@ -1710,9 +1617,9 @@ parse_rs274x(gint levelOfRecursion, gerb_file_t *fd, gerbv_image_t *image,
 	break;
     case A2I('K','O'): /* Knock Out */
         state->layer = gerbv_image_return_new_layer (state->layer);
-        gerber_update_any_running_knockout_measurements (image);
+        gerber_update_any_running_knockout_measurements (state);
         /* reset any previous knockout measurements */
-        knockoutMeasure = FALSE;
+        state->knockout_measure = FALSE;
         op[0] = gerb_fgetc(fd);
 	if (op[0] == '*') { /* Disable previous SR parameters */
 	    state->layer->knockout.type = GERBV_KNOCKOUT_TYPE_NOKNOCKOUT;
@@ -1722,7 +1629,8 @@ parse_rs274x(gint levelOfRecursion, gerb_file_t *fd, gerbv_image_t *image,
 	} else if (op[0] == 'D') {
 	    state->layer->knockout.polarity = GERBV_POLARITY_DARK;
 	} else {
-	    gerbv_stats_printf(error_list, GERBV_MESSAGE_ERROR, -1,
+	    gerbv_stats_printf_line(error_list,
+		    GERBV_MESSAGE_ERROR, -1, *line_num_p,
 		    _("Knockout must supply a polarity (C, D, or *) "
 			"at line %ld in file \"%s\""),
 		    *line_num_p, fd->filename);
@@ -1757,15 +1665,16 @@ parse_rs274x(gint levelOfRecursion, gerb_file_t *fd, gerbv_image_t *image,
 	        state->layer->knockout.border = gerb_fgetdouble(fd) / scale;
 	        /* this is a bordered knockout, so we need to start measuring the
 	           size of a square bordering all future components */
-	        knockoutMeasure = TRUE;
-	        knockoutLimitXmin = HUGE_VAL;
-	        knockoutLimitYmin = HUGE_VAL;
-	        knockoutLimitXmax = -HUGE_VAL;
-	        knockoutLimitYmax = -HUGE_VAL;
-	        knockoutLayer = state->layer;
+	        state->knockout_measure = TRUE;
+	        state->knockout_limit.left = HUGE_VAL;
+	        state->knockout_limit.bottom = HUGE_VAL;
+	        state->knockout_limit.right = -HUGE_VAL;
+	        state->knockout_limit.top = -HUGE_VAL;
+	        state->knockout_layer = state->layer;
 	        break;
 	    default:
-		gerbv_stats_printf(error_list, GERBV_MESSAGE_ERROR, -1,
+		gerbv_stats_printf_line(error_list,
+			GERBV_MESSAGE_ERROR, -1, *line_num_p,
 			_("Unknown variable in knockout "
 			    "at line %ld in file \"%s\""),
 			*line_num_p, fd->filename);
@@ -1799,7 +1708,8 @@ parse_rs274x(gint levelOfRecursion, gerb_file_t *fd, gerbv_image_t *image,
 		state->layer->stepAndRepeat.dist_Y = gerb_fgetdouble(fd) / scale;
 		break;
 	    default:
-		gerbv_stats_printf(error_list, GERBV_MESSAGE_ERROR, -1,
+		gerbv_stats_printf_line(error_list,
+			GERBV_MESSAGE_ERROR, -1, *line_num_p,
 			_("Step-and-repeat parameter error "
 			   "at line %ld in file \"%s\""),
 			*line_num_p, fd->filename);
@@ -1825,14 +1735,16 @@ parse_rs274x(gint levelOfRecursion, gerb_file_t *fd, gerbv_image_t *image,
 	state->layer->rotation = DEG2RAD(gerb_fgetdouble(fd));
 	op[0] = gerb_fgetc(fd);
 	if (op[0] != '*') {
-	    gerbv_stats_printf(error_list, GERBV_MESSAGE_ERROR, -1,
+	    gerbv_stats_printf_line(error_list,
+		    GERBV_MESSAGE_ERROR, -1, *line_num_p,
 		    _("Error in layer rotation command "
 		       "at line %ld in file \"%s\""),
 		    *line_num_p, fd->filename);
 	}
 	break;
     default:
-	gerbv_stats_printf(error_list, GERBV_MESSAGE_ERROR, -1,
+	gerbv_stats_printf_line(error_list,
+		GERBV_MESSAGE_ERROR, -1, *line_num_p,
 		_("Unknown RS-274X extension found %%%s%s%% "
 		    "at line %ld in file \"%s\""),
 		gerbv_escape_char(op[0]), gerbv_escape_char(op[1]),
@@ -1850,78 +1762,113 @@ parse_rs274x(gint levelOfRecursion, gerb_file_t *fd, gerbv_image_t *image,
 } /* parse_rs274x */
 
 
-/*
- * Stack declarations and operations to be used by the simple engine that
- * executes the parsed aperture macros.
- */
+/* ------------------------------------------------------------------ */
+/* Apertures calling the same macro with the same parameters and scale
+ * share the simplified macro of the first one; it must not be changed. */
 typedef struct {
-    double *stack;
-    size_t sp;
-    size_t capacity;
-} macro_stack_t;
+    gerbv_amacro_t *amacro;
+    gdouble scale;
+    int nuf_parameters;
+    double *parameter;		/* The nuf_parameters parameters */
+} amacro_cache_key_t;
 
+typedef struct {
+    amacro_cache_key_t key;
+    gerbv_simplified_amacro_t *simplified;
+    gboolean clearOperatorUsed;
+} amacro_cache_entry_t;
 
-static macro_stack_t *
-new_stack(size_t stack_size)
+static guint
+amacro_cache_hash (gconstpointer p)
 {
-    macro_stack_t *s;
+    const amacro_cache_key_t *key = p;
+    const guchar *bytes;
+    guint h = 5381 + g_direct_hash (key->amacro) + key->nuf_parameters;
+    gsize i;
 
-    s = (macro_stack_t *) g_new0 (macro_stack_t,1);
-    s->stack = (double *) g_new0 (double, stack_size);
-    s->sp = 0;
-    s->capacity = stack_size;
-    return s;
-} /* new_stack */
+    bytes = (const guchar *) &key->scale;
+    for (i = 0; i < sizeof (key->scale); i++)
+	h = h * 33 + bytes[i];
+    bytes = (const guchar *) key->parameter;
+    for (i = 0; i < sizeof (double) * key->nuf_parameters; i++)
+	h = h * 33 + bytes[i];
 
+    return h;
+} /* amacro_cache_hash */
 
-static void
-free_stack(macro_stack_t *s)
+static gboolean
+amacro_cache_equal (gconstpointer a, gconstpointer b)
 {
-    if (s && s->stack)
-	free(s->stack);
+    const amacro_cache_key_t *ka = a, *kb = b;
 
-    if (s)
-	free(s);
+    return ka->amacro == kb->amacro
+	&& ka->nuf_parameters == kb->nuf_parameters
+	&& memcmp (&ka->scale, &kb->scale, sizeof (ka->scale)) == 0
+	&& memcmp (ka->parameter, kb->parameter,
+		   sizeof (double) * ka->nuf_parameters) == 0;
+} /* amacro_cache_equal */
 
-    return;
-} /* free_stack */
+/* ------------------------------------------------------------------ */
+void
+gerber_destroy_amacro_cache (gerbv_image_t *image)
+{
+    GHashTable *shared;
+    GHashTableIter iter;
+    gerbv_aperture_iter_t apertures;
+    gerbv_aperture_t *aperture;
+    gpointer value;
+    gerbv_simplified_amacro_t *sam, *next;
+
+    if (image->amacro_cache == NULL)
+	return;
 
+    shared = g_hash_table_new (NULL, NULL);
+    g_hash_table_iter_init (&iter, image->amacro_cache);
+    while (g_hash_table_iter_next (&iter, NULL, &value)) {
+	amacro_cache_entry_t *entry = value;
 
-static void
-push(macro_stack_t *s, double val)
-{
-    if (s->sp >= s->capacity) {
-        GERB_FATAL_ERROR(_("push will overflow stack capacity"));
-        return;
+	g_hash_table_add (shared, entry->simplified);
     }
-    s->stack[s->sp++] = val;
-    return;
-} /* push */
 
+    /* Keep the apertures from freeing the shared macros */
+    gerbv_image_aperture_iter_init (&apertures, image);
+    while (gerbv_image_aperture_iter_next (&apertures, NULL, &aperture)) {
+	if (g_hash_table_contains (shared, aperture->simplified))
+	    aperture->simplified = NULL;
+    }
+    g_hash_table_destroy (shared);
 
-static int
-pop(macro_stack_t *s, double *value)
-{
-    /* Check if we try to pop an empty stack */
-    if (s->sp == 0) {
-	return -1;
+    g_hash_table_iter_init (&iter, image->amacro_cache);
+    while (g_hash_table_iter_next (&iter, NULL, &value)) {
+	amacro_cache_entry_t *entry = value;
+
+	for (sam = entry->simplified; sam != NULL; sam = next) {
+	    next = sam->next;
+	    if (image->arena == NULL)
+		g_free (sam->parameter);
+	    g_free (sam);
+	}
+	g_free (entry->key.parameter);
+	g_free (entry);
     }
-    
-    *value = s->stack[--s->sp];
-    return 0;
-} /* pop */
 
+    g_hash_table_destroy (image->amacro_cache);
+    image->amacro_cache = NULL;
+} /* gerber_destroy_amacro_cache */
 
 /* ------------------------------------------------------------------ */
 static int
-simplify_aperture_macro(gerbv_aperture_t *aperture, gdouble scale)
+simplify_aperture_macro(gerbv_image_t *image, gerbv_aperture_t *aperture,
+			gdouble scale)
 {
     const int extra_stack_size = 10;
-    macro_stack_t *s;
-    gerbv_instruction_t *ip;
+    amacro_code_t *code;
+    const amacro_op_t *op;
+    double stack_buf[APERTURE_PARAMETERS_MAX];
+    double *stack;
+    size_t sp = 0, capacity;
     int handled = 1, nuf_parameters = 0, i, j, clearOperatorUsed = FALSE;
-    double *lp; /* Local copy of parameters */
-    double tmp[2] = {0.0, 0.0};
+    double lp[APERTURE_PARAMETERS_MAX]; /* Local copy of parameters */
     gerbv_aperture_type_t type = GERBV_APTYPE_NONE;
     gerbv_simplified_amacro_t *sam;
 
@@ -1931,66 +1878,54 @@ simplify_aperture_macro(gerbv_aperture_t *aperture, gdouble scale)
     if (aperture->amacro == NULL)
 	GERB_FATAL_ERROR(_("aperture->amacro NULL in simplify aperture macro"));
 
-    /* Allocate stack for VM */
-    s = new_stack(aperture->amacro->nuf_push + extra_stack_size);
-    if (s == NULL) 
-	GERB_FATAL_ERROR("malloc stack failed in %s()", __FUNCTION__);
+    /* Macros are compiled once when they are parsed; the program was
+     * checked then, so the loop below needs no checks */
+    code = aperture->amacro->code;
+    if (code == NULL)
+	code = aperture->amacro->code = amacro_compile(aperture->amacro);
+    if (code->error != NULL)
+	GERB_FATAL_ERROR("%s", _(code->error));
+
+    /* Stack for the VM, on the C stack unless the macro is huge */
+    capacity = code->stack_size + extra_stack_size;
+    if (capacity <= G_N_ELEMENTS(stack_buf)) {
+	stack = stack_buf;
+	memset(stack_buf, 0, sizeof(stack_buf));
+    } else {
+	stack = g_new0 (double, capacity);
+    }
 
     /* Make a copy of the parameter list that we can rewrite if necessary */
-    lp = g_new (double,APERTURE_PARAMETERS_MAX);
-
-    memcpy(lp, aperture->parameter, sizeof(double) * APERTURE_PARAMETERS_MAX);
+    memset(lp, 0, sizeof(lp));
+    memcpy(lp, aperture->parameter,
+	   sizeof(double) * MIN(aperture->nuf_parameters, APERTURE_PARAMETERS_MAX));
     
-    for(ip = aperture->amacro->program; ip != NULL; ip = ip->next) {
-	switch(ip->opcode) {
-	case GERBV_OPCODE_NOP:
-	    break;
+    for (op = code->ops; op < code->ops + code->nuf_ops; op++) {
+	switch(op->opcode) {
 	case GERBV_OPCODE_PUSH :
-	    push(s, ip->data.fval);
+	    stack[sp++] = op->fval;
 	    break;
-        case GERBV_OPCODE_PPUSH : {
-	    ssize_t const idx = ip->data.ival - 1;
-	    if ((idx < 0) || (idx >= APERTURE_PARAMETERS_MAX))
-		GERB_FATAL_ERROR(_("Tried to access oob aperture"));
-	    push(s, lp[idx]);
+	case GERBV_OPCODE_PPUSH :
+	    stack[sp++] = lp[op->ival - 1];
 	    break;
-	}
-	case GERBV_OPCODE_PPOP: {
-	    if (pop(s, &tmp[0]) < 0)
-		GERB_FATAL_ERROR(_("Tried to pop an empty stack"));
-	    ssize_t const idx = ip->data.ival - 1;
-	    if ((idx < 0) || (idx >= APERTURE_PARAMETERS_MAX))
-		GERB_FATAL_ERROR(_("Tried to access oob aperture"));
-	    lp[idx] = tmp[0];
+	case GERBV_OPCODE_PPOP:
+	    lp[op->ival - 1] = stack[--sp];
 	    break;
-	}
 	case GERBV_OPCODE_ADD :
-	    if (pop(s, &tmp[0]) < 0)
-		GERB_FATAL_ERROR(_("Tried to pop an empty stack"));
-	    if (pop(s, &tmp[1]) < 0)
-		GERB_FATAL_ERROR(_("Tried to pop an empty stack"));
-	    push(s, tmp[1] + tmp[0]);
+	    sp--;
+	    stack[sp - 1] = stack[sp - 1] + stack[sp];
 	    break;
 	case GERBV_OPCODE_SUB :
-	    if (pop(s, &tmp[0]) < 0)
-		GERB_FATAL_ERROR(_("Tried to pop an empty stack"));
-	    if (pop(s, &tmp[1]) < 0)
-		GERB_FATAL_ERROR(_("Tried to pop an empty stack"));
-	    push(s, tmp[1] - tmp[0]);
+	    sp--;
+	    stack[sp - 1] = stack[sp - 1] - stack[sp];
 	    break;
 	case GERBV_OPCODE_MUL :
-	    if (pop(s, &tmp[0]) < 0)
-		GERB_FATAL_ERROR(_("Tried to pop an empty stack"));
-	    if (pop(s, &tmp[1]) < 0)
-		GERB_FATAL_ERROR(_("Tried to pop an empty stack"));
-	    push(s, tmp[1] * tmp[0]);
+	    sp--;
+	    stack[sp - 1] = stack[sp - 1] * stack[sp];
 	    break;
 	case GERBV_OPCODE_DIV :
-	    if (pop(s, &tmp[0]) < 0)
-		GERB_FATAL_ERROR(_("Tried to pop an empty stack"));
-	    if (pop(s, &tmp[1]) < 0)
-		GERB_FATAL_ERROR(_("Tried to pop an empty stack"));
-	    push(s, tmp[1] / tmp[0]);
+	    sp--;
+	    stack[sp - 1] = stack[sp - 1] / stack[sp];
 	    break;
 	case GERBV_OPCODE_PRIM :
 	    /* 
@@ -1998,7 +1933,7 @@ simplify_aperture_macro(gerbv_aperture_t *aperture, gdouble scale)
 	     * The exposure is always the first element on stack independent
 	     * of aperture macro.
 	     */
-	    switch(ip->data.ival) {
+	    switch(op->ival) {
 	    case 1:
 		dprintf("  Aperture macro circle [1] (");
 		type = GERBV_APTYPE_MACRO_CIRCLE;
@@ -2020,7 +1955,7 @@ simplify_aperture_macro(gerbv_aperture_t *aperture, gdouble scale)
 		 *
 		 * @see CVE-2021-40394
 		 */
-		int const sstack = (int)s->stack[1];
+		int const sstack = (int)stack[1];
 		if ((sstack < 0) || (sstack >= INT_MAX / 4)) {
 			GERB_COMPILE_ERROR(_("Possible signed integer overflow "
 					"in calculating number of parameters "
@@ -2067,11 +2002,13 @@ simplify_aperture_macro(gerbv_aperture_t *aperture, gdouble scale)
 	    }
 
 	    if (type != GERBV_APTYPE_NONE) { 
-		if (nuf_parameters > APERTURE_PARAMETERS_MAX) {
+		/* CVE-2021-40400
+		 */
+		if (nuf_parameters > (int)capacity) {
 			GERB_COMPILE_ERROR(_("Number of parameters to aperture macro (%d) "
-					"are more than gerbv is able to store (%d)"),
-					nuf_parameters, APERTURE_PARAMETERS_MAX);
-			nuf_parameters = APERTURE_PARAMETERS_MAX;
+					"capped to stack capacity (%zu)"),
+					nuf_parameters, capacity);
+			nuf_parameters = capacity;
 		}
 
 		/*
@@ -2081,19 +2018,19 @@ simplify_aperture_macro(gerbv_aperture_t *aperture, gdouble scale)
 		sam = g_new (gerbv_simplified_amacro_t, 1);
 		sam->type = type;
 		sam->next = NULL;
-		memset(sam->parameter, 0, 
-		       sizeof(double) * APERTURE_PARAMETERS_MAX);
-
-		/* CVE-2021-40400
-		 */
-		if (nuf_parameters > s->capacity) {
-			GERB_COMPILE_ERROR(_("Number of parameters to aperture macro (%d) "
-					"capped to stack capacity (%zu)"),
-					nuf_parameters, s->capacity);
-			nuf_parameters = s->capacity;
-		}
-		memcpy(sam->parameter, s->stack, 
+		sam->parameter = gerb_image_new_parameters(image, nuf_parameters);
+		sam->nuf_parameters = nuf_parameters;
+		memcpy(sam->parameter, stack, 
 		       sizeof(double) *  nuf_parameters);
+
+		/* Only keep the points of a capped outline that were stored,
+		 * readers find the rotation after the last point */
+		if (type == GERBV_APTYPE_MACRO_OUTLINE
+			&& (sam->parameter[OUTLINE_NUMBER_OF_POINTS] < 0
+			    || OUTLINE_ROTATION_IDX(sam->parameter)
+				>= nuf_parameters))
+		    sam->parameter[OUTLINE_NUMBER_OF_POINTS] =
+			MAX((nuf_parameters - 3) / 2 - 1, 0);
 		
 		/* convert any mm values to inches */
 		switch (type) {
@@ -2173,7 +2110,7 @@ simplify_aperture_macro(gerbv_aperture_t *aperture, gdouble scale)
 
 #ifdef DEBUG
 		for (i = 0; i < nuf_parameters; i++) {
-		    dprintf("%f, ", s->stack[i]);
+		    dprintf("%f, ", stack[i]);
 		}
 #endif /* DEBUG */
 		dprintf(")\n");
@@ -2185,14 +2122,14 @@ simplify_aperture_macro(gerbv_aperture_t *aperture, gdouble scale)
 	     * I can do this. The correct way to do this should be to 
 	     * subtract number of used elements in each primitive operation.
 	     */
-	    s->sp = 0;
+	    sp = 0;
 	    break;
 	default :
 	    break;
 	}
     }
-    free_stack(s);
-    g_free (lp);
+    if (stack != stack_buf)
+	g_free (stack);
 
     /* store a flag to let the renderer know if it should expect any "clear"
        primatives */
@@ -2201,6 +2138,78 @@ simplify_aperture_macro(gerbv_aperture_t *aperture, gdouble scale)
 } /* simplify_aperture_macro */
 
 
+/* ------------------------------------------------------------------ */
+/* Simplify the macro of aperture, or share the result of an earlier
+ * aperture calling the macro with the same parameters and scale. */
+static void
+simplify_aperture_macro_cached(gerbv_image_t *image,
+			       gerbv_aperture_t *aperture, gdouble scale)
+{
+    amacro_cache_entry_t *entry;
+    amacro_cache_key_t key;
+    double *parameter;
+
+    /* Only looked up with the parameters of aperture, copied to insert */
+    key.amacro = aperture->amacro;
+    key.scale = scale;
+    key.nuf_parameters = MAX(aperture->nuf_parameters, 0);
+    key.parameter = aperture->parameter;
+
+    if (image->amacro_cache == NULL)
+	image->amacro_cache = g_hash_table_new(amacro_cache_hash,
+					       amacro_cache_equal);
+
+    entry = g_hash_table_lookup(image->amacro_cache, &key);
+    if (entry != NULL) {
+	dprintf("   Sharing simplified macro \"%s\"\n",
+		aperture->amacro->name);
+	aperture->simplified = entry->simplified;
+	aperture->parameter[0] = (gdouble) entry->clearOperatorUsed;
+	return;
+    }
+
+    /* The key keeps the parameters as they were before simplifying */
+    parameter = g_new(double, MAX(key.nuf_parameters, 1));
+    memcpy(parameter, key.parameter, sizeof(double) * key.nuf_parameters);
+
+    simplify_aperture_macro(image, aperture, scale);
+    if (image->parse_stats != NULL)
+	image->parse_stats->macros++;
+    if (aperture->simplified == NULL) {
+	g_free(parameter);
+	return;
+    }
+
+    entry = g_new(amacro_cache_entry_t, 1);
+    entry->key = key;
+    entry->key.parameter = parameter;
+    entry->simplified = aperture->simplified;
+    entry->clearOperatorUsed = aperture->parameter[0] != 0.0;
+    g_hash_table_insert(image->amacro_cache, &entry->key, entry);
+} /* simplify_aperture_macro_cached */
+
+
+/* ------------------------------------------------------------------ */
+/* The next token of *rest like strtok(), but keeping the position in
+ * rest so that files can be parsed on several threads at once */
+static char *
+aperture_definition_token(char **rest, const char *delim)
+{
+    char *token = *rest + strspn(*rest, delim);
+
+    if (*token == '\0') {
+	*rest = token;
+	return NULL;
+    }
+
+    *rest = token + strcspn(token, delim);
+    if (**rest != '\0')
+	*(*rest)++ = '\0';
+
+    return token;
+} /* aperture_definition_token */
+
+
 /* ------------------------------------------------------------------ */
 static int 
 parse_aperture_definition(gerb_file_t *fd, gerbv_aperture_t *aperture,
@@ -2208,15 +2217,17 @@ parse_aperture_definition(gerb_file_t *fd, gerbv_aperture_t *aperture,
 			  long int *line_num_p)
 {
     int ano, i;
-    char *ad;
+    char *ad, *rest;
     char *token;
     gerbv_amacro_t *curr_amacro;
     gerbv_amacro_t *amacro = image->amacro;
     gerbv_error_list_t *error_list = image->gerbv_stats->error_list;
     gdouble tempHolder;
+    double parameter[APERTURE_PARAMETERS_MAX];
     
     if (gerb_fgetc(fd) != 'D') {
-	gerbv_stats_printf(error_list, GERBV_MESSAGE_ERROR, -1,
+	gerbv_stats_printf_line(error_list,
+		GERBV_MESSAGE_ERROR, -1, *line_num_p,
 		_("Found AD code with no following 'D' "
 		    "at line %ld in file \"%s\""),
 		*line_num_p, fd->filename);
@@ -2234,17 +2245,20 @@ parse_aperture_definition(gerb_file_t *fd, gerbv_aperture_t *aperture,
     ad = gerb_fgetstring(fd, '*');
 
     if (ad == NULL) {
-	gerbv_stats_printf(error_list, GERBV_MESSAGE_ERROR, -1,
+	gerbv_stats_printf_line(error_list,
+		GERBV_MESSAGE_ERROR, -1, *line_num_p,
 		_("Invalid aperture definition at line %ld in file \"%s\", "
 		    "cannot find '*'"),
 		*line_num_p, fd->filename);
 	return -1;
     }
 
-    token = strtok(ad, ",");
+    rest = ad;
+    token = aperture_definition_token(&rest, ",");
     
     if (token == NULL) {
-	gerbv_stats_printf(error_list, GERBV_MESSAGE_ERROR, -1,
+	gerbv_stats_printf_line(error_list,
+		GERBV_MESSAGE_ERROR, -1, *line_num_p,
 		_("Invalid aperture definition at line %ld in file \"%s\""),
 		*line_num_p, fd->filename);
 	return -1;
@@ -2285,10 +2299,12 @@ parse_aperture_definition(gerb_file_t *fd, gerbv_aperture_t *aperture,
     /*
      * Parse all parameters
      */
-    for (token = strtok(NULL, "X"), i = 0; token != NULL; 
-	 token = strtok(NULL, "X"), i++) {
+    for (token = aperture_definition_token(&rest, "X"), i = 0;
+	 token != NULL;
+	 token = aperture_definition_token(&rest, "X"), i++) {
 	if (i == APERTURE_PARAMETERS_MAX) {
-	    gerbv_stats_printf(error_list, GERBV_MESSAGE_ERROR, -1,
+	    gerbv_stats_printf_line(error_list,
+		    GERBV_MESSAGE_ERROR, -1, *line_num_p,
 		    _("Maximum number of allowed parameters exceeded "
 			"in aperture %d at line %ld in file \"%s\""),
 		    ano, *line_num_p, fd->filename);
@@ -2296,7 +2312,7 @@ parse_aperture_definition(gerb_file_t *fd, gerbv_aperture_t *aperture,
 	}
 	errno = 0;
 
-	tempHolder = strtod(token, NULL);
+	tempHolder = g_ascii_strtod(token, NULL);
 	/* convert any MM values to inches */
 	/* don't scale polygon angles or side numbers, or macro parmaeters */
 	if (!(((aperture->type == GERBV_APTYPE_POLYGON) && ((i==1) || (i==2)))||
@@ -2304,16 +2320,19 @@ parse_aperture_definition(gerb_file_t *fd, gerbv_aperture_t *aperture,
 	    tempHolder /= scale;
 	}
 	
-	aperture->parameter[i] = tempHolder;
+	parameter[i] = tempHolder;
 	if (errno) {
-	    gerbv_stats_printf(error_list, GERBV_MESSAGE_WARNING, -1,
+	    gerbv_stats_printf_line(error_list,
+		    GERBV_MESSAGE_WARNING, -1, *line_num_p,
 		    _("Failed to read all parameters exceeded in "
 			"aperture %d at line %ld in file \"%s\""),
 		    ano, *line_num_p, fd->filename);
-            aperture->parameter[i] = 0.0;
+            parameter[i] = 0.0;
         }
     }
     
+    aperture->parameter = gerb_image_new_parameters(image, i);
+    memcpy(aperture->parameter, parameter, sizeof(double) * i);
     aperture->nuf_parameters = i;
     
     gerb_ungetc(fd);
@@ -2321,7 +2340,7 @@ parse_aperture_definition(gerb_file_t *fd, gerbv_aperture_t *aperture,
     if (aperture->type == GERBV_APTYPE_MACRO) {
 	dprintf("Simplifying aperture %d using aperture macro \"%s\"\n", ano,
 		aperture->amacro->name);
-	simplify_aperture_macro(aperture, scale);
+	simplify_aperture_macro_cached(image, aperture, scale);
 	dprintf("Done simplifying\n");
     }
     
@@ -2538,6 +2557,7 @@ calc_cirseg_mq(struct gerbv_net *net, int cw,
 static void
 calc_cirseg_bbox(const gerbv_cirseg_t *cirseg,
 		double apert_size_x, double apert_size_y,
+		const cairo_matrix_t *matrix,
 		gerbv_render_size_t *bbox)
 {
 	gdouble x, y, ang1, ang2, step_pi_2;
@@ -2552,7 +2572,7 @@ calc_cirseg_bbox(const gerbv_cirseg_t *cirseg,
 	/* Start arc point */
 	x = cirseg->cp_x + cirseg->width*cos(ang1)/2;
 	y = cirseg->cp_y + cirseg->width*sin(ang1)/2;
-	gerber_update_min_and_max(bbox, x, y,
+	update_min_and_max(matrix, bbox, x, y,
 				apert_size_x, apert_size_x,
 				apert_size_y, apert_size_y);
 
@@ -2562,7 +2582,7 @@ calc_cirseg_bbox(const gerbv_cirseg_t *cirseg,
 				step_pi_2 += M_PI_2) {
 		x = cirseg->cp_x + cirseg->width*cos(step_pi_2)/2;
 		y = cirseg->cp_y + cirseg->width*sin(step_pi_2)/2;
-		gerber_update_min_and_max(bbox, x, y,
+		update_min_and_max(matrix, bbox, x, y,
 					apert_size_x, apert_size_x,
 					apert_size_y, apert_size_y);
 	}
@@ -2570,20 +2590,22 @@ calc_cirseg_bbox(const gerbv_cirseg_t *cirseg,
 	/* Stop arc point */
 	x = cirseg->cp_x + cirseg->width*cos(ang2)/2;
 	y = cirseg->cp_y + cirseg->width*sin(ang2)/2;
-	gerber_update_min_and_max(bbox, x, y,
+	update_min_and_max(matrix, bbox, x, y,
 				apert_size_x, apert_size_x,
 				apert_size_y, apert_size_y);
 }
 
 static void
-gerber_update_any_running_knockout_measurements (gerbv_image_t *image)
+gerber_update_any_running_knockout_measurements (gerb_state_t *state)
 {
-    if (knockoutMeasure) {
-	knockoutLayer->knockout.lowerLeftX = knockoutLimitXmin;
-	knockoutLayer->knockout.lowerLeftY = knockoutLimitYmin;
-	knockoutLayer->knockout.width = knockoutLimitXmax - knockoutLimitXmin;
-	knockoutLayer->knockout.height = knockoutLimitYmax - knockoutLimitYmin;
-	knockoutMeasure = FALSE;
+    if (state->knockout_measure) {
+	gerbv_knockout_t *ko = &state->knockout_layer->knockout;
+
+	ko->lowerLeftX = state->knockout_limit.left;
+	ko->lowerLeftY = state->knockout_limit.bottom;
+	ko->width = state->knockout_limit.right - state->knockout_limit.left;
+	ko->height = state->knockout_limit.top - state->knockout_limit.bottom;
+	state->knockout_measure = FALSE;
     }
 }
 
@@ -2635,8 +2657,11 @@ gerber_update_image_min_max (gerbv_render_size_t *boundingBox,
 			boundingBox->top + repeat_off_Y);
 }
 
-void
-gerber_update_min_and_max(gerbv_render_size_t *boundingBox,
+/* Grow boundingBox by the aperture extent around (x, y), transformed by
+ * matrix (if not NULL) to the final rendered position */
+static void
+update_min_and_max(const cairo_matrix_t *matrix,
+			  gerbv_render_size_t *boundingBox,
 			  gdouble x, gdouble y, gdouble apertureSizeX1,
 			  gdouble apertureSizeX2,gdouble apertureSizeY1,
 			  gdouble apertureSizeY2)
@@ -2648,8 +2673,10 @@ gerber_update_min_and_max(gerbv_render_size_t *boundingBox,
        for any scaling, offsets, mirroring, etc */
     /* NOTE: we need to already add/subtract in the aperture size since
        the final rendering may be scaled */
-    cairo_matrix_transform_point (&currentMatrix, &ourX1, &ourY1);
-    cairo_matrix_transform_point (&currentMatrix, &ourX2, &ourY2);
+    if (matrix != NULL) {
+	cairo_matrix_transform_point (matrix, &ourX1, &ourY1);
+	cairo_matrix_transform_point (matrix, &ourX2, &ourY2);
+    }
 
     /* check both points against the min/max, since depending on the rotation,
        mirroring, etc, either point could possibly be a min or max */
@@ -2662,6 +2689,19 @@ gerber_update_min_and_max(gerbv_render_size_t *boundingBox,
     boundingBox->bottom = MIN(boundingBox->bottom, ourY2);
     boundingBox->top =    MAX(boundingBox->top,    ourY1);
     boundingBox->top =    MAX(boundingBox->top,    ourY2);
+} /* update_min_and_max */
+
+/* Used for objects created outside of a parse, which are already in
+ * image coordinates */
+void
+gerber_update_min_and_max(gerbv_render_size_t *boundingBox,
+			  gdouble x, gdouble y, gdouble apertureSizeX1,
+			  gdouble apertureSizeX2,gdouble apertureSizeY1,
+			  gdouble apertureSizeY2)
+{
+    update_min_and_max (NULL, boundingBox, x, y,
+		    apertureSizeX1, apertureSizeX2,
+		    apertureSizeY1, apertureSizeY2);
 } /* gerber_update_min_and_max */
 
 static gboolean
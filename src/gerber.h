@@ -55,16 +55,23 @@ typedef struct gerb_state {
     gerbv_netstate_t *state;
     int in_parea_fill;
     int mq_on;		/* Is multiquadrant circular iterpolation */
+    cairo_matrix_t matrix;	/* Transformation of the current block */
+    gboolean knockout_measure;	/* Measuring a bordered %KO */
+    gerbv_render_size_t knockout_limit;
+    gerbv_layer_t *knockout_layer;
 } gerb_state_t;
 
 /*
  * parse gerber file pointed to by fd
  */
 gerbv_image_t *parse_gerb(gerb_file_t *fd, gchar *directoryPath);
-gboolean gerber_is_rs274x_p(gerb_file_t *fd, gboolean *returnFoundBinary);
-gboolean gerber_is_rs274d_p(gerb_file_t *fd);
 gerbv_net_t *
-gerber_create_new_net (gerbv_net_t *currentNet, gerbv_layer_t *layer, gerbv_netstate_t *state);
+gerber_create_new_net (gerbv_image_t *image, gerbv_net_t *currentNet,
+		gerbv_layer_t *layer, gerbv_netstate_t *state);
+
+/* Free the simplified aperture macros apertures of image share */
+void
+gerber_destroy_amacro_cache (gerbv_image_t *image);
 
 gboolean
 gerber_create_new_aperture (gerbv_image_t *image, int *indexNumber,
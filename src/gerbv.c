@@ -34,6 +34,7 @@
 #include <stdlib.h>
 #include <math.h>
 #include <errno.h>
+#include <glib/gstdio.h>
 
 #ifdef HAVE_LIBGEN_H
 # include <libgen.h> /* dirname */
@@ -62,6 +63,9 @@
 #include "draw.h"
 
 #include "pick-and-place.h"
+#include "gerb_zip.h"
+#include "gerb_classify.h"
+#include "gerb_cache.h"
 
 /* DEBUG printing.  #define DEBUG 1 in config.h to use this fcn. */
 #define dprintf if(DEBUG) printf
@@ -214,6 +218,9 @@ gerbv_destroy_fileinfo (gerbv_fileinfo_t *fileInfo){
 	gerbv_destroy_image (fileInfo->image);
 	g_free (fileInfo->fullPathname);
 	g_free (fileInfo->name);
+	g_free (fileInfo->sourceHash);
+	g_free (fileInfo->archivePathname);
+	g_free (fileInfo->archiveMember);
 	if (fileInfo->privateRenderData) {
 		cairo_surface_destroy ((cairo_surface_t *)
 			fileInfo->privateRenderData);
@@ -312,6 +319,37 @@ gerbv_save_layer_from_index(gerbv_project_t *gerbvProject, gint index, gchar *fi
 }
 
 
+/* ------------------------------------------------------------------ */
+/* What a layer was parsed from, to tell later if its file changed */
+typedef struct {
+    gint64 mtime;
+    gint64 size;	/* -1 if the layer must always be parsed again */
+    gchar *hash;	/* NULL until it is needed */
+} file_stamp_t;
+
+/* The modification time to record for a file, 0 if it was written in the
+ * last second: it may change again without its time changing */
+static gint64
+source_mtime (GStatBuf *statinfo)
+{
+  if (statinfo->st_mtime >= g_get_real_time () / G_USEC_PER_SEC - 1)
+    return 0;
+
+  return statinfo->st_mtime;
+} /* source_mtime */
+
+/* ------------------------------------------------------------------ */
+/* Set hash to the SHA-256 of fd, or size to -1 if fd includes other
+ * files: those can change without fd changing */
+static void
+stamp_contents (gerb_file_t *fd, gint64 *size, gchar **hash)
+{
+  if (gerb_fincludes (fd))
+    *size = -1;
+  else
+    *hash = gerb_fchecksum (fd);
+} /* stamp_contents */
+
 /* ------------------------------------------------------------------ */
 int
 gerbv_revert_file(gerbv_project_t *gerbvProject, int idx){
@@ -322,6 +360,69 @@ gerbv_revert_file(gerbv_project_t *gerbvProject, int idx){
   return rv;
 }
 
+/* ------------------------------------------------------------------ */
+/* TRUE unless the file of fileInfo still holds the contents it was
+ * parsed from */
+static gboolean
+source_changed (gerbv_fileinfo_t *fileInfo)
+{
+  GStatBuf statinfo;
+  gerb_file_t *fd;
+  gchar *hash;
+  gboolean unchangedTime, changed;
+
+  if (fileInfo->sourceSize < 0
+      || g_stat (fileInfo->fullPathname, &statinfo) != 0
+      || statinfo.st_size != fileInfo->sourceSize)
+    return TRUE;
+
+  unchangedTime = (fileInfo->sourceMtime != 0
+      && statinfo.st_mtime == fileInfo->sourceMtime);
+  if (unchangedTime && fileInfo->sourceHash != NULL)
+    return FALSE;
+
+  /* Without the hash of what was parsed, a touched file is parsed again */
+  if (!unchangedTime && fileInfo->sourceHash == NULL)
+    return TRUE;
+
+  fd = gerb_fopen (fileInfo->fullPathname);
+  if (fd == NULL)
+    return TRUE;
+
+  /* The file still holds what was parsed: hash it now, for the next
+   * time it is touched */
+  if (fileInfo->sourceHash == NULL) {
+    stamp_contents (fd, &fileInfo->sourceSize, &fileInfo->sourceHash);
+    gerb_fclose (fd);
+    return fileInfo->sourceHash == NULL;
+  }
+
+  /* Touched, or written while it was read: compare the contents */
+  hash = gerb_fchecksum (fd);
+  gerb_fclose (fd);
+
+  changed = (hash == NULL || strcmp (hash, fileInfo->sourceHash) != 0);
+  if (!changed)
+    fileInfo->sourceMtime = source_mtime (&statinfo);
+  g_free (hash);
+
+  return changed;
+} /* source_changed */
+
+/* ------------------------------------------------------------------ */
+int
+gerbv_revert_changed_file(gerbv_project_t *gerbvProject, int idx)
+{
+  gerbv_fileinfo_t *fileInfo = gerbvProject->file[idx];
+
+  if (!fileInfo->layer_dirty && !source_changed (fileInfo)) {
+    dprintf("%s not changed, keeping it\n", fileInfo->fullPathname);
+    return 1;
+  }
+
+  return gerbv_revert_file (gerbvProject, idx);
+} /* gerbv_revert_changed_file */
+
 /* ------------------------------------------------------------------ */
 void 
 gerbv_revert_all_files(gerbv_project_t *gerbvProject) 
@@ -336,6 +437,20 @@ gerbv_revert_all_files(gerbv_project_t *gerbvProject)
   }
 } /* gerbv_revert_all_files */
 
+/* ------------------------------------------------------------------ */
+void 
+gerbv_revert_changed_files(gerbv_project_t *gerbvProject) 
+{
+  int idx;
+  
+  for (idx = 0; idx <= gerbvProject->last_loaded; idx++) {
+    if (gerbvProject->file[idx] && gerbvProject->file[idx]->fullPathname) {
+      (void) gerbv_revert_changed_file (gerbvProject, idx);
+      gerbvProject->file[idx]->layer_dirty = FALSE;
+    }
+  }
+} /* gerbv_revert_changed_files */
+
 /* ------------------------------------------------------------------ */
 void 
 gerbv_unload_layer(gerbv_project_t *gerbvProject, int index) 
@@ -428,6 +543,12 @@ gerbv_add_parsed_image_to_project (gerbv_project_t *gerbvProject, gerbv_image_t
     if (reload) {
 	gerbv_destroy_image(gerbvProject->file[idx]->image);
 	gerbvProject->file[idx]->image = parsed_image;
+	/* The renderer draws layers without render data again */
+	if (gerbvProject->file[idx]->privateRenderData) {
+	    cairo_surface_destroy ((cairo_surface_t *)
+		    gerbvProject->file[idx]->privateRenderData);
+	    gerbvProject->file[idx]->privateRenderData = NULL;
+	}
 	return 0;
     } else {
 	/* Load new file. */
@@ -460,52 +581,23 @@ gerbv_add_parsed_image_to_project (gerbv_project_t *gerbvProject, gerbv_image_t
 }
 
 /* ------------------------------------------------------------------ */
-int
-gerbv_open_image(gerbv_project_t *gerbvProject, gchar const* filename, int idx, int reload,
-		gerbv_HID_Attribute *fattr, int n_fattr, gboolean forceLoadFile)
+/* Parse an opened file into one image (or two, for pick-and-place
+ * files) and close it.  The project is not touched here, so this may run
+ * on a worker thread.  reloadLayertype is only used when reload is TRUE.  */
+static void
+parse_image_from_fd (gerb_file_t *fd, gchar const* filename,
+		gerbv_HID_Attribute *attr_list, int n_attr,
+		int reload, gerbv_layertype_t reloadLayertype,
+		gboolean forceLoadFile, gerbv_image_t **image,
+		gerbv_image_t **image2, gboolean *isPnpFile)
 {
-    gerb_file_t *fd;
     gerbv_image_t *parsed_image = NULL, *parsed_image2 = NULL;
-    gint retv = -1;
-    gboolean isPnpFile = FALSE, foundBinary;
-    gerbv_HID_Attribute *attr_list = NULL;
-    int n_attr = 0;
-    /* If we're reloading, we'll pass in our file format attribute list
-     * since this is our hook for letting the user override the fileformat.
-     */
-    if (reload)
-	{
-	    /* We're reloading so use the attribute list in memory */
-	    attr_list =  gerbvProject->file[idx]->image->info->attr_list;
-	    n_attr =  gerbvProject->file[idx]->image->info->n_attr;
-	}
-    else
-	{
-	    /* We're not reloading so use the attribute list read from the 
-	     * project file if given or NULL otherwise.
-	     */
-	    attr_list = fattr;
-	    n_attr = n_fattr;
-	}
-    /* if we don't have enough spots, then grow the file list by 2 to account for the possible 
-       loading of two images for PNP files */
-    if ((idx+1) >= gerbvProject->max_files) {
-	gerbvProject->file = g_renew (gerbv_fileinfo_t *,
-			gerbvProject->file, gerbvProject->max_files + 2);
+    gboolean foundBinary;
+    guint binaryMask;
 
-	gerbvProject->file[gerbvProject->max_files] = NULL;
-	gerbvProject->file[gerbvProject->max_files+1] = NULL;
-	gerbvProject->max_files += 2;
-    }
-    
-    dprintf("In open_image, about to try opening filename = %s\n", filename);
-    
-    fd = gerb_fopen(filename);
-    if (fd == NULL) {
-	GERB_COMPILE_ERROR(_("Trying to open \"%s\": %s"),
-			filename, strerror(errno));
-	return -1;
-    }
+    *image = NULL;
+    *image2 = NULL;
+    *isPnpFile = FALSE;
 
     /* Store filename info fd for further use */
     fd->filename = g_strdup(filename);
@@ -517,7 +609,11 @@ gerbv_open_image(gerbv_project_t *gerbvProject, gchar const* filename, int idx,
        if user opens the layer from the menu...if from the command line, we go
        ahead and try to load it anyways) */
 
-    if (gerber_is_rs274x_p(fd, &foundBinary)) {
+    /* A file including the same file many times reads it once */
+    gerb_include_cache_begin();
+
+    switch (gerb_classify(fd, &foundBinary, &binaryMask)) {
+    case GERB_FILE_TYPE_RS274X:
 	dprintf("Found RS-274X file\n");
 	if (!foundBinary || forceLoadFile) {
 		/* figure out the directory path in case parse_gerb needs to
@@ -526,18 +622,19 @@ gerbv_open_image(gerbv_project_t *gerbvProject, gchar const* filename, int idx,
 		parsed_image = parse_gerb(fd, currentLoadDirectory);
 		g_free (currentLoadDirectory);
 	}
-    } else if(drill_file_p(fd, &foundBinary)) {
+	break;
+    case GERB_FILE_TYPE_DRILL:
 	dprintf("Found drill file\n");
 	if (!foundBinary || forceLoadFile)
 	    parsed_image = parse_drillfile(fd, attr_list, n_attr, reload);
-	
-    } else if (pick_and_place_check_file_type(fd, &foundBinary)) {
+	break;
+    case GERB_FILE_TYPE_PICKANDPLACE:
 	dprintf("Found pick-n-place file\n");
 	if (!foundBinary || forceLoadFile) {
 		if (!reload) {
 			pick_and_place_parse_file_to_images(fd, &parsed_image, &parsed_image2);
 		} else {
-			switch (gerbvProject->file[idx]->image->layertype) {
+			switch (reloadLayertype) {
 			case GERBV_LAYERTYPE_PICKANDPLACE_TOP:
 				/* Non NULL pointer is used as "not to reload" mark */
 				parsed_image2 = (void *)!NULL;
@@ -555,9 +652,10 @@ gerbv_open_image(gerbv_project_t *gerbvProject, gchar const* filename, int idx,
 			}
 		}
 			
-		isPnpFile = TRUE;
+		*isPnpFile = TRUE;
 	}
-    } else if (gerber_is_rs274d_p(fd)) {
+	break;
+    case GERB_FILE_TYPE_RS274D: {
 	gchar *str = g_strdup_printf(_("Most likely found a RS-274D file "
 			"\"%s\" ... trying to open anyways\n"), filename);
 	dprintf("%s", str);
@@ -571,19 +669,165 @@ gerbv_open_image(gerbv_project_t *gerbvProject, gchar const* filename, int idx,
 		parsed_image = parse_gerb(fd, currentLoadDirectory);
 		g_free (currentLoadDirectory);
 	}
-    } else {
+	break;
+    }
+    default:
 	/* This is not a known file */
 	dprintf("Unknown filetype");
 	GERB_COMPILE_ERROR(_("%s: Unknown file type."), filename);
 	parsed_image = NULL;
     }
+
+    /* Only the head of the file was checked for binary bytes before
+     * parsing it, the rest while it was parsed */
+    if ((gerb_fbinary(fd) & binaryMask) && !forceLoadFile
+	    && parsed_image != NULL) {
+	GERB_COMPILE_ERROR(_("%s: Binary data found after the start "
+			"of the file, not loading it."), filename);
+	gerbv_destroy_image(parsed_image);
+	gerbv_destroy_image(parsed_image2);
+	parsed_image = parsed_image2 = NULL;
+	*isPnpFile = FALSE;
+    }
     
+    gerb_include_cache_end();
     g_free(fd->filename);
     gerb_fclose(fd);
+
+    *image = parsed_image;
+    *image2 = parsed_image2;
+} /* parse_image_from_fd */
+
+/* ------------------------------------------------------------------ */
+/* stamp gets what the file was when it was read, for a later reload */
+static void
+parse_image_from_file (gchar const* filename,
+		gerbv_HID_Attribute *attr_list, int n_attr,
+		int reload, gerbv_layertype_t reloadLayertype,
+		gboolean forceLoadFile, gerbv_image_t **image,
+		gerbv_image_t **image2, gboolean *isPnpFile,
+		file_stamp_t *stamp)
+{
+    gerb_file_t *fd;
+    gchar *cachePath;
+    GStatBuf statinfo;
+
+    *image = NULL;
+    *image2 = NULL;
+    *isPnpFile = FALSE;
+    stamp->size = -1;
+    stamp->hash = NULL;
+
+    dprintf("In open_image, about to try opening filename = %s\n", filename);
+    
+    /* Before it is read, so that a change while it is read moves its
+     * time on */
+    if (g_stat (filename, &statinfo) == 0) {
+	stamp->mtime = source_mtime (&statinfo);
+	stamp->size = statinfo.st_size;
+    }
+
+    fd = gerb_fopen(filename);
+    if (fd == NULL) {
+	GERB_COMPILE_ERROR(_("Trying to open \"%s\": %s"),
+			filename, strerror(errno));
+	return;
+    }
+
+    /* Hashing the contents costs another pass over them: only the cache
+     * needs the hash now, else source_changed() works it out when the
+     * layer is first checked for changes */
+    if (gerb_cache_enabled ())
+	stamp_contents (fd, &stamp->size, &stamp->hash);
+
+    /* Images parsed from the same contents before are read back from
+     * the cache directory instead */
+    cachePath = gerb_cache_path (stamp->hash, attr_list, n_attr, reload,
+		    forceLoadFile);
+    if (cachePath != NULL
+	    && gerb_cache_load (cachePath, image, image2, isPnpFile)) {
+	dprintf("Read %s from the cache\n", filename);
+	gerb_fclose (fd);
+	g_free (cachePath);
+	return;
+    }
+
+    parse_image_from_fd (fd, filename, attr_list, n_attr, reload,
+		    reloadLayertype, forceLoadFile, image, image2, isPnpFile);
+
+    if (cachePath != NULL) {
+	gerb_cache_store (cachePath, *image, *image2, *isPnpFile);
+	g_free (cachePath);
+    }
+} /* parse_image_from_file */
+
+/* ------------------------------------------------------------------ */
+/* Record the zip archive and the name of the file in it the layer at idx
+ * was unpacked from, NULL if it was not */
+static void
+set_layer_archive (gerbv_project_t *gerbvProject, int idx,
+		gchar const* archive, gchar const* member)
+{
+    gerbv_fileinfo_t *fileInfo = gerbvProject->file[idx];
+    gchar *oldArchive = fileInfo->archivePathname;
+    gchar *oldMember = fileInfo->archiveMember;
+
+    /* A reload passes the names it already has */
+    fileInfo->archivePathname = g_strdup (archive);
+    fileInfo->archiveMember = g_strdup (member);
+    g_free (oldArchive);
+    g_free (oldMember);
+} /* set_layer_archive */
+
+/* ------------------------------------------------------------------ */
+/* Record stamp (NULL if there is no file to check) in the layer at idx */
+static void
+stamp_layer (gerbv_project_t *gerbvProject, int idx, file_stamp_t *stamp)
+{
+    gerbv_fileinfo_t *fileInfo = gerbvProject->file[idx];
+
+    g_free (fileInfo->sourceHash);
+    fileInfo->sourceHash = NULL;
+    fileInfo->sourceMtime = 0;
+    fileInfo->sourceSize = -1;
+    if (stamp == NULL)
+	return;
+
+    fileInfo->sourceMtime = stamp->mtime;
+    fileInfo->sourceSize = stamp->size;
+    fileInfo->sourceHash = g_strdup (stamp->hash);
+} /* stamp_layer */
+
+/* ------------------------------------------------------------------ */
+/* Add the image(s) returned by parse_image_from_file() to the project
+ * at idx (and idx + 1 for the bottom side of a pick-and-place file).
+ * stamp is what the file was when it was read, NULL if the images were
+ * not read from a file of their own.  archive and member name the zip
+ * archive and the file in it the images were unpacked from, or are NULL. */
+static int
+add_parsed_images_to_project (gerbv_project_t *gerbvProject,
+		gchar const* filename, gerbv_image_t *parsed_image,
+		gerbv_image_t *parsed_image2, gboolean isPnpFile,
+		int idx, int reload, file_stamp_t *stamp,
+		gchar const* archive, gchar const* member)
+{
+    gint retv = -1;
+
     if (parsed_image == NULL) {
 	return -1;
     }
     
+    /* if we don't have enough spots, then grow the file list by 2 to account for the possible 
+       loading of two images for PNP files */
+    if ((idx+1) >= gerbvProject->max_files) {
+	gerbvProject->file = g_renew (gerbv_fileinfo_t *,
+			gerbvProject->file, gerbvProject->max_files + 2);
+
+	gerbvProject->file[gerbvProject->max_files] = NULL;
+	gerbvProject->file[gerbvProject->max_files+1] = NULL;
+	gerbvProject->max_files += 2;
+    }
+    
     if (parsed_image) {
 	/* strip the filename to the base */
 	gchar *baseName = g_path_get_basename (filename);
@@ -595,10 +839,15 @@ gerbv_open_image(gerbv_project_t *gerbvProject, gchar const* filename, int idx,
     	retv = gerbv_add_parsed_image_to_project (gerbvProject, parsed_image, filename, displayedName, idx, reload);
     	g_free (baseName);
     	g_free (displayedName);
+	if (retv != -1) {
+	    stamp_layer (gerbvProject, idx, stamp);
+	    set_layer_archive (gerbvProject, idx, archive, member);
+	}
     }
 
     /* Set layer_dirty flag to FALSE */
-    gerbvProject->file[idx]->layer_dirty = FALSE;
+    if (gerbvProject->file[idx])
+	gerbvProject->file[idx]->layer_dirty = FALSE;
 
     /* for PNP place files, we may need to add a second image for the other
        board side */
@@ -610,11 +859,586 @@ gerbv_open_image(gerbv_project_t *gerbvProject, gchar const* filename, int idx,
     	retv = gerbv_add_parsed_image_to_project (gerbvProject, parsed_image2, filename, displayedName, idx + 1, reload);
     	g_free (baseName);
     	g_free (displayedName);
+	if (retv != -1) {
+	    stamp_layer (gerbvProject, idx + 1, stamp);
+	    set_layer_archive (gerbvProject, idx + 1, archive, member);
+	}
+    }
+
+    return retv;
+} /* add_parsed_images_to_project */
+
+/* ------------------------------------------------------------------ */
+/* Unpack member i of zip and parse it like a file called name */
+static void
+parse_image_from_zip_member (gerb_zip_t *zip, guint i, gchar const* name,
+		gerbv_HID_Attribute *attr_list, int n_attr,
+		int reload, gerbv_layertype_t reloadLayertype,
+		gboolean forceLoadFile, gerbv_image_t **image,
+		gerbv_image_t **image2, gboolean *isPnpFile)
+{
+    gerb_zip_member_t *member;
+    gerb_file_t *fd;
+    char *data;
+
+    *image = NULL;
+    *image2 = NULL;
+    *isPnpFile = FALSE;
+
+    member = &g_array_index (zip->members, gerb_zip_member_t, i);
+    data = gerb_zip_inflate (zip, i);
+    if (data == NULL) {
+	GERB_COMPILE_ERROR(_("Trying to unpack \"%s\": %s"),
+			name, _("damaged or out of memory"));
+	return;
+    }
+
+    fd = gerb_fopen_buffer (data, member->length);
+    if (fd == NULL) {
+	GERB_COMPILE_ERROR(_("Trying to open \"%s\": %s"),
+			name, strerror(errno));
+	g_free (data);
+	return;
+    }
+
+    parse_image_from_fd (fd, name, attr_list, n_attr, reload,
+		    reloadLayertype, forceLoadFile, image, image2, isPnpFile);
+    g_free (data);
+} /* parse_image_from_zip_member */
+
+/* ------------------------------------------------------------------ */
+/* Parse the layer at idx again from the zip archive it was unpacked from */
+static int
+reload_zip_member (gerbv_project_t *gerbvProject, int idx,
+		gerbv_HID_Attribute *attr_list, int n_attr,
+		gerbv_layertype_t reloadLayertype, gboolean forceLoadFile)
+{
+    gerbv_fileinfo_t *fileInfo = gerbvProject->file[idx];
+    gerbv_image_t *parsed_image = NULL, *parsed_image2 = NULL;
+    gboolean isPnpFile = FALSE;
+    gerb_zip_t *zip;
+    gint i;
+
+    zip = gerb_zip_open (fileInfo->archivePathname);
+    if (zip == NULL) {
+	GERB_COMPILE_ERROR(_("Trying to open \"%s\": %s"),
+			fileInfo->archivePathname, strerror(errno));
+	return -1;
+    }
+
+    i = gerb_zip_find (zip, fileInfo->archiveMember);
+    if (i == -1) {
+	GERB_COMPILE_ERROR(_("Trying to open \"%s\": %s"),
+			fileInfo->fullPathname, strerror(ENOENT));
+	gerb_zip_close (zip);
+	return -1;
+    }
+
+    parse_image_from_zip_member (zip, i, fileInfo->fullPathname,
+		    attr_list, n_attr, TRUE, reloadLayertype, forceLoadFile,
+		    &parsed_image, &parsed_image2, &isPnpFile);
+    gerb_zip_close (zip);
+
+    return add_parsed_images_to_project (gerbvProject,
+		    fileInfo->fullPathname, parsed_image, parsed_image2,
+		    isPnpFile, idx, TRUE, NULL, fileInfo->archivePathname,
+		    fileInfo->archiveMember);
+} /* reload_zip_member */
+
+static int open_zip_images (gerbv_project_t *gerbvProject,
+		gchar const* filename, int idx, gerbv_HID_Attribute *attr_list,
+		int n_attr, gboolean forceLoadFile, int *n_loaded);
+
+/* ------------------------------------------------------------------ */
+int
+gerbv_open_image(gerbv_project_t *gerbvProject, gchar const* filename, int idx, int reload,
+		gerbv_HID_Attribute *fattr, int n_fattr, gboolean forceLoadFile)
+{
+    gerbv_image_t *parsed_image = NULL, *parsed_image2 = NULL;
+    gboolean isPnpFile = FALSE;
+    gerbv_layertype_t reloadLayertype = GERBV_LAYERTYPE_RS274X;
+    gerbv_HID_Attribute *attr_list = NULL;
+    int n_attr = 0;
+    file_stamp_t stamp = { 0, 0, NULL };
+    int retv;
+    /* If we're reloading, we'll pass in our file format attribute list
+     * since this is our hook for letting the user override the fileformat.
+     */
+    if (reload)
+	{
+	    /* We're reloading so use the attribute list in memory */
+	    attr_list =  gerbvProject->file[idx]->image->info->attr_list;
+	    n_attr =  gerbvProject->file[idx]->image->info->n_attr;
+	    reloadLayertype = gerbvProject->file[idx]->image->layertype;
+	}
+    else
+	{
+	    /* We're not reloading so use the attribute list read from the 
+	     * project file if given or NULL otherwise.
+	     */
+	    attr_list = fattr;
+	    n_attr = n_fattr;
+	}
+
+    if (!reload && gerb_zip_p (filename)) {
+	int n_loaded;
+
+	/* Each file in the archive becomes a layer of its own */
+	return open_zip_images (gerbvProject, filename, idx, attr_list,
+			n_attr, forceLoadFile, &n_loaded) == -1 ? -1 : 1;
     }
 
+    if (reload && gerbvProject->file[idx]->archivePathname != NULL)
+	return reload_zip_member (gerbvProject, idx, attr_list, n_attr,
+			reloadLayertype, forceLoadFile);
+
+    parse_image_from_file (filename, attr_list, n_attr, reload,
+		    reloadLayertype, forceLoadFile,
+		    &parsed_image, &parsed_image2, &isPnpFile, &stamp);
+
+    retv = add_parsed_images_to_project (gerbvProject, filename,
+		    parsed_image, parsed_image2, isPnpFile, idx, reload,
+		    &stamp, NULL, NULL);
+    g_free (stamp.hash);
+
     return retv;
 } /* open_image */
 
+/* ------------------------------------------------------------------ */
+int
+gerbv_open_image_from_buffer(gerbv_project_t *gerbvProject, gchar const* data,
+		gsize length, gchar const* name, int idx,
+		gerbv_HID_Attribute *fattr, int n_fattr, gboolean forceLoadFile)
+{
+    gerb_file_t *fd;
+    gerbv_image_t *parsed_image = NULL, *parsed_image2 = NULL;
+    gboolean isPnpFile = FALSE;
+
+    fd = gerb_fopen_buffer(data, length);
+    if (fd == NULL) {
+	GERB_COMPILE_ERROR(_("Trying to open \"%s\": %s"),
+			name, strerror(errno));
+	return -1;
+    }
+
+    parse_image_from_fd (fd, name, fattr, n_fattr, FALSE,
+		    GERBV_LAYERTYPE_RS274X, forceLoadFile,
+		    &parsed_image, &parsed_image2, &isPnpFile);
+
+    return add_parsed_images_to_project (gerbvProject, name,
+		    parsed_image, parsed_image2, isPnpFile, idx, FALSE, NULL,
+		    NULL, NULL);
+} /* gerbv_open_image_from_buffer */
+
+/* ------------------------------------------------------------------ */
+/* State of one file loaded by gerbv_open_images() */
+typedef struct open_images_job {
+    gchar const* filename;	/* the file, or the layer name of a member */
+    gerbv_HID_Attribute *attr_list;
+    int n_attr;
+    gerb_zip_t *zip;		/* if not NULL, unpack member of zip */
+    guint member;
+    gboolean isZip;		/* the file is a zip archive of layers */
+    struct open_images_job *members;	/* of the archive, one each */
+    guint n_members;
+    gboolean forceLoadFile;
+    goffset size;		/* used to schedule the largest files first */
+    gerbv_image_t *image, *image2;
+    gboolean isPnpFile;
+    file_stamp_t stamp;
+    GArray *log;		/* messages held back while parsing */
+} open_images_job_t;
+
+typedef struct {
+    gchar *domain;
+    GLogLevelFlags level;
+    gchar *message;
+} open_images_log_item_t;
+
+/* Set on a worker thread to the job it is parsing */
+static GPrivate open_images_current_job = G_PRIVATE_INIT (NULL);
+
+/* The log domains whose messages are held back while parsing */
+static const gchar *open_images_log_domains[] = {
+    NULL, "libgerbv", "GLib", "GLib-GObject", "Gdk", "Gtk"
+};
+
+/* Messages from worker threads must not reach the application's log
+ * handlers directly (the GUI handler writes to GTK widgets), so they are
+ * stored with the job and replayed in layer order later.  Parser messages
+ * arrive through the message sink, this catches anything logged directly. */
+static void
+open_images_log_handler (const gchar *log_domain, GLogLevelFlags log_level,
+		const gchar *message, gpointer user_data)
+{
+    open_images_job_t *job = g_private_get (&open_images_current_job);
+    open_images_log_item_t item;
+
+    if (job == NULL) {
+	g_log_default_handler (log_domain, log_level, message, user_data);
+	return;
+    }
+
+    item.domain = g_strdup (log_domain);
+    item.level = log_level;
+    item.message = g_strdup (message);
+    g_array_append_val (job->log, item);
+}
+
+/* Message sink of the parsers running on a worker thread */
+static void
+open_images_message_sink (gerbv_message_type_t type, const gchar *text,
+		gpointer user_data)
+{
+    open_images_job_t *job = user_data;
+    open_images_log_item_t item;
+
+    switch (type) {
+    case GERBV_MESSAGE_ERROR:
+	item.level = G_LOG_LEVEL_CRITICAL;
+	break;
+    case GERBV_MESSAGE_WARNING:
+	item.level = G_LOG_LEVEL_WARNING;
+	break;
+    default:
+	return;
+    }
+
+    item.domain = NULL;
+    item.message = g_strdup (text);
+    g_array_append_val (job->log, item);
+}
+
+static void
+open_images_worker (gpointer data, gpointer user_data)
+{
+    open_images_job_t *job = data;
+
+    g_private_set (&open_images_current_job, job);
+    gerbv_set_message_sink (open_images_message_sink, job);
+    if (job->zip != NULL)
+	parse_image_from_zip_member (job->zip, job->member, job->filename,
+			job->attr_list, job->n_attr,
+			FALSE, GERBV_LAYERTYPE_RS274X, job->forceLoadFile,
+			&job->image, &job->image2, &job->isPnpFile);
+    else
+	parse_image_from_file (job->filename,
+			job->attr_list, job->n_attr,
+			FALSE, GERBV_LAYERTYPE_RS274X, job->forceLoadFile,
+			&job->image, &job->image2, &job->isPnpFile,
+			&job->stamp);
+    gerbv_set_message_sink (NULL, NULL);
+    g_private_set (&open_images_current_job, NULL);
+}
+
+static gint
+open_images_job_compare_size (gconstpointer a, gconstpointer b)
+{
+    const open_images_job_t *ja = *(open_images_job_t * const *)a;
+    const open_images_job_t *jb = *(open_images_job_t * const *)b;
+
+    return (ja->size < jb->size) - (ja->size > jb->size);
+}
+
+/* ------------------------------------------------------------------ */
+/* Parse the n_jobs files of queue on a pool of worker threads, the
+ * largest first, and wait for all of them */
+static void
+open_images_run (open_images_job_t **queue, int n_jobs)
+{
+    GThreadPool *pool = NULL;
+    guint handler_ids[G_N_ELEMENTS (open_images_log_domains)];
+    gint n_threads;
+    int i;
+
+    if (n_jobs <= 0)
+	return;
+
+    n_threads = MIN((gint) g_get_num_processors (), n_jobs);
+
+    /* Load time is bound by the slowest file, so start the biggest first */
+    qsort (queue, n_jobs, sizeof (queue[0]),
+		    open_images_job_compare_size);
+
+    /* Files included by several of these are read once */
+    gerb_include_cache_begin ();
+
+    for (i = 0; i < (int) G_N_ELEMENTS (open_images_log_domains); i++)
+	handler_ids[i] = g_log_set_handler (open_images_log_domains[i],
+		    G_LOG_FLAG_FATAL | G_LOG_FLAG_RECURSION | G_LOG_LEVEL_MASK,
+		    open_images_log_handler, NULL);
+
+    if (n_threads > 1)
+	pool = g_thread_pool_new (open_images_worker, NULL,
+			n_threads, TRUE, NULL);
+
+    for (i = 0; i < n_jobs; i++) {
+	if (pool == NULL || !g_thread_pool_push (pool, queue[i], NULL))
+	    open_images_worker (queue[i], NULL);
+    }
+
+    /* Wait for all files to be parsed */
+    if (pool != NULL)
+	g_thread_pool_free (pool, FALSE, TRUE);
+
+    for (i = 0; i < (int) G_N_ELEMENTS (open_images_log_domains); i++)
+	g_log_remove_handler (open_images_log_domains[i], handler_ids[i]);
+    gerb_include_cache_end ();
+} /* open_images_run */
+
+/* ------------------------------------------------------------------ */
+/* Replay the messages held back while parsing job */
+static void
+open_images_replay_log (open_images_job_t *job)
+{
+    guint j;
+
+    for (j = 0; j < job->log->len; j++) {
+	open_images_log_item_t *item = &g_array_index (job->log,
+			open_images_log_item_t, j);
+
+	g_log (item->domain, item->level & G_LOG_LEVEL_MASK,
+			"%s", item->message);
+	g_free (item->domain);
+	g_free (item->message);
+    }
+    g_array_free (job->log, TRUE);
+} /* open_images_replay_log */
+
+/* ------------------------------------------------------------------ */
+/* Open the zip archive of archive->filename and make a job of each of
+ * its members, to be parsed with the other files.  Returns FALSE if the
+ * archive could not be opened. */
+static gboolean
+open_zip_jobs (open_images_job_t *archive)
+{
+    gerb_zip_t *zip;
+    guint i;
+
+    zip = gerb_zip_open (archive->filename);
+    if (zip == NULL) {
+	GERB_COMPILE_ERROR(_("Trying to open \"%s\": %s"),
+			archive->filename, strerror(errno));
+	return FALSE;
+    }
+
+    archive->zip = zip;
+    archive->n_members = zip->members->len;
+    archive->members = g_new0 (open_images_job_t, archive->n_members);
+    for (i = 0; i < archive->n_members; i++) {
+	gerb_zip_member_t *member = &g_array_index (zip->members,
+			gerb_zip_member_t, i);
+	open_images_job_t *job = &archive->members[i];
+
+	job->filename = g_build_filename (archive->filename, member->name,
+			NULL);
+	job->attr_list = archive->attr_list;
+	job->n_attr = archive->n_attr;
+	job->zip = zip;
+	job->member = i;
+	job->forceLoadFile = archive->forceLoadFile;
+	job->size = member->length;
+	job->log = g_array_new (FALSE, FALSE,
+			sizeof (open_images_log_item_t));
+    }
+
+    return TRUE;
+} /* open_zip_jobs */
+
+/* ------------------------------------------------------------------ */
+/* Add the parsed members of the archive of open_zip_jobs() as layers
+ * from idx on, in the order of the archive, and close it.  Returns the
+ * index of the first layer, or -1 if none could be loaded. */
+static int
+add_zip_images (gerbv_project_t *gerbvProject, open_images_job_t *archive,
+		int idx, int *n_loaded)
+{
+    int first_idx = -1;
+    guint i;
+
+    *n_loaded = 0;
+
+    for (i = 0; i < archive->n_members; i++) {
+	open_images_job_t *job = &archive->members[i];
+
+	open_images_replay_log (job);
+
+	if (first_idx != -1)
+	    idx = gerbvProject->last_loaded + 1;
+	if (add_parsed_images_to_project (gerbvProject, job->filename,
+			job->image, job->image2, job->isPnpFile,
+			idx, FALSE, NULL, archive->filename,
+			g_array_index (archive->zip->members,
+				gerb_zip_member_t, job->member).name) != -1) {
+	    if (first_idx == -1)
+		first_idx = idx;
+	    (*n_loaded)++;
+	}
+
+	g_free ((gchar *) job->filename);
+    }
+
+    if (first_idx == -1)
+	GERB_COMPILE_ERROR(_("No layer could be read from \"%s\""),
+			archive->filename);
+
+    g_free (archive->members);
+    archive->members = NULL;
+    gerb_zip_close (archive->zip);
+    archive->zip = NULL;
+
+    return first_idx;
+} /* add_zip_images */
+
+/* ------------------------------------------------------------------ */
+/* Unpack and parse all members of a zip archive at once and add them as
+ * layers from idx on, in the order of the archive.  Returns the index of
+ * the first layer, or -1 if none could be loaded. */
+static int
+open_zip_images (gerbv_project_t *gerbvProject, gchar const* filename,
+		int idx, gerbv_HID_Attribute *attr_list, int n_attr,
+		gboolean forceLoadFile, int *n_loaded)
+{
+    open_images_job_t archive = { 0 }, **queue;
+    guint i;
+
+    *n_loaded = 0;
+
+    archive.filename = filename;
+    archive.attr_list = attr_list;
+    archive.n_attr = n_attr;
+    archive.forceLoadFile = forceLoadFile;
+    if (!open_zip_jobs (&archive))
+	return -1;
+
+    queue = g_new (open_images_job_t *, archive.n_members);
+    for (i = 0; i < archive.n_members; i++)
+	queue[i] = &archive.members[i];
+    open_images_run (queue, archive.n_members);
+    g_free (queue);
+
+    return add_zip_images (gerbvProject, &archive, idx, n_loaded);
+} /* open_zip_images */
+
+/* ------------------------------------------------------------------ */
+int
+gerbv_open_images (gerbv_project_t *gerbvProject,
+		gerbv_open_request_t *requests, int n_requests,
+		gboolean forceLoadFile)
+{
+    open_images_job_t *jobs;
+    GPtrArray *queue;
+    gint n_loaded = 0;
+    int i;
+
+    if (n_requests <= 0)
+	return 0;
+
+    jobs = g_new0 (open_images_job_t, n_requests);
+    queue = g_ptr_array_sized_new (n_requests);
+    for (i = 0; i < n_requests; i++) {
+	GStatBuf statinfo;
+
+	jobs[i].filename = requests[i].filename;
+	jobs[i].attr_list = requests[i].attr_list;
+	jobs[i].n_attr = requests[i].n_attr;
+	jobs[i].forceLoadFile = forceLoadFile;
+	jobs[i].log = g_array_new (FALSE, FALSE,
+			sizeof (open_images_log_item_t));
+
+	/* A single file of an archive is unpacked with the other files */
+	if (requests[i].member != NULL) {
+	    gint m = -1;
+
+	    jobs[i].zip = gerb_zip_open (requests[i].filename);
+	    if (jobs[i].zip != NULL)
+		m = gerb_zip_find (jobs[i].zip, requests[i].member);
+	    if (m == -1) {
+		GERB_COMPILE_ERROR(_("Trying to open \"%s\": %s"),
+				requests[i].filename, jobs[i].zip == NULL
+				? strerror(errno) : strerror(ENOENT));
+		if (jobs[i].zip != NULL)
+		    gerb_zip_close (jobs[i].zip);
+		jobs[i].zip = NULL;
+		jobs[i].filename = NULL;
+		continue;
+	    }
+
+	    jobs[i].member = m;
+	    jobs[i].size = g_array_index (jobs[i].zip->members,
+			    gerb_zip_member_t, m).length;
+	    jobs[i].filename = g_build_filename (requests[i].filename,
+			    requests[i].member, NULL);
+	    g_ptr_array_add (queue, &jobs[i]);
+	    continue;
+	}
+
+	/* The members of archives are parsed with the other files */
+	jobs[i].isZip = gerb_zip_p (requests[i].filename);
+	if (jobs[i].isZip) {
+	    guint m;
+
+	    if (!open_zip_jobs (&jobs[i])) {
+		jobs[i].filename = NULL;
+		continue;
+	    }
+	    for (m = 0; m < jobs[i].n_members; m++)
+		g_ptr_array_add (queue, &jobs[i].members[m]);
+	    continue;
+	}
+
+	if (g_stat (requests[i].filename, &statinfo) == 0)
+	    jobs[i].size = statinfo.st_size;
+	g_ptr_array_add (queue, &jobs[i]);
+    }
+
+    open_images_run ((open_images_job_t **) queue->pdata, queue->len);
+
+    /* Replay the messages and add the images in the requested order */
+    for (i = 0; i < n_requests; i++) {
+	open_images_job_t *job = &jobs[i];
+
+	open_images_replay_log (job);
+
+	if (job->filename == NULL) {
+	    requests[i].idx = -1;
+	    continue;
+	}
+
+	if (job->isZip) {
+	    int n_members;
+
+	    requests[i].idx = add_zip_images (gerbvProject, job,
+			    gerbvProject->last_loaded + 1, &n_members);
+	    n_loaded += n_members;
+	    continue;
+	}
+
+	requests[i].idx = gerbvProject->last_loaded + 1;
+	if (add_parsed_images_to_project (gerbvProject,
+			job->filename, job->image, job->image2,
+			job->isPnpFile, requests[i].idx, FALSE,
+			job->zip != NULL ? NULL : &job->stamp,
+			job->zip != NULL ? requests[i].filename : NULL,
+			requests[i].member) == -1)
+	    requests[i].idx = -1;
+	else
+	    n_loaded++;
+	g_free (job->stamp.hash);
+
+	if (job->zip != NULL) {
+	    gerb_zip_close (job->zip);
+	    g_free ((gchar *) job->filename);
+	}
+    }
+
+    g_ptr_array_free (queue, TRUE);
+    g_free (jobs);
+
+    return n_loaded;
+} /* gerbv_open_images */
+
+/* ------------------------------------------------------------------ */
 gerbv_image_t *
 gerbv_create_rs274x_image_from_filename (gchar const* filename){
 	gerbv_image_t *returnImage;
@@ -83,14 +83,19 @@ extern "C" {
 #endif
 
 #define APERTURE_MIN 10
-#define APERTURE_MAX 9999
+#define APERTURE_MAX 65535 /* Highest D code (table index) accepted */
 
 /*
- * Maximum number of aperture parameters is set by the outline aperture
- * macro. There (p. 28) is defined up to 50 points in polygon.
- * So 50 points with x and y plus two for holding extra data gives...
+ * Maximum number of parameters in an aperture definition, and so of the
+ * $n variables of an aperture macro. Simplified aperture macros, like
+ * outlines with many points, are not limited by it.
  */
 #define APERTURE_PARAMETERS_MAX 102
+/*
+ * Parameters are allocated per aperture, but never fewer than this many;
+ * the standard apertures and the statistics use the first five.
+ */
+#define APERTURE_PARAMETERS_MIN 5
 #define GERBV_SCALE_MIN 10
 #define GERBV_SCALE_MAX 3000
 #define MAX_ERRMSGLEN 25
@@ -395,14 +400,25 @@ typedef struct {
 } gerbv_HID_Attribute;
 /* end of HID attributes from PCB */
 
-/*! A linked list of errors found in the files */   
+/*! A linked list of errors found in the files.  A message reported again
+    with the same text is only counted. */   
 typedef struct error_list {
     int layer;
     gchar *error_text;
     gerbv_message_type_t type;
     struct error_list *next;
+    int count; /*!< the times the message was reported */
+    long first_line; /*!< the line it was first reported at, 0 if unknown */
+    long last_line; /*!< the line it was last reported at, 0 if unknown */
+    struct gerb_stats_index *index; /*!< lookup of the messages, kept on the first one (private) */
 } gerbv_error_list_t;
 
+/*! Receives the messages reported by a parser (see gerbv_set_message_sink()) */
+typedef void (*gerbv_message_sink_t) (gerbv_message_type_t type, /*!< the severity of the message */
+		const gchar *text, /*!< the message text */
+		gpointer user_data /*!< the pointer given to gerbv_set_message_sink() */
+);
+
 typedef struct instruction {
     gerbv_opcodes_t opcode;
     union {
@@ -417,11 +433,13 @@ typedef struct amacro {
     gerbv_instruction_t *program;
     unsigned int nuf_push;  /* Nuf pushes in program to estimate stack size */
     struct amacro *next;
+    struct amacro_code *code; /* program compiled by amacro_compile() */
 } gerbv_amacro_t;
 
 typedef struct gerbv_simplified_amacro {
     gerbv_aperture_type_t type;
-    double parameter[APERTURE_PARAMETERS_MAX];
+    double *parameter; /* MAX(nuf_parameters, APERTURE_PARAMETERS_MIN) */
+    int nuf_parameters;
     struct gerbv_simplified_amacro *next;
 } gerbv_simplified_amacro_t;
 
@@ -429,7 +447,7 @@ typedef struct gerbv_aperture {
     gerbv_aperture_type_t type;
     gerbv_amacro_t *amacro;
     gerbv_simplified_amacro_t *simplified;
-    double parameter[APERTURE_PARAMETERS_MAX];
+    double *parameter; /* MAX(nuf_parameters, APERTURE_PARAMETERS_MIN), owned by the image, see gerbv_image_new_aperture() */
     int nuf_parameters;
     gerbv_unit_t unit;
 } gerbv_aperture_t;
@@ -443,6 +461,7 @@ typedef struct gerbv_aperture_list {
     gerbv_aperture_type_t type;
     double parameter[5];
     struct gerbv_aperture_list *next;
+    struct gerb_stats_index *index; /*!< lookup of the elements, kept on the first one (private) */
 } gerbv_aperture_list_t;
 
 /*! Contains statistics on the various codes used in a RS274X file */
@@ -502,6 +521,7 @@ typedef struct drill_list {
     gchar *drill_unit;
     int drill_count;
     struct drill_list *next;
+    struct gerb_stats_index *index; /*!< lookup of the elements, kept on the first one (private) */
 } gerbv_drill_list_t;
 
 /*! Struct holding statistics of drill commands used.  Used in reporting statistics */
@@ -552,12 +572,35 @@ typedef struct {
 
 } gerbv_drill_stats_t;
 
+/*! Number of G, D and M codes timed apart; higher ones share the last slot */
+#define GERBV_PARSE_STATS_CODES 100
+
+/*!  Counters of how a file was parsed, kept while gerbv_set_parse_stats() is on.
+     The time of a code runs until the next code is read, so a D01 includes
+     the coordinates before it and creating its net. */
+typedef struct {
+    gint64 bytes; /*!< the size of the file and of the files it included */
+    gint64 usec; /*!< the time it took to parse, in microseconds */
+    guint nets; /*!< the nets created */
+    guint arcs; /*!< the arcs whose center and angles were calculated */
+    guint macros; /*!< the aperture macros simplified (not those shared with an identical aperture) */
+    gsize peak_alloc; /*!< the bytes held by the storage of the nets when parsing ended (it only grows while parsing) */
+    gint64 G_usec[GERBV_PARSE_STATS_CODES]; /*!< microseconds spent in each G code */
+    gint64 D_usec[GERBV_PARSE_STATS_CODES]; /*!< microseconds spent in each D code */
+    gint64 M_usec[GERBV_PARSE_STATS_CODES]; /*!< microseconds spent in each M code */
+    gint64 other_usec; /*!< microseconds spent elsewhere, like in % parameters and tool changes */
+    gint64 mark; /*!< when the code being timed was read (private) */
+    gint64 *current; /*!< the counter of the code being timed (private) */
+} gerbv_parse_stats_t;
+
 typedef struct {
 	gpointer image;		/* gerbv_image_t* */
 	gpointer net;		/* gerbv_net_t* */
 } gerbv_selection_item_t;
 
-/*! Struct holding info about the last selection */
+/*! Struct holding info about the last selection.  It must start zeroed
+    (selectedNodeCounts NULL), as selection_init() leaves it, and be freed
+    with selection_free_array() */
 typedef struct {
 	gerbv_selection_t type;
 	gdouble lowerLeftX;
@@ -565,6 +608,8 @@ typedef struct {
 	gdouble upperRightX;
 	gdouble upperRightY;
 	GArray *selectedNodeArray;
+	GHashTable *selectedNodeCounts;	/* (private) the number of items of
+					   each net, kept by selection.c */
 } gerbv_selection_info_t;
 
 /*!  Stores image transformation information, used to modify the rendered
@@ -705,7 +750,7 @@ typedef struct gerbv_image_info {
 /*!  The structure used to hold a layer (RS274X, drill, or pick-and-place data) */
 typedef struct {
   gerbv_layertype_t layertype; /*!< the type of layer (RS274X, drill, or pick-and-place) */
-  gerbv_aperture_t *aperture[APERTURE_MAX]; /*!< an array with all apertures used */
+  struct gerb_aperture_table *apertures; /*!< the apertures by D code (private), see gerbv_image_get_aperture() and gerbv_image_aperture_iter_init() */
   gerbv_layer_t *layers; /*!< an array of all RS274X layers used (only used in RS274X types) */
   gerbv_netstate_t *states; /*!< an array of all RS274X states used (only used in RS274X types) */
   gerbv_amacro_t *amacro; /*!< an array of all macros used (only used in RS274X types) */
@@ -714,8 +759,41 @@ typedef struct {
   gerbv_net_t *netlist; /*!< an array of all geometric entities in the layer */
   gerbv_stats_t *gerbv_stats; /*!< RS274X statistics for the layer */
   gerbv_drill_stats_t *drill_stats;  /*!< Excellon drill statistics for the layer */
+  struct gerb_image_arena *arena; /*!< storage of the nets, cirsegs and labels, all freed with the image (private) */
+  GHashTable *amacro_cache; /*!< simplified aperture macros shared by identical apertures (private) */
+  gerbv_parse_stats_t *parse_stats; /*!< how the file was parsed, NULL unless gerbv_set_parse_stats() was on */
+  struct gerb_net_index *net_index; /*!< the nets by where they are drawn, made when first drawn in a window (private) */
 } gerbv_image_t;
 
+/*!  Steps through the apertures defined in an image, see gerbv_image_aperture_iter_init() */
+typedef struct {
+  const gerbv_image_t *image; /*!< the image stepped through */
+  guint position; /*!< the index of the next aperture among the defined ones */
+} gerbv_aperture_iter_t;
+
+/*!  The nets of an image as one array per field (built on demand) */
+typedef struct {
+  guint n_nets; /*!< the number of nets, the empty first net of the netlist not included */
+  gdouble *start_x; /*!< the X coordinate of the start point of each net */
+  gdouble *start_y; /*!< the Y coordinate of the start point of each net */
+  gdouble *stop_x; /*!< the X coordinate of the end point of each net */
+  gdouble *stop_y; /*!< the Y coordinate of the end point of each net */
+  gdouble *left; /*!< the left side of the bounding box of each net */
+  gdouble *right; /*!< the right side of the bounding box of each net */
+  gdouble *bottom; /*!< the bottom of the bounding box of each net */
+  gdouble *top; /*!< the top of the bounding box of each net */
+  guint16 *aperture; /*!< the aperture index of each net */
+  guint8 *aperture_state; /*!< the gerbv_aperture_state_t of each net */
+  guint8 *interpolation; /*!< the gerbv_interpolation_t of each net */
+  guint32 *layer; /*!< the index of the layer of each net in layers */
+  guint32 *state; /*!< the index of the netstate of each net in states */
+  gerbv_layer_t **layers; /*!< the layers used by the nets, in order of first use */
+  guint n_layers; /*!< the number of entries in layers */
+  gerbv_netstate_t **states; /*!< the netstates used by the nets, in order of first use */
+  guint n_states; /*!< the number of entries in states */
+  gerbv_net_t **net; /*!< the net in the netlist each entry was copied from */
+} gerbv_net_columns_t;
+
 /*!  Holds information related to an individual layer that is part of a project */
 typedef struct {
   gerbv_image_t *image; /*!< the image holding all the geometry of the layer */
@@ -727,6 +805,11 @@ typedef struct {
   gchar *name; /*!< the name used when referring to this layer (e.g. in a layer selection menu) */
   gerbv_user_transformation_t transform; /*!< user-specified transformation for this layer (mirroring, translating, etc) */
   gboolean layer_dirty;  /*!< True if layer has been modified since last save */
+  gint64 sourceMtime; /*!< modification time of the file when it was parsed, 0 if it may have changed while it was read */
+  gint64 sourceSize; /*!< size of the file when it was parsed, -1 if the layer must always be parsed again (not read from a file of its own, or including other files) */
+  gchar *sourceHash; /*!< SHA-256 of the contents parsed, NULL until a reload or a check for changes works it out */
+  gchar *archivePathname; /*!< the zip archive the layer was unpacked from, or NULL if it was read from a file of its own */
+  gchar *archiveMember; /*!< the name of the layer's file inside archivePathname */
 } gerbv_fileinfo_t;
 
 /*!  The top-level structure used in libgerbv.  A gerbv_project_t groups together
@@ -746,6 +829,15 @@ typedef struct {
   gchar *project;     /*!< the default name for the private project file */
 } gerbv_project_t;
 
+/*!  Describes one file to be loaded by gerbv_open_images() */
+typedef struct {
+  gchar const* filename; /*!< the full pathname of the file to be parsed */
+  gerbv_HID_Attribute *attr_list; /*!< file format attributes (e.g. read from a project file), or NULL */
+  int n_attr; /*!< the number of entries in attr_list */
+  int idx; /*!< set to the project index of the new layer (the first one for a zip archive), or -1 if the file could not be loaded */
+  gchar const* member; /*!< if not NULL, filename is a zip archive and only this file in it is loaded */
+} gerbv_open_request_t;
+
 /*! Color of layer */
 typedef struct{
     unsigned char red;
@@ -807,6 +899,19 @@ gerbv_image_move_selected_objects (GArray *selectionArray, gdouble translationX,
 gerbv_net_t *
 gerbv_image_return_next_renderable_object (gerbv_net_t *oldNet);
 
+//! Copy the netlist of an image into columns, one array per field
+/*! This is a snapshot: changes to the nets afterwards are not seen in
+    the columns, and changes to the columns don't go back to the nets.
+    The netlist stays the primary form of the image.
+    \return the new columns, free with gerbv_image_destroy_net_columns() */
+gerbv_net_columns_t *
+gerbv_image_create_net_columns (gerbv_image_t *image /*!< the image to copy the nets of */
+);
+
+//! Free columns made by gerbv_image_create_net_columns()
+void
+gerbv_image_destroy_net_columns (gerbv_net_columns_t *columns);
+
 //! Create a new project structure and initialize some important variables
 gerbv_project_t *
 gerbv_create_project (void);
@@ -844,9 +949,24 @@ gerbv_save_layer_from_index(gerbv_project_t *gerbvProject, gint index, gchar *fi
 int
 gerbv_revert_file(gerbv_project_t *gerbvProject, int idx);
 
+//! Reload a layer from its file, unless neither the file nor the layer changed since the file was parsed
+/*! A layer which is kept keeps its image and its render data.
+    \return 1 if the layer was kept, 0 if it was reloaded, -1 on errors */
+int
+gerbv_revert_changed_file(gerbv_project_t *gerbvProject, /*!< the project to use */
+		int idx /*!< the index of the layer */
+);
+
 void 
 gerbv_revert_all_files(gerbv_project_t *gerbvProject);
 
+//! Reload all layers whose files (or the layers themselves) changed since they were parsed
+/*! Like gerbv_revert_all_files(), but each layer is reloaded only if
+    gerbv_revert_changed_file() finds a change. */
+void 
+gerbv_revert_changed_files(gerbv_project_t *gerbvProject /*!< the project to use */
+);
+
 void 
 gerbv_unload_layer(gerbv_project_t *gerbvProject, int index);
 
@@ -859,9 +979,74 @@ gerbv_change_layer_order(gerbv_project_t *gerbvProject, gint oldPosition, gint n
 gint
 gerbv_add_parsed_image_to_project (gerbv_project_t *gerbvProject, gerbv_image_t *parsed_image,
 			gchar const* filename, gchar const* baseName, int idx, int reload);
+//! Parse a file and add it as a new layer at idx
+/*! gzipped files are inflated while they are read.  A zip archive is
+    loaded as one layer per file in it, from idx on; the layers are named
+    after the archive path followed by the path of the file inside it. */
 int
 gerbv_open_image(gerbv_project_t *gerbvProject, gchar const* filename, int idx, int reload,
 		gerbv_HID_Attribute *fattr, int n_fattr, gboolean forceLoadFile);
+
+//! Parse a file held in memory and add it as a new layer
+/*! The data is parsed in place, without being copied or written to a
+    file, and isn't needed any more once this returns.  name is shown as
+    the layer name, and its directory is used to look up files included
+    with %IF.  Such a layer can't be reverted from disk.
+    \return the same as gerbv_open_image() */
+int
+gerbv_open_image_from_buffer(gerbv_project_t *gerbvProject, /*!< the existing project to add the new layer to */
+		gchar const* data, /*!< the contents of the file */
+		gsize length, /*!< the number of bytes at data */
+		gchar const* name, /*!< the name to use for the layer */
+		int idx, /*!< the index of the new layer */
+		gerbv_HID_Attribute *fattr, /*!< the file format attributes, or NULL */
+		int n_fattr, /*!< the number of entries in fattr */
+		gboolean forceLoadFile /*!< TRUE to load the data even if it is binary */
+);
+
+//! Cut RS-274X files of at least size bytes into tokens on all CPUs
+/*! Worker threads split the file at '*' block ends and turn each piece
+    into an array of tokens (codes with their numbers).  The parse then
+    steps through the tokens in order to apply the modal state, and
+    produces the same image.  0 (the default) disables this. */
+void
+gerbv_set_parallel_parse_threshold (gsize size /*!< the file size in bytes, or 0 */
+);
+
+//! Keep the images parsed from files in dir, and read them back from there
+/*! The images of a file are stored under a hash of its contents (and of the
+    file format attributes it is parsed with), and are mapped back in
+    instead of parsing the file again while it is unchanged.  Files which
+    include other files, zip archives and buffers are always parsed, and
+    so is a file when its layer is reloaded.  NULL (the default) turns the
+    cache off. */
+void
+gerbv_set_image_cache_dir (gchar const *dir /*!< the cache directory, created when needed, or NULL */
+);
+
+//! Count how each file is parsed into the parse_stats of its image
+/*! This times every G, D and M code read, so it is off by default.
+    Images read back from the cache directory have no parse_stats. */
+void
+gerbv_set_parse_stats (gboolean enabled /*!< TRUE to keep the counters */
+);
+
+//! Parse several files concurrently and add them as new layers in the order given
+/*! Each file is parsed on a pool of worker threads.  Once all of them are
+    finished, the images are added to the project in the order of the
+    requests array, so the resulting layer order does not depend on which
+    file finished parsing first.  Log messages emitted while parsing are
+    held back and replayed per file, in order, on the calling thread.
+    Each file in a zip archive is unpacked in memory and loaded as a
+    layer of its own, in the order of the archive, unless the request
+    names a single member to load.
+    \return the number of layers which were loaded successfully */
+int
+gerbv_open_images (gerbv_project_t *gerbvProject, /*!< the existing project to add the new layers to */
+	gerbv_open_request_t *requests, /*!< the files to load; idx is filled in for each entry */
+	int n_requests, /*!< the number of entries in requests */
+	gboolean forceLoadFile /*!< TRUE to load files even if they contain binary data */
+);
 		
 void
 gerbv_render_get_boundingbox(gerbv_project_t *gerbvProject, gerbv_render_size_t *boundingbox);
@@ -1055,6 +1240,46 @@ gerbv_image_create_rectangle_object (gerbv_image_t *image, /*!< the image to dra
 void
 gerbv_image_create_dummy_apertures (gerbv_image_t *parsed_image /*!< the image to repair */
 );
+
+//! Return the aperture with the specified D code, or NULL if there is none
+gerbv_aperture_t *
+gerbv_image_get_aperture (gerbv_image_t *image, /*!< the image to search */
+		int number /*!< the D code (or tool number) */
+);
+
+//! Allocate an aperture with room for the specified number of parameters
+/*! The parameters (at least APERTURE_PARAMETERS_MIN, all 0) belong to the
+    image and are freed with it, don't free or replace them.  Store the
+    aperture with gerbv_image_set_aperture().
+    \return the new aperture, with nuf_parameters set */
+gerbv_aperture_t *
+gerbv_image_new_aperture (gerbv_image_t *image, /*!< the image the aperture is for */
+		int nuf_parameters /*!< the number of parameters */
+);
+
+//! Store an aperture under the specified D code, or remove it with NULL
+//! \return FALSE if the D code is not between 0 and APERTURE_MAX
+gboolean
+gerbv_image_set_aperture (gerbv_image_t *image, /*!< the image to change */
+		int number, /*!< the D code (or tool number) */
+		gerbv_aperture_t *aperture /*!< the aperture, which the image will own */
+);
+
+//! Start stepping through the apertures defined in an image, by increasing D code
+/*! No aperture may be stored in or removed from the image until the last
+    one has been returned. */
+void
+gerbv_image_aperture_iter_init (gerbv_aperture_iter_t *iter, /*!< the iterator to start */
+		const gerbv_image_t *image /*!< the image to step through */
+);
+
+//! Step to the next aperture defined in the image
+//! \return FALSE after the last one
+gboolean
+gerbv_image_aperture_iter_next (gerbv_aperture_iter_t *iter, /*!< the iterator */
+		int *number, /*!< set to the D code, unless NULL */
+		gerbv_aperture_t **aperture /*!< set to the aperture, unless NULL */
+);
 		
 /*! Create new struct for holding drill stats */
 gerbv_drill_stats_t *
@@ -1088,6 +1313,21 @@ gerbv_stats_add_layer(gerbv_stats_t *accum_stats,
 		int this_layer
 );
 
+/*! Send the messages the parsers report on the calling thread to sink
+ *  instead of the GLib log.  Messages are still recorded in the error
+ *  list of the image stats.  Pass NULL to restore logging. */
+void
+gerbv_set_message_sink(gerbv_message_sink_t sink, /*!< the function to call, or NULL */
+		gpointer user_data /*!< passed to sink */
+);
+
+/*! Keep at most limit different messages in each error list (1000 by
+ *  default, 0 for no limit).  Further ones are only counted in a last
+ *  message saying so. */
+void
+gerbv_set_error_list_limit(guint limit /*!< the number of messages */
+);
+
 void
 gerbv_attribute_destroy_HID_attribute (gerbv_HID_Attribute *attributeList, int n_attr);
 
@@ -922,7 +922,7 @@ interface_create_gui (int req_width, int req_height)
 	screen.win.curAnalyzeMenuItem = menuitem_analyze;
 	gtk_container_add (GTK_CONTAINER (menubar1), menuitem_analyze);
 
-	screen.selectionInfo.selectedNodeArray = selection_new_array ();
+	selection_init (&screen.selectionInfo);
 
 	menuitem_analyze_menu = gtk_menu_new ();
 	gtk_menu_set_accel_group (GTK_MENU(menuitem_analyze_menu), accel_group);
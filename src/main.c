@@ -56,6 +56,7 @@
 #include "interface.h"
 #include "render.h"
 #include "project.h"
+#include "watch.h"
 
 #if (DEBUG)
 # define dprintf printf("%s():  ", __FUNCTION__); printf
@@ -146,6 +147,10 @@ const struct option longopts[] = {
     {"window",		required_argument,  NULL,    'w'},
     {"export",          required_argument,  NULL,    'x'},
     {"geometry",        required_argument,  &longopt_val, 1},
+    {"parallel-parse",  required_argument,  &longopt_val, 3},
+    {"cache-dir",       required_argument,  &longopt_val, 4},
+    {"watch",           no_argument,	    &longopt_val, 5},
+    {"parse-stats",     required_argument,  &longopt_val, 6},
     /* GDK/GDK debug flags to be "let through" */
     {"gtk-module",      required_argument,  &longopt_val, 2},
     {"g-fatal-warnings",no_argument,	    &longopt_val, 2},
@@ -191,7 +196,11 @@ main_open_project_from_filename(gerbv_project_t *gerbvProject, gchar *filename)
 {
 	project_list_t *list, *plist;
 	gint i, max_layer_num = -1;
+	guint j;
 	gerbv_fileinfo_t *file_info;
+	GArray *requests;
+	GPtrArray *layers;
+	gchar *dirName;
 
 	dprintf("Opening project = %s\n", (gchar *) filename);
 	list = read_project_file(filename);
@@ -214,6 +223,9 @@ main_open_project_from_filename(gerbv_project_t *gerbvProject, gchar *filename)
 
 	/* Increase the layer count each time and find (if any) the
 	 * corresponding entry */
+	requests = g_array_new (FALSE, FALSE, sizeof (gerbv_open_request_t));
+	layers = g_ptr_array_new ();
+	dirName = g_path_get_dirname (filename);
 	for (i = -1; i <= max_layer_num; i++) {
 		plist = list;
 		while (plist) {
@@ -222,58 +234,72 @@ main_open_project_from_filename(gerbv_project_t *gerbvProject, gchar *filename)
 				continue;
 			}
 
-			GdkColor colorTemplate = {0,
-				plist->rgb[0], plist->rgb[1], plist->rgb[2]};
 			if (i == -1) {
+				GdkColor colorTemplate = {0,
+					plist->rgb[0], plist->rgb[1], plist->rgb[2]};
 				screen.background_is_from_project= TRUE;
 				gerbvProject->background = colorTemplate;
 				plist = plist->next;
 				continue;
 			}
 
-			gchar *fullName = NULL;
-			gchar *dirName = NULL;
-			gint fileIndex = gerbvProject->last_loaded + 1;
+			gerbv_open_request_t request = {NULL, plist->attr_list,
+							plist->n_attr, -1,
+							plist->member};
 
 			if (!g_path_is_absolute (plist->filename)) {
 				/* Build the full pathname to the layer */
-				dirName = g_path_get_dirname (filename);
-				fullName = g_build_filename (dirName,
+				request.filename = g_build_filename (dirName,
 					plist->filename, NULL);
 			} else {
-				fullName = g_strdup (plist->filename);
+				request.filename = g_strdup (plist->filename);
 			}
 
-			if (gerbv_open_image(gerbvProject, fullName,
-					fileIndex, FALSE,
-					plist->attr_list,
-					plist->n_attr, TRUE) == -1) {
-				GERB_MESSAGE(_("could not read file: %s"),
-						fullName);
-				plist = plist->next;
-				continue;
-			}
-
-			g_free (dirName);
-			g_free (fullName);
-
-			/* Change color from default to from the project list */
-			file_info = gerbvProject->file[fileIndex];
-			file_info->color = colorTemplate;
-			file_info->alpha = plist->alpha;
-			file_info->transform.inverted =	plist->inverted;
-			file_info->transform.translateX = plist->translate_x;
-			file_info->transform.translateY = plist->translate_y;
-			file_info->transform.rotation = plist->rotation;
-			file_info->transform.scaleX = plist->scale_x;
-			file_info->transform.scaleY = plist->scale_y;
-			file_info->transform.mirrorAroundX = plist->mirror_x;
-			file_info->transform.mirrorAroundY = plist->mirror_y;
-			file_info->isVisible = plist->visible;
+			g_array_append_val (requests, request);
+			g_ptr_array_add (layers, plist);
 
 			plist = plist->next;
 		}
 	}
+	g_free (dirName);
+
+	/* Parse all layers at once, they are added in the order above */
+	gerbv_open_images (gerbvProject,
+			(gerbv_open_request_t *) requests->data,
+			requests->len, TRUE);
+
+	for (j = 0; j < requests->len; j++) {
+		gerbv_open_request_t *request = &g_array_index (requests,
+						gerbv_open_request_t, j);
+		plist = g_ptr_array_index (layers, j);
+
+		if (request->idx == -1) {
+			GERB_MESSAGE(_("could not read file: %s"),
+					request->filename);
+			g_free ((gchar *) request->filename);
+			continue;
+		}
+
+		g_free ((gchar *) request->filename);
+
+		/* Change color from default to from the project list */
+		GdkColor colorTemplate = {0,
+			plist->rgb[0], plist->rgb[1], plist->rgb[2]};
+		file_info = gerbvProject->file[request->idx];
+		file_info->color = colorTemplate;
+		file_info->alpha = plist->alpha;
+		file_info->transform.inverted =	plist->inverted;
+		file_info->transform.translateX = plist->translate_x;
+		file_info->transform.translateY = plist->translate_y;
+		file_info->transform.rotation = plist->rotation;
+		file_info->transform.scaleX = plist->scale_x;
+		file_info->transform.scaleY = plist->scale_y;
+		file_info->transform.mirrorAroundX = plist->mirror_x;
+		file_info->transform.mirrorAroundY = plist->mirror_y;
+		file_info->isVisible = plist->visible;
+	}
+	g_array_free (requests, TRUE);
+	g_ptr_array_free (layers, TRUE);
 
 	project_destroy_project_list(list);
 
@@ -308,21 +334,31 @@ main_save_project_from_filename(gerbv_project_t *gerbvProject, gchar *filename)
     /* loop over all layer files */
     for (idx = 0; idx <= gerbvProject->last_loaded; idx++) {
 	if (gerbvProject->file[idx]) {
+	    gchar const *pathname;
+
+	    file_info = gerbvProject->file[idx];
 	    plist = g_new0 (project_list_t, 1);
 	    plist->next = list;
 	    plist->layerno = idx;
+
+	    /* a layer from a zip archive is saved as the archive and the
+	       name of its file in there */
+	    pathname = file_info->fullPathname;
+	    if (file_info->archivePathname) {
+		pathname = file_info->archivePathname;
+		plist->member = g_strdup(file_info->archiveMember);
+	    }
 	    
 	    /* figure out the relative path to the layer from the project
 	       directory */
-	    if (strncmp (dirName, gerbvProject->file[idx]->fullPathname, strlen(dirName)) == 0) {
+	    if (strncmp (dirName, pathname, strlen(dirName)) == 0) {
 		/* skip over the common dirname and the separator */
-		plist->filename = g_strdup(gerbvProject->file[idx]->fullPathname + strlen(dirName) + 1);
+		plist->filename = g_strdup(pathname + strlen(dirName) + 1);
 	    } else {
 		/* if we can't figure out a relative path, just save the 
 		 * absolute one */
-		plist->filename = g_strdup(gerbvProject->file[idx]->fullPathname);
+		plist->filename = g_strdup(pathname);
 	    }
-	    file_info = gerbvProject->file[idx];
 	    plist->rgb[0] =		file_info->color.red;
 	    plist->rgb[1] =		file_info->color.green;
 	    plist->rgb[2] =		file_info->color.blue;
@@ -416,6 +452,153 @@ static void
 attach_console_for_win(void) {}
 #endif
 
+/* ------------------------------------------------------------------ */
+/* Read all of stdin, for a layer file name of "-" */
+static GString *
+main_read_stdin(void)
+{
+    GString *data = g_string_new (NULL);
+    gchar buf[65536];
+    size_t n;
+
+    while ((n = fread (buf, 1, sizeof (buf), stdin)) > 0)
+	g_string_append_len (data, buf, n);
+
+    return data;
+}
+
+/* ------------------------------------------------------------------ */
+/* Print str as a JSON string */
+static void
+main_print_json_string(const gchar *str)
+{
+    putchar('"');
+    for (; str != NULL && *str != '\0'; str++) {
+	if (*str == '"' || *str == '\\')
+	    printf("\\%c", *str);
+	else if ((guchar)*str < 0x20)
+	    printf("\\u%04x", (guchar)*str);
+	else
+	    putchar(*str);
+    }
+    putchar('"');
+}
+
+/* ------------------------------------------------------------------ */
+/* Print the nonzero times of codes as "<letter><code>": usec */
+static void
+main_print_parse_stats_codes(char letter, const gint64 *usec,
+			     gboolean *first)
+{
+    int i;
+
+    for (i = 0; i < GERBV_PARSE_STATS_CODES; i++) {
+	if (usec[i] == 0)
+	    continue;
+	printf("%s\"%c%02d\": %" G_GINT64_FORMAT,
+		*first ? "" : ", ", letter, i, usec[i]);
+	*first = FALSE;
+    }
+}
+
+/* ------------------------------------------------------------------ */
+/* Print how the layers of project were parsed, as a JSON array for
+ * --parse-stats=json, with the code counts of their stats */
+static void
+main_print_parse_stats(gerbv_project_t *project)
+{
+    gboolean firstLayer = TRUE;
+    int i;
+
+    printf("[");
+    for (i = 0; i <= project->last_loaded; i++) {
+	gerbv_fileinfo_t *file = project->file[i];
+	gerbv_parse_stats_t *ps;
+	gerbv_image_t *image;
+	gboolean first = TRUE;
+
+	if (file == NULL || file->image == NULL)
+	    continue;
+
+	image = file->image;
+	ps = image->parse_stats;
+	printf("%s\n  {\"file\": ", firstLayer ? "" : ",");
+	main_print_json_string(file->fullPathname ? file->fullPathname
+						  : file->name);
+	printf(", \"type\": ");
+	main_print_json_string(image->info->type);
+	firstLayer = FALSE;
+
+	if (ps == NULL) {
+	    /* Read back from the cache, or it isn't a parsed file */
+	    printf(", \"parse\": null");
+	} else {
+	    printf(", \"parse\": {\"bytes\": %" G_GINT64_FORMAT
+		    ", \"usec\": %" G_GINT64_FORMAT
+		    ", \"bytes_per_sec\": %.0f"
+		    ", \"nets\": %u, \"arcs\": %u, \"macros\": %u"
+		    ", \"peak_alloc\": %" G_GSIZE_FORMAT
+		    ", \"code_usec\": {",
+		    ps->bytes, ps->usec,
+		    ps->usec > 0 ? ps->bytes * 1e6 / ps->usec : 0.0,
+		    ps->nets, ps->arcs, ps->macros, ps->peak_alloc);
+	    main_print_parse_stats_codes('G', ps->G_usec, &first);
+	    main_print_parse_stats_codes('D', ps->D_usec, &first);
+	    main_print_parse_stats_codes('M', ps->M_usec, &first);
+	    printf("%s\"other\": %" G_GINT64_FORMAT "}}",
+		    first ? "" : ", ", ps->other_usec);
+	}
+
+#define PRINT_COUNT(stats, field) \
+	printf("%s\"" #field "\": %d", first ? "" : ", ", (stats)->field); \
+	first = FALSE
+
+	first = TRUE;
+	if (image->gerbv_stats != NULL) {
+	    gerbv_stats_t *st = image->gerbv_stats;
+
+	    printf(", \"stats\": {");
+	    PRINT_COUNT(st, G0); PRINT_COUNT(st, G1); PRINT_COUNT(st, G2);
+	    PRINT_COUNT(st, G3); PRINT_COUNT(st, G4); PRINT_COUNT(st, G10);
+	    PRINT_COUNT(st, G11); PRINT_COUNT(st, G12); PRINT_COUNT(st, G36);
+	    PRINT_COUNT(st, G37); PRINT_COUNT(st, G54); PRINT_COUNT(st, G55);
+	    PRINT_COUNT(st, G70); PRINT_COUNT(st, G71); PRINT_COUNT(st, G74);
+	    PRINT_COUNT(st, G75); PRINT_COUNT(st, G90); PRINT_COUNT(st, G91);
+	    PRINT_COUNT(st, G_unknown);
+	    PRINT_COUNT(st, D1); PRINT_COUNT(st, D2); PRINT_COUNT(st, D3);
+	    PRINT_COUNT(st, D_unknown); PRINT_COUNT(st, D_error);
+	    PRINT_COUNT(st, M0); PRINT_COUNT(st, M1); PRINT_COUNT(st, M2);
+	    PRINT_COUNT(st, M_unknown);
+	    PRINT_COUNT(st, X); PRINT_COUNT(st, Y);
+	    PRINT_COUNT(st, I); PRINT_COUNT(st, J);
+	    PRINT_COUNT(st, star); PRINT_COUNT(st, unknown);
+	    printf("}");
+	} else if (image->drill_stats != NULL) {
+	    gerbv_drill_stats_t *st = image->drill_stats;
+
+	    printf(", \"stats\": {");
+	    PRINT_COUNT(st, comment); PRINT_COUNT(st, F);
+	    PRINT_COUNT(st, G00); PRINT_COUNT(st, G01); PRINT_COUNT(st, G02);
+	    PRINT_COUNT(st, G03); PRINT_COUNT(st, G04); PRINT_COUNT(st, G05);
+	    PRINT_COUNT(st, G85); PRINT_COUNT(st, G90); PRINT_COUNT(st, G91);
+	    PRINT_COUNT(st, G93); PRINT_COUNT(st, G_unknown);
+	    PRINT_COUNT(st, M00); PRINT_COUNT(st, M01); PRINT_COUNT(st, M18);
+	    PRINT_COUNT(st, M25); PRINT_COUNT(st, M30); PRINT_COUNT(st, M31);
+	    PRINT_COUNT(st, M45); PRINT_COUNT(st, M47); PRINT_COUNT(st, M48);
+	    PRINT_COUNT(st, M71); PRINT_COUNT(st, M72); PRINT_COUNT(st, M95);
+	    PRINT_COUNT(st, M97); PRINT_COUNT(st, M98);
+	    PRINT_COUNT(st, M_unknown);
+	    PRINT_COUNT(st, R); PRINT_COUNT(st, unknown);
+	    PRINT_COUNT(st, total_count);
+	    printf("}");
+	}
+#undef PRINT_COUNT
+
+	printf("}");
+    }
+    printf("%s]\n", firstLayer ? "" : "\n");
+}
+
 /* ------------------------------------------------------------------ */
 int
 main(int argc, char *argv[])
@@ -435,6 +618,7 @@ main(int argc, char *argv[])
     int unit_flag_counter;
     gboolean initial_mirror_x = FALSE;
     gboolean initial_mirror_y = FALSE;
+    gboolean printParseStats = FALSE;
     const gchar *exportFilename = NULL;
     gfloat userSuppliedOriginX=0.0,userSuppliedOriginY=0.0,userSuppliedDpiX=72.0, userSuppliedDpiY=72.0, 
 	   userSuppliedWidth=0, userSuppliedHeight=0,
@@ -613,6 +797,33 @@ main(int argc, char *argv[])
 		}
 		*/
 		break;
+	    case 3: /* parallel-parse */
+		errno = 0;
+		gint64 threshold_mb = g_ascii_strtoll(optarg, &rest, 10);
+		if (errno || rest == optarg || threshold_mb < 0) {
+		    fprintf(stderr, _("You must give a size in megabytes "
+				"to --parallel-parse\n"));
+		    exit(1);
+		}
+		/* 0 cuts every file, a threshold of 0 would cut none */
+		gerbv_set_parallel_parse_threshold(threshold_mb > 0
+			? (gsize)threshold_mb << 20 : 1);
+		break;
+	    case 4: /* cache-dir */
+		gerbv_set_image_cache_dir(optarg);
+		break;
+	    case 5: /* watch */
+		watch_set_enabled(TRUE);
+		break;
+	    case 6: /* parse-stats */
+		if (strcmp(optarg, "json") != 0) {
+		    fprintf(stderr, _("Unrecognized format \"%s\" "
+				"for --parse-stats, use json\n"), optarg);
+		    exit(1);
+		}
+		gerbv_set_parse_stats(TRUE);
+		printParseStats = TRUE;
+		break;
 	    default:
 		break;
 	    }
@@ -921,34 +1132,96 @@ main(int argc, char *argv[])
 	    main_open_project_from_filename (mainProject, project_filename);
 	    mainProject->path = g_path_get_dirname (project_filename);
 	}
-    } else {
-    	gint loadedIndex = 0;
-	for(i = optind ; i < argc; i++) {
-	    g_free (mainProject->path);
-	    if (!g_path_is_absolute(argv[i])) {
+    } else if (optind < argc) {
+	gint n_files = argc - optind;
+	gerbv_open_request_t *requests = g_new0 (gerbv_open_request_t, n_files);
+
+	gint first, last;
+	GString *stdinData = NULL;
+
+	for(i = 0; i < n_files; i++) {
+	    if (strcmp(argv[optind + i], "-") == 0) {
+		requests[i].filename = g_strdup ("stdin");
+	    } else if (!g_path_is_absolute(argv[optind + i])) {
 		gchar *currentDir = g_get_current_dir ();
-		gchar *fullName = g_build_filename (currentDir,
-						    argv[i], NULL);
-		gerbv_open_layer_from_filename_with_color (mainProject, fullName,
-			mainDefaultColors[loadedIndex % NUMBER_OF_DEFAULT_COLORS].red*257,
-			mainDefaultColors[loadedIndex % NUMBER_OF_DEFAULT_COLORS].green*257,
-			mainDefaultColors[loadedIndex % NUMBER_OF_DEFAULT_COLORS].blue*257,
-			mainDefaultColors[loadedIndex % NUMBER_OF_DEFAULT_COLORS].alpha*257);
-		mainProject->path = g_path_get_dirname (fullName);
-		g_free (fullName);
+		requests[i].filename = g_build_filename (currentDir,
+						    argv[optind + i], NULL);
 		g_free (currentDir);
 	    } else {
-		gerbv_open_layer_from_filename_with_color (mainProject, argv[i],
-			mainDefaultColors[loadedIndex % NUMBER_OF_DEFAULT_COLORS].red*257,
-			mainDefaultColors[loadedIndex % NUMBER_OF_DEFAULT_COLORS].green*257,
-			mainDefaultColors[loadedIndex % NUMBER_OF_DEFAULT_COLORS].blue*257,
-			mainDefaultColors[loadedIndex % NUMBER_OF_DEFAULT_COLORS].alpha*257);
-		mainProject->path = g_path_get_dirname (argv[i]);
+		requests[i].filename = g_strdup (argv[optind + i]);
+	    }
+	}
+
+	/* Files are loaded in batches between the "-" entries, which are
+	 * read from stdin in place so that the layer order is kept */
+	for (first = 0; first < n_files; first = last + 1) {
+	    for (last = first; last < n_files; last++) {
+		if (strcmp(argv[optind + last], "-") == 0)
+		    break;
+	    }
+
+	    if (last > first)
+		gerbv_open_images (mainProject, requests + first,
+				last - first, TRUE);
+
+	    if (last < n_files) {
+		/* stdin can only be read once */
+		if (stdinData == NULL) {
+		    stdinData = main_read_stdin ();
+		    requests[last].idx = mainProject->last_loaded + 1;
+		    if (gerbv_open_image_from_buffer (mainProject,
+				stdinData->str, stdinData->len,
+				requests[last].filename, requests[last].idx,
+				NULL, 0, TRUE) == -1)
+			requests[last].idx = -1;
+		} else {
+		    requests[last].idx = -1;
+		}
 	    }
-	    loadedIndex++;
+	}
+	if (stdinData)
+	    g_string_free (stdinData, TRUE);
+
+	for(i = 0; i < n_files; i++) {
+	    gerbv_fileinfo_t *file_info;
+
+	    if (requests[i].idx == -1) {
+		GERB_COMPILE_WARNING(_("Could not read \"%s\" (loaded %d)"),
+				requests[i].filename, mainProject->last_loaded);
+		g_free ((gchar *) requests[i].filename);
+		continue;
+	    }
+
+	    file_info = mainProject->file[requests[i].idx];
+	    GdkColor colorTemplate = {0,
+		mainDefaultColors[i % NUMBER_OF_DEFAULT_COLORS].red*257,
+		mainDefaultColors[i % NUMBER_OF_DEFAULT_COLORS].green*257,
+		mainDefaultColors[i % NUMBER_OF_DEFAULT_COLORS].blue*257};
+	    file_info->color = colorTemplate;
+	    file_info->alpha =
+		mainDefaultColors[i % NUMBER_OF_DEFAULT_COLORS].alpha*257;
+	    g_free ((gchar *) requests[i].filename);
+	}
+	g_free (requests);
+
+	g_free (mainProject->path);
+	if (strcmp(argv[argc - 1], "-") == 0) {
+	    mainProject->path = g_get_current_dir ();
+	} else if (!g_path_is_absolute(argv[argc - 1])) {
+	    gchar *currentDir = g_get_current_dir ();
+	    gchar *fullName = g_build_filename (currentDir,
+						argv[argc - 1], NULL);
+	    mainProject->path = g_path_get_dirname (fullName);
+	    g_free (fullName);
+	    g_free (currentDir);
+	} else {
+	    mainProject->path = g_path_get_dirname (argv[argc - 1]);
 	}
     }
 
+    if (printParseStats)
+	main_print_parse_stats(mainProject);
+
     if (initial_rotation != 0.0) {
 	/* Set initial layer orientation */
 
@@ -1157,6 +1430,8 @@ gerbv_print_help(void)
 	printf(_(
 "Usage: gerbv [OPTIONS...] [FILE...]\n"
 "\n"
+"A FILE of - is read from the standard input.\n"
+"\n"
 "Available options:\n"));
 
 #ifdef HAVE_GETOPT_LONG
@@ -1281,6 +1556,29 @@ gerbv_print_help(void)
 "  -p<prjfile>             Load project file <prjfile>.\n"));
 #endif
 
+#ifdef HAVE_GETOPT_LONG
+	printf(_(
+"  --parallel-parse=<MB>   Cut RS274X files of at least <MB> megabytes\n"
+"                          into tokens on all CPUs, 0 cuts all of them.\n"));
+#endif
+
+#ifdef HAVE_GETOPT_LONG
+	printf(_(
+"  --cache-dir=<dir>       Keep parsed files in <dir> and read them back\n"
+"                          from there while they are unchanged.\n"));
+#endif
+
+#ifdef HAVE_GETOPT_LONG
+	printf(_(
+"  --watch                 Reload layers when their files change.\n"));
+#endif
+
+#ifdef HAVE_GETOPT_LONG
+	printf(_(
+"  --parse-stats=json      Print how long each file took to parse, and\n"
+"                          what it holds, to stdout.\n"));
+#endif
+
 #ifdef HAVE_GETOPT_LONG
 	printf(_(
 "  -u, --units=<inch|mm|mil>\n"
@@ -33,11 +33,13 @@
 #include <string.h>
 
 #include "gerber.h"
+#include "gerb_image.h"
+#include "gerb_stats.h"
 #include "common.h"
 #include "csv.h"
 #include "pick-and-place.h"
 
-static gerbv_net_t *pnp_new_net(gerbv_net_t *net); 
+static gerbv_net_t *pnp_new_net(gerbv_image_t *image, gerbv_net_t *net); 
 static void pnp_reset_bbox (gerbv_net_t *net);
 static void pnp_init_net(gerbv_net_t *net, gerbv_image_t *image,
 		const char *label,
@@ -132,12 +134,15 @@ pick_and_place_reset_bounding_box (gerbv_net_t *net) {
 static double
 pick_and_place_get_float_unit(const char *str, const char *def_unit)
 {
-    double x = 0.0;
+    double x;
     char unit_str[41] = {0,};
     const char *unit = unit_str;
+    char *end;
 
     /* float, optional space, optional unit mm,cm,in,mil */
-    sscanf(str, "%lf %40s", &x, unit_str);
+    x = g_ascii_strtod(str, &end);
+    if (end != str)
+	sscanf(end, "%40s", unit_str);
 
     if (unit_str[0] == '\0')
 	unit = def_unit;
@@ -173,6 +178,18 @@ pick_and_place_get_float_unit(const char *str, const char *def_unit)
     return x;
 } /* pick_and_place_get_float_unit */
 
+/* Reads a float number without unit like sscanf("%lf") would, but
+ * independent of the locale.  FALSE if str does not start with one. */
+static gboolean
+pick_and_place_get_float(const char *str, double *value)
+{
+    char *end;
+
+    *value = g_ascii_strtod(str, &end);
+
+    return end != str;
+} /* pick_and_place_get_float */
+
 
 /** search a string for a delimiter.
  Must occur at least n times. */
@@ -240,13 +257,7 @@ pick_and_place_parse_file(gerb_file_t *fd)
     /* Unit declaration for "PcbXY Version 1.0" files as exported by pcb */
     const char *def_unit_prefix = "# X,Y in ";
     
-    /*
-     * many locales redefine "." as "," and so on, so sscanf has problems when
-     * reading Pick and Place files using %f format 
-     */
-    setlocale(LC_NUMERIC, "C" );
-
-    while ( fgets(buf, MAXL, fd->fd) != NULL ) {
+    while ( gerb_fgets(buf, MAXL, fd) != NULL ) {
 	int len = strlen(buf)-1;
 	int i_length = 0, i_width = 0;
 	
@@ -333,11 +344,13 @@ pick_and_place_parse_file(gerb_file_t *fd)
 	    /* This line causes segfault if we accidently starts parsing 
 	     * a gerber file. It is crap crap crap */
 	    if (row[9]) {
-		int const rc = sscanf(row[9], "%lf", &pnpPartData.rotation); // no units, always deg
+		/* no units, always deg */
+		gboolean const ok = pick_and_place_get_float(row[9],
+						&pnpPartData.rotation);
 
 		/* CVE-2021-40403
 		 */
-		if (1 != rc) {
+		if (!ok) {
 			g_array_free (pnpParseDataArray, TRUE);
 			return NULL;  
 		}
@@ -364,8 +377,10 @@ pick_and_place_parse_file(gerb_file_t *fd)
 
 	    /* CVE-2021-40403
 	     */
-	    int const rc = sscanf(row[5], "%lf", &pnpPartData.rotation); // no units, always deg
-	    if (1 != rc) {
+	    /* no units, always deg */
+	    gboolean const ok = pick_and_place_get_float(row[5],
+					    &pnpPartData.rotation);
+	    if (!ok) {
 		g_array_free (pnpParseDataArray, TRUE);
 		return NULL;  
 	    }
@@ -403,7 +418,7 @@ pick_and_place_parse_file(gerb_file_t *fd)
     }   
     gerb_transf_free(tr_rot);
     /* fd->ptr=0; */
-    /* rewind(fd->fd); */
+    /* gerb_frewind(fd); */
 	
     /* so a sanity check and see if this is a valid pnp file */
     if ((((float) parsedLines / (float) lineCounter) < 0.3) ||
@@ -416,135 +431,6 @@ pick_and_place_parse_file(gerb_file_t *fd)
 } /* pick_and_place_parse_file */
 
 
-/*	------------------------------------------------------------------
- *	pick_and_place_check_file_type
- *	------------------------------------------------------------------
- *	Description: Tries to parse the given file into a pick-and-place
- *		data set. If it fails to read any good rows, then returns
- *		FALSE, otherwise it returns TRUE.
- *	Notes: 
- *	------------------------------------------------------------------
- */
-gboolean
-pick_and_place_check_file_type(gerb_file_t *fd, gboolean *returnFoundBinary)
-{
-    char *buf;
-    int len = 0;
-    int i;
-    char *letter;
-    gboolean found_binary = FALSE;
-    gboolean found_G54 = FALSE;
-    gboolean found_M0 = FALSE;
-    gboolean found_M2 = FALSE;
-    gboolean found_G2 = FALSE;
-    gboolean found_ADD = FALSE;
-    gboolean found_comma = FALSE;
-    gboolean found_R = FALSE;
-    gboolean found_U = FALSE;
-    gboolean found_C = FALSE;
-    gboolean found_boardside = FALSE;
-
-    buf = malloc(MAXL);
-    if (buf == NULL)
-	GERB_FATAL_ERROR("malloc buf failed in %s()", __FUNCTION__);
-
-    while (fgets(buf, MAXL, fd->fd) != NULL) {
-	len = strlen(buf);
-     
-	/* First look through the file for indications of its type */
-	
-	/* check for non-binary file */
-	for (i = 0; i < len; i++) {
-	    if (!isprint((int) buf[i]) && (buf[i] != '\r') && 
-                (buf[i] != '\n') && (buf[i] != '\t')) {
-		found_binary = TRUE;
-	    }
-	}
-	
-	if (g_strstr_len(buf, len, "G54")) {
-	    found_G54 = TRUE;
-	}
-	if (g_strstr_len(buf, len, "M00")) {
-	    found_M0 = TRUE;
-	}
-	if (g_strstr_len(buf, len, "M02")) {
-	    found_M2 = TRUE;
-	}
-	if (g_strstr_len(buf, len, "G02")) {
-	    found_G2 = TRUE;
-	}
-	if (g_strstr_len(buf, len, "ADD")) {
-	    found_ADD = TRUE;
-	}
-	if (g_strstr_len(buf, len, ",")) {
-	    found_comma = TRUE;
-	}
-	/* Semicolon can be separator too */
-	if (g_strstr_len(buf, len, ";")) {
-	    found_comma = TRUE;
-	}
-	
-	/* Look for refdes -- This is dumb, but what else can we do? */
-	if ((letter = g_strstr_len(buf, len, "R")) != NULL) {
-	    if (isdigit((int) letter[1])) { /* grab char after R */
-		found_R = TRUE;
-	    }
-	}
-	if ((letter = g_strstr_len(buf, len, "C")) != NULL) {
-	    if (isdigit((int) letter[1])) { /* grab char after C */
-		found_C = TRUE;
-	    }
-	}
-	if ((letter = g_strstr_len(buf, len, "U")) != NULL) {
-	    if (isdigit((int) letter[1])) { /* grab char after U */
-		found_U = TRUE;
-	    }
-	}
-	
-	/* Look for board side indicator since this is required
-	 * by many vendors */
-	if (g_strstr_len(buf, len, "top")) {
-	    found_boardside = TRUE;
-	}
-	if (g_strstr_len(buf, len, "Top")) {
-	    found_boardside = TRUE;
-	}
-	if (g_strstr_len(buf, len, "TOP")) {
-	    found_boardside = TRUE;
-	}
-	/* Also look for evidence of "Layer" in header.... */
-	if (g_strstr_len(buf, len, "ayer")) {
-	    found_boardside = TRUE;
-	}
-	if (g_strstr_len(buf, len, "AYER")) {
-	    found_boardside = TRUE;
-	}
-	
-    }
-    rewind(fd->fd);
-    free(buf);
-
-    /* Now form logical expression determining if this is a pick-place file */
-    *returnFoundBinary = found_binary;
-    if (found_G54) 
-	return FALSE;
-    if (found_M0) 
-	return FALSE;
-    if (found_M2) 
-	return FALSE;
-    if (found_G2) 
-	return FALSE;
-    if (found_ADD) 
-	return FALSE;
-    if (found_comma && (found_R || found_C || found_U) && 
-	found_boardside) 
-	return TRUE;
-    
-    return FALSE;
-    
-} /* pick_and_place_check_file_type */
-
-
 /*	------------------------------------------------------------------
  *	pick_and_place_convert_pnp_data_to_image
  *	------------------------------------------------------------------
@@ -556,6 +442,7 @@ gerbv_image_t *
 pick_and_place_convert_pnp_data_to_image(GArray *parsedPickAndPlaceData, gint boardSide) 
 {
     gerbv_image_t *image = NULL;
+    gerbv_aperture_t *aperture;
     gerbv_net_t *curr_net = NULL;
     gerbv_transf_t *tr_rot = gerb_transf_new();
     gerbv_drill_stats_t *stats;  /* Eventually replace with pick_place_stats */
@@ -609,18 +496,17 @@ pick_and_place_convert_pnp_data_to_image(GArray *parsedPickAndPlaceData, gint bo
     image->info->max_x = -HUGE_VAL;
     image->info->max_y = -HUGE_VAL;
 
-    image->aperture[0] = g_new0(gerbv_aperture_t, 1);
-    assert(image->aperture[0] != NULL);
-    image->aperture[0]->type = GERBV_APTYPE_CIRCLE;
-    image->aperture[0]->amacro = NULL;
-    image->aperture[0]->parameter[0] = draw_width;
-    image->aperture[0]->nuf_parameters = 1;
+    aperture = gerbv_image_new_aperture(image, 1);
+    aperture->type = GERBV_APTYPE_CIRCLE;
+    aperture->amacro = NULL;
+    aperture->parameter[0] = draw_width;
+    gerbv_image_set_aperture(image, 0, aperture);
 
     for (guint i = 0; i < parsedPickAndPlaceData->len; i++) {
 	PnpPartData partData = g_array_index(parsedPickAndPlaceData, PnpPartData, i);
 	float radius,labelOffset;  
 
-	curr_net = pnp_new_net(curr_net);
+	curr_net = pnp_new_net(image, curr_net);
 	curr_net->layer = image->layers;
 	curr_net->state = image->states;
 
@@ -646,7 +532,7 @@ pick_and_place_convert_pnp_data_to_image(GArray *parsedPickAndPlaceData, gint bo
 	if ((boardSide == 1) && !((partData.layer[0]=='t') || (partData.layer[0]=='T')))
 		continue;
 
-	curr_net = pnp_new_net(curr_net);
+	curr_net = pnp_new_net(image, curr_net);
 	pnp_init_net(curr_net, image, partData.designator,
 			GERBV_APERTURE_STATE_OFF,
 			GERBV_INTERPOLATION_LINEARx1);
@@ -665,7 +551,7 @@ pick_and_place_convert_pnp_data_to_image(GArray *parsedPickAndPlaceData, gint bo
 	    (partData.shape == PART_SHAPE_STD)) {
 	    // TODO: draw rectangle length x width taking into account rotation or pad x,y
 
-	    curr_net = pnp_new_net(curr_net);
+	    curr_net = pnp_new_net(image, curr_net);
 	    pnp_init_net(curr_net, image, partData.designator,
 			    GERBV_APERTURE_STATE_ON,
 			    GERBV_INTERPOLATION_LINEARx1);
@@ -677,7 +563,7 @@ pick_and_place_convert_pnp_data_to_image(GArray *parsedPickAndPlaceData, gint bo
 	    
 /* TODO: write unifying function */
 
-	    curr_net = pnp_new_net(curr_net);
+	    curr_net = pnp_new_net(image, curr_net);
 	    pnp_init_net(curr_net, image, partData.designator,
 			    GERBV_APERTURE_STATE_ON,
 			    GERBV_INTERPOLATION_LINEARx1);
@@ -687,7 +573,7 @@ pick_and_place_convert_pnp_data_to_image(GArray *parsedPickAndPlaceData, gint bo
 	    gerb_transf_apply(-partData.length/2, -partData.width/2, tr_rot, 
 			      &curr_net->stop_x, &curr_net->stop_y);
 
-	    curr_net = pnp_new_net(curr_net);
+	    curr_net = pnp_new_net(image, curr_net);
 	    pnp_init_net(curr_net, image, partData.designator,
 			    GERBV_APERTURE_STATE_ON,
 			    GERBV_INTERPOLATION_LINEARx1);
@@ -697,7 +583,7 @@ pick_and_place_convert_pnp_data_to_image(GArray *parsedPickAndPlaceData, gint bo
 	    gerb_transf_apply(partData.length/2, -partData.width/2, tr_rot, 
 			      &curr_net->stop_x, &curr_net->stop_y);
 
-	    curr_net = pnp_new_net(curr_net);
+	    curr_net = pnp_new_net(image, curr_net);
 	    pnp_init_net(curr_net, image, partData.designator,
 			    GERBV_APERTURE_STATE_ON,
 			    GERBV_INTERPOLATION_LINEARx1);
@@ -707,7 +593,7 @@ pick_and_place_convert_pnp_data_to_image(GArray *parsedPickAndPlaceData, gint bo
 	    gerb_transf_apply(partData.length/2, partData.width/2, tr_rot, 
 			      &curr_net->stop_x, &curr_net->stop_y);
 
-	    curr_net = pnp_new_net(curr_net);
+	    curr_net = pnp_new_net(image, curr_net);
 	    pnp_init_net(curr_net, image, partData.designator,
 			    GERBV_APERTURE_STATE_ON,
 			    GERBV_INTERPOLATION_LINEARx1);
@@ -723,7 +609,7 @@ pick_and_place_convert_pnp_data_to_image(GArray *parsedPickAndPlaceData, gint bo
 		gerb_transf_apply(partData.length/4, partData.width/4, tr_rot, 
 				  &curr_net->stop_x, &curr_net->stop_y);
 
-		curr_net = pnp_new_net(curr_net);
+		curr_net = pnp_new_net(image, curr_net);
 		pnp_init_net(curr_net, image, partData.designator,
 				GERBV_APERTURE_STATE_ON,
 				GERBV_INTERPOLATION_LINEARx1);
@@ -752,7 +638,7 @@ pick_and_place_convert_pnp_data_to_image(GArray *parsedPickAndPlaceData, gint bo
 	    curr_net->stop_y = tmp_y;
 
 
-	    curr_net = pnp_new_net(curr_net);
+	    curr_net = pnp_new_net(image, curr_net);
 	    pnp_init_net(curr_net, image, partData.designator,
 			    GERBV_APERTURE_STATE_ON,
 			    GERBV_INTERPOLATION_CW_CIRCULAR);
@@ -762,7 +648,7 @@ pick_and_place_convert_pnp_data_to_image(GArray *parsedPickAndPlaceData, gint bo
 	    curr_net->stop_x = partData.pad_x;
 	    curr_net->stop_y = partData.pad_y;
 
-	    curr_net->cirseg = g_new0 (gerbv_cirseg_t, 1);
+	    curr_net->cirseg = gerb_image_new_cirseg (image);
 	    curr_net->cirseg->angle1 = 0.0;
 	    curr_net->cirseg->angle2 = 360.0;
 	    curr_net->cirseg->cp_x = partData.mid_x;
@@ -801,31 +687,48 @@ pick_and_place_convert_pnp_data_to_image(GArray *parsedPickAndPlaceData, gint bo
  *       this function, since it does very little sanity checking itself.
  *	------------------------------------------------------------------
  */
+/* Convert one side, timing it with reading the file (parse_usec) */
+static gerbv_image_t *
+pick_and_place_convert_timed(GArray *parsedPickAndPlaceData, gint boardSide,
+			gerb_file_t *fd, gint64 parse_usec)
+{
+	gint64 start = g_get_monotonic_time();
+	gerbv_image_t *image;
+
+	image = pick_and_place_convert_pnp_data_to_image(parsedPickAndPlaceData,
+			boardSide);
+	gerb_parse_stats_begin(image, fd->datalen, start - parse_usec);
+	gerb_parse_stats_end(image);
+
+	return image;
+}
+
 void
 pick_and_place_parse_file_to_images(gerb_file_t *fd, gerbv_image_t **topImage,
 			gerbv_image_t **bottomImage) 
 { 
+	gint64 start = g_get_monotonic_time();
 	GArray *parsedPickAndPlaceData = pick_and_place_parse_file (fd);
+	gint64 parse_usec = g_get_monotonic_time() - start;
 
 	if (parsedPickAndPlaceData != NULL) {
 		/* Non NULL pointer is used as "not to reload" mark */
 		if (*bottomImage == NULL)
-			*bottomImage = pick_and_place_convert_pnp_data_to_image(parsedPickAndPlaceData, 0);
+			*bottomImage = pick_and_place_convert_timed(parsedPickAndPlaceData, 0, fd, parse_usec);
 
 		if (*topImage == NULL)
-			*topImage = pick_and_place_convert_pnp_data_to_image(parsedPickAndPlaceData, 1);
+			*topImage = pick_and_place_convert_timed(parsedPickAndPlaceData, 1, fd, parse_usec);
 
 		g_array_free (parsedPickAndPlaceData, TRUE);
 	}
 } /* pick_and_place_parse_file_to_images */
 
 static gerbv_net_t *
-pnp_new_net(gerbv_net_t *net)
+pnp_new_net(gerbv_image_t *image, gerbv_net_t *net)
 {
 	gerbv_net_t *n;
-	net->next = g_new0(gerbv_net_t, 1);
+	net->next = gerb_image_new_net(image);
 	n = net->next;
-	assert(n != NULL);
 
 	pnp_reset_bbox (n);
 
@@ -853,6 +756,6 @@ pnp_init_net(gerbv_net_t *net, gerbv_image_t *image, const char *label,
 	net->state = image->states;
 
 	if (strlen(label) > 0) {
-		net->label = g_string_new (label);
+		net->label = gerb_image_new_label (image, label);
 	}
 }
@@ -67,7 +67,4 @@ void
 pick_and_place_parse_file_to_images (gerb_file_t *fd, gerbv_image_t **topImage,
 			gerbv_image_t **bottomImage);
 
-gboolean
-pick_and_place_check_file_type(gerb_file_t *fd, gboolean *returnFoundBinary);
-
 #endif /* GERBV_LAYERTYPE_PICKANDPLACE_H */
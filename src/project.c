@@ -669,6 +669,8 @@ define_layer(scheme *sc, pointer args)
 	    plist->filename = convert_path_separators(plist->filename,
 			    UNIX_MINGW);
 	    plist->is_pnp = 1;
+	} else if (strcmp(str, "member") == 0) {
+	    plist->member = g_strdup(get_value_string(sc, value));
 	} else if (strcmp(str, "inverted") == 0) {
 	    if (value == sc->F) {
 		plist->inverted = 0;
@@ -1057,6 +1059,7 @@ project_destroy_project_list (project_list_t *projectList){
 		tempP2 = tempP->next;
 		
 		g_free (tempP->filename);
+		g_free (tempP->member);
 		gerbv_attribute_destroy_HID_attribute (tempP->attr_list, tempP->n_attr);
 		tempP->attr_list = NULL;
 		tempP = tempP2;
@@ -1092,6 +1095,9 @@ write_project_file(gerbv_project_t *gerbvProject, char const* filename, project_
 	
 	fprintf(fd, "(cons 'filename \"%s\")\n",
 		convert_path_separators(p->filename, MINGW_UNIX));
+
+	if (p->member)
+	    fprintf(fd, "\t(cons 'member \"%s\")\n", p->member);
     
 	if (p->inverted)
 	    fprintf(fd, "\t(cons 'inverted #t)\n");
@@ -33,6 +33,7 @@
 typedef struct project_list_t {
     int layerno;
     char *filename;
+    char *member;	/* the layer's file in the zip archive filename, or NULL */
     int rgb[3];
     int alpha;
     char inverted;
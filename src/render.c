@@ -53,6 +53,7 @@
 #include "interface.h"
 #include "render.h"
 #include "selection.h"
+#include "gerb_hit.h"
 
 #ifdef WIN32
 # include <cairo-win32.h>
@@ -425,7 +426,10 @@ static void render_selection (void)
 }
 
 /* ------------------------------------------------------ */
-void render_refresh_rendered_image_on_screen (void) {
+/* With cairo, changedOnly draws only the layers without a surface (new or
+ * reloaded ones) and keeps the others, which must fit the view as it is */
+static void
+render_refresh_layers_on_screen (gboolean changedOnly) {
 	GdkCursor *cursor;
 	
 	dprintf("----> Entering redraw_pixmap...\n");
@@ -452,6 +456,8 @@ void render_refresh_rendered_image_on_screen (void) {
 	    for(i = mainProject->last_loaded; i >= 0; i--) {
 		if (mainProject->file[i]) {
 		    cairo_t *cr;
+		    if (changedOnly && mainProject->file[i]->privateRenderData)
+			continue;
 		    if (mainProject->file[i]->privateRenderData) 
 			cairo_surface_destroy ((cairo_surface_t *) mainProject->file[i]->privateRenderData);
 		    mainProject->file[i]->privateRenderData = 
@@ -472,22 +478,22 @@ void render_refresh_rendered_image_on_screen (void) {
 	callbacks_force_expose_event_for_screen();
 }
 
+/* ------------------------------------------------------ */
+void render_refresh_rendered_image_on_screen (void) {
+	render_refresh_layers_on_screen (FALSE);
+}
+
+/* ------------------------------------------------------ */
+void render_refresh_changed_layers_on_screen (void) {
+	render_refresh_layers_on_screen (TRUE);
+}
+
 /* ------------------------------------------------------ */
 void
 render_remove_selected_objects_belonging_to_layer (
 			gerbv_selection_info_t *sel_info, gerbv_image_t *image)
 {
-	guint i;
-
-	for (i = 0; i < selection_length (sel_info);) {
-		gerbv_selection_item_t sItem =
-			selection_get_item_by_index (sel_info, i);
-
-		if (image == (gerbv_image_t *) sItem.image)
-			selection_clear_item_by_index (sel_info, i);
-		else
-			i++;
-	}
+	selection_clear_image (sel_info, image);
 }
 
 /* ------------------------------------------------------ */
@@ -511,37 +517,23 @@ static void
 render_find_selected_objects_and_refresh_display (gint activeFileIndex,
 		enum selection_action action)
 {
-	enum draw_mode mode = FIND_SELECTIONS;
-
 	/* clear the old selection array if desired */
 	if ((action == SELECTION_REPLACE)
 	 && (selection_length (&screen.selectionInfo) != 0))
 		selection_clear (&screen.selectionInfo);
 
-	if (action == SELECTION_TOGGLE)
-		mode = FIND_SELECTIONS_TOGGLE;
-
-	/* make sure we have a bufferSurface...if we start up in FAST mode, we may not
-	   have one yet, but we need it for selections */
-	if (!render_create_cairo_buffer_surface ())
-		return;
-
-	/* call draw_image... passing the FILL_SELECTION mode to just search for
-	   nets which match the selection, and fill the selection buffer with them */
-	cairo_t *cr = cairo_create (screen.bufferSurface);	
-	gerbv_render_cairo_set_scale_and_translation (cr, &screenRenderInfo);
-	draw_image_to_cairo_target (cr,
-			mainProject->file[activeFileIndex]->image,
-			1.0/MAX (screenRenderInfo.scaleFactorX,
-				screenRenderInfo.scaleFactorY),
-			mode, &screen.selectionInfo, &screenRenderInfo, TRUE,
-			mainProject->file[activeFileIndex]->transform, TRUE);
-	cairo_destroy (cr);
+	/* test the nets near the selection against their shapes, and fill
+	   the selection buffer with those which match */
+	gerb_hit_find_selections (mainProject->file[activeFileIndex]->image,
+			&screen.selectionInfo, &screenRenderInfo,
+			&mainProject->file[activeFileIndex]->transform,
+			action == SELECTION_TOGGLE);
 
 	/* re-render the selection buffer layer */
 	if (screenRenderInfo.renderType <= GERBV_RENDER_TYPE_GDK_XOR) {
 		render_refresh_rendered_image_on_screen ();
-	} else {
+	} else if (screen.windowSurface) {
+		/* the composite is made on the window's surface */
 		render_recreate_composite_surface ();
 		callbacks_force_expose_event_for_screen ();
 	}
@@ -56,6 +56,10 @@ render_draw_measure_distance(void);
 
 void render_refresh_rendered_image_on_screen (void);
 
+/* Like render_refresh_rendered_image_on_screen(), but only the layers
+ * which were added or reloaded since are drawn again */
+void render_refresh_changed_layers_on_screen (void);
+
 void
 render_remove_selected_objects_belonging_to_layer (
 			gerbv_selection_info_t *sel_info, gerbv_image_t *image);
@@ -25,15 +25,54 @@
     \ingroup libgerbv
 */
 
+#include <string.h>
+
 #include "gerbv.h"
+#include "selection.h"
+
+static void selection_count_net (GHashTable *counts, gpointer net, gint change)
+{
+	guint count = GPOINTER_TO_UINT (g_hash_table_lookup (counts, net));
+
+	count += change;
+	if (count)
+		g_hash_table_insert (counts, net, GUINT_TO_POINTER (count));
+	else
+		g_hash_table_remove (counts, net);
+}
+
+/* The number of items of each net, counted on first use */
+static GHashTable *selection_net_counts (gerbv_selection_info_t *sel_info)
+{
+	if (sel_info->selectedNodeCounts == NULL) {
+		sel_info->selectedNodeCounts = g_hash_table_new (NULL, NULL);
+		for (guint i = 0; i < selection_length (sel_info); i++)
+			selection_count_net (sel_info->selectedNodeCounts,
+				selection_get_item_by_index (sel_info, i).net,
+				1);
+	}
+
+	return sel_info->selectedNodeCounts;
+}
 
 GArray *selection_new_array (void)
 {
 	return g_array_new (FALSE, FALSE, sizeof (gerbv_selection_item_t));
 }
 
+void selection_init (gerbv_selection_info_t *sel_info)
+{
+	memset (sel_info, 0, sizeof (*sel_info));
+	sel_info->selectedNodeArray = selection_new_array ();
+}
+
 gchar *selection_free_array (gerbv_selection_info_t *sel_info)
 {
+	if (sel_info->selectedNodeCounts != NULL) {
+		g_hash_table_destroy (sel_info->selectedNodeCounts);
+		sel_info->selectedNodeCounts = NULL;
+	}
+
 	return g_array_free (sel_info->selectedNodeArray, FALSE);
 }
 
@@ -52,6 +91,8 @@ gerbv_selection_item_t selection_get_item_by_index (
 void selection_clear_item_by_index (
 			gerbv_selection_info_t *sel_info, guint idx)
 {
+	selection_count_net (selection_net_counts (sel_info),
+			selection_get_item_by_index (sel_info, idx).net, -1);
 	g_array_remove_index (sel_info->selectedNodeArray, idx);
 }
 
@@ -60,10 +101,74 @@ void selection_clear (gerbv_selection_info_t *sel_info)
 	if (selection_length(sel_info))
 		g_array_remove_range (sel_info->selectedNodeArray, 0,
 				sel_info->selectedNodeArray->len);
+	if (sel_info->selectedNodeCounts != NULL)
+		g_hash_table_remove_all (sel_info->selectedNodeCounts);
 }
 
 void selection_add_item (gerbv_selection_info_t *sel_info,
 				gerbv_selection_item_t *item)
 {
+	selection_count_net (selection_net_counts (sel_info), item->net, 1);
 	g_array_append_val (sel_info->selectedNodeArray, *item);
 }
+
+gboolean selection_contains_net (gerbv_selection_info_t *sel_info,
+				gpointer net)
+{
+	return g_hash_table_contains (selection_net_counts (sel_info), net);
+}
+
+/* Remove the items matching in one pass, keeping the order of the others */
+static guint selection_clear_matching (gerbv_selection_info_t *sel_info,
+		gboolean (*matches) (gerbv_selection_item_t *item,
+					gpointer data),
+		gpointer data)
+{
+	GArray *array = sel_info->selectedNodeArray;
+	GHashTable *counts = selection_net_counts (sel_info);
+	guint i, kept = 0;
+
+	for (i = 0; i < array->len; i++) {
+		gerbv_selection_item_t *item =
+			&g_array_index (array, gerbv_selection_item_t, i);
+
+		if (matches (item, data)) {
+			selection_count_net (counts, item->net, -1);
+			continue;
+		}
+		if (kept != i)
+			g_array_index (array, gerbv_selection_item_t, kept) =
+									*item;
+		kept++;
+	}
+	i -= kept;
+	g_array_set_size (array, kept);
+
+	return i;
+}
+
+static gboolean selection_item_of_image (gerbv_selection_item_t *item,
+				gpointer image)
+{
+	return item->image == image;
+}
+
+static gboolean selection_item_of_nets (gerbv_selection_item_t *item,
+				gpointer nets)
+{
+	return g_hash_table_contains ((GHashTable *) nets, item->net);
+}
+
+guint selection_clear_image (gerbv_selection_info_t *sel_info,
+				gpointer image)
+{
+	return selection_clear_matching (sel_info,
+			selection_item_of_image, image);
+}
+
+guint selection_clear_nets (gerbv_selection_info_t *sel_info,
+				GHashTable *nets)
+{
+	return selection_clear_matching (sel_info,
+			selection_item_of_nets, nets);
+}
@@ -26,6 +26,10 @@
 */
 
 GArray *selection_new_array (void);
+/* Zero sel_info and give it an empty selection array */
+void selection_init (gerbv_selection_info_t *sel_info);
+/* Free the selection array of sel_info, and its counts of the nets */
+gchar *selection_free_array (gerbv_selection_info_t *sel_info);
 guint selection_length (gerbv_selection_info_t *sel_info);
 void selection_add_item (gerbv_selection_info_t *sel_info,
 					gerbv_selection_item_t *item);
@@ -34,4 +38,12 @@ gerbv_selection_item_t selection_get_item_by_index (
 void selection_clear_item_by_index (
 				gerbv_selection_info_t *sel_info, guint idx);
 void selection_clear (gerbv_selection_info_t *sel_info);
+gboolean selection_contains_net (gerbv_selection_info_t *sel_info,
+					gpointer net);
+/* Remove all items of image, or whose net is a key of nets, and return
+ * how many were removed */
+guint selection_clear_image (gerbv_selection_info_t *sel_info,
+					gpointer image);
+guint selection_clear_nets (gerbv_selection_info_t *sel_info,
+					GHashTable *nets);
 
@@ -0,0 +1,188 @@
+/*
+ * gEDA - GNU Electronic Design Automation
+ *
+ * watch.c -- this file is a part of gerbv.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/** \file watch.c
+    \brief Reloading layers when their files change
+    \ingroup gerbv
+*/
+
+#include "gerbv.h"
+
+#ifdef HAVE_STRING_H
+# include <string.h>
+#endif
+
+#include <gio/gio.h>
+
+#include "common.h"
+#include "main.h"
+#include "callbacks.h"
+#include "watch.h"
+
+#define dprintf if(DEBUG) printf
+
+/* A file read by one or more layers */
+typedef struct {
+    gchar *path;
+    GFileMonitor *monitor;
+    guint settleId;	/* the timeout waiting for writes to stop, or 0 */
+} watch_t;
+
+static gboolean watchEnabled = FALSE;
+
+/* The watch_t of each path */
+static GHashTable *watches = NULL;
+
+/* ------------------------------------------------------ */
+static void
+watch_free (gpointer data)
+{
+	watch_t *watch = data;
+
+	if (watch->settleId)
+		g_source_remove (watch->settleId);
+	g_file_monitor_cancel (watch->monitor);
+	g_object_unref (watch->monitor);
+	g_free (watch->path);
+	g_free (watch);
+}
+
+/* ------------------------------------------------------ */
+static gboolean
+watch_settled (gpointer data)
+{
+	watch_t *watch = data;
+
+	watch->settleId = 0;
+	dprintf ("%s settled, reloading its layers\n", watch->path);
+	callbacks_reload_changed_layers (watch->path);
+
+	return FALSE;
+}
+
+/* ------------------------------------------------------ */
+/* A tool writing a file may do so in many steps, or by replacing it;
+ * wait until it has been left alone for a while */
+static void
+watch_changed (GFileMonitor *monitor, GFile *file, GFile *other_file,
+		GFileMonitorEvent event_type, gpointer data)
+{
+	watch_t *watch = data;
+
+	switch (event_type) {
+	case G_FILE_MONITOR_EVENT_CHANGED:
+	case G_FILE_MONITOR_EVENT_CHANGES_DONE_HINT:
+	case G_FILE_MONITOR_EVENT_CREATED:
+		break;
+	default:
+		return;
+	}
+
+	if (watch->settleId)
+		g_source_remove (watch->settleId);
+	watch->settleId = g_timeout_add (WATCH_SETTLE_MS,
+			watch_settled, watch);
+}
+
+/* ------------------------------------------------------ */
+static void
+watch_add (gchar const *path)
+{
+	GFile *file = g_file_new_for_path (path);
+	GFileMonitor *monitor;
+	GError *error = NULL;
+	watch_t *watch;
+
+	monitor = g_file_monitor_file (file, G_FILE_MONITOR_NONE,
+			NULL, &error);
+	g_object_unref (file);
+	if (monitor == NULL) {
+		/* Layers read from inside an archive, for example */
+		dprintf ("Can't watch %s: %s\n", path, error->message);
+		g_error_free (error);
+		return;
+	}
+
+	watch = g_new0 (watch_t, 1);
+	watch->path = g_strdup (path);
+	watch->monitor = monitor;
+	g_signal_connect (monitor, "changed",
+			G_CALLBACK (watch_changed), watch);
+	g_hash_table_insert (watches, watch->path, watch);
+}
+
+/* ------------------------------------------------------ */
+static gboolean
+watch_unused (gpointer key, gpointer value, gpointer data)
+{
+	GHashTable *paths = data;
+
+	return !g_hash_table_contains (paths, key);
+}
+
+/* ------------------------------------------------------ */
+void
+watch_sync (void)
+{
+	GHashTable *paths;
+	GHashTableIter iter;
+	gpointer path;
+	gint i;
+
+	if (!watchEnabled)
+		return;
+
+	if (watches == NULL)
+		watches = g_hash_table_new_full (g_str_hash, g_str_equal,
+				NULL, watch_free);
+
+	paths = g_hash_table_new (g_str_hash, g_str_equal);
+	for (i = 0; i <= mainProject->last_loaded; i++) {
+		gerbv_fileinfo_t *file = mainProject->file[i];
+
+		/* A layer from a zip archive changes with the archive */
+		if (file != NULL && file->archivePathname != NULL)
+			g_hash_table_add (paths, file->archivePathname);
+		else if (file != NULL && file->fullPathname != NULL)
+			g_hash_table_add (paths, file->fullPathname);
+	}
+
+	g_hash_table_foreach_remove (watches, watch_unused, paths);
+
+	g_hash_table_iter_init (&iter, paths);
+	while (g_hash_table_iter_next (&iter, &path, NULL)) {
+		if (!g_hash_table_contains (watches, path))
+			watch_add (path);
+	}
+
+	g_hash_table_destroy (paths);
+}
+
+/* ------------------------------------------------------ */
+void
+watch_set_enabled (gboolean enabled)
+{
+	watchEnabled = enabled;
+
+	if (!enabled && watches != NULL) {
+		g_hash_table_destroy (watches);
+		watches = NULL;
+	}
+}
@@ -0,0 +1,38 @@
+/*
+ * gEDA - GNU Electronic Design Automation
+ *
+ * watch.h -- this file is a part of gerbv.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/** \file watch.h
+    \brief Header info for reloading layers when their files change
+    \ingroup gerbv
+*/
+
+#ifndef WATCH_H
+#define WATCH_H
+
+/* Time in ms a file must be left alone before its layers are reloaded */
+#define WATCH_SETTLE_MS 500
+
+/* Turn watching the files of the layers on or off */
+void watch_set_enabled (gboolean enabled);
+
+/* Watch the files of the layers of the project as they are now */
+void watch_sync (void);
+
+#endif /* WATCH_H */
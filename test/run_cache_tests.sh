@@ -0,0 +1,4 @@
+#!/bin/sh
+# The second export of each test reads its layers back from the cache
+rm -rf cache
+./run_tests.sh --cache `pwd`/cache "$@"
@@ -0,0 +1,4 @@
+#!/bin/sh
+# Compare the nets gerb_hit selects with the pixels drawn for them
+srcdir=${srcdir:-.}
+./test_hit ${srcdir}/inputs/*.gbx ${srcdir}/inputs/*.exc ${srcdir}/inputs/*.drl
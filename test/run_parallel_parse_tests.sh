@@ -0,0 +1,3 @@
+#!/bin/sh
+# Every RS274X file is parsed from the tokens of the worker threads
+./run_tests.sh --parallel-parse "$@"
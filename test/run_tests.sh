@@ -58,7 +58,7 @@ reports until this message is gone
 $0 -- Run gerbv regression tests
 
 $0 -h|--help
-$0 [-g | --golden dir] [-r|--regen] [testname1 [testname2[ ...]]]
+$0 [-g | --golden dir] [-r|--regen] [-c|--cache dir] [-p|--parallel-parse] [testname1 [testname2[ ...]]]
 
 OVERVIEW
 
@@ -80,6 +80,13 @@ OPTIONS
 
 -v | --valgrind        :  Specifies that valgrind should check gerbv.
 
+-c | --cache <dir>     :  Export each layout twice with <dir> as the cache
+                          of parsed files, so that the compared PNG file
+                          is rendered from the images read back from it.
+
+-p | --parallel-parse  :  Cut every RS274X file into tokens on worker
+                          threads before parsing it.
+
 LIMITATIONS
 
 The GUI interface is not checked via the regression testsuite.
@@ -123,6 +130,18 @@ while test -n "$1"
 	  shift
 	  ;;
 
+      -c|--cache)
+	# render from images read back from the cache
+	  cachedir="$2"
+	  shift 2
+	  ;;
+
+      -p|--parallel-parse)
+	# parse every RS274X file from the tokens of the worker threads
+	  parallel_parse=yes
+	  shift
+	  ;;
+
       -*)
 	  echo "unknown option: $1"
 	  exit 1
@@ -310,6 +329,15 @@ for t in $all_tests ; do
     # export the layout to PNG
     #
 
+    if test "X$parallel_parse" = "Xyes" ; then
+	gerbv_flags="${gerbv_flags} --parallel-parse=0"
+    fi
+    if test "X$cachedir" != "X" ; then
+	# the first export fills the cache, the second one reads it
+	gerbv_flags="${gerbv_flags} --cache-dir=${cachedir}"
+	echo "${GERBV} ${gerbv_flags} --output=${outpng} ${path_files}"
+	${GERBV} ${gerbv_flags} --output=${outpng} ${path_files}
+    fi
     echo "${GERBV} ${gerbv_flags} --output=${outpng} ${path_files}"
     ${GERBV} ${gerbv_flags} --output=${outpng} ${path_files}
 
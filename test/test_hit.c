@@ -0,0 +1,328 @@
+/*
+ * gEDA - GNU Electronic Design Automation
+ * This file is a part of gerbv.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111 USA
+ */
+
+/** \file test_hit.c
+    \brief Compares the nets gerb_hit finds with the pixels cairo draws
+
+    Selections used to be found by drawing each net and testing the
+    pixels it covered.  Here each net of a layer is drawn alone, as the
+    selection buffer is drawn, and gerb_hit_find_selections() is asked
+    about clicks and boxes around it: a click amid the pixels of the net
+    must select it and a click well away from them must not, a box around
+    the pixels must select it and a box within them must not.
+
+    Usage: test_hit file...
+*/
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "gerbv.h"
+#include "draw.h"
+#include "gerb_hit.h"
+#include "selection.h"
+
+#define TEST_DISPLAY_SIZE 256
+
+/* No more nets than about this are tested in a layer */
+#define TEST_NETS_MAX 300
+
+/* The failures reported for a layer, the others are only counted */
+#define TEST_REPORTS_MAX 10
+
+/* The pixels drawn for a net, left > right if there are none */
+typedef struct {
+    int left, right, bottom, top;
+} test_extents_t;
+
+static guint test_failures, test_reported;
+
+/* ------------------------------------------------------------------ */
+static void
+test_fail (const char *filename, guint netIndex, const char *what,
+	   double x, double y)
+{
+    test_failures++;
+    if (test_reported++ < TEST_REPORTS_MAX)
+	printf ("%s: net %u %s at (%g, %g)\n", filename, netIndex, what, x, y);
+}
+
+/* ------------------------------------------------------------------ */
+/* Draw net alone, as the selection buffer is drawn */
+static cairo_surface_t *
+test_draw_net (gerbv_image_t *image, gerbv_net_t *net,
+	       gerbv_render_info_t *renderInfo,
+	       gerbv_user_transformation_t *transform)
+{
+    gerbv_selection_info_t sel;
+    gerbv_selection_item_t item = {image, net};
+    cairo_surface_t *surface;
+    cairo_t *cr;
+
+    selection_init (&sel);
+    selection_add_item (&sel, &item);
+
+    surface = cairo_image_surface_create (CAIRO_FORMAT_A8,
+	    renderInfo->displayWidth, renderInfo->displayHeight);
+    cr = cairo_create (surface);
+    gerbv_render_cairo_set_scale_and_translation (cr, renderInfo);
+    cairo_set_source_rgba (cr, 1.0, 1.0, 1.0, 1.0);
+    draw_image_to_cairo_target (cr, image,
+	    1.0/MAX(renderInfo->scaleFactorX, renderInfo->scaleFactorY),
+	    DRAW_SELECTIONS, &sel, renderInfo, TRUE, *transform, TRUE);
+    cairo_destroy (cr);
+    cairo_surface_flush (surface);
+
+    g_free (selection_free_array (&sel));
+
+    return surface;
+}
+
+/* ------------------------------------------------------------------ */
+static gboolean
+test_pixel (cairo_surface_t *surface, int x, int y)
+{
+    if (x < 0 || x >= cairo_image_surface_get_width (surface)
+     || y < 0 || y >= cairo_image_surface_get_height (surface))
+	return FALSE;
+
+    return cairo_image_surface_get_data (surface)[
+	    y * cairo_image_surface_get_stride (surface) + x] != 0;
+}
+
+/* ------------------------------------------------------------------ */
+/* Whether the pixels within r of (x, y) are all drawn, or none are */
+static gboolean
+test_block (cairo_surface_t *surface, int x, int y, int r, gboolean drawn)
+{
+    int i, j;
+
+    for (i = x - r; i <= x + r; i++) {
+	for (j = y - r; j <= y + r; j++) {
+	    if (test_pixel (surface, i, j) != drawn)
+		return FALSE;
+	}
+    }
+
+    return TRUE;
+}
+
+/* ------------------------------------------------------------------ */
+static void
+test_extents (cairo_surface_t *surface, test_extents_t *extents)
+{
+    int x, y;
+
+    extents->left = extents->bottom = G_MAXINT;
+    extents->right = extents->top = G_MININT;
+    for (y = 0; y < cairo_image_surface_get_height (surface); y++) {
+	for (x = 0; x < cairo_image_surface_get_width (surface); x++) {
+	    if (!test_pixel (surface, x, y))
+		continue;
+	    extents->left = MIN(extents->left, x);
+	    extents->right = MAX(extents->right, x);
+	    extents->bottom = MIN(extents->bottom, y);
+	    extents->top = MAX(extents->top, y);
+	}
+    }
+}
+
+/* ------------------------------------------------------------------ */
+/* Whether gerb_hit_find_selections() selects net with a click or box */
+static gboolean
+test_hit (gerbv_image_t *image, gerbv_net_t *net, gerbv_selection_t type,
+	  double left, double bottom, double right, double top,
+	  gerbv_render_info_t *renderInfo,
+	  gerbv_user_transformation_t *transform)
+{
+    gerbv_selection_info_t sel;
+    gboolean hit;
+
+    selection_init (&sel);
+    sel.type = type;
+    sel.lowerLeftX = left;
+    sel.lowerLeftY = bottom;
+    sel.upperRightX = right;
+    sel.upperRightY = top;
+
+    gerb_hit_find_selections (image, &sel, renderInfo, transform, FALSE);
+    hit = selection_contains_net (&sel, net);
+
+    g_free (selection_free_array (&sel));
+
+    return hit;
+}
+
+/* ------------------------------------------------------------------ */
+static gboolean
+test_is_right_angle (double angle)
+{
+    return fabs (remainder (angle, M_PI_2)) < 1e-9;
+}
+
+/* ------------------------------------------------------------------ */
+/* Test the nets of image drawn with renderInfo and transform */
+static void
+test_layer (const char *filename, gerbv_image_t *image,
+	    gerbv_render_info_t *renderInfo,
+	    gerbv_user_transformation_t *transform)
+{
+    gerbv_net_t *net;
+    guint count = 0, netIndex = 0, step;
+
+    test_reported = 0;
+
+    for (net = image->netlist->next; net != NULL;
+	    net = gerbv_image_return_next_renderable_object (net)) {
+	/* Knockout areas are drawn with the selection buffer, whichever
+	 * nets are in it */
+	if (net->layer->knockout.firstInstance) {
+	    printf ("%s: knockout not tested\n", filename);
+	    return;
+	}
+	count++;
+    }
+    step = count / TEST_NETS_MAX + 1;
+
+    for (net = image->netlist->next; net != NULL;
+	    net = gerbv_image_return_next_renderable_object (net)) {
+	gerbv_step_and_repeat_t *sr = &net->layer->stepAndRepeat;
+	cairo_surface_t *surface;
+	test_extents_t e;
+	gboolean aligned;
+	int x, y, w, h, stride;
+
+	/* A clear net is drawn clearing the selection buffer, with no
+	 * pixels to compare with */
+	if (netIndex++ % step != 0
+	 || net->layer->polarity == GERBV_POLARITY_CLEAR)
+	    continue;
+
+	surface = test_draw_net (image, net, renderInfo, transform);
+	test_extents (surface, &e);
+	if (e.left > e.right) {
+	    cairo_surface_destroy (surface);
+	    continue;
+	}
+	w = e.right - e.left + 1;
+	h = e.top - e.bottom + 1;
+
+	/* Clicks on the pixel centres around the net */
+	stride = MAX(1, (MAX(w, h) + 8) / 16);
+	for (y = e.bottom - 4; y <= e.top + 4; y += stride) {
+	    for (x = e.left - 4; x <= e.right + 4; x += stride) {
+		gboolean drawn;
+
+		if (test_block (surface, x, y, 1, TRUE))
+		    drawn = TRUE;
+		else if (test_block (surface, x, y, 3, FALSE))
+		    drawn = FALSE;
+		else
+		    continue;
+
+		if (test_hit (image, net, GERBV_SELECTION_POINT_CLICK,
+			    x + 0.5, y + 0.5, x + 0.5, y + 0.5,
+			    renderInfo, transform) != drawn)
+		    test_fail (filename, netIndex - 1, drawn
+			    ? "not selected by a click on it"
+			    : "selected by a click off it",
+			    x + 0.5, y + 0.5);
+	    }
+	}
+	cairo_surface_destroy (surface);
+
+	/* With repeats, a box around one repeat selects the net, and the
+	 * pixels cut by the edges of the display have no extents */
+	if (sr->X * sr->Y != 1 || e.left == 0 || e.bottom == 0
+	 || e.right == renderInfo->displayWidth - 1
+	 || e.top == renderInfo->displayHeight - 1)
+	    continue;
+
+	/* The extents gerb_hit finds are of the shape before it is
+	 * rotated, which in between right angles are larger */
+	aligned = test_is_right_angle (transform->rotation)
+	       && test_is_right_angle (image->info->imageRotation)
+	       && test_is_right_angle (net->layer->rotation);
+	x = 3 + (aligned ? 0 : (w + h) / 4);
+	if (!test_hit (image, net, GERBV_SELECTION_DRAG_BOX,
+		    e.left - x, e.bottom - x, e.right + 1 + x, e.top + 1 + x,
+		    renderInfo, transform))
+	    test_fail (filename, netIndex - 1,
+		    "not selected by a box around it", e.left, e.bottom);
+
+	if (w > 8 && h > 8
+	 && test_hit (image, net, GERBV_SELECTION_DRAG_BOX,
+		    e.left + 3, e.bottom + 3, e.right - 2, e.top - 2,
+		    renderInfo, transform))
+	    test_fail (filename, netIndex - 1,
+		    "selected by a box within it", e.left, e.bottom);
+    }
+}
+
+/* ------------------------------------------------------------------ */
+int
+main (int argc, char *argv[])
+{
+    /* The layer as loaded, then rotated and mirrored by the user */
+    gerbv_user_transformation_t transforms[] = {
+	{0, 0, 1, 1, 0, FALSE, FALSE, FALSE},
+	{0.1, -0.2, 1, 1, M_PI/6, FALSE, TRUE, FALSE},
+    };
+    gerbv_render_info_t renderInfo;
+    gerbv_project_t *project;
+    gerbv_fileinfo_t *file;
+    guint i;
+    int n;
+
+    for (n = 1; n < argc; n++) {
+	project = gerbv_create_project ();
+	gerbv_open_layer_from_filename (project, argv[n]);
+	file = project->file[0];
+	if (project->last_loaded < 0 || file == NULL || file->image == NULL
+	 || file->image->netlist == NULL) {
+	    printf ("%s: not loaded\n", argv[n]);
+	    test_failures++;
+	    gerbv_destroy_project (project);
+	    continue;
+	}
+
+	for (i = 0; i < G_N_ELEMENTS (transforms); i++) {
+	    file->transform = transforms[i];
+
+	    renderInfo.renderType = GERBV_RENDER_TYPE_CAIRO_NORMAL;
+	    renderInfo.displayWidth = TEST_DISPLAY_SIZE;
+	    renderInfo.displayHeight = TEST_DISPLAY_SIZE;
+	    renderInfo.show_cross_on_drill_holes = FALSE;
+	    gerbv_render_zoom_to_fit_display (project, &renderInfo);
+
+	    test_layer (argv[n], file->image, &renderInfo, &file->transform);
+	}
+
+	gerbv_destroy_project (project);
+    }
+
+    printf ("%u failures\n", test_failures);
+
+    return test_failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}